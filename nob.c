@@ -5,6 +5,11 @@
 #define BUILD_DIR "./build/"
 #define PANIM_DIR "./panim/"
 #define PLUGS_DIR "./plugs/"
+#define TESTS_DIR "./tests/"
+
+// Run the tests (`./nob -test`) or the benchmarks (`./nob -bench`) after building them
+static bool run_tests = false;
+static bool run_benchmarks = false;
 
 void cflags(Nob_Cmd *cmd)
 {
@@ -44,7 +49,7 @@ void libs(Nob_Cmd *cmd)
     nob_cmd_append(cmd, "-Wl,-rpath="PANIM_DIR);
     nob_cmd_append(cmd, "-L./raylib/raylib-5.5_win64_mingw-w64/lib");
     nob_cmd_append(cmd, "-L../../ffmpeg-install/bin");
-    nob_cmd_append(cmd, "-l:raylib.dll", "-lm", "-lpthread", "-l:avcodec.lib", "-l:avutil.lib", "-l:avformat.lib", "-l:swresample.lib", "-l:swscale.lib");
+    nob_cmd_append(cmd, "-l:raylib.dll", "-lm", "-lpthread", "-lopengl32", "-l:avcodec.lib", "-l:avutil.lib", "-l:avformat.lib", "-l:swresample.lib", "-l:swscale.lib");
     #endif
 }
 
@@ -116,6 +121,64 @@ bool build_exe(bool force, Nob_Cmd *cmd, const char **input_paths, size_t input_
     return true;
 }
 
+// The benchmarks are optimized, at -O0 the intrinsics of the SIMD kernels are slower than the scalar code
+bool build_bench(bool force, Nob_Cmd *cmd, const char **input_paths, size_t input_paths_len, const char *output_path)
+{
+    int rebuild_is_needed = nob_needs_rebuild(output_path, input_paths, input_paths_len);
+    if (rebuild_is_needed < 0) return false;
+
+    if (force || rebuild_is_needed) {
+        cc(cmd);
+        nob_cmd_append(cmd, "-O2", "-o", output_path);
+        nob_da_append_many(cmd, input_paths, input_paths_len);
+        libs(cmd);
+        return nob_cmd_run_sync_and_reset(cmd);
+    }
+
+    nob_log(NOB_INFO, "%s is up-to-date", output_path);
+    return true;
+}
+
+// TESTS_DIR"<name>_test.c" is built together with the sources of panim it tests into BUILD_DIR"<name>_test",
+// and TESTS_DIR"<name>_bench.c" into BUILD_DIR"<name>_bench" if the test has a benchmark
+typedef struct {
+    const char *name;
+    const char *sources[8];
+    bool bench;
+} Test;
+
+static const Test tests[] = {
+    {"yuv", {PANIM_DIR"yuv.c", PANIM_DIR"workers.c", PANIM_DIR"damage.c", PANIM_DIR"hash.c"}, true},
+    {"mixer", {PANIM_DIR"mixer.c"}, true},
+    {"hash", {PANIM_DIR"hash.c", PANIM_DIR"workers.c"}, false},
+    {"qoi", {PANIM_DIR"qoi.c"}, false},
+    {"frame_cache", {PANIM_DIR"frame_cache.c", PANIM_DIR"qoi.c", PANIM_DIR"workers.c"}, false},
+    {"images", {PANIM_DIR"images.c", PANIM_DIR"qoi.c", PANIM_DIR"workers.c"}, false},
+    {"scale", {PANIM_DIR"scale.c", PANIM_DIR"workers.c"}, false},
+    {"gif", {PANIM_DIR"gif.c", PANIM_DIR"workers.c"}, false},
+    {"accum", {PANIM_DIR"accum.c", PANIM_DIR"workers.c"}, false},
+    {"tiles", {PANIM_DIR"tiles.c", PANIM_DIR"gl.c", PANIM_DIR"qoi.c", PANIM_DIR"images.c", PANIM_DIR"workers.c"}, false},
+    {"frame_server", {PANIM_DIR"frame_server.c"}, false},
+    {"checkpoint", {PANIM_DIR"checkpoint.c"}, false},
+    {"range", {PANIM_DIR"range.c"}, false},
+};
+
+bool build_test(bool force, Nob_Cmd *cmd, const Test *test)
+{
+    Nob_File_Paths input_paths = {0};
+    nob_da_append(&input_paths, nob_temp_sprintf(TESTS_DIR"%s_test.c", test->name));
+    for (size_t i = 0; i < NOB_ARRAY_LEN(test->sources) && test->sources[i] != NULL; ++i) {
+        nob_da_append(&input_paths, test->sources[i]);
+    }
+    bool ok = build_exe(force, cmd, input_paths.items, input_paths.count, nob_temp_sprintf(BUILD_DIR"%s_test", test->name));
+    if (ok && test->bench) {
+        input_paths.items[0] = nob_temp_sprintf(TESTS_DIR"%s_bench.c", test->name);
+        ok = build_bench(force, cmd, input_paths.items, input_paths.count, nob_temp_sprintf(BUILD_DIR"%s_bench", test->name));
+    }
+    nob_da_free(input_paths);
+    return ok;
+}
+
 int main(int argc, char **argv)
 {
     NOB_GO_REBUILD_URSELF(argc, argv);
@@ -128,6 +191,10 @@ int main(int argc, char **argv)
         const char *flag = nob_shift_args(&argc, &argv);
         if (strcmp(flag, "-f") == 0) {
             force = true;
+        } else if (strcmp(flag, "-test") == 0) {
+            run_tests = true;
+        } else if (strcmp(flag, "-bench") == 0) {
+            run_benchmarks = true;
         } else {
             nob_log(NOB_ERROR, "Unknown flag %s", flag);
             return 1;
@@ -157,17 +224,52 @@ int main(int argc, char **argv)
 
     {
         const char *output_path = BUILD_DIR"panim";
-        const char *input_paths[] = {
-            PANIM_DIR"panim.c",
-            #ifndef _WIN32
-            PANIM_DIR"ffmpeg_linux.c"
-            #else
-            PANIM_DIR"ffmpeg_windows.c"
-            #endif
-        };
-        size_t input_paths_len = NOB_ARRAY_LEN(input_paths);
-        if (!build_exe(force, &cmd, input_paths, input_paths_len, output_path)) return 1;
+        Nob_File_Paths input_paths = {0};
+        nob_da_append(&input_paths, PANIM_DIR"panim.c");
+        nob_da_append(&input_paths, PANIM_DIR"gl.c");
+        nob_da_append(&input_paths, PANIM_DIR"readback.c");
+        nob_da_append(&input_paths, PANIM_DIR"workers.c");
+        nob_da_append(&input_paths, PANIM_DIR"yuv.c");
+        nob_da_append(&input_paths, PANIM_DIR"mixer.c");
+        nob_da_append(&input_paths, PANIM_DIR"hash.c");
+        nob_da_append(&input_paths, PANIM_DIR"damage.c");
+        nob_da_append(&input_paths, PANIM_DIR"qoi.c");
+        nob_da_append(&input_paths, PANIM_DIR"frame_cache.c");
+        nob_da_append(&input_paths, PANIM_DIR"images.c");
+        nob_da_append(&input_paths, PANIM_DIR"scale.c");
+        nob_da_append(&input_paths, PANIM_DIR"gif.c");
+        nob_da_append(&input_paths, PANIM_DIR"msaa.c");
+        nob_da_append(&input_paths, PANIM_DIR"gpu_timer.c");
+        nob_da_append(&input_paths, PANIM_DIR"accum.c");
+        nob_da_append(&input_paths, PANIM_DIR"tiles.c");
+        nob_da_append(&input_paths, PANIM_DIR"frame_server.c");
+        nob_da_append(&input_paths, PANIM_DIR"checkpoint.c");
+        nob_da_append(&input_paths, PANIM_DIR"range.c");
+        #ifndef _WIN32
+        nob_da_append(&input_paths, PANIM_DIR"ffmpeg_linux.c");
+        #else
+        nob_da_append(&input_paths, PANIM_DIR"ffmpeg_windows.c");
+        #endif
+        if (!build_exe(force, &cmd, input_paths.items, input_paths.count, output_path)) return 1;
+    }
+
+    for (size_t i = 0; i < NOB_ARRAY_LEN(tests); ++i) {
+        if (!build_test(force, &cmd, &tests[i])) return 1;
+    }
+
+    // A failed test does not stop the rest of them
+    bool ok = true;
+    for (size_t i = 0; i < NOB_ARRAY_LEN(tests); ++i) {
+        if (run_tests) {
+            nob_cmd_append(&cmd, nob_temp_sprintf(BUILD_DIR"%s_test", tests[i].name));
+            ok = nob_cmd_run_sync_and_reset(&cmd) && ok;
+        }
+        if (run_benchmarks && tests[i].bench) {
+            nob_cmd_append(&cmd, nob_temp_sprintf(BUILD_DIR"%s_bench", tests[i].name));
+            ok = nob_cmd_run_sync_and_reset(&cmd) && ok;
+        }
     }
+    if (!ok) return 1;
 
     return 0;
 }
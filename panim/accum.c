@@ -0,0 +1,220 @@
+#include <assert.h>
+
+#include "accum.h"
+#include "workers.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ACCUM_X86
+#include <immintrin.h>
+#endif
+
+// Bytes per chunk of the workers
+#define ACCUM_CHUNK (64*1024)
+// Dividing by count is multiplying by ceil(2^24/count) and shifting. For sums below 2^16 and
+// count up to ACCUM_MAX_COUNT it is exact, and the product still fits into 32 bits.
+#define ACCUM_SHIFT 24
+
+static inline uint32_t accum_reciprocal(size_t count)
+{
+    return ((1u << ACCUM_SHIFT) + count - 1)/count;
+}
+
+static size_t accum_add_scalar(uint16_t *sum, const uint8_t *src, size_t i, size_t size, bool first)
+{
+    for (; i < size; ++i) sum[i] = first ? src[i] : sum[i] + src[i];
+    return i;
+}
+
+static size_t accum_resolve_scalar(uint8_t *dst, const uint16_t *sum, size_t i, size_t size, size_t count)
+{
+    uint32_t reciprocal = accum_reciprocal(count);
+    uint32_t half = count/2;
+    for (; i < size; ++i) dst[i] = ((sum[i] + half)*reciprocal) >> ACCUM_SHIFT;
+    return i;
+}
+
+#ifdef ACCUM_X86
+__attribute__((target("sse4.1")))
+static size_t accum_add_sse41(uint16_t *sum, const uint8_t *src, size_t i, size_t size, bool first)
+{
+    for (; i + 16 <= size; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_cvtepu8_epi16(s);
+        __m128i hi = _mm_cvtepu8_epi16(_mm_srli_si128(s, 8));
+        if (!first) {
+            lo = _mm_add_epi16(lo, _mm_loadu_si128((const __m128i*)(sum + i)));
+            hi = _mm_add_epi16(hi, _mm_loadu_si128((const __m128i*)(sum + i + 8)));
+        }
+        _mm_storeu_si128((__m128i*)(sum + i), lo);
+        _mm_storeu_si128((__m128i*)(sum + i + 8), hi);
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i accum_divide_sse41(__m128i x, __m128i half, __m128i reciprocal)
+{
+    return _mm_srli_epi32(_mm_mullo_epi32(_mm_add_epi32(x, half), reciprocal), ACCUM_SHIFT);
+}
+
+__attribute__((target("sse4.1")))
+static size_t accum_resolve_sse41(uint8_t *dst, const uint16_t *sum, size_t i, size_t size, size_t count)
+{
+    const __m128i reciprocal = _mm_set1_epi32(accum_reciprocal(count));
+    const __m128i half = _mm_set1_epi32(count/2);
+    for (; i + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(sum + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(sum + i + 8));
+        __m128i a0 = accum_divide_sse41(_mm_cvtepu16_epi32(a), half, reciprocal);
+        __m128i a1 = accum_divide_sse41(_mm_cvtepu16_epi32(_mm_srli_si128(a, 8)), half, reciprocal);
+        __m128i b0 = accum_divide_sse41(_mm_cvtepu16_epi32(b), half, reciprocal);
+        __m128i b1 = accum_divide_sse41(_mm_cvtepu16_epi32(_mm_srli_si128(b, 8)), half, reciprocal);
+        __m128i x = _mm_packus_epi16(_mm_packus_epi32(a0, a1), _mm_packus_epi32(b0, b1));
+        _mm_storeu_si128((__m128i*)(dst + i), x);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t accum_add_avx2(uint16_t *sum, const uint8_t *src, size_t i, size_t size, bool first)
+{
+    for (; i + 32 <= size; i += 32) {
+        __m256i lo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + i)));
+        __m256i hi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + i + 16)));
+        if (!first) {
+            lo = _mm256_add_epi16(lo, _mm256_loadu_si256((const __m256i*)(sum + i)));
+            hi = _mm256_add_epi16(hi, _mm256_loadu_si256((const __m256i*)(sum + i + 16)));
+        }
+        _mm256_storeu_si256((__m256i*)(sum + i), lo);
+        _mm256_storeu_si256((__m256i*)(sum + i + 16), hi);
+    }
+    return accum_add_sse41(sum, src, i, size, first);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i accum_divide_avx2(__m128i x, __m256i half, __m256i reciprocal)
+{
+    return _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_add_epi32(_mm256_cvtepu16_epi32(x), half), reciprocal), ACCUM_SHIFT);
+}
+
+__attribute__((target("avx2")))
+static size_t accum_resolve_avx2(uint8_t *dst, const uint16_t *sum, size_t i, size_t size, size_t count)
+{
+    const __m256i reciprocal = _mm256_set1_epi32(accum_reciprocal(count));
+    const __m256i half = _mm256_set1_epi32(count/2);
+    for (; i + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(sum + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(sum + i + 8));
+        // packus works within the 128-bit lanes, the permute puts the halves back in order
+        __m256i x = _mm256_packus_epi32(accum_divide_avx2(a, half, reciprocal), accum_divide_avx2(b, half, reciprocal));
+        x = _mm256_permute4x64_epi64(x, 0xD8);
+        __m128i y = _mm_packus_epi16(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+        _mm_storeu_si128((__m128i*)(dst + i), y);
+    }
+    return accum_resolve_sse41(dst, sum, i, size, count);
+}
+#endif // ACCUM_X86
+
+const char *accum_kernel_name(Accum_Kernel kernel)
+{
+    switch (kernel) {
+    case ACCUM_KERNEL_SCALAR: return "scalar";
+    case ACCUM_KERNEL_SSE41:  return "SSE4.1";
+    case ACCUM_KERNEL_AVX2:   return "AVX2";
+    case COUNT_ACCUM_KERNELS:
+    default:                  return "unknown";
+    }
+}
+
+Accum_Kernel accum_best_kernel(void)
+{
+#ifdef ACCUM_X86
+    if (__builtin_cpu_supports("avx2")) return ACCUM_KERNEL_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return ACCUM_KERNEL_SSE41;
+#endif
+    return ACCUM_KERNEL_SCALAR;
+}
+
+void accum_add_with(Accum_Kernel kernel, uint16_t *sum, const uint8_t *src, size_t size, bool first)
+{
+    size_t i = 0;
+    switch (kernel) {
+#ifdef ACCUM_X86
+    case ACCUM_KERNEL_AVX2:  i = accum_add_avx2(sum, src, 0, size, first);  break;
+    case ACCUM_KERNEL_SSE41: i = accum_add_sse41(sum, src, 0, size, first); break;
+#endif
+    default: break;
+    }
+    accum_add_scalar(sum, src, i, size, first);
+}
+
+void accum_resolve_with(Accum_Kernel kernel, uint8_t *dst, const uint16_t *sum, size_t size, size_t count)
+{
+    assert(count > 0 && count <= ACCUM_MAX_COUNT);
+    size_t i = 0;
+    switch (kernel) {
+#ifdef ACCUM_X86
+    case ACCUM_KERNEL_AVX2:  i = accum_resolve_avx2(dst, sum, 0, size, count);  break;
+    case ACCUM_KERNEL_SSE41: i = accum_resolve_sse41(dst, sum, 0, size, count); break;
+#endif
+    default: break;
+    }
+    accum_resolve_scalar(dst, sum, i, size, count);
+}
+
+typedef struct {
+    Accum_Kernel kernel;
+    uint16_t *sum;
+    uint8_t *dst;
+    const uint8_t *src;
+    size_t size;
+    size_t count;
+    bool first;
+} Accum_Job;
+
+static void accum_add_job(void *ctx, size_t begin, size_t end)
+{
+    Accum_Job *job = ctx;
+    size_t from = begin*ACCUM_CHUNK;
+    size_t to = end*ACCUM_CHUNK < job->size ? end*ACCUM_CHUNK : job->size;
+    accum_add_with(job->kernel, job->sum + from, job->src + from, to - from, job->first);
+}
+
+static void accum_resolve_job(void *ctx, size_t begin, size_t end)
+{
+    Accum_Job *job = ctx;
+    size_t from = begin*ACCUM_CHUNK;
+    size_t to = end*ACCUM_CHUNK < job->size ? end*ACCUM_CHUNK : job->size;
+    accum_resolve_with(job->kernel, job->dst + from, job->sum + from, to - from, job->count);
+}
+
+static Accum_Kernel accum_kernel(void)
+{
+    static Accum_Kernel kernel = COUNT_ACCUM_KERNELS;
+    if (kernel == COUNT_ACCUM_KERNELS) kernel = accum_best_kernel();
+    return kernel;
+}
+
+void accum_add(uint16_t *sum, const uint8_t *src, size_t size, bool first)
+{
+    Accum_Job job = {
+        .kernel = accum_kernel(),
+        .sum = sum,
+        .src = src,
+        .size = size,
+        .first = first,
+    };
+    workers_parallel_for((size + ACCUM_CHUNK - 1)/ACCUM_CHUNK, accum_add_job, &job);
+}
+
+void accum_resolve(uint8_t *dst, const uint16_t *sum, size_t size, size_t count)
+{
+    Accum_Job job = {
+        .kernel = accum_kernel(),
+        .sum = (uint16_t*)sum,
+        .dst = dst,
+        .size = size,
+        .count = count,
+    };
+    workers_parallel_for((size + ACCUM_CHUNK - 1)/ACCUM_CHUNK, accum_resolve_job, &job);
+}
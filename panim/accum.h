@@ -0,0 +1,32 @@
+#ifndef ACCUM_H_
+#define ACCUM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Accumulation of 8-bit frames into 16 bits per channel, for averaging several sub-frames
+// of the animation into one frame of the video (motion blur). Up to ACCUM_MAX_COUNT frames
+// fit without overflowing. Both operations are split across the workers and use AVX2 or
+// SSE4.1 when the CPU has them, with a scalar fallback that is also the reference.
+
+#define ACCUM_MAX_COUNT 256
+
+typedef enum {
+    ACCUM_KERNEL_SCALAR,
+    ACCUM_KERNEL_SSE41,
+    ACCUM_KERNEL_AVX2,
+    COUNT_ACCUM_KERNELS,
+} Accum_Kernel;
+
+// sum += src, or sum = src if first. size is in bytes of src.
+void accum_add(uint16_t *sum, const uint8_t *src, size_t size, bool first);
+// dst = sum/count, rounded to the nearest
+void accum_resolve(uint8_t *dst, const uint16_t *sum, size_t size, size_t count);
+Accum_Kernel accum_best_kernel(void);
+const char *accum_kernel_name(Accum_Kernel kernel);
+// Single threaded versions with a specific kernel. Mostly useful for checking the kernels against each other.
+void accum_add_with(Accum_Kernel kernel, uint16_t *sum, const uint8_t *src, size_t size, bool first);
+void accum_resolve_with(Accum_Kernel kernel, uint8_t *dst, const uint16_t *sum, size_t size, size_t count);
+
+#endif // ACCUM_H_
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "nob.h"
+#include "checkpoint.h"
+
+const char *checkpoint_dir(const char *output_path)
+{
+    return nob_temp_sprintf("%s.checkpoint", output_path);
+}
+
+const char *checkpoint_segment_path(const Checkpoint *cp, size_t index)
+{
+    return nob_temp_sprintf("%s/segment%05zu%s", cp->dir, index, cp->ext);
+}
+
+static const char *checkpoint_note_path(const Checkpoint *cp)
+{
+    return nob_temp_sprintf("%s/checkpoint.txt", cp->dir);
+}
+
+// Written next to the note and renamed over it, so a crash never leaves half of it behind
+static bool checkpoint_write(const Checkpoint *cp)
+{
+    const char *content = nob_temp_sprintf("%s\n%zu %zu\n", cp->settings, cp->segment_frames, cp->segments_count);
+    const char *temp_path = nob_temp_sprintf("%s/checkpoint.tmp", cp->dir);
+    if (!nob_write_entire_file(temp_path, content, strlen(content))) return false;
+    return nob_rename(temp_path, checkpoint_note_path(cp));
+}
+
+static bool checkpoint_read(Checkpoint *cp)
+{
+    cp->segments_count = 0;
+    const char *path = checkpoint_note_path(cp);
+    if (nob_file_exists(path) != 1) {
+        TraceLog(LOG_INFO, "CHECKPOINT: there is no checkpoint in %s, starting from the beginning", cp->dir);
+        return true;
+    }
+
+    Nob_String_Builder sb = {0};
+    if (!nob_read_entire_file(path, &sb)) return false;
+    nob_sb_append_null(&sb);
+    size_t settings_size = strlen(cp->settings);
+    size_t frames = 0;
+    size_t segments_count = 0;
+    bool ok = strncmp(sb.items, cp->settings, settings_size) == 0 && sb.items[settings_size] == '\n' &&
+              sscanf(sb.items + settings_size + 1, "%zu %zu", &frames, &segments_count) == 2 && frames > 0;
+    nob_sb_free(sb);
+    if (!ok) {
+        TraceLog(LOG_ERROR, "CHECKPOINT: the checkpoint in %s was made by a render with other settings or another animation", cp->dir);
+        return false;
+    }
+    cp->segment_frames = frames;
+    cp->segments_count = segments_count;
+    return true;
+}
+
+bool checkpoint_start(Checkpoint *cp, bool resume)
+{
+    cp->segments_count = 0;
+    if (resume && !checkpoint_read(cp)) return false;
+    if (!nob_mkdir_if_not_exists(cp->dir)) return false;
+    return checkpoint_write(cp);
+}
+
+bool checkpoint_render(Checkpoint *cp, size_t begin, size_t end, const Checkpoint_Renderer *renderer, size_t *frame)
+{
+    *frame = 0;
+    for (; *frame < begin + cp->segments_count*cp->segment_frames && !renderer->finished(renderer->ctx); ++*frame) {
+        renderer->skip_frame(renderer->ctx);
+    }
+    if (cp->segments_count > 0) {
+        TraceLog(LOG_INFO, "CHECKPOINT: resuming after %zu segments, skipped %zu frames", cp->segments_count, *frame - begin);
+    }
+
+    while (*frame < end && !renderer->finished(renderer->ctx)) {
+        if (!renderer->start_segment(renderer->ctx, checkpoint_segment_path(cp, cp->segments_count))) return false;
+        size_t segment_end = *frame + cp->segment_frames < end ? *frame + cp->segment_frames : end;
+        bool ok = true;
+        for (; *frame < segment_end && !renderer->finished(renderer->ctx) && ok; ++*frame) {
+            ok = renderer->render_frame(renderer->ctx);
+        }
+        if (!renderer->finish_segment(renderer->ctx, !ok) || !ok) return false;
+        cp->segments_count += 1;
+        if (!checkpoint_write(cp)) return false;
+    }
+    return true;
+}
+
+void checkpoint_remove(const Checkpoint *cp)
+{
+    for (size_t i = 0; i < cp->segments_count; ++i) remove(checkpoint_segment_path(cp, i));
+    remove(checkpoint_note_path(cp));
+    remove(cp->dir);
+}
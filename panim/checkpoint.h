@@ -0,0 +1,54 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Renders that survive being interrupted. The video is rendered in segments of a fixed amount of
+// frames into a directory next to the output, and after every segment a note of how many of them
+// are complete is written there. An interrupted render is continued by skipping the frames of the
+// complete segments without drawing them, and rendering the rest.
+//
+// The state of the animation is never saved: it is opaque to panim, and it is reached again by
+// running the animation up to the first missing frame. So the animation has to advance exactly
+// the same way every time, like it does in render mode.
+
+// How the frames of the animation are skipped and rendered into the segments
+typedef struct {
+    void *ctx;
+    bool (*finished)(void *ctx);
+    // Advances the animation by one frame without rendering it
+    void (*skip_frame)(void *ctx);
+    bool (*start_segment)(void *ctx, const char *path);
+    bool (*render_frame)(void *ctx);
+    // Cancels the segment instead of completing it if cancel is true
+    bool (*finish_segment)(void *ctx, bool cancel);
+} Checkpoint_Renderer;
+
+typedef struct {
+    // Where the segments and the note are kept, see checkpoint_dir()
+    const char *dir;
+    // Everything that changes the frames. A checkpoint with other settings is never continued.
+    const char *settings;
+    // Extension of the segments, which picks their container
+    const char *ext;
+    size_t segment_frames;
+    // The complete segments
+    size_t segments_count;
+} Checkpoint;
+
+// Where the checkpoint of a render into output_path is kept until the render is complete
+const char *checkpoint_dir(const char *output_path);
+const char *checkpoint_segment_path(const Checkpoint *cp, size_t index);
+// Creates the directory and writes the note. With resume it first takes over how many segments an
+// interrupted render completed and how long they are. Having no checkpoint to resume is fine and
+// starts from the beginning, having one with other settings is an error.
+bool checkpoint_start(Checkpoint *cp, bool resume);
+// Renders the frames from begin to end, or until the animation is finished, skipping the ones of
+// the complete segments. *frame is where it stopped. If rendering fails the complete segments are
+// kept for resuming.
+bool checkpoint_render(Checkpoint *cp, size_t begin, size_t end, const Checkpoint_Renderer *renderer, size_t *frame);
+// Removes the segments, the note and the directory once the render is complete
+void checkpoint_remove(const Checkpoint *cp);
+
+#endif // CHECKPOINT_H_
@@ -0,0 +1,118 @@
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "damage.h"
+#include "hash.h"
+#include "workers.h"
+
+void damage_init(Damage *damage, size_t width, size_t height)
+{
+    memset(damage, 0, sizeof(*damage));
+    damage->width = width;
+    damage->height = height;
+    damage->tile_size = DAMAGE_TILE_SIZE;
+    for (;;) {
+        damage->cols = (width + damage->tile_size - 1)/damage->tile_size;
+        damage->rows = (height + damage->tile_size - 1)/damage->tile_size;
+        if (damage->cols*damage->rows <= DAMAGE_MAX_TILES) break;
+        damage->tile_size *= 2;
+    }
+}
+
+void damage_clear(Damage *damage)
+{
+    memset(damage->tiles, 0, damage->cols*damage->rows*sizeof(damage->tiles[0]));
+    damage->dirty_count = 0;
+}
+
+void damage_fill(Damage *damage)
+{
+    memset(damage->tiles, 1, damage->cols*damage->rows*sizeof(damage->tiles[0]));
+    damage->dirty_count = damage->cols*damage->rows;
+}
+
+void damage_merge(Damage *damage, const Damage *other)
+{
+    assert(damage->cols == other->cols && damage->rows == other->rows);
+    for (size_t i = 0; i < damage->cols*damage->rows; ++i) {
+        if (other->tiles[i] && !damage->tiles[i]) {
+            damage->tiles[i] = true;
+            damage->dirty_count += 1;
+        }
+    }
+}
+
+bool damage_is_full(const Damage *damage)
+{
+    return damage->dirty_count == damage->cols*damage->rows;
+}
+
+void damage_add_rect(Damage *damage, Rectangle rect)
+{
+    if (rect.width <= 0 || rect.height <= 0) return;
+
+    // Screen y goes down, the tiles go up from the bottom
+    float left = fmaxf(floorf(rect.x), 0);
+    float right = fminf(ceilf(rect.x + rect.width), damage->width);
+    float bottom = fmaxf(floorf(damage->height - (rect.y + rect.height)), 0);
+    float top = fminf(ceilf(damage->height - rect.y), damage->height);
+    if (left >= right || bottom >= top) return;
+
+    size_t size = damage->tile_size;
+    size_t col_begin = (size_t)left/size;
+    size_t col_end = ((size_t)right + size - 1)/size;
+    size_t row_begin = (size_t)bottom/size;
+    size_t row_end = ((size_t)top + size - 1)/size;
+    for (size_t row = row_begin; row < row_end; ++row) {
+        for (size_t col = col_begin; col < col_end; ++col) {
+            bool *tile = &damage->tiles[row*damage->cols + col];
+            if (!*tile) damage->dirty_count += 1;
+            *tile = true;
+        }
+    }
+}
+
+void damage_tile_rect(const Damage *damage, size_t col, size_t row, size_t *x, size_t *y, size_t *w, size_t *h)
+{
+    size_t size = damage->tile_size;
+    *x = col*size;
+    *y = row*size;
+    *w = damage->width - *x < size ? damage->width - *x : size;
+    *h = damage->height - *y < size ? damage->height - *y : size;
+}
+
+typedef struct {
+    const Damage *dirty;
+    const uint8_t *pixels;
+    uint64_t *hashes;
+    Damage *changed;
+} Damage_Hash_Job;
+
+static void damage_hash_job(void *ctx, size_t begin, size_t end)
+{
+    Damage_Hash_Job *job = ctx;
+    const Damage *dirty = job->dirty;
+    size_t stride = dirty->width*4;
+    for (size_t i = begin; i < end; ++i) {
+        if (!dirty->tiles[i]) continue;
+        size_t x, y, w, h;
+        damage_tile_rect(dirty, i%dirty->cols, i/dirty->cols, &x, &y, &w, &h);
+        uint64_t hash = hash_rect(job->pixels + y*stride + x*4, stride, w*4, h);
+        job->changed->tiles[i] = hash != job->hashes[i];
+        job->hashes[i] = hash;
+    }
+}
+
+void damage_hash_tiles(const Damage *dirty, const void *pixels, uint64_t *hashes, Damage *changed)
+{
+    damage_init(changed, dirty->width, dirty->height);
+    Damage_Hash_Job job = {
+        .dirty = dirty,
+        .pixels = pixels,
+        .hashes = hashes,
+        .changed = changed,
+    };
+    workers_parallel_for(dirty->cols*dirty->rows, damage_hash_job, &job);
+    for (size_t i = 0; i < changed->cols*changed->rows; ++i) changed->dirty_count += changed->tiles[i];
+}
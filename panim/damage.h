@@ -0,0 +1,46 @@
+#ifndef DAMAGE_H_
+#define DAMAGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <raylib.h>
+
+// Which parts of a rendered frame changed since the previous one, in tiles of
+// DAMAGE_TILE_SIZE pixels. Frames that would need more than DAMAGE_MAX_TILES of them
+// (8K and up) get tiles twice as big, as many times as it takes. The rows of tiles go
+// bottom-up like the rows of pixels that come out of the readback, so tile row 0 is
+// at the bottom of the screen.
+
+#define DAMAGE_TILE_SIZE 64
+#define DAMAGE_MAX_TILES 4096
+
+typedef struct {
+    size_t width;
+    size_t height;
+    size_t tile_size;
+    size_t cols;
+    size_t rows;
+    size_t dirty_count;
+    bool tiles[DAMAGE_MAX_TILES];
+} Damage;
+
+// Starts with nothing dirty
+void damage_init(Damage *damage, size_t width, size_t height);
+void damage_clear(Damage *damage);
+// Marks the whole frame as dirty
+void damage_fill(Damage *damage);
+// rect is in screen coordinates, with y going down
+void damage_add_rect(Damage *damage, Rectangle rect);
+// Marks the tiles that are dirty in other as dirty in damage too. Both must have the same size.
+void damage_merge(Damage *damage, const Damage *other);
+bool damage_is_full(const Damage *damage);
+// Pixels of the tile in the frame
+void damage_tile_rect(const Damage *damage, size_t col, size_t row, size_t *x, size_t *y, size_t *w, size_t *h);
+
+// Hashes the dirty tiles of the bottom-up RGBA pixels across the workers, compares them with
+// hashes (one per tile, updated in place) and marks the tiles that actually changed in changed.
+void damage_hash_tiles(const Damage *dirty, const void *pixels, uint64_t *hashes, Damage *changed);
+
+#endif // DAMAGE_H_
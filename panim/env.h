@@ -10,6 +10,11 @@ typedef struct {
     float screen_height;
     bool rendering;
     void (*play_sound)(Sound sound, Wave wave);
+    // Optional. Tells the engine that only rect (in screen coordinates) changed since the previous
+    // frame, so it does not have to read back the rest of the screen while rendering. The rect must
+    // cover both where things were and where they are now. Can be called several times per frame.
+    // A frame without any reports is treated as fully changed, an empty rect means nothing changed.
+    void (*report_damage)(Rectangle rect);
 } Env;
 
 #endif // ENV_H_
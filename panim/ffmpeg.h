@@ -4,11 +4,54 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+#include "damage.h"
+
 typedef struct FFMPEG FFMPEG;
 
-FFMPEG *ffmpeg_start_rendering_video(const char *output_path, size_t width, size_t height, size_t fps);
+typedef enum {
+    FFMPEG_CODEC_H264, // libx264 at 2500k with AAC audio, for the final videos
+    FFMPEG_CODEC_FFV1, // Lossless FFV1 with FLAC audio, for masters. Needs a container that takes them, like .mkv
+} FFMPEG_Codec;
+
+typedef struct {
+    FFMPEG_Codec codec;
+    // Amount of frames that can be queued for the writer thread before
+    // ffmpeg_send_frame_flipped() blocks. 0 writes on the calling thread.
+    size_t queue_depth;
+} FFMPEG_Config;
+
+// Applies to the renderings started after it was changed
+extern FFMPEG_Config ffmpeg_config;
+
+// Renders a video with an audio track made of the samples passed to ffmpeg_send_sound_samples()
+// muxed into it. sample_rate 0 leaves out the audio track. On Windows only 0 is supported, and
+// neither are ffmpeg_start_encoding_final() and ffmpeg_start_rendering_video_rows().
+//
+// A .y4m output_path is written directly, without ffmpeg and without compression, so the rendering
+// only waits for the disk. Y4M has no audio, so the audio track goes next to it into a .wav with the
+// same name (see ffmpeg_y4m_audio_path()).
+FFMPEG *ffmpeg_start_rendering_video(const char *output_path, size_t width, size_t height, size_t fps, size_t sample_rate, size_t channels);
+// Encodes a rendered intermediate (a .y4m, or an FFV1 master) into the final H.264 video in a
+// background ffmpeg process. audio_path may be NULL. ffmpeg_end_rendering() waits for it to finish.
+FFMPEG *ffmpeg_start_encoding_final(const char *input_path, const char *audio_path, const char *output_path);
+bool ffmpeg_is_y4m_path(const char *path);
+// Path of the .wav that goes with a .y4m. Returns the amount of characters like snprintf().
+int ffmpeg_y4m_audio_path(char *buffer, size_t size, const char *y4m_path);
+// Like ffmpeg_start_rendering_video(), but the frames are sent in horizontal strips with ffmpeg_send_rows()
+// and are never all in memory at once, for sizes that do not fit into it (see --tile). They always go
+// through the ffmpeg executable as RGBA and ffmpeg converts them itself. .y4m is not supported.
+FFMPEG *ffmpeg_start_rendering_video_rows(const char *output_path, size_t width, size_t height, size_t fps, size_t sample_rate, size_t channels);
+// Top-down RGBA rows of width pixels. The strips of a frame have to add up to its height.
+bool ffmpeg_send_rows(FFMPEG *ffmpeg, const void *rows, size_t width, size_t count);
 FFMPEG *ffmpeg_start_rendering_audio(const char *output_path);
 bool ffmpeg_send_frame_flipped(FFMPEG *ffmpeg, void *data, size_t width, size_t height);
+// Same as ffmpeg_send_frame_flipped(), but only the tiles in changed differ from the previous frame,
+// so only those are converted. NULL means everything changed.
+bool ffmpeg_send_frame_flipped_damage(FFMPEG *ffmpeg, void *data, size_t width, size_t height, const Damage *changed);
+// Sends the same frame as the previous one again. The already converted frame is resent, so nothing
+// is converted again.
+bool ffmpeg_send_repeated_frame(FFMPEG *ffmpeg);
+// Interleaved s16 samples
 bool ffmpeg_send_sound_samples(FFMPEG *ffmpeg, void *data, size_t size);
 bool ffmpeg_end_rendering(FFMPEG *ffmpeg, bool cancel);
 
@@ -1,74 +1,539 @@
+#define _GNU_SOURCE
 #include <assert.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdatomic.h>
 
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 #include <raylib.h>
 
 #include "ffmpeg.h"
+#include "yuv.h"
 
 #define READ_END 0
 #define WRITE_END 1
+// Requested size of the pipe buffer. Linux caps it at /proc/sys/fs/pipe-max-size (1MiB by default).
+#define FFMPEG_PIPE_SIZE (1024*1024)
+// The muxed audio track is passed to the ffmpeg child as this file descriptor (pipe:3)
+#define FFMPEG_AUDIO_FD 3
+// .y4m files are preallocated in extents of this size, so the file system lays them out contiguously
+// instead of growing them one write at a time
+#define FFMPEG_FILE_EXTENT (256*1024*1024)
+// Written parts of a .y4m are handed to the disk every this many bytes and dropped from the page
+// cache once they are on it, so a long render does not push everything else out of memory
+#define FFMPEG_FILE_FLUSH (32*1024*1024)
+#define FFMPEG_WAV_HEADER_SIZE 44
+// Encoder settings of the final videos
+#define FFMPEG_H264_VIDEO_ARGS "-c:v", "libx264", "-vb", "2500k"
+#define FFMPEG_H264_AUDIO_ARGS "-c:a", "aac", "-ab", "200k"
+
+FFMPEG_Config ffmpeg_config = {
+    .queue_depth = 4,
+};
+
+typedef struct {
+    void *data;
+    size_t size;
+    bool end;
+} FFMPEG_Slot;
+
+// One side of the ring sleeping until the other side moves its index. waiting keeps the futex
+// syscalls off the path of every frame, the other side only makes one when somebody sleeps.
+typedef struct {
+    atomic_uint futex;
+    atomic_bool waiting;
+} FFMPEG_Sleeper;
+
+typedef struct {
+    uint8_t *items;
+    size_t count;
+    size_t capacity;
+} FFMPEG_Samples;
 
 struct FFMPEG {
+    // Either a forked ffmpeg reading from the pipe, or a .y4m file written directly into the pipe with pid < 0
     int pipe;
     pid_t pid;
+    bool y4m;
+    // Frames are sent in strips with ffmpeg_send_rows()
+    bool rows;
+    off_t file_size;
+    off_t file_allocated;
+    off_t file_flushed;
+    bool file_preallocate;
+
+    // Single producer (render loop), single consumer (writer thread) lock-free ring of preallocated
+    // frames. head is only advanced by the producer and tail only by the consumer, and the side that
+    // finds the ring full or empty sleeps on a futex until the other one moves its index.
+    FFMPEG_Slot *slots;
+    size_t slots_count;
+    // Frame packed on the calling thread when there is no writer thread
+    void *frame;
+    size_t slot_size;
+    atomic_size_t head;
+    atomic_size_t tail;
+    FFMPEG_Sleeper producer;
+    FFMPEG_Sleeper consumer;
+    pthread_t writer;
+    atomic_bool failed;
+    atomic_bool cancelled;
+
+    // Interleaved s16 samples of the audio track muxed into the video. The render thread appends
+    // them to pending and whoever writes them swaps pending with writing, so the lock is only held
+    // for the swap. The ffmpeg executable reads them from a second pipe on their own thread, because
+    // it may wait for audio while the video pipe is full.
+    bool has_audio;
+    size_t channels;
+    int audio_pipe;
+    pthread_t audio_writer;
+    pthread_mutex_t audio_mutex;
+    pthread_cond_t audio_cond;
+    FFMPEG_Samples audio_pending;
+    FFMPEG_Samples audio_writing;
+    bool audio_end;
+    // Bytes of samples written into the .wav of a .y4m
+    size_t audio_written;
 };
 
-FFMPEG *ffmpeg_start_rendering_video(const char *output_path, size_t width, size_t height, size_t fps)
+// Keeps calling writev() until every iovec is written, because the pipe may accept only a part of them
+static bool ffmpeg_writev_all(int fd, struct iovec *iov, size_t iovcnt)
 {
-    int pipefd[2];
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        size_t written = n;
+        while (iovcnt > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov += 1;
+            iovcnt -= 1;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+static bool ffmpeg_write_all(int fd, void *data, size_t size)
+{
+    struct iovec iov = { .iov_base = data, .iov_len = size };
+    return ffmpeg_writev_all(fd, &iov, 1);
+}
+
+// Appends to the .y4m with large sequential writes into preallocated extents
+static bool ffmpeg_file_writev(FFMPEG *ffmpeg, struct iovec *iov, size_t iovcnt)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < iovcnt; ++i) size += iov[i].iov_len;
+
+#ifdef FALLOC_FL_KEEP_SIZE
+    while (ffmpeg->file_preallocate && ffmpeg->file_size + (off_t)size > ffmpeg->file_allocated) {
+        if (fallocate(ffmpeg->pipe, FALLOC_FL_KEEP_SIZE, ffmpeg->file_allocated, FFMPEG_FILE_EXTENT) < 0) {
+            // Not every file system can do it, and it is only an optimization anyway
+            ffmpeg->file_preallocate = false;
+            break;
+        }
+        ffmpeg->file_allocated += FFMPEG_FILE_EXTENT;
+    }
+#endif
+
+    if (!ffmpeg_writev_all(ffmpeg->pipe, iov, iovcnt)) return false;
+    ffmpeg->file_size += size;
+
+#ifdef SYNC_FILE_RANGE_WRITE
+    if (ffmpeg->file_size - ffmpeg->file_flushed >= FFMPEG_FILE_FLUSH) {
+        // Start writing out this chunk, wait for the previous one, which had a whole chunk worth of time,
+        // and drop it from the page cache
+        off_t begin = ffmpeg->file_flushed;
+        sync_file_range(ffmpeg->pipe, begin, ffmpeg->file_size - begin, SYNC_FILE_RANGE_WRITE);
+        if (begin > 0) {
+            off_t prev_begin = begin > FFMPEG_FILE_FLUSH ? begin - FFMPEG_FILE_FLUSH : 0;
+            sync_file_range(ffmpeg->pipe, prev_begin, begin - prev_begin,
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(ffmpeg->pipe, prev_begin, begin - prev_begin, POSIX_FADV_DONTNEED);
+        }
+        ffmpeg->file_flushed = ffmpeg->file_size;
+    }
+#endif
+
+    return true;
+}
+
+// Writes a packed frame into the pipe, or into the .y4m together with its frame header
+static bool ffmpeg_write_frame(FFMPEG *ffmpeg, void *data, size_t size)
+{
+    bool ok = false;
+    if (ffmpeg->y4m) {
+        static const char frame_header[] = "FRAME\n";
+        struct iovec iov[] = {
+            { .iov_base = (void*)frame_header, .iov_len = sizeof(frame_header) - 1 },
+            { .iov_base = data, .iov_len = size },
+        };
+        ok = ffmpeg_file_writev(ffmpeg, iov, 2);
+        if (!ok) TraceLog(LOG_ERROR, "FFMPEG: failed to write frame into the file: %s", strerror(errno));
+    } else {
+        ok = ffmpeg_write_all(ffmpeg->pipe, data, size);
+        if (!ok) TraceLog(LOG_ERROR, "FFMPEG: failed to write frame into ffmpeg pipe: %s", strerror(errno));
+    }
+    return ok;
+}
+
+// The ffmpeg executable gets yuv420p from us, which is 1.5 bytes per pixel through the pipe instead of 4.
+// If prev is the previous packed frame and changed is not NULL, only the changed tiles are converted
+// on top of a copy of prev.
+static size_t ffmpeg_pack_frame(void *dst, const void *prev, void *data, size_t width, size_t height, const Damage *changed)
+{
+    size_t size = yuv420_size(width, height);
+    if (prev != NULL && changed != NULL && changed->width == width && changed->height == height) {
+        if (prev != dst) memcpy(dst, prev, size);
+        yuv420_from_rgba_damage(dst, data, changed);
+    } else {
+        yuv420_from_rgba(dst, data, width, height, true);
+    }
+    return size;
+}
+
+static void ffmpeg_grow_pipe(int pipe)
+{
+#ifdef F_SETPIPE_SZ
+    if (fcntl(pipe, F_SETPIPE_SZ, FFMPEG_PIPE_SIZE) < 0) {
+        TraceLog(LOG_WARNING, "FFMPEG: could not grow the pipe buffer: %s", strerror(errno));
+    }
+#else
+    (void) pipe;
+#endif
+}
+
+static FFMPEG *ffmpeg_alloc(void)
+{
+    FFMPEG *ffmpeg = malloc(sizeof(FFMPEG));
+    assert(ffmpeg != NULL && "Buy MORE RAM lol!!");
+    memset(ffmpeg, 0, sizeof(*ffmpeg));
+    ffmpeg->pid = -1;
+    ffmpeg->pipe = -1;
+    ffmpeg->audio_pipe = -1;
+    atomic_init(&ffmpeg->failed, false);
+    atomic_init(&ffmpeg->cancelled, false);
+    return ffmpeg;
+}
+
+static void ffmpeg_push_samples(FFMPEG *ffmpeg, const void *data, size_t size)
+{
+    pthread_mutex_lock(&ffmpeg->audio_mutex);
+    FFMPEG_Samples *pending = &ffmpeg->audio_pending;
+    if (pending->count + size > pending->capacity) {
+        size_t capacity = pending->capacity == 0 ? 64*1024 : pending->capacity;
+        while (pending->count + size > capacity) capacity *= 2;
+        pending->items = realloc(pending->items, capacity);
+        assert(pending->items != NULL && "Buy MORE RAM lol!!");
+        pending->capacity = capacity;
+    }
+    memcpy(pending->items + pending->count, data, size);
+    pending->count += size;
+    pthread_cond_signal(&ffmpeg->audio_cond);
+    pthread_mutex_unlock(&ffmpeg->audio_mutex);
+}
+
+// Moves the pending samples into ffmpeg->audio_writing. Blocks until there are some or the
+// rendering ended. Returns false when there is nothing left to write.
+static bool ffmpeg_take_samples(FFMPEG *ffmpeg)
+{
+    pthread_mutex_lock(&ffmpeg->audio_mutex);
+    while (ffmpeg->audio_pending.count == 0 && !ffmpeg->audio_end) {
+        pthread_cond_wait(&ffmpeg->audio_cond, &ffmpeg->audio_mutex);
+    }
+    FFMPEG_Samples taken = ffmpeg->audio_pending;
+    ffmpeg->audio_pending = ffmpeg->audio_writing;
+    ffmpeg->audio_pending.count = 0;
+    ffmpeg->audio_writing = taken;
+    pthread_mutex_unlock(&ffmpeg->audio_mutex);
+    return taken.count > 0;
+}
+
+static bool ffmpeg_write_samples(FFMPEG *ffmpeg)
+{
+    FFMPEG_Samples *samples = &ffmpeg->audio_writing;
+    if (!ffmpeg_write_all(ffmpeg->audio_pipe, samples->items, samples->count)) {
+        TraceLog(LOG_ERROR, "FFMPEG: failed to write sound into ffmpeg pipe: %s", strerror(errno));
+        return false;
+    }
+    ffmpeg->audio_written += samples->count;
+    return true;
+}
+
+// Sleeps while *index is still value
+static void ffmpeg_sleep_while(FFMPEG_Sleeper *sleeper, atomic_size_t *index, size_t value)
+{
+    while (atomic_load(index) == value) {
+        // Reading the futex before announcing the sleep makes a wake up in between fail the FUTEX_WAIT
+        unsigned int futex = atomic_load(&sleeper->futex);
+        atomic_store(&sleeper->waiting, true);
+        if (atomic_load(index) != value) break;
+        syscall(SYS_futex, &sleeper->futex, FUTEX_WAIT_PRIVATE, futex, NULL, NULL, 0);
+    }
+    atomic_store(&sleeper->waiting, false);
+}
+
+// Called after moving the index the sleeper waits on
+static void ffmpeg_wake(FFMPEG_Sleeper *sleeper)
+{
+    if (!atomic_load(&sleeper->waiting)) return;
+    atomic_fetch_add(&sleeper->futex, 1);
+    syscall(SYS_futex, &sleeper->futex, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// The producer side of the ring, only blocks when the writer thread is behind by the whole queue
+static FFMPEG_Slot *ffmpeg_slot_reserve(FFMPEG *ffmpeg)
+{
+    size_t head = atomic_load_explicit(&ffmpeg->head, memory_order_relaxed);
+    ffmpeg_sleep_while(&ffmpeg->producer, &ffmpeg->tail, head - ffmpeg->slots_count);
+    return &ffmpeg->slots[head%ffmpeg->slots_count];
+}
+
+static void ffmpeg_slot_publish(FFMPEG *ffmpeg)
+{
+    atomic_fetch_add(&ffmpeg->head, 1);
+    ffmpeg_wake(&ffmpeg->consumer);
+}
 
-    if (pipe(pipefd) < 0) {
+static void ffmpeg_block_sigpipe(void)
+{
+    // If ffmpeg dies we want write() to fail with EPIPE instead of killing the whole process
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+static void *ffmpeg_audio_writer(void *arg)
+{
+    FFMPEG *ffmpeg = arg;
+    ffmpeg_block_sigpipe();
+
+    while (ffmpeg_take_samples(ffmpeg)) {
+        if (atomic_load(&ffmpeg->failed) || atomic_load(&ffmpeg->cancelled)) continue;
+        if (!ffmpeg_write_samples(ffmpeg)) atomic_store(&ffmpeg->failed, true);
+    }
+
+    return NULL;
+}
+
+static void *ffmpeg_writer(void *arg)
+{
+    FFMPEG *ffmpeg = arg;
+    ffmpeg_block_sigpipe();
+
+    for (;;) {
+        size_t tail = atomic_load_explicit(&ffmpeg->tail, memory_order_relaxed);
+        ffmpeg_sleep_while(&ffmpeg->consumer, &ffmpeg->head, tail);
+        FFMPEG_Slot *slot = &ffmpeg->slots[tail%ffmpeg->slots_count];
+        bool healthy = !atomic_load(&ffmpeg->failed) && !atomic_load(&ffmpeg->cancelled);
+
+        if (slot->end) break;
+
+        // Keep consuming after a failure, so the producer never waits on a dead writer
+        if (healthy && !ffmpeg_write_frame(ffmpeg, slot->data, slot->size)) atomic_store(&ffmpeg->failed, true);
+
+        atomic_fetch_add(&ffmpeg->tail, 1);
+        ffmpeg_wake(&ffmpeg->producer);
+    }
+
+    return NULL;
+}
+
+static void ffmpeg_start_writer(FFMPEG *ffmpeg, size_t frame_size)
+{
+    ffmpeg->slots_count = ffmpeg_config.queue_depth;
+    ffmpeg->slot_size = frame_size;
+    if (ffmpeg->slots_count == 0) return;
+
+    ffmpeg->slots = calloc(ffmpeg->slots_count, sizeof(*ffmpeg->slots));
+    assert(ffmpeg->slots != NULL && "Buy MORE RAM lol!!");
+    for (size_t i = 0; i < ffmpeg->slots_count; ++i) {
+        ffmpeg->slots[i].data = malloc(frame_size);
+        assert(ffmpeg->slots[i].data != NULL && "Buy MORE RAM lol!!");
+    }
+    atomic_init(&ffmpeg->head, 0);
+    atomic_init(&ffmpeg->tail, 0);
+    atomic_init(&ffmpeg->producer.futex, 0);
+    atomic_init(&ffmpeg->producer.waiting, false);
+    atomic_init(&ffmpeg->consumer.futex, 0);
+    atomic_init(&ffmpeg->consumer.waiting, false);
+
+    int err = pthread_create(&ffmpeg->writer, NULL, ffmpeg_writer, ffmpeg);
+    if (err != 0) {
+        TraceLog(LOG_WARNING, "FFMPEG: could not start writer thread, writing on the render thread: %s", strerror(err));
+        for (size_t i = 0; i < ffmpeg->slots_count; ++i) free(ffmpeg->slots[i].data);
+        free(ffmpeg->slots);
+        ffmpeg->slots = NULL;
+        ffmpeg->slots_count = 0;
+    }
+}
+
+static void ffmpeg_stop_writer(FFMPEG *ffmpeg, bool cancel)
+{
+    if (ffmpeg->slots_count == 0) return;
+
+    if (cancel) atomic_store(&ffmpeg->cancelled, true);
+
+    ffmpeg_slot_reserve(ffmpeg)->end = true;
+    ffmpeg_slot_publish(ffmpeg);
+
+    pthread_join(ffmpeg->writer, NULL);
+
+    for (size_t i = 0; i < ffmpeg->slots_count; ++i) free(ffmpeg->slots[i].data);
+    free(ffmpeg->slots);
+}
+
+// Nothing but the audio writer drains the samples, so the rendering can not go on without it
+static bool ffmpeg_start_audio(FFMPEG *ffmpeg, size_t channels)
+{
+    ffmpeg->channels = channels;
+    pthread_mutex_init(&ffmpeg->audio_mutex, NULL);
+    pthread_cond_init(&ffmpeg->audio_cond, NULL);
+
+    int err = pthread_create(&ffmpeg->audio_writer, NULL, ffmpeg_audio_writer, ffmpeg);
+    if (err != 0) {
+        TraceLog(LOG_ERROR, "FFMPEG: could not start audio writer thread: %s", strerror(err));
+        pthread_mutex_destroy(&ffmpeg->audio_mutex);
+        pthread_cond_destroy(&ffmpeg->audio_cond);
+        return false;
+    }
+    ffmpeg->has_audio = true;
+    return true;
+}
+
+static void ffmpeg_stop_audio(FFMPEG *ffmpeg, bool cancel)
+{
+    if (!ffmpeg->has_audio) return;
+
+    if (cancel) atomic_store(&ffmpeg->cancelled, true);
+    pthread_mutex_lock(&ffmpeg->audio_mutex);
+    ffmpeg->audio_end = true;
+    pthread_cond_signal(&ffmpeg->audio_cond);
+    pthread_mutex_unlock(&ffmpeg->audio_mutex);
+    pthread_join(ffmpeg->audio_writer, NULL);
+
+    pthread_mutex_destroy(&ffmpeg->audio_mutex);
+    pthread_cond_destroy(&ffmpeg->audio_cond);
+    free(ffmpeg->audio_pending.items);
+    free(ffmpeg->audio_writing.items);
+}
+
+// The pipes are close-on-exec, so the ffmpeg processes of other outputs started later (renditions)
+// do not inherit their write ends and keep them open, and the reader sees EOF when we close ours
+static bool ffmpeg_pipe(int pipefd[2])
+{
+    if (pipe2(pipefd, O_CLOEXEC) < 0) {
         TraceLog(LOG_ERROR, "FFMPEG: Could not create a pipe: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// Reopens fd as target in the child without close-on-exec. dup2() leaves the flag alone when
+// they are the same fd already.
+static bool ffmpeg_child_reopen(int fd, int target)
+{
+    if (fd == target) return fcntl(fd, F_SETFD, 0) == 0;
+    return dup2(fd, target) >= 0;
+}
+
+// With rows the frames come as RGBA in strips from ffmpeg_send_rows(), and go into the pipe as they are
+static FFMPEG *ffmpeg_start_pipe_video(const char *output_path, size_t width, size_t height, size_t fps, size_t sample_rate, size_t channels, bool rows)
+{
+    int pipefd[2];
+    int audio_pipefd[2] = {-1, -1};
+
+    if (!ffmpeg_pipe(pipefd)) return NULL;
+    if (sample_rate > 0 && !ffmpeg_pipe(audio_pipefd)) {
+        close(pipefd[READ_END]);
+        close(pipefd[WRITE_END]);
         return NULL;
     }
 
     pid_t child = fork();
     if (child < 0) {
         TraceLog(LOG_ERROR, "FFMPEG: could not fork a child: %s", strerror(errno));
+        close(pipefd[READ_END]);
+        close(pipefd[WRITE_END]);
+        if (sample_rate > 0) {
+            close(audio_pipefd[READ_END]);
+            close(audio_pipefd[WRITE_END]);
+        }
         return NULL;
     }
 
     if (child == 0) {
-        if (dup2(pipefd[READ_END], STDIN_FILENO) < 0) {
+        // The write ends go first, one of them may occupy FFMPEG_AUDIO_FD
+        close(pipefd[WRITE_END]);
+        if (sample_rate > 0) close(audio_pipefd[WRITE_END]);
+        if (!ffmpeg_child_reopen(pipefd[READ_END], STDIN_FILENO)) {
             TraceLog(LOG_ERROR, "FFMPEG CHILD: could not reopen read end of pipe as stdin: %s", strerror(errno));
             exit(1);
         }
-        close(pipefd[WRITE_END]);
+        if (sample_rate > 0 && !ffmpeg_child_reopen(audio_pipefd[READ_END], FFMPEG_AUDIO_FD)) {
+            TraceLog(LOG_ERROR, "FFMPEG CHILD: could not reopen read end of the audio pipe as fd %d: %s", FFMPEG_AUDIO_FD, strerror(errno));
+            exit(1);
+        }
 
         char resolution[64];
         snprintf(resolution, sizeof(resolution), "%zux%zu", width, height);
         char framerate[64];
         snprintf(framerate, sizeof(framerate), "%zu", fps);
+        char audio_rate[64];
+        snprintf(audio_rate, sizeof(audio_rate), "%zu", sample_rate);
+        char audio_channels[64];
+        snprintf(audio_channels, sizeof(audio_channels), "%zu", channels);
+
+        const char *args[64];
+        size_t args_count = 0;
+        #define ARG(...) do { \
+            const char *xs[] = {__VA_ARGS__}; \
+            for (size_t i = 0; i < sizeof(xs)/sizeof(xs[0]); ++i) args[args_count++] = xs[i]; \
+        } while (0)
+        ARG("ffmpeg");
+        ARG("-loglevel", "verbose");
+        ARG("-y");
+        ARG("-f", "rawvideo", "-pix_fmt", rows ? "rgba" : "yuv420p", "-s", resolution, "-r", framerate, "-i", "-");
+        if (sample_rate > 0) {
+            ARG("-f", "s16le", "-sample_rate", audio_rate, "-channels", audio_channels, "-i", "pipe:3");
+        }
+        switch (ffmpeg_config.codec) {
+        case FFMPEG_CODEC_FFV1:
+            // Every frame is a keyframe, so the master can be cut anywhere, and the slices are encoded in parallel
+            ARG("-c:v", "ffv1", "-level", "3", "-g", "1", "-slices", "16");
+            ARG("-c:a", "flac");
+            break;
+        case FFMPEG_CODEC_H264:
+        default:
+            ARG(FFMPEG_H264_VIDEO_ARGS);
+            ARG(FFMPEG_H264_AUDIO_ARGS);
+        }
+        ARG("-pix_fmt", "yuv420p");
+        ARG(output_path);
+        args[args_count] = NULL;
+        #undef ARG
 
-        int ret = execlp("ffmpeg",
-            "ffmpeg",
-
-            "-loglevel", "verbose",
-            "-y",
-
-            "-f", "rawvideo",
-            "-pix_fmt", "rgba",
-            "-s", resolution,
-            "-r", framerate,
-            "-i", "-",
-
-            "-c:v", "libx264",
-            "-vb", "2500k",
-            "-c:a", "aac",
-            "-ab", "200k",
-            "-pix_fmt", "yuv420p",
-            output_path,
-
-            NULL
-        );
+        int ret = execvp("ffmpeg", (char * const*)args);
         if (ret < 0) {
             TraceLog(LOG_ERROR, "FFMPEG CHILD: could not run ffmpeg as a child process: %s", strerror(errno));
             exit(1);
@@ -81,30 +546,229 @@ FFMPEG *ffmpeg_start_rendering_video(const char *output_path, size_t width, size
         TraceLog(LOG_WARNING, "FFMPEG: could not close read end of the pipe on the parent's end: %s", strerror(errno));
     }
 
-    FFMPEG *ffmpeg = malloc(sizeof(FFMPEG));
-    assert(ffmpeg != NULL && "Buy MORE RAM lol!!");
+    ffmpeg_grow_pipe(pipefd[WRITE_END]);
+    if (sample_rate > 0 && close(audio_pipefd[READ_END]) < 0) {
+        TraceLog(LOG_WARNING, "FFMPEG: could not close read end of the audio pipe on the parent's end: %s", strerror(errno));
+    }
+
+    FFMPEG *ffmpeg = ffmpeg_alloc();
     ffmpeg->pid = child;
     ffmpeg->pipe = pipefd[WRITE_END];
+    if (sample_rate > 0) {
+        ffmpeg->audio_pipe = audio_pipefd[WRITE_END];
+        if (!ffmpeg_start_audio(ffmpeg, channels)) {
+            close(pipefd[WRITE_END]);
+            close(audio_pipefd[WRITE_END]);
+            kill(child, SIGKILL);
+            waitpid(child, NULL, 0);
+            free(ffmpeg);
+            return NULL;
+        }
+    }
+    ffmpeg->rows = rows;
+    // The strips are written right away, a queue of whole frames is what they avoid
+    if (!rows) ffmpeg_start_writer(ffmpeg, yuv420_size(width, height));
     return ffmpeg;
 }
 
-FFMPEG *ffmpeg_start_rendering_audio(const char *output_path)
+bool ffmpeg_is_y4m_path(const char *path)
 {
-    int pipefd[2];
+    const char *ext = strrchr(path, '.');
+    return ext != NULL && strcmp(ext, ".y4m") == 0;
+}
 
-    if (pipe(pipefd) < 0) {
-        TraceLog(LOG_ERROR, "FFMPEG: Could not create a pipe: %s", strerror(errno));
+int ffmpeg_y4m_audio_path(char *buffer, size_t size, const char *y4m_path)
+{
+    size_t base = strlen(y4m_path);
+    if (ffmpeg_is_y4m_path(y4m_path)) base -= strlen(".y4m");
+    return snprintf(buffer, size, "%.*s.wav", (int)base, y4m_path);
+}
+
+static void ffmpeg_put_le(uint8_t *p, uint32_t x, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i) p[i] = x >> (8*i);
+}
+
+// PCM s16 .wav header. The sizes are patched in once the amount of samples is known.
+static bool ffmpeg_write_wav_header(int fd, size_t sample_rate, size_t channels, size_t data_size)
+{
+    uint8_t header[FFMPEG_WAV_HEADER_SIZE];
+    memcpy(header, "RIFF", 4);
+    ffmpeg_put_le(header + 4, FFMPEG_WAV_HEADER_SIZE - 8 + data_size, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    ffmpeg_put_le(header + 16, 16, 4);
+    ffmpeg_put_le(header + 20, 1, 2); // PCM
+    ffmpeg_put_le(header + 22, channels, 2);
+    ffmpeg_put_le(header + 24, sample_rate, 4);
+    ffmpeg_put_le(header + 28, sample_rate*channels*sizeof(int16_t), 4);
+    ffmpeg_put_le(header + 32, channels*sizeof(int16_t), 2);
+    ffmpeg_put_le(header + 34, 16, 2);
+    memcpy(header + 36, "data", 4);
+    ffmpeg_put_le(header + 40, data_size, 4);
+    return pwrite(fd, header, sizeof(header), 0) == sizeof(header);
+}
+
+static bool ffmpeg_finish_wav(int fd, size_t data_size)
+{
+    uint8_t size[4];
+    ffmpeg_put_le(size, FFMPEG_WAV_HEADER_SIZE - 8 + data_size, 4);
+    if (pwrite(fd, size, 4, 4) != 4) return false;
+    ffmpeg_put_le(size, data_size, 4);
+    return pwrite(fd, size, 4, 40) == 4;
+}
+
+static FFMPEG *ffmpeg_start_y4m_video(const char *output_path, size_t width, size_t height, size_t fps, size_t sample_rate, size_t channels)
+{
+    int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        TraceLog(LOG_ERROR, "FFMPEG: could not open %s: %s", output_path, strerror(errno));
+        return NULL;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    FFMPEG *ffmpeg = ffmpeg_alloc();
+    ffmpeg->pipe = fd;
+    ffmpeg->y4m = true;
+    ffmpeg->file_preallocate = true;
+
+    // Same chroma siting and range yuv420_from_rgba() produces
+    char header[256];
+    int header_size = snprintf(header, sizeof(header), "YUV4MPEG2 W%zu H%zu F%zu:1 Ip A1:1 C420jpeg XYSCSS=420JPEG XCOLORRANGE=LIMITED\n", width, height, fps);
+    struct iovec iov = { .iov_base = header, .iov_len = header_size };
+    if (!ffmpeg_file_writev(ffmpeg, &iov, 1)) {
+        TraceLog(LOG_ERROR, "FFMPEG: could not write into %s: %s", output_path, strerror(errno));
+        close(fd);
+        free(ffmpeg);
+        return NULL;
+    }
+
+    if (sample_rate > 0) {
+        char audio_path[PATH_MAX];
+        if (ffmpeg_y4m_audio_path(audio_path, sizeof(audio_path), output_path) >= (int)sizeof(audio_path)) {
+            TraceLog(LOG_ERROR, "FFMPEG: path %s is too long", output_path);
+            close(fd);
+            free(ffmpeg);
+            return NULL;
+        }
+        int audio_fd = open(audio_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (audio_fd < 0 || !ffmpeg_write_wav_header(audio_fd, sample_rate, channels, 0) || lseek(audio_fd, FFMPEG_WAV_HEADER_SIZE, SEEK_SET) < 0) {
+            TraceLog(LOG_ERROR, "FFMPEG: could not write into %s: %s", audio_path, strerror(errno));
+            if (audio_fd >= 0) close(audio_fd);
+            close(fd);
+            free(ffmpeg);
+            return NULL;
+        }
+        ffmpeg->audio_pipe = audio_fd;
+        if (!ffmpeg_start_audio(ffmpeg, channels)) {
+            close(audio_fd);
+            close(fd);
+            free(ffmpeg);
+            return NULL;
+        }
+    }
+
+    ffmpeg_start_writer(ffmpeg, yuv420_size(width, height));
+    return ffmpeg;
+}
+
+static bool ffmpeg_end_y4m(FFMPEG *ffmpeg, bool cancel)
+{
+    ffmpeg_stop_writer(ffmpeg, cancel);
+    ffmpeg_stop_audio(ffmpeg, cancel);
+    bool ok = !cancel && !atomic_load(&ffmpeg->failed);
+
+    // Gives back what is left of the last preallocated extent
+    if (ftruncate(ffmpeg->pipe, ffmpeg->file_size) < 0) {
+        TraceLog(LOG_WARNING, "FFMPEG: could not trim the file: %s", strerror(errno));
+    }
+    if (close(ffmpeg->pipe) < 0) {
+        TraceLog(LOG_ERROR, "FFMPEG: could not close the file: %s", strerror(errno));
+        ok = false;
+    }
+    if (ffmpeg->audio_pipe >= 0) {
+        if (ok && !ffmpeg_finish_wav(ffmpeg->audio_pipe, ffmpeg->audio_written)) {
+            TraceLog(LOG_ERROR, "FFMPEG: could not finish the audio file: %s", strerror(errno));
+            ok = false;
+        }
+        if (close(ffmpeg->audio_pipe) < 0) ok = false;
+    }
+
+    free(ffmpeg->frame);
+    free(ffmpeg);
+    return ok;
+}
+
+FFMPEG *ffmpeg_start_encoding_final(const char *input_path, const char *audio_path, const char *output_path)
+{
+    pid_t child = fork();
+    if (child < 0) {
+        TraceLog(LOG_ERROR, "FFMPEG: could not fork a child: %s", strerror(errno));
         return NULL;
     }
 
+    if (child == 0) {
+        // Stay out of the way of whatever is rendered in the meantime
+        if (nice(10) < 0) TraceLog(LOG_WARNING, "FFMPEG CHILD: could not lower the priority: %s", strerror(errno));
+
+        const char *args[32];
+        size_t args_count = 0;
+        #define ARG(...) do { \
+            const char *xs[] = {__VA_ARGS__}; \
+            for (size_t i = 0; i < sizeof(xs)/sizeof(xs[0]); ++i) args[args_count++] = xs[i]; \
+        } while (0)
+        ARG("ffmpeg");
+        ARG("-loglevel", "error");
+        ARG("-y");
+        ARG("-i", input_path);
+        if (audio_path != NULL) ARG("-i", audio_path);
+        ARG(FFMPEG_H264_VIDEO_ARGS);
+        ARG(FFMPEG_H264_AUDIO_ARGS);
+        ARG("-pix_fmt", "yuv420p");
+        ARG(output_path);
+        args[args_count] = NULL;
+        #undef ARG
+
+        execvp("ffmpeg", (char * const*)args);
+        TraceLog(LOG_ERROR, "FFMPEG CHILD: could not run ffmpeg as a child process: %s", strerror(errno));
+        exit(1);
+    }
+
+    FFMPEG *ffmpeg = ffmpeg_alloc();
+    ffmpeg->pid = child;
+    return ffmpeg;
+}
+
+FFMPEG *ffmpeg_start_rendering_video(const char *output_path, size_t width, size_t height, size_t fps, size_t sample_rate, size_t channels)
+{
+    if (ffmpeg_is_y4m_path(output_path)) return ffmpeg_start_y4m_video(output_path, width, height, fps, sample_rate, channels);
+    return ffmpeg_start_pipe_video(output_path, width, height, fps, sample_rate, channels, false);
+}
+
+FFMPEG *ffmpeg_start_rendering_video_rows(const char *output_path, size_t width, size_t height, size_t fps, size_t sample_rate, size_t channels)
+{
+    if (ffmpeg_is_y4m_path(output_path)) {
+        TraceLog(LOG_ERROR, "FFMPEG: .y4m frames are planar and can not be written in strips");
+        return NULL;
+    }
+    return ffmpeg_start_pipe_video(output_path, width, height, fps, sample_rate, channels, true);
+}
+
+FFMPEG *ffmpeg_start_rendering_audio(const char *output_path)
+{
+    int pipefd[2];
+
+    if (!ffmpeg_pipe(pipefd)) return NULL;
+
     pid_t child = fork();
     if (child < 0) {
         TraceLog(LOG_ERROR, "FFMPEG: could not fork a child: %s", strerror(errno));
+        close(pipefd[READ_END]);
+        close(pipefd[WRITE_END]);
         return NULL;
     }
 
     if (child == 0) {
-        if (dup2(pipefd[READ_END], STDIN_FILENO) < 0) {
+        if (!ffmpeg_child_reopen(pipefd[READ_END], STDIN_FILENO)) {
             TraceLog(LOG_ERROR, "FFMPEG CHILD: could not reopen read end of pipe as stdin: %s", strerror(errno));
             exit(1);
         }
@@ -138,8 +802,7 @@ FFMPEG *ffmpeg_start_rendering_audio(const char *output_path)
         TraceLog(LOG_WARNING, "FFMPEG: could not close read end of the pipe on the parent's end: %s", strerror(errno));
     }
 
-    FFMPEG *ffmpeg = malloc(sizeof(FFMPEG));
-    assert(ffmpeg != NULL && "Buy MORE RAM lol!!");
+    FFMPEG *ffmpeg = ffmpeg_alloc();
     ffmpeg->pid = child;
     ffmpeg->pipe = pipefd[WRITE_END];
     return ffmpeg;
@@ -147,16 +810,27 @@ FFMPEG *ffmpeg_start_rendering_audio(const char *output_path)
 
 bool ffmpeg_end_rendering(FFMPEG *ffmpeg, bool cancel)
 {
+    if (ffmpeg->y4m) return ffmpeg_end_y4m(ffmpeg, cancel);
+
     int pipe = ffmpeg->pipe;
+    int audio_pipe = ffmpeg->audio_pipe;
     pid_t pid = ffmpeg->pid;
 
-    free(ffmpeg);
-
-    if (close(pipe) < 0) {
+    // Killing first unblocks the writers if they are stuck in write()
+    if (cancel) kill(pid, SIGKILL);
+    ffmpeg_stop_writer(ffmpeg, cancel);
+    // ffmpeg may want to see the end of the video before it reads the rest of the audio
+    if (pipe >= 0 && close(pipe) < 0) {
         TraceLog(LOG_WARNING, "FFMPEG: could not close write end of the pipe on the parent's end: %s", strerror(errno));
     }
+    ffmpeg_stop_audio(ffmpeg, cancel);
+    if (audio_pipe >= 0 && close(audio_pipe) < 0) {
+        TraceLog(LOG_WARNING, "FFMPEG: could not close write end of the audio pipe on the parent's end: %s", strerror(errno));
+    }
+    bool failed = atomic_load(&ffmpeg->failed);
 
-    if (cancel) kill(pid, SIGKILL);
+    free(ffmpeg->frame);
+    free(ffmpeg);
 
     for (;;) {
         int wstatus = 0;
@@ -172,7 +846,7 @@ bool ffmpeg_end_rendering(FFMPEG *ffmpeg, bool cancel)
                 return false;
             }
 
-            return true;
+            return !failed;
         }
 
         if (WIFSIGNALED(wstatus)) {
@@ -186,19 +860,79 @@ bool ffmpeg_end_rendering(FFMPEG *ffmpeg, bool cancel)
 
 bool ffmpeg_send_frame_flipped(FFMPEG *ffmpeg, void *data, size_t width, size_t height)
 {
-    for (size_t y = height; y > 0; --y) {
-        // TODO: write() may not necessarily write the entire row. We may want to repeat the call.
-        if (write(ffmpeg->pipe, (uint32_t*)data + (y - 1)*width, sizeof(uint32_t)*width) < 0) {
-            TraceLog(LOG_ERROR, "FFMPEG: failed to write frame into ffmpeg pipe: %s", strerror(errno));
-            return false;
+    return ffmpeg_send_frame_flipped_damage(ffmpeg, data, width, height, NULL);
+}
+
+bool ffmpeg_send_frame_flipped_damage(FFMPEG *ffmpeg, void *data, size_t width, size_t height, const Damage *changed)
+{
+    if (ffmpeg->slots_count == 0) {
+        // The previous frame is still packed in ffmpeg->frame
+        void *prev = ffmpeg->frame;
+        if (ffmpeg->frame == NULL) {
+            ffmpeg->frame = malloc(yuv420_size(width, height));
+            assert(ffmpeg->frame != NULL && "Buy MORE RAM lol!!");
         }
+        size_t size = ffmpeg_pack_frame(ffmpeg->frame, prev, data, width, height, changed);
+        return ffmpeg_write_frame(ffmpeg, ffmpeg->frame, size);
+    }
+
+    assert(yuv420_size(width, height) <= ffmpeg->slot_size);
+    if (atomic_load(&ffmpeg->failed)) return false;
+
+    FFMPEG_Slot *slot = ffmpeg_slot_reserve(ffmpeg);
+    // Like in ffmpeg_send_repeated_frame(), the previous slot is safe to read
+    size_t head = atomic_load_explicit(&ffmpeg->head, memory_order_relaxed);
+    const void *prev = head > 0 ? ffmpeg->slots[(head - 1)%ffmpeg->slots_count].data : NULL;
+    slot->size = ffmpeg_pack_frame(slot->data, prev, data, width, height, changed);
+    slot->end = false;
+    ffmpeg_slot_publish(ffmpeg);
+
+    return !atomic_load(&ffmpeg->failed);
+}
+
+bool ffmpeg_send_rows(FFMPEG *ffmpeg, const void *rows, size_t width, size_t count)
+{
+    assert(ffmpeg->rows && "the rendering was not started with ffmpeg_start_rendering_video_rows()");
+    if (!ffmpeg_write_all(ffmpeg->pipe, (void*)rows, width*count*sizeof(uint32_t))) {
+        TraceLog(LOG_ERROR, "FFMPEG: failed to write rows into ffmpeg pipe: %s", strerror(errno));
+        return false;
     }
     return true;
 }
 
+bool ffmpeg_send_repeated_frame(FFMPEG *ffmpeg)
+{
+    if (ffmpeg->slots_count == 0) {
+        // The previous frame is still packed in ffmpeg->frame
+        assert(ffmpeg->frame != NULL && "No frame to repeat");
+        return ffmpeg_write_frame(ffmpeg, ffmpeg->frame, ffmpeg->slot_size);
+    }
+
+    size_t head = atomic_load_explicit(&ffmpeg->head, memory_order_relaxed);
+    assert(head > 0 && "No frame to repeat");
+    if (atomic_load(&ffmpeg->failed)) return false;
+
+    FFMPEG_Slot *slot = ffmpeg_slot_reserve(ffmpeg);
+    FFMPEG_Slot *prev = &ffmpeg->slots[(head - 1)%ffmpeg->slots_count];
+    // The writer only reads prev and the producer is the only one who modifies the slots,
+    // so prev can be copied while it is being written into the pipe
+    if (slot != prev) memcpy(slot->data, prev->data, prev->size);
+    slot->size = prev->size;
+    slot->end = false;
+    ffmpeg_slot_publish(ffmpeg);
+
+    return !atomic_load(&ffmpeg->failed);
+}
+
 bool ffmpeg_send_sound_samples(FFMPEG *ffmpeg, void *data, size_t size)
 {
-    if (write(ffmpeg->pipe, data, size) < 0) {
+    if (ffmpeg->has_audio) {
+        if (atomic_load(&ffmpeg->failed)) return false;
+        ffmpeg_push_samples(ffmpeg, data, size);
+        return true;
+    }
+
+    if (!ffmpeg_write_all(ffmpeg->pipe, data, size)) {
         TraceLog(LOG_ERROR, "FFMPEG: failed to write sound into ffmpeg pipe: %s", strerror(errno));
         return false;
     }
@@ -10,6 +10,8 @@
 
 #include <raylib.h>
 
+#include "ffmpeg.h"
+
 #include <libavcodec/avcodec.h>
 #include <libavutil/mathematics.h>
 #include <libavformat/avformat.h>
@@ -26,6 +28,10 @@
 #define STREAM_PIX_FMT    AV_PIX_FMT_YUV420P /* default pix_fmt */
 
 #define SCALE_FLAGS SWS_BICUBIC
+
+// The frames are encoded on the calling thread here, so there is nothing to queue
+FFMPEG_Config ffmpeg_config = {0};
+
 typedef struct OutputStream{
     AVStream* st;
     AVCodecContext* enc;
@@ -504,8 +510,14 @@ static void close_stream(OutputStream* ost){
     swr_free(&ost->swr_ctx);
 }
 
-FFMPEG *ffmpeg_start_rendering_video(const char *filename, size_t width, size_t height, size_t fps)
+// The samples are not encoded here, so the videos can only be rendered without an audio track
+FFMPEG *ffmpeg_start_rendering_video(const char *filename, size_t width, size_t height, size_t fps, size_t sample_rate, size_t channels)
 {
+    (void) channels;
+    if (sample_rate > 0) {
+        TraceLog(LOG_ERROR, "FFMPEG: the audio track of the video is not supported on Windows");
+        return NULL;
+    }
     OutputStream video_st = {0}, audio_st = {0};
     const AVOutputFormat* fmt;
     AVFormatContext* oc;
@@ -532,7 +544,8 @@ FFMPEG *ffmpeg_start_rendering_video(const char *filename, size_t width, size_t
     /* Add the audio and video streams using the default format codecs
      * and initialize the codecs. */
     if(fmt->video_codec != AV_CODEC_ID_NONE){
-        add_stream(&video_st, oc, &video_codec, fmt->video_codec, ffmpeg);
+        enum AVCodecID video_codec_id = ffmpeg_config.codec == FFMPEG_CODEC_FFV1 ? AV_CODEC_ID_FFV1 : fmt->video_codec;
+        add_stream(&video_st, oc, &video_codec, video_codec_id, ffmpeg);
         have_video = 1;
         encode_video = 1;
     }
@@ -585,6 +598,53 @@ FFMPEG *ffmpeg_start_rendering_video(const char *filename, size_t width, size_t
     return ffmpeg;
 }
 
+// There is no ffmpeg executable to run here, panim.c rejects --final on Windows
+FFMPEG *ffmpeg_start_encoding_final(const char *input_path, const char *audio_path, const char *output_path)
+{
+    (void) input_path;
+    (void) audio_path;
+    (void) output_path;
+    TraceLog(LOG_ERROR, "FFMPEG: encoding the final video is not supported on Windows");
+    return NULL;
+}
+
+// The frames are encoded whole by libav here, panim.c rejects --tile on Windows
+FFMPEG *ffmpeg_start_rendering_video_rows(const char *output_path, size_t width, size_t height, size_t fps, size_t sample_rate, size_t channels)
+{
+    (void) output_path;
+    (void) width;
+    (void) height;
+    (void) fps;
+    (void) sample_rate;
+    (void) channels;
+    TraceLog(LOG_ERROR, "FFMPEG: rendering the video in strips is not supported on Windows");
+    return NULL;
+}
+
+bool ffmpeg_send_rows(FFMPEG *ffmpeg, const void *rows, size_t width, size_t count)
+{
+    (void) ffmpeg;
+    (void) rows;
+    (void) width;
+    (void) count;
+    TraceLog(LOG_ERROR, "FFMPEG: rendering the video in strips is not supported on Windows");
+    return false;
+}
+
+// .y4m goes through libavformat like everything else here, so there is no separate audio file
+bool ffmpeg_is_y4m_path(const char *path)
+{
+    const char *ext = strrchr(path, '.');
+    return ext != NULL && strcmp(ext, ".y4m") == 0;
+}
+
+int ffmpeg_y4m_audio_path(char *buffer, size_t size, const char *y4m_path)
+{
+    size_t base = strlen(y4m_path);
+    if (ffmpeg_is_y4m_path(y4m_path)) base -= strlen(".y4m");
+    return snprintf(buffer, size, "%.*s.wav", (int)base, y4m_path);
+}
+
 FFMPEG *ffmpeg_start_rendering_audio(const char *output_path)
 {
     (void) output_path;
@@ -621,10 +681,29 @@ bool ffmpeg_send_frame_flipped(FFMPEG *ffmpeg, void *data, size_t width, size_t
     return ffmpeg->encode_video;
 }
 
+bool ffmpeg_send_frame_flipped_damage(FFMPEG *ffmpeg, void *data, size_t width, size_t height, const Damage *changed)
+{
+    (void) changed;
+    return ffmpeg_send_frame_flipped(ffmpeg, data, width, height);
+}
+
+bool ffmpeg_send_repeated_frame(FFMPEG *ffmpeg)
+{
+    // The previous picture is still in the frame, so it is only encoded again
+    OutputStream *ost = &ffmpeg->video_st;
+    if(av_frame_make_writable(ost->frame) < 0)
+        return false;
+    ost->frame->pts = ost->next_pts++;
+    write_frame(ffmpeg->oc, ost->enc, ost->st, ost->frame, ost->tmp_pkt);
+    return true;
+}
+
+// The videos never have an audio track here, see ffmpeg_start_rendering_video()
 bool ffmpeg_send_sound_samples(FFMPEG *ffmpeg, void *data, size_t size)
 {
     (void) ffmpeg;
     (void) data;
     (void) size;
-    return true;
+    TraceLog(LOG_ERROR, "FFMPEG: the audio track of the video is not supported on Windows");
+    return false;
 }
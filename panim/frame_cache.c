@@ -0,0 +1,233 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "frame_cache.h"
+#include "qoi.h"
+#include "workers.h"
+
+// Enough strips to keep all the workers busy, small enough to not hurt the compression ratio
+#define FRAME_CACHE_STRIPS 16
+
+typedef struct Frame_Cache_Entry Frame_Cache_Entry;
+
+struct Frame_Cache_Entry {
+    size_t index;
+    size_t width;
+    size_t height;
+    size_t size;
+    size_t strip_offsets[FRAME_CACHE_STRIPS + 1];
+    uint8_t *data;
+    // Neighbours in the LRU list
+    Frame_Cache_Entry *newer;
+    Frame_Cache_Entry *older;
+};
+
+struct Frame_Cache {
+    size_t budget;
+    size_t size;
+    size_t count;
+    // Entries by frame index, NULL if the frame is not cached
+    Frame_Cache_Entry **entries;
+    size_t entries_capacity;
+    Frame_Cache_Entry *newest;
+    Frame_Cache_Entry *oldest;
+    // Worst case output of every strip, reused between the frames
+    uint8_t *scratch;
+    size_t scratch_size;
+};
+
+typedef struct {
+    const uint8_t *rgba;
+    uint8_t *out;
+    size_t width;
+    size_t height;
+    size_t strip_capacity;
+    size_t strip_sizes[FRAME_CACHE_STRIPS];
+    const Frame_Cache_Entry *entry;
+    bool ok[FRAME_CACHE_STRIPS];
+} Frame_Cache_Job;
+
+static void frame_cache_strip_rows(size_t height, size_t strip, size_t *begin, size_t *end)
+{
+    *begin = strip*height/FRAME_CACHE_STRIPS;
+    *end = (strip + 1)*height/FRAME_CACHE_STRIPS;
+}
+
+static void frame_cache_encode_job(void *ctx, size_t begin, size_t end)
+{
+    Frame_Cache_Job *job = ctx;
+    for (size_t strip = begin; strip < end; ++strip) {
+        size_t row_begin, row_end;
+        frame_cache_strip_rows(job->height, strip, &row_begin, &row_end);
+        job->strip_sizes[strip] = qoi_encode_frame(job->rgba + row_begin*job->width*4, job->width, row_end - row_begin,
+                                             false, job->out + strip*job->strip_capacity);
+    }
+}
+
+static void frame_cache_decode_job(void *ctx, size_t begin, size_t end)
+{
+    Frame_Cache_Job *job = ctx;
+    const Frame_Cache_Entry *entry = job->entry;
+    for (size_t strip = begin; strip < end; ++strip) {
+        size_t row_begin, row_end;
+        frame_cache_strip_rows(job->height, strip, &row_begin, &row_end);
+        job->ok[strip] = qoi_decode_frame(entry->data + entry->strip_offsets[strip],
+                                    entry->strip_offsets[strip + 1] - entry->strip_offsets[strip],
+                                    job->out + row_begin*job->width*4, job->width, row_end - row_begin);
+    }
+}
+
+Frame_Cache *frame_cache_create(size_t budget)
+{
+    Frame_Cache *fc = malloc(sizeof(Frame_Cache));
+    assert(fc != NULL && "Buy MORE RAM lol!!");
+    memset(fc, 0, sizeof(*fc));
+    fc->budget = budget;
+    return fc;
+}
+
+void frame_cache_destroy(Frame_Cache *fc)
+{
+    frame_cache_clear(fc);
+    free(fc->entries);
+    free(fc->scratch);
+    free(fc);
+}
+
+static void frame_cache_unlink(Frame_Cache *fc, Frame_Cache_Entry *entry)
+{
+    if (entry->newer) entry->newer->older = entry->older; else fc->newest = entry->older;
+    if (entry->older) entry->older->newer = entry->newer; else fc->oldest = entry->newer;
+    entry->newer = NULL;
+    entry->older = NULL;
+}
+
+static void frame_cache_link_newest(Frame_Cache *fc, Frame_Cache_Entry *entry)
+{
+    entry->older = fc->newest;
+    entry->newer = NULL;
+    if (fc->newest) fc->newest->newer = entry; else fc->oldest = entry;
+    fc->newest = entry;
+}
+
+static void frame_cache_remove(Frame_Cache *fc, Frame_Cache_Entry *entry)
+{
+    frame_cache_unlink(fc, entry);
+    fc->entries[entry->index] = NULL;
+    fc->size -= entry->size;
+    fc->count -= 1;
+    free(entry->data);
+    free(entry);
+}
+
+void frame_cache_clear(Frame_Cache *fc)
+{
+    while (fc->oldest) frame_cache_remove(fc, fc->oldest);
+}
+
+static Frame_Cache_Entry *frame_cache_find(Frame_Cache *fc, size_t index)
+{
+    if (index >= fc->entries_capacity) return NULL;
+    return fc->entries[index];
+}
+
+bool frame_cache_put(Frame_Cache *fc, size_t index, const void *rgba, size_t width, size_t height)
+{
+    Frame_Cache_Job job = {
+        .rgba = rgba,
+        .width = width,
+        .height = height,
+        .strip_capacity = qoi_frame_max_size(width, (height + FRAME_CACHE_STRIPS - 1)/FRAME_CACHE_STRIPS),
+    };
+    size_t scratch_size = job.strip_capacity*FRAME_CACHE_STRIPS;
+    if (fc->scratch_size < scratch_size) {
+        free(fc->scratch);
+        fc->scratch = malloc(scratch_size);
+        assert(fc->scratch != NULL && "Buy MORE RAM lol!!");
+        fc->scratch_size = scratch_size;
+    }
+    job.out = fc->scratch;
+    workers_parallel_for(FRAME_CACHE_STRIPS, frame_cache_encode_job, &job);
+
+    Frame_Cache_Entry *old = frame_cache_find(fc, index);
+    if (old) frame_cache_remove(fc, old);
+
+    size_t size = 0;
+    for (size_t strip = 0; strip < FRAME_CACHE_STRIPS; ++strip) size += job.strip_sizes[strip];
+    if (size > fc->budget) return false;
+    while (fc->size + size > fc->budget) frame_cache_remove(fc, fc->oldest);
+
+    if (index >= fc->entries_capacity) {
+        size_t capacity = fc->entries_capacity > 0 ? fc->entries_capacity : 256;
+        while (index >= capacity) capacity *= 2;
+        fc->entries = realloc(fc->entries, capacity*sizeof(*fc->entries));
+        assert(fc->entries != NULL && "Buy MORE RAM lol!!");
+        memset(fc->entries + fc->entries_capacity, 0, (capacity - fc->entries_capacity)*sizeof(*fc->entries));
+        fc->entries_capacity = capacity;
+    }
+
+    Frame_Cache_Entry *entry = malloc(sizeof(Frame_Cache_Entry));
+    assert(entry != NULL && "Buy MORE RAM lol!!");
+    memset(entry, 0, sizeof(*entry));
+    entry->index = index;
+    entry->width = width;
+    entry->height = height;
+    entry->size = size;
+    entry->data = malloc(size);
+    assert(entry->data != NULL && "Buy MORE RAM lol!!");
+    for (size_t strip = 0; strip < FRAME_CACHE_STRIPS; ++strip) {
+        size_t offset = entry->strip_offsets[strip];
+        memcpy(entry->data + offset, job.out + strip*job.strip_capacity, job.strip_sizes[strip]);
+        entry->strip_offsets[strip + 1] = offset + job.strip_sizes[strip];
+    }
+
+    fc->entries[index] = entry;
+    fc->size += size;
+    fc->count += 1;
+    frame_cache_link_newest(fc, entry);
+    return true;
+}
+
+bool frame_cache_get(Frame_Cache *fc, size_t index, void *rgba, size_t width, size_t height)
+{
+    Frame_Cache_Entry *entry = frame_cache_find(fc, index);
+    if (entry == NULL || entry->width != width || entry->height != height) return false;
+
+    Frame_Cache_Job job = {
+        .out = rgba,
+        .width = width,
+        .height = height,
+        .entry = entry,
+    };
+    workers_parallel_for(FRAME_CACHE_STRIPS, frame_cache_decode_job, &job);
+    for (size_t strip = 0; strip < FRAME_CACHE_STRIPS; ++strip) {
+        if (!job.ok[strip]) {
+            TraceLog(LOG_ERROR, "FRAME_CACHE: frame %zu is corrupted", index);
+            frame_cache_remove(fc, entry);
+            return false;
+        }
+    }
+
+    frame_cache_unlink(fc, entry);
+    frame_cache_link_newest(fc, entry);
+    return true;
+}
+
+bool frame_cache_has(Frame_Cache *fc, size_t index)
+{
+    return frame_cache_find(fc, index) != NULL;
+}
+
+size_t frame_cache_count(Frame_Cache *fc)
+{
+    return fc->count;
+}
+
+size_t frame_cache_size(Frame_Cache *fc)
+{
+    return fc->size;
+}
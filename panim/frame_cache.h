@@ -0,0 +1,29 @@
+#ifndef FRAME_CACHE_H_
+#define FRAME_CACHE_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Bounded in-RAM cache of QOI compressed RGBA frames keyed by frame index.
+// Every frame is split into horizontal strips that are compressed and decompressed
+// in parallel across the workers. When the compressed frames do not fit into the
+// budget anymore the least recently used ones are evicted.
+
+typedef struct Frame_Cache Frame_Cache;
+
+// budget is the amount of bytes of compressed frames the cache may hold
+Frame_Cache *frame_cache_create(size_t budget);
+void frame_cache_destroy(Frame_Cache *fc);
+void frame_cache_clear(Frame_Cache *fc);
+// Compresses and stores the frame, replacing the one with the same index.
+// Returns false if the frame alone does not fit into the budget.
+bool frame_cache_put(Frame_Cache *fc, size_t index, const void *rgba, size_t width, size_t height);
+// Decompresses the frame into rgba and marks it as recently used.
+// Returns false if the frame is not cached or was cached with a different size.
+bool frame_cache_get(Frame_Cache *fc, size_t index, void *rgba, size_t width, size_t height);
+bool frame_cache_has(Frame_Cache *fc, size_t index);
+size_t frame_cache_count(Frame_Cache *fc);
+// Bytes of compressed frames that are currently cached
+size_t frame_cache_size(Frame_Cache *fc);
+
+#endif // FRAME_CACHE_H_
@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "frame_server.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FRAME_SERVER_PAGE_SIZE 4096
+
+struct Frame_Server {
+    char *socket_path;
+    int listener;
+    size_t fps;
+    // -1 until the first frame says how big they are
+    int memfd;
+    Frame_Server_Header *header;
+    size_t size;
+    size_t width;
+    size_t height;
+};
+
+static void frame_server_wake(_Atomic uint32_t *futex)
+{
+    syscall(SYS_futex, (uint32_t*)futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+Frame_Server *frame_server_create(const char *socket_path, size_t fps)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        TraceLog(LOG_ERROR, "FRAME SERVER: socket path %s is too long", socket_path);
+        return NULL;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        TraceLog(LOG_ERROR, "FRAME SERVER: could not create a socket: %s", strerror(errno));
+        return NULL;
+    }
+    unlink(socket_path);
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 16) < 0) {
+        TraceLog(LOG_ERROR, "FRAME SERVER: could not listen on %s: %s", socket_path, strerror(errno));
+        close(listener);
+        return NULL;
+    }
+
+    Frame_Server *server = malloc(sizeof(Frame_Server));
+    assert(server != NULL && "Buy MORE RAM lol!!");
+    memset(server, 0, sizeof(*server));
+    server->socket_path = strdup(socket_path);
+    assert(server->socket_path != NULL && "Buy MORE RAM lol!!");
+    server->listener = listener;
+    server->fps = fps;
+    server->memfd = -1;
+    TraceLog(LOG_INFO, "FRAME SERVER: serving frames on %s", socket_path);
+    return server;
+}
+
+// Tells the readers that are still mapping the old memfd to come back for the new one
+static void frame_server_unmap(Frame_Server *server)
+{
+    if (server->memfd < 0) return;
+    atomic_store(&server->header->closed, 1);
+    atomic_fetch_add(&server->header->futex, 1);
+    frame_server_wake(&server->header->futex);
+    munmap(server->header, server->size);
+    close(server->memfd);
+    server->memfd = -1;
+    server->header = NULL;
+}
+
+static bool frame_server_map(Frame_Server *server, size_t width, size_t height)
+{
+    size_t slot_size = (width*height*4 + FRAME_SERVER_PAGE_SIZE - 1)/FRAME_SERVER_PAGE_SIZE*FRAME_SERVER_PAGE_SIZE;
+    size_t slots_offset = (sizeof(Frame_Server_Header) + FRAME_SERVER_PAGE_SIZE - 1)/FRAME_SERVER_PAGE_SIZE*FRAME_SERVER_PAGE_SIZE;
+    size_t size = slots_offset + FRAME_SERVER_SLOTS*slot_size;
+
+    int memfd = memfd_create("panim-frames", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0) {
+        TraceLog(LOG_ERROR, "FRAME SERVER: could not create a memfd: %s", strerror(errno));
+        return false;
+    }
+    if (ftruncate(memfd, size) < 0) {
+        TraceLog(LOG_ERROR, "FRAME SERVER: could not allocate %zu bytes of shared memory: %s", size, strerror(errno));
+        close(memfd);
+        return false;
+    }
+    // The readers can trust the size, it can not change under their mappings anymore
+    fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (mapping == MAP_FAILED) {
+        TraceLog(LOG_ERROR, "FRAME SERVER: could not map the shared memory: %s", strerror(errno));
+        close(memfd);
+        return false;
+    }
+
+    // ftruncate() zeroed it, so every slot_sequence is 0 already
+    Frame_Server_Header *header = mapping;
+    header->magic = FRAME_SERVER_MAGIC;
+    header->version = FRAME_SERVER_VERSION;
+    header->width = width;
+    header->height = height;
+    header->fps = server->fps;
+    header->slots_count = FRAME_SERVER_SLOTS;
+    header->slots_offset = slots_offset;
+    header->slot_size = slot_size;
+
+    server->memfd = memfd;
+    server->header = header;
+    server->size = size;
+    server->width = width;
+    server->height = height;
+    return true;
+}
+
+// Hands the memfd to everybody who is waiting on the socket
+static void frame_server_accept(Frame_Server *server)
+{
+    for (;;) {
+        int client = accept4(server->listener, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+
+        char byte = 0;
+        struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+        union {
+            char buffer[CMSG_SPACE(sizeof(int))];
+            struct cmsghdr align;
+        } control = {0};
+        struct msghdr msg = {
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control.buffer,
+            .msg_controllen = sizeof(control.buffer),
+        };
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &server->memfd, sizeof(int));
+        if (sendmsg(client, &msg, MSG_NOSIGNAL) < 0) {
+            TraceLog(LOG_WARNING, "FRAME SERVER: could not send the frames to a reader: %s", strerror(errno));
+        }
+        close(client);
+    }
+}
+
+bool frame_server_publish(Frame_Server *server, const void *pixels, size_t width, size_t height)
+{
+    if (server->memfd >= 0 && (width != server->width || height != server->height)) frame_server_unmap(server);
+    if (server->memfd < 0 && !frame_server_map(server, width, height)) return false;
+    frame_server_accept(server);
+
+    Frame_Server_Header *header = server->header;
+    uint64_t sequence = atomic_load_explicit(&header->sequence, memory_order_relaxed) + 1;
+    size_t slot = sequence%FRAME_SERVER_SLOTS;
+    atomic_store_explicit(&header->slot_sequences[slot], 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy((uint8_t*)header + header->slots_offset + slot*header->slot_size, pixels, width*height*4);
+    atomic_store_explicit(&header->slot_sequences[slot], sequence, memory_order_release);
+    atomic_store_explicit(&header->sequence, sequence, memory_order_release);
+    atomic_store_explicit(&header->futex, (uint32_t)sequence, memory_order_release);
+    frame_server_wake(&header->futex);
+    return true;
+}
+
+void frame_server_destroy(Frame_Server *server)
+{
+    frame_server_unmap(server);
+    close(server->listener);
+    unlink(server->socket_path);
+    free(server->socket_path);
+    free(server);
+}
+
+bool frame_client_connect(Frame_Client *client, const char *socket_path)
+{
+    memset(client, 0, sizeof(*client));
+    client->memfd = -1;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, socket_path);
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) return false;
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return false;
+    }
+
+    // The server only answers once it has a frame to say how big they are
+    char byte = 0;
+    struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control = {0};
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = sizeof(control.buffer),
+    };
+    ssize_t n;
+    do n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC); while (n < 0 && errno == EINTR);
+    close(sock);
+    struct cmsghdr *cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) return false;
+    int memfd;
+    memcpy(&memfd, CMSG_DATA(cmsg), sizeof(int));
+
+    off_t size = lseek(memfd, 0, SEEK_END);
+    void *mapping = size >= (off_t)sizeof(Frame_Server_Header)
+        ? mmap(NULL, size, PROT_READ, MAP_SHARED, memfd, 0)
+        : MAP_FAILED;
+    if (mapping == MAP_FAILED) {
+        close(memfd);
+        return false;
+    }
+    const Frame_Server_Header *header = mapping;
+    if (header->magic != FRAME_SERVER_MAGIC || header->version != FRAME_SERVER_VERSION ||
+        header->slots_offset + (uint64_t)header->slots_count*header->slot_size > (uint64_t)size) {
+        munmap(mapping, size);
+        close(memfd);
+        return false;
+    }
+
+    client->memfd = memfd;
+    client->header = header;
+    client->size = size;
+    return true;
+}
+
+void frame_client_disconnect(Frame_Client *client)
+{
+    if (client->header != NULL) munmap((void*)client->header, client->size);
+    if (client->memfd >= 0) close(client->memfd);
+    memset(client, 0, sizeof(*client));
+    client->memfd = -1;
+}
+
+const void *frame_client_wait(Frame_Client *client, uint64_t *sequence, int timeout_ms)
+{
+    // The futex is in memory mapped read-only, which FUTEX_WAIT is fine with
+    Frame_Server_Header *header = (Frame_Server_Header*)client->header;
+    struct timespec deadline = {0};
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms/1000;
+        deadline.tv_nsec += (timeout_ms%1000)*1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    for (;;) {
+        if (atomic_load_explicit(&header->closed, memory_order_acquire)) return NULL;
+        uint32_t futex = atomic_load_explicit(&header->futex, memory_order_acquire);
+        uint64_t latest = atomic_load_explicit(&header->sequence, memory_order_acquire);
+        if (latest > *sequence) {
+            size_t slot = latest%header->slots_count;
+            if (atomic_load_explicit(&header->slot_sequences[slot], memory_order_acquire) == latest) {
+                *sequence = latest;
+                return (const uint8_t*)header + header->slots_offset + slot*header->slot_size;
+            }
+            // Overwritten already, there is a newer one
+            continue;
+        }
+
+        struct timespec timeout = {0};
+        if (timeout_ms >= 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            timeout.tv_sec = deadline.tv_sec - now.tv_sec;
+            timeout.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if (timeout.tv_nsec < 0) {
+                timeout.tv_sec -= 1;
+                timeout.tv_nsec += 1000000000L;
+            }
+            if (timeout.tv_sec < 0) return NULL;
+        }
+        syscall(SYS_futex, (uint32_t*)&header->futex, FUTEX_WAIT, futex, timeout_ms >= 0 ? &timeout : NULL, NULL, 0);
+    }
+}
+
+bool frame_client_valid(const Frame_Client *client, uint64_t sequence)
+{
+    atomic_thread_fence(memory_order_acquire);
+    const Frame_Server_Header *header = client->header;
+    size_t slot = sequence%header->slots_count;
+    return atomic_load_explicit((_Atomic uint64_t*)&header->slot_sequences[slot], memory_order_relaxed) == sequence;
+}
+
+#else
+
+// TODO: the frame server is not implemented on Windows yet
+Frame_Server *frame_server_create(const char *socket_path, size_t fps)
+{
+    (void) socket_path;
+    (void) fps;
+    TraceLog(LOG_ERROR, "FRAME SERVER: serving frames is not supported on Windows yet");
+    return NULL;
+}
+
+void frame_server_destroy(Frame_Server *server)
+{
+    (void) server;
+}
+
+bool frame_server_publish(Frame_Server *server, const void *pixels, size_t width, size_t height)
+{
+    (void) server;
+    (void) pixels;
+    (void) width;
+    (void) height;
+    return false;
+}
+
+bool frame_client_connect(Frame_Client *client, const char *socket_path)
+{
+    (void) socket_path;
+    memset(client, 0, sizeof(*client));
+    return false;
+}
+
+void frame_client_disconnect(Frame_Client *client)
+{
+    (void) client;
+}
+
+const void *frame_client_wait(Frame_Client *client, uint64_t *sequence, int timeout_ms)
+{
+    (void) client;
+    (void) sequence;
+    (void) timeout_ms;
+    return NULL;
+}
+
+bool frame_client_valid(const Frame_Client *client, uint64_t sequence)
+{
+    (void) client;
+    (void) sequence;
+    return false;
+}
+
+#endif // _WIN32
@@ -0,0 +1,74 @@
+#ifndef FRAME_SERVER_H_
+#define FRAME_SERVER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Publishes the frames panim renders or shows to any number of local processes through shared
+// memory, without files or copies on their side. Linux only.
+//
+// The frames live in a ring of FRAME_SERVER_SLOTS slots in a sealed memfd. Readers connect to the
+// Unix socket the server listens on and receive the memfd over it (SCM_RIGHTS), map it read-only
+// and read the pixels right out of the mapping. The server never waits for the readers: it
+// overwrites the oldest slot, and a reader that is too slow sees that its slot changed under it
+// and drops the frame. New frames are announced with a futex on the header, so any amount of
+// readers can sleep on it.
+//
+// Protocol (the fields are in the byte order of the machine):
+// - The mapping starts with a Frame_Server_Header, the slots follow at slots_offset, slot_size
+//   bytes apart. A slot holds height rows of width RGBA8 pixels, bottom-up like OpenGL hands them out.
+// - sequence is the number of the latest published frame, counting from 1. It lives in
+//   slot sequence%slots_count.
+// - slot_sequences[i] is the frame in slot i, 0 while it is being written. A frame was read
+//   intact if the slot had its number both before and after reading it (a seqlock).
+// - futex has the low 32 bits of sequence and is woken (FUTEX_WAKE, not private) on every frame.
+// - When the size of the frames changes the server sets closed, wakes the readers and
+//   starts over with a new memfd. The readers then connect again.
+
+#define FRAME_SERVER_MAGIC 0x4d4e4150 // "PANM"
+#define FRAME_SERVER_VERSION 1
+#define FRAME_SERVER_SLOTS 4
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;
+    uint32_t slots_count;
+    uint64_t slots_offset;
+    uint64_t slot_size;
+    _Atomic uint64_t sequence;
+    _Atomic uint64_t slot_sequences[FRAME_SERVER_SLOTS];
+    _Atomic uint32_t futex;
+    _Atomic uint32_t closed;
+} Frame_Server_Header;
+
+typedef struct Frame_Server Frame_Server;
+
+// Listens on socket_path, replacing whatever is there. fps is only passed on to the readers.
+Frame_Server *frame_server_create(const char *socket_path, size_t fps);
+void frame_server_destroy(Frame_Server *server);
+// Copies the bottom-up RGBA pixels into the next slot and wakes the readers. Also hands the memfd
+// to the readers that connected since the previous frame.
+bool frame_server_publish(Frame_Server *server, const void *pixels, size_t width, size_t height);
+
+// The reading side, for the tools that consume the frames
+typedef struct {
+    int memfd;
+    const Frame_Server_Header *header;
+    size_t size;
+} Frame_Client;
+
+bool frame_client_connect(Frame_Client *client, const char *socket_path);
+void frame_client_disconnect(Frame_Client *client);
+// Waits up to timeout_ms (-1 forever) for a frame newer than *sequence and returns its pixels,
+// updating *sequence. Returns NULL on timeout, or when the server closed the memfd and the
+// client has to connect again. Skips the frames that were overwritten in the meantime.
+const void *frame_client_wait(Frame_Client *client, uint64_t *sequence, int timeout_ms);
+// Whether the frame is still intact, checked after being done with its pixels
+bool frame_client_valid(const Frame_Client *client, uint64_t sequence);
+
+#endif // FRAME_SERVER_H_
@@ -0,0 +1,622 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "nob.h"
+#include "gif.h"
+#include "workers.h"
+
+// Index 255 is left out of the palettes for the transparent pixels
+#define GIF_PALETTE_COLORS 255
+#define GIF_TRANSPARENT 255
+#define GIF_MIN_DELAY 2
+// The histogram and the lookup table of the palette work on 5 bits per channel
+#define GIF_HISTOGRAM_BITS 5
+#define GIF_HISTOGRAM_SIZE (1 << (3*GIF_HISTOGRAM_BITS))
+// Only every GIF_HISTOGRAM_STEP-th pixel of every GIF_HISTOGRAM_STEP-th row goes into the histogram
+#define GIF_HISTOGRAM_STEP 2
+// Mean squared error per pixel, summed over the channels, above which a frame gets a new palette
+#define GIF_PALETTE_MAX_ERROR 192
+// Amplitude of the ordered dithering
+#define GIF_DITHER_SPREAD 24
+#define GIF_LZW_MIN_CODE_SIZE 8
+#define GIF_LZW_MAX_CODE 4095
+#define GIF_LZW_TABLE_BITS 13
+#define GIF_LZW_TABLE_SIZE (1 << GIF_LZW_TABLE_BITS)
+
+typedef struct {
+    uint16_t bin;
+    uint32_t weight;
+} Gif_Color;
+
+typedef struct {
+    size_t begin;
+    size_t end;
+    uint64_t weight;
+    size_t channel; // Channel with the largest range
+    size_t range;
+} Gif_Box;
+
+// Frame that is written once the next one arrives, because its delay goes in front of it
+typedef struct {
+    Nob_String_Builder data;
+    size_t frame;
+    bool valid;
+} Gif_Pending;
+
+struct Gif {
+    FILE *file;
+    char *output_path;
+    size_t width;
+    size_t height;
+    size_t fps;
+    // Only every stride-th frame is considered, to keep the delays at least GIF_MIN_DELAY
+    size_t stride;
+    size_t frames;
+    size_t written_frames;
+    bool failed;
+
+    // Bottom-up RGBA of what the GIF currently shows
+    uint8_t *shown;
+    // The last frame in between the strides, in case it is followed by repeats
+    uint8_t *latest;
+    bool latest_pending;
+
+    // Changed columns [begin, end) of every top-down row, empty if the row did not change
+    size_t *changed_begin;
+    size_t *changed_end;
+    uint8_t *indices;
+
+    uint32_t *histogram;
+    uint32_t *frame_histogram;
+    uint8_t palette[256][3];
+    uint8_t *palette_lut;
+    size_t palettes_count;
+
+    Gif_Color *colors;
+    uint32_t *lzw_keys;
+    uint16_t *lzw_codes;
+    Gif_Pending pending;
+};
+
+typedef struct {
+    Gif *gif;
+    const uint8_t *pixels;
+    bool first;
+    size_t left;
+    size_t right;
+    size_t top;
+} Gif_Job;
+
+static const uint8_t gif_bayer[8][8] = {
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 },
+};
+
+bool gif_is_path(const char *output_path)
+{
+    const char *ext = strrchr(output_path, '.');
+    return ext != NULL && strcmp(ext, ".gif") == 0;
+}
+
+static inline size_t gif_bin(uint8_t r, uint8_t g, uint8_t b)
+{
+    const size_t shift = 8 - GIF_HISTOGRAM_BITS;
+    return ((size_t)(r >> shift) << (2*GIF_HISTOGRAM_BITS)) | ((size_t)(g >> shift) << GIF_HISTOGRAM_BITS) | (b >> shift);
+}
+
+// The center of the bin in 8 bits
+static inline uint8_t gif_bin_channel(size_t bin, size_t channel)
+{
+    const size_t shift = 8 - GIF_HISTOGRAM_BITS;
+    size_t value = (bin >> ((2 - channel)*GIF_HISTOGRAM_BITS)) & ((1 << GIF_HISTOGRAM_BITS) - 1);
+    return (value << shift) | (1 << (shift - 1));
+}
+
+static inline uint8_t gif_clamp(int x)
+{
+    return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+static inline const uint8_t *gif_row(const Gif *gif, const uint8_t *pixels, size_t y)
+{
+    return pixels + (gif->height - 1 - y)*gif->width*4;
+}
+
+static bool gif_write(Gif *gif, const void *data, size_t size)
+{
+    if (gif->failed) return false;
+    if (fwrite(data, size, 1, gif->file) != 1) {
+        TraceLog(LOG_ERROR, "GIF: could not write %s: %s", gif->output_path, strerror(errno));
+        gif->failed = true;
+        return false;
+    }
+    return true;
+}
+
+static void gif_append_u16(Nob_String_Builder *sb, size_t x)
+{
+    nob_da_append(sb, x & 0xFF);
+    nob_da_append(sb, (x >> 8) & 0xFF);
+}
+
+static void gif_append_palette(Nob_String_Builder *sb, const uint8_t palette[256][3])
+{
+    nob_sb_append_buf(sb, palette, 256*3);
+}
+
+/// Palette
+
+static int gif_compare_colors_r(const void *a, const void *b)
+{
+    return (int)gif_bin_channel(((const Gif_Color*)a)->bin, 0) - (int)gif_bin_channel(((const Gif_Color*)b)->bin, 0);
+}
+
+static int gif_compare_colors_g(const void *a, const void *b)
+{
+    return (int)gif_bin_channel(((const Gif_Color*)a)->bin, 1) - (int)gif_bin_channel(((const Gif_Color*)b)->bin, 1);
+}
+
+static int gif_compare_colors_b(const void *a, const void *b)
+{
+    return (int)gif_bin_channel(((const Gif_Color*)a)->bin, 2) - (int)gif_bin_channel(((const Gif_Color*)b)->bin, 2);
+}
+
+static void gif_box_measure(const Gif_Color *colors, Gif_Box *box)
+{
+    uint8_t lo[3] = { 255, 255, 255 };
+    uint8_t hi[3] = { 0, 0, 0 };
+    box->weight = 0;
+    for (size_t i = box->begin; i < box->end; ++i) {
+        box->weight += colors[i].weight;
+        for (size_t c = 0; c < 3; ++c) {
+            uint8_t x = gif_bin_channel(colors[i].bin, c);
+            if (x < lo[c]) lo[c] = x;
+            if (x > hi[c]) hi[c] = x;
+        }
+    }
+    box->channel = 0;
+    box->range = 0;
+    for (size_t c = 0; c < 3; ++c) {
+        if ((size_t)(hi[c] - lo[c]) > box->range) {
+            box->range = hi[c] - lo[c];
+            box->channel = c;
+        }
+    }
+}
+
+// Median cut of the histogram into at most GIF_PALETTE_COLORS colors
+static void gif_build_palette(Gif *gif)
+{
+    size_t colors_count = 0;
+    for (size_t bin = 0; bin < GIF_HISTOGRAM_SIZE; ++bin) {
+        if (gif->histogram[bin] == 0) continue;
+        gif->colors[colors_count++] = CLITERAL(Gif_Color) { .bin = bin, .weight = gif->histogram[bin] };
+    }
+
+    Gif_Box boxes[GIF_PALETTE_COLORS];
+    size_t boxes_count = 0;
+    if (colors_count > 0) {
+        boxes[boxes_count] = CLITERAL(Gif_Box) { .begin = 0, .end = colors_count };
+        gif_box_measure(gif->colors, &boxes[boxes_count++]);
+    }
+
+    static int (*const compare[3])(const void*, const void*) = { gif_compare_colors_r, gif_compare_colors_g, gif_compare_colors_b };
+    while (boxes_count < GIF_PALETTE_COLORS) {
+        // Splitting the boxes that are both big and common first
+        Gif_Box *box = NULL;
+        for (size_t i = 0; i < boxes_count; ++i) {
+            if (boxes[i].range == 0 || boxes[i].end - boxes[i].begin < 2) continue;
+            if (box == NULL || boxes[i].weight*boxes[i].range > box->weight*box->range) box = &boxes[i];
+        }
+        if (box == NULL) break;
+
+        qsort(gif->colors + box->begin, box->end - box->begin, sizeof(Gif_Color), compare[box->channel]);
+        uint64_t half = 0;
+        size_t split = box->begin + 1;
+        for (; split < box->end - 1; ++split) {
+            half += gif->colors[split - 1].weight;
+            if (half*2 >= box->weight) break;
+        }
+
+        Gif_Box *upper = &boxes[boxes_count++];
+        *upper = CLITERAL(Gif_Box) { .begin = split, .end = box->end };
+        box->end = split;
+        gif_box_measure(gif->colors, box);
+        gif_box_measure(gif->colors, upper);
+    }
+
+    memset(gif->palette, 0, sizeof(gif->palette));
+    for (size_t i = 0; i < boxes_count; ++i) {
+        uint64_t sum[3] = {0};
+        for (size_t j = boxes[i].begin; j < boxes[i].end; ++j) {
+            for (size_t c = 0; c < 3; ++c) sum[c] += (uint64_t)gif_bin_channel(gif->colors[j].bin, c)*gif->colors[j].weight;
+        }
+        for (size_t c = 0; c < 3; ++c) gif->palette[i][c] = (sum[c] + boxes[i].weight/2)/boxes[i].weight;
+    }
+    // The unused entries stay black
+    gif->palettes_count += 1;
+}
+
+static void gif_palette_lut_job(void *ctx, size_t begin, size_t end)
+{
+    Gif *gif = ctx;
+    for (size_t bin = begin; bin < end; ++bin) {
+        int r = gif_bin_channel(bin, 0);
+        int g = gif_bin_channel(bin, 1);
+        int b = gif_bin_channel(bin, 2);
+        size_t best = 0;
+        int best_distance = INT32_MAX;
+        for (size_t i = 0; i < GIF_PALETTE_COLORS; ++i) {
+            int dr = r - gif->palette[i][0];
+            int dg = g - gif->palette[i][1];
+            int db = b - gif->palette[i][2];
+            int distance = dr*dr + dg*dg + db*db;
+            if (distance < best_distance) {
+                best_distance = distance;
+                best = i;
+            }
+        }
+        gif->palette_lut[bin] = best;
+    }
+}
+
+// Adds the sampled colors of the rectangle to the histogram and tells whether the current
+// palette is still good enough for them
+static bool gif_update_histogram(Gif *gif, const uint8_t *pixels, size_t left, size_t right, size_t top, size_t bottom)
+{
+    memset(gif->frame_histogram, 0, GIF_HISTOGRAM_SIZE*sizeof(*gif->frame_histogram));
+    uint64_t samples = 0;
+    for (size_t y = top; y < bottom; y += GIF_HISTOGRAM_STEP) {
+        const uint8_t *row = gif_row(gif, pixels, y);
+        for (size_t x = left; x < right; x += GIF_HISTOGRAM_STEP) {
+            gif->frame_histogram[gif_bin(row[x*4 + 0], row[x*4 + 1], row[x*4 + 2])] += 1;
+            samples += 1;
+        }
+    }
+
+    uint64_t error = 0;
+    for (size_t bin = 0; bin < GIF_HISTOGRAM_SIZE; ++bin) {
+        uint32_t count = gif->frame_histogram[bin];
+        // The older frames fade out of the histogram, so colors that are gone stop taking up the palette
+        gif->histogram[bin] = gif->histogram[bin] - gif->histogram[bin]/4 + count;
+        if (count == 0 || gif->palettes_count == 0) continue;
+        const uint8_t *color = gif->palette[gif->palette_lut[bin]];
+        for (size_t c = 0; c < 3; ++c) {
+            int d = (int)gif_bin_channel(bin, c) - color[c];
+            error += (uint64_t)count*d*d;
+        }
+    }
+    return gif->palettes_count > 0 && error <= samples*GIF_PALETTE_MAX_ERROR;
+}
+
+/// Frames
+
+static void gif_diff_job(void *ctx, size_t begin, size_t end)
+{
+    Gif_Job *job = ctx;
+    Gif *gif = job->gif;
+    size_t stride = gif->width*4;
+    for (size_t y = begin; y < end; ++y) {
+        const uint8_t *row = gif_row(gif, job->pixels, y);
+        const uint8_t *shown = gif_row(gif, gif->shown, y);
+        if (job->first) {
+            gif->changed_begin[y] = 0;
+            gif->changed_end[y] = gif->width;
+            continue;
+        }
+        if (memcmp(row, shown, stride) == 0) {
+            gif->changed_begin[y] = gif->changed_end[y] = 0;
+            continue;
+        }
+        size_t left = 0;
+        while (memcmp(row + left*4, shown + left*4, 4) == 0) left += 1;
+        size_t right = gif->width;
+        while (memcmp(row + (right - 1)*4, shown + (right - 1)*4, 4) == 0) right -= 1;
+        gif->changed_begin[y] = left;
+        gif->changed_end[y] = right;
+    }
+}
+
+static void gif_quantize_job(void *ctx, size_t begin, size_t end)
+{
+    Gif_Job *job = ctx;
+    Gif *gif = job->gif;
+    size_t width = job->right - job->left;
+    for (size_t y = job->top + begin; y < job->top + end; ++y) {
+        const uint8_t *row = gif_row(gif, job->pixels, y);
+        uint8_t *shown = (uint8_t*)gif_row(gif, gif->shown, y);
+        uint8_t *indices = gif->indices + (y - job->top)*width;
+        for (size_t x = job->left; x < job->right; ++x) {
+            const uint8_t *p = row + x*4;
+            if (!job->first && memcmp(p, shown + x*4, 4) == 0) {
+                indices[x - job->left] = GIF_TRANSPARENT;
+                continue;
+            }
+            int offset = ((int)gif_bayer[y%8][x%8]*2 + 1 - 64)*GIF_DITHER_SPREAD/128;
+            size_t bin = gif_bin(gif_clamp(p[0] + offset), gif_clamp(p[1] + offset), gif_clamp(p[2] + offset));
+            indices[x - job->left] = gif->palette_lut[bin];
+        }
+        memcpy(shown + job->left*4, row + job->left*4, width*4);
+    }
+}
+
+typedef struct {
+    Nob_String_Builder *out;
+    uint8_t block[255];
+    size_t block_size;
+    uint32_t bits;
+    size_t bits_count;
+} Gif_Bits;
+
+static void gif_flush_block(Gif_Bits *bits)
+{
+    if (bits->block_size == 0) return;
+    nob_da_append(bits->out, bits->block_size);
+    nob_sb_append_buf(bits->out, bits->block, bits->block_size);
+    bits->block_size = 0;
+}
+
+static void gif_put_code(Gif_Bits *bits, uint32_t code, size_t size)
+{
+    bits->bits |= code << bits->bits_count;
+    bits->bits_count += size;
+    while (bits->bits_count >= 8) {
+        bits->block[bits->block_size++] = bits->bits & 0xFF;
+        if (bits->block_size == sizeof(bits->block)) gif_flush_block(bits);
+        bits->bits >>= 8;
+        bits->bits_count -= 8;
+    }
+}
+
+// LZW with variable code sizes and a clear code once the dictionary is full, split into sub-blocks
+static void gif_lzw_encode(Gif *gif, Nob_String_Builder *out, const uint8_t *indices, size_t count)
+{
+    const uint32_t clear = 1 << GIF_LZW_MIN_CODE_SIZE;
+    const uint32_t end_of_information = clear + 1;
+
+    nob_da_append(out, GIF_LZW_MIN_CODE_SIZE);
+    Gif_Bits bits = { .out = out };
+    size_t size = GIF_LZW_MIN_CODE_SIZE + 1;
+    uint32_t last_code = end_of_information;
+    memset(gif->lzw_keys, 0, GIF_LZW_TABLE_SIZE*sizeof(*gif->lzw_keys));
+    gif_put_code(&bits, clear, size);
+
+    uint32_t current = indices[0];
+    for (size_t i = 1; i < count; ++i) {
+        // Keys are the code of the prefix and the next index, plus one so that zero is empty
+        uint32_t key = ((current << 8) | indices[i]) + 1;
+        size_t h = (key*2654435761u) >> (32 - GIF_LZW_TABLE_BITS);
+        while (gif->lzw_keys[h] != 0 && gif->lzw_keys[h] != key) h = (h + 1)%GIF_LZW_TABLE_SIZE;
+        if (gif->lzw_keys[h] == key) {
+            current = gif->lzw_codes[h];
+            continue;
+        }
+
+        gif_put_code(&bits, current, size);
+        last_code += 1;
+        gif->lzw_keys[h] = key;
+        gif->lzw_codes[h] = last_code;
+        if (last_code >= (1u << size)) size += 1;
+        if (last_code == GIF_LZW_MAX_CODE) {
+            gif_put_code(&bits, clear, size);
+            size = GIF_LZW_MIN_CODE_SIZE + 1;
+            last_code = end_of_information;
+            memset(gif->lzw_keys, 0, GIF_LZW_TABLE_SIZE*sizeof(*gif->lzw_keys));
+        }
+        current = indices[i];
+    }
+    gif_put_code(&bits, current, size);
+    gif_put_code(&bits, end_of_information, size);
+    if (bits.bits_count > 0) gif_put_code(&bits, 0, 8 - bits.bits_count);
+    gif_flush_block(&bits);
+    nob_da_append(out, 0);
+}
+
+static size_t gif_centiseconds(const Gif *gif, size_t frame)
+{
+    return (frame*100 + gif->fps/2)/gif->fps;
+}
+
+// Writes the pending frame, which is shown until the frame `until`
+static bool gif_flush_pending(Gif *gif, size_t until)
+{
+    if (!gif->pending.valid) return true;
+    gif->pending.valid = false;
+
+    size_t delay = gif_centiseconds(gif, until) - gif_centiseconds(gif, gif->pending.frame);
+    uint8_t control[] = {
+        0x21, 0xF9, 0x04,
+        // Leave the frame in place for the next one to draw over, with a transparent index
+        (1 << 2) | 1,
+        delay & 0xFF, (delay >> 8) & 0xFF,
+        GIF_TRANSPARENT,
+        0x00,
+    };
+    if (!gif_write(gif, control, sizeof(control))) return false;
+    if (!gif_write(gif, gif->pending.data.items, gif->pending.data.count)) return false;
+    gif->written_frames += 1;
+    return true;
+}
+
+static bool gif_add_frame(Gif *gif, const uint8_t *pixels)
+{
+    gif->latest_pending = false;
+
+    Gif_Job job = {
+        .gif = gif,
+        .pixels = pixels,
+        .first = gif->frames == 0,
+    };
+    workers_parallel_for(gif->height, gif_diff_job, &job);
+
+    size_t top = gif->height, bottom = 0;
+    size_t left = gif->width, right = 0;
+    for (size_t y = 0; y < gif->height; ++y) {
+        if (gif->changed_begin[y] >= gif->changed_end[y]) continue;
+        if (top == gif->height) top = y;
+        bottom = y + 1;
+        if (gif->changed_begin[y] < left) left = gif->changed_begin[y];
+        if (gif->changed_end[y] > right) right = gif->changed_end[y];
+    }
+    // Nothing changed, the pending frame is just shown for longer
+    if (top >= bottom) return true;
+
+    if (!gif_update_histogram(gif, pixels, left, right, top, bottom)) {
+        gif_build_palette(gif);
+        workers_parallel_for(GIF_HISTOGRAM_SIZE, gif_palette_lut_job, gif);
+    }
+
+    job.left = left;
+    job.right = right;
+    job.top = top;
+    workers_parallel_for(bottom - top, gif_quantize_job, &job);
+
+    if (!gif_flush_pending(gif, gif->frames)) return false;
+
+    if (job.first) {
+        Nob_String_Builder header = {0};
+        nob_sb_append_cstr(&header, "GIF89a");
+        gif_append_u16(&header, gif->width);
+        gif_append_u16(&header, gif->height);
+        // Global palette of 256 colors with 8 bits per channel
+        nob_da_append(&header, 0xF7);
+        nob_da_append(&header, 0x00);
+        nob_da_append(&header, 0x00);
+        gif_append_palette(&header, gif->palette);
+        // Loop forever
+        nob_sb_append_buf(&header, "\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 19);
+        bool ok = gif_write(gif, header.items, header.count);
+        nob_sb_free(header);
+        if (!ok) return false;
+    }
+
+    Nob_String_Builder *data = &gif->pending.data;
+    data->count = 0;
+    nob_da_append(data, 0x2C);
+    gif_append_u16(data, left);
+    gif_append_u16(data, top);
+    gif_append_u16(data, right - left);
+    gif_append_u16(data, bottom - top);
+    // The first palette is the global one. Once there is a newer one every frame carries it along.
+    if (gif->palettes_count > 1) {
+        nob_da_append(data, 0x87);
+        gif_append_palette(data, gif->palette);
+    } else {
+        nob_da_append(data, 0x00);
+    }
+    gif_lzw_encode(gif, data, gif->indices, (right - left)*(bottom - top));
+    gif->pending.frame = gif->frames;
+    gif->pending.valid = true;
+    return true;
+}
+
+Gif *gif_start(const char *output_path, size_t width, size_t height, size_t fps)
+{
+    if (width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF) {
+        TraceLog(LOG_ERROR, "GIF: %zux%zu is not a valid size for a GIF", width, height);
+        return NULL;
+    }
+    FILE *file = fopen(output_path, "wb");
+    if (file == NULL) {
+        TraceLog(LOG_ERROR, "GIF: could not open %s: %s", output_path, strerror(errno));
+        return NULL;
+    }
+
+    Gif *gif = malloc(sizeof(Gif));
+    assert(gif != NULL && "Buy MORE RAM lol!!");
+    memset(gif, 0, sizeof(*gif));
+    gif->file = file;
+    gif->output_path = strdup(output_path);
+    gif->width = width;
+    gif->height = height;
+    gif->fps = fps;
+    gif->stride = (GIF_MIN_DELAY*fps + 99)/100;
+    if (gif->stride == 0) gif->stride = 1;
+
+    gif->shown = malloc(width*height*4);
+    gif->latest = malloc(width*height*4);
+    gif->changed_begin = malloc(height*sizeof(*gif->changed_begin));
+    gif->changed_end = malloc(height*sizeof(*gif->changed_end));
+    gif->indices = malloc(width*height);
+    gif->histogram = calloc(GIF_HISTOGRAM_SIZE, sizeof(*gif->histogram));
+    gif->frame_histogram = malloc(GIF_HISTOGRAM_SIZE*sizeof(*gif->frame_histogram));
+    gif->palette_lut = malloc(GIF_HISTOGRAM_SIZE);
+    gif->colors = malloc(GIF_HISTOGRAM_SIZE*sizeof(*gif->colors));
+    gif->lzw_keys = malloc(GIF_LZW_TABLE_SIZE*sizeof(*gif->lzw_keys));
+    gif->lzw_codes = malloc(GIF_LZW_TABLE_SIZE*sizeof(*gif->lzw_codes));
+    assert(gif->output_path != NULL && gif->shown != NULL && gif->latest != NULL && "Buy MORE RAM lol!!");
+    assert(gif->changed_begin != NULL && gif->changed_end != NULL && gif->indices != NULL && "Buy MORE RAM lol!!");
+    assert(gif->histogram != NULL && gif->frame_histogram != NULL && gif->palette_lut != NULL && "Buy MORE RAM lol!!");
+    assert(gif->colors != NULL && gif->lzw_keys != NULL && gif->lzw_codes != NULL && "Buy MORE RAM lol!!");
+    return gif;
+}
+
+bool gif_send_frame_flipped(Gif *gif, const void *pixels)
+{
+    if (gif->failed) return false;
+    bool ok = true;
+    if (gif->frames%gif->stride == 0) {
+        ok = gif_add_frame(gif, pixels);
+    } else {
+        memcpy(gif->latest, pixels, gif->width*gif->height*4);
+        gif->latest_pending = true;
+    }
+    gif->frames += 1;
+    return ok;
+}
+
+bool gif_send_repeated_frame(Gif *gif)
+{
+    if (gif->failed) return false;
+    bool ok = true;
+    // The frame that is repeated was skipped, so it has to be shown now
+    if (gif->frames%gif->stride == 0 && gif->latest_pending) ok = gif_add_frame(gif, gif->latest);
+    gif->frames += 1;
+    return ok;
+}
+
+bool gif_end(Gif *gif, bool cancel)
+{
+    bool ok = !cancel && !gif->failed;
+    if (ok && gif->written_frames == 0 && !gif->pending.valid) {
+        TraceLog(LOG_ERROR, "GIF: no frames were sent into %s", gif->output_path);
+        ok = false;
+    }
+    if (ok) ok = gif_flush_pending(gif, gif->frames);
+    if (ok) ok = gif_write(gif, "\x3B", 1);
+    if (fclose(gif->file) != 0) ok = false;
+    if (ok) {
+        TraceLog(LOG_INFO, "GIF: %zu frames of %zu written into %s with %zu palettes",
+                 gif->written_frames, gif->frames, gif->output_path, gif->palettes_count);
+    } else {
+        remove(gif->output_path);
+    }
+
+    free(gif->shown);
+    free(gif->latest);
+    free(gif->changed_begin);
+    free(gif->changed_end);
+    free(gif->indices);
+    free(gif->histogram);
+    free(gif->frame_histogram);
+    free(gif->palette_lut);
+    free(gif->colors);
+    free(gif->lzw_keys);
+    free(gif->lzw_codes);
+    nob_sb_free(gif->pending.data);
+    free(gif->output_path);
+    free(gif);
+    return ok;
+}
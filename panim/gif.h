@@ -0,0 +1,29 @@
+#ifndef GIF_H_
+#define GIF_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Exports the rendered frames as an animated GIF, for short loops that go into docs and chats.
+//
+// The palette is built incrementally: the colors of every frame are added to a decaying
+// histogram, and a new palette is only computed from it (by median cut) when the current one
+// stops fitting the frame, so most frames share the global palette. The frames are quantized
+// with ordered dithering, which keeps static areas stable between frames, on the workers.
+// Every frame after the first one only covers the rectangle that changed, with the pixels that
+// did not change inside of it transparent.
+//
+// GIF delays are in hundredths of a second and most viewers slow down anything shorter than
+// two of them, so with fps above 50 only every n-th frame is kept.
+
+typedef struct Gif Gif;
+
+bool gif_is_path(const char *output_path);
+Gif *gif_start(const char *output_path, size_t width, size_t height, size_t fps);
+// pixels are bottom-up RGBA frames of width*height*4 bytes. The alpha is ignored.
+bool gif_send_frame_flipped(Gif *gif, const void *pixels);
+// Shows the previous frame for one more frame
+bool gif_send_repeated_frame(Gif *gif);
+bool gif_end(Gif *gif, bool cancel);
+
+#endif // GIF_H_
@@ -0,0 +1,53 @@
+#include <raylib.h>
+
+#include "gl.h"
+
+#ifndef _WIN32
+// Provided by the GLFW that is built into raylib
+typedef void (*GLFWglproc)(void);
+GLFWglproc glfwGetProcAddress(const char *procname);
+#define gl_get_proc_address(name) ((void*)glfwGetProcAddress(name))
+#else
+// windows.h can't be included next to raylib.h, so declare what we need by hand
+__declspec(dllimport) void *__stdcall wglGetProcAddress(const char *name);
+__declspec(dllimport) void *__stdcall GetModuleHandleA(const char *name);
+__declspec(dllimport) void *__stdcall GetProcAddress(void *module, const char *name);
+static void *gl_get_proc_address(const char *name)
+{
+    void *proc = (void*)wglGetProcAddress(name);
+    if (proc == NULL) proc = (void*)GetProcAddress(GetModuleHandleA("opengl32.dll"), name);
+    return proc;
+}
+#endif
+
+Gl_Procs gl = {0};
+
+#define GL_PROC(name, ...) \
+    *(void**)&gl.name = gl_get_proc_address("gl" #name); \
+    if (gl.name == NULL) { \
+        TraceLog(LOG_WARNING, "GL: could not load gl%s", #name); \
+        ok = false; \
+    }
+
+bool gl_load_procs(void)
+{
+    bool ok = true;
+    LIST_OF_GL_PROCS
+    return ok;
+}
+
+bool gl_load_msaa_procs(void)
+{
+    bool ok = true;
+    LIST_OF_GL_MSAA_PROCS
+    return ok;
+}
+
+bool gl_load_timer_procs(void)
+{
+    bool ok = true;
+    LIST_OF_GL_TIMER_PROCS
+    return ok;
+}
+
+#undef GL_PROC
@@ -0,0 +1,99 @@
+#ifndef GL_H_
+#define GL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// OpenGL entry points that raylib does not wrap in rlgl.h.
+// They are loaded at runtime from the context raylib created, so gl_load_procs()
+// must be called after InitWindow().
+
+typedef unsigned int GLenum;
+typedef unsigned int GLuint;
+typedef unsigned int GLbitfield;
+typedef int GLint;
+typedef int GLsizei;
+typedef ptrdiff_t GLintptr;
+typedef ptrdiff_t GLsizeiptr;
+typedef uint64_t GLuint64;
+typedef unsigned char GLboolean;
+typedef struct __GLsync *GLsync;
+
+#define GL_UNSIGNED_BYTE               0x1401
+#define GL_RGBA                        0x1908
+#define GL_READ_FRAMEBUFFER            0x8CA8
+#define GL_PIXEL_PACK_BUFFER           0x88EB
+#define GL_STREAM_READ                 0x88E1
+#define GL_MAP_READ_BIT                0x0001
+#define GL_SYNC_GPU_COMMANDS_COMPLETE  0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT     0x0001
+#define GL_TIMEOUT_IGNORED             0xFFFFFFFFFFFFFFFFull
+#define GL_WAIT_FAILED                 0x911D
+#define GL_PACK_ROW_LENGTH             0x0D02
+#define GL_FRAMEBUFFER                 0x8D40
+#define GL_DRAW_FRAMEBUFFER            0x8CA9
+#define GL_RENDERBUFFER                0x8D41
+#define GL_RGBA8                       0x8058
+#define GL_DEPTH_COMPONENT24           0x81A6
+#define GL_COLOR_ATTACHMENT0           0x8CE0
+#define GL_DEPTH_ATTACHMENT            0x8D00
+#define GL_FRAMEBUFFER_COMPLETE        0x8CD5
+#define GL_COLOR_BUFFER_BIT            0x00004000
+#define GL_NEAREST                     0x2600
+#define GL_MAX_SAMPLES                 0x8D57
+#define GL_TIME_ELAPSED                0x88BF
+#define GL_QUERY_RESULT                0x8866
+
+#define LIST_OF_GL_PROCS \
+    GL_PROC(GenBuffers, void, GLsizei, GLuint*) \
+    GL_PROC(DeleteBuffers, void, GLsizei, const GLuint*) \
+    GL_PROC(BindBuffer, void, GLenum, GLuint) \
+    GL_PROC(BufferData, void, GLenum, GLsizeiptr, const void*, GLenum) \
+    GL_PROC(MapBufferRange, void*, GLenum, GLintptr, GLsizeiptr, GLbitfield) \
+    GL_PROC(UnmapBuffer, GLboolean, GLenum) \
+    GL_PROC(BindFramebuffer, void, GLenum, GLuint) \
+    GL_PROC(ReadPixels, void, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void*) \
+    GL_PROC(FenceSync, GLsync, GLenum, GLbitfield) \
+    GL_PROC(ClientWaitSync, GLenum, GLsync, GLbitfield, GLuint64) \
+    GL_PROC(DeleteSync, void, GLsync) \
+    GL_PROC(Flush, void, void) \
+    GL_PROC(PixelStorei, void, GLenum, GLint) \
+    GL_PROC(GetIntegerv, void, GLenum, GLint*) \
+
+// Multisampled framebuffers and resolving them, see msaa.h
+#define LIST_OF_GL_MSAA_PROCS \
+    GL_PROC(GenFramebuffers, void, GLsizei, GLuint*) \
+    GL_PROC(DeleteFramebuffers, void, GLsizei, const GLuint*) \
+    GL_PROC(GenRenderbuffers, void, GLsizei, GLuint*) \
+    GL_PROC(DeleteRenderbuffers, void, GLsizei, const GLuint*) \
+    GL_PROC(BindRenderbuffer, void, GLenum, GLuint) \
+    GL_PROC(RenderbufferStorageMultisample, void, GLenum, GLsizei, GLenum, GLsizei, GLsizei) \
+    GL_PROC(FramebufferRenderbuffer, void, GLenum, GLenum, GLenum, GLuint) \
+    GL_PROC(CheckFramebufferStatus, GLenum, GLenum) \
+    GL_PROC(BlitFramebuffer, void, GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLbitfield, GLenum) \
+
+// Timer queries for measuring how long the GPU takes to draw the frames
+#define LIST_OF_GL_TIMER_PROCS \
+    GL_PROC(GenQueries, void, GLsizei, GLuint*) \
+    GL_PROC(DeleteQueries, void, GLsizei, const GLuint*) \
+    GL_PROC(BeginQuery, void, GLenum, GLuint) \
+    GL_PROC(EndQuery, void, GLenum) \
+    GL_PROC(GetQueryObjectui64v, void, GLuint, GLenum, GLuint64*) \
+
+#define GL_PROC(name, ret, ...) ret (*name)(__VA_ARGS__);
+typedef struct {
+    LIST_OF_GL_PROCS
+    LIST_OF_GL_MSAA_PROCS
+    LIST_OF_GL_TIMER_PROCS
+} Gl_Procs;
+#undef GL_PROC
+
+extern Gl_Procs gl;
+
+// Every list is loaded on its own, so a missing optional entry point only disables what needs it
+bool gl_load_procs(void);
+bool gl_load_msaa_procs(void);
+bool gl_load_timer_procs(void);
+
+#endif // GL_H_
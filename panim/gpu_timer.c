@@ -0,0 +1,72 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "gl.h"
+#include "gpu_timer.h"
+
+// Spans in flight before the oldest one is waited for
+#define GPU_TIMER_QUERIES 8
+
+struct Gpu_Timer {
+    GLuint queries[GPU_TIMER_QUERIES];
+    bool pending[GPU_TIMER_QUERIES];
+    size_t next;
+    GLuint64 total;
+};
+
+Gpu_Timer *gpu_timer_create(void)
+{
+    if (!gl_load_timer_procs()) {
+        TraceLog(LOG_WARNING, "GPU_TIMER: timer queries are not available");
+        return NULL;
+    }
+    Gpu_Timer *timer = malloc(sizeof(Gpu_Timer));
+    assert(timer != NULL && "Buy MORE RAM lol!!");
+    memset(timer, 0, sizeof(*timer));
+    gl.GenQueries(GPU_TIMER_QUERIES, timer->queries);
+    return timer;
+}
+
+void gpu_timer_destroy(Gpu_Timer *timer)
+{
+    gpu_timer_total(timer);
+    gl.DeleteQueries(GPU_TIMER_QUERIES, timer->queries);
+    free(timer);
+}
+
+static void gpu_timer_collect(Gpu_Timer *timer, size_t i)
+{
+    if (!timer->pending[i]) return;
+    GLuint64 elapsed = 0;
+    gl.GetQueryObjectui64v(timer->queries[i], GL_QUERY_RESULT, &elapsed);
+    timer->total += elapsed;
+    timer->pending[i] = false;
+}
+
+void gpu_timer_begin(Gpu_Timer *timer)
+{
+    gpu_timer_collect(timer, timer->next);
+    gl.BeginQuery(GL_TIME_ELAPSED, timer->queries[timer->next]);
+}
+
+void gpu_timer_end(Gpu_Timer *timer)
+{
+    gl.EndQuery(GL_TIME_ELAPSED);
+    timer->pending[timer->next] = true;
+    timer->next = (timer->next + 1)%GPU_TIMER_QUERIES;
+}
+
+double gpu_timer_total(Gpu_Timer *timer)
+{
+    for (size_t i = 0; i < GPU_TIMER_QUERIES; ++i) gpu_timer_collect(timer, i);
+    return timer->total*1e-9;
+}
+
+void gpu_timer_reset(Gpu_Timer *timer)
+{
+    gpu_timer_total(timer);
+    timer->total = 0;
+}
@@ -0,0 +1,21 @@
+#ifndef GPU_TIMER_H_
+#define GPU_TIMER_H_
+
+#include <stdbool.h>
+
+// Measures how long the GPU spends on a span of GL commands with timer queries. The results
+// are collected a few spans later, so the measuring does not stall the pipeline.
+
+typedef struct Gpu_Timer Gpu_Timer;
+
+// Returns NULL if timer queries are not available
+Gpu_Timer *gpu_timer_create(void);
+void gpu_timer_destroy(Gpu_Timer *timer);
+// The spans can not be nested
+void gpu_timer_begin(Gpu_Timer *timer);
+void gpu_timer_end(Gpu_Timer *timer);
+// Waits for all the spans to finish and returns their total time in seconds
+double gpu_timer_total(Gpu_Timer *timer);
+void gpu_timer_reset(Gpu_Timer *timer);
+
+#endif // GPU_TIMER_H_
@@ -0,0 +1,209 @@
+#include <string.h>
+
+#include "hash.h"
+#include "workers.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HASH_X86
+#include <immintrin.h>
+#endif
+
+#define HASH_LANES 8
+#define HASH_STRIPE (HASH_LANES*sizeof(uint32_t))
+// Blocks are never smaller than this, and there are never more than HASH_MAX_BLOCKS of them
+#define HASH_MIN_BLOCK_SIZE (64*1024)
+#define HASH_MAX_BLOCKS 256
+
+#define HASH_PRIME32_1 0x9E3779B1u
+#define HASH_PRIME32_2 0x85EBCA77u
+#define HASH_PRIME64 0x100000001B3ull
+
+static inline uint32_t hash_rotl32(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t hash_round(uint32_t acc, uint32_t input)
+{
+    return hash_rotl32(acc + input*HASH_PRIME32_2, 13)*HASH_PRIME32_1;
+}
+
+static void hash_init_lanes(uint32_t lanes[HASH_LANES])
+{
+    for (size_t i = 0; i < HASH_LANES; ++i) lanes[i] = HASH_PRIME32_1*(i + 1);
+}
+
+static void hash_stripes_scalar(uint32_t lanes[HASH_LANES], const uint8_t *p, size_t stripes)
+{
+    for (size_t s = 0; s < stripes; ++s, p += HASH_STRIPE) {
+        for (size_t i = 0; i < HASH_LANES; ++i) {
+            uint32_t w;
+            memcpy(&w, p + i*sizeof(w), sizeof(w));
+            lanes[i] = hash_round(lanes[i], w);
+        }
+    }
+}
+
+#ifdef HASH_X86
+
+__attribute__((target("sse4.1")))
+static inline __m128i hash_round_sse41(__m128i acc, __m128i input)
+{
+    acc = _mm_add_epi32(acc, _mm_mullo_epi32(input, _mm_set1_epi32(HASH_PRIME32_2)));
+    acc = _mm_or_si128(_mm_slli_epi32(acc, 13), _mm_srli_epi32(acc, 32 - 13));
+    return _mm_mullo_epi32(acc, _mm_set1_epi32(HASH_PRIME32_1));
+}
+
+__attribute__((target("sse4.1")))
+static void hash_stripes_sse41(uint32_t lanes[HASH_LANES], const uint8_t *p, size_t stripes)
+{
+    __m128i lo = _mm_loadu_si128((const __m128i*)lanes);
+    __m128i hi = _mm_loadu_si128((const __m128i*)(lanes + 4));
+    for (size_t s = 0; s < stripes; ++s, p += HASH_STRIPE) {
+        lo = hash_round_sse41(lo, _mm_loadu_si128((const __m128i*)p));
+        hi = hash_round_sse41(hi, _mm_loadu_si128((const __m128i*)(p + 16)));
+    }
+    _mm_storeu_si128((__m128i*)lanes, lo);
+    _mm_storeu_si128((__m128i*)(lanes + 4), hi);
+}
+
+__attribute__((target("avx2")))
+static void hash_stripes_avx2(uint32_t lanes[HASH_LANES], const uint8_t *p, size_t stripes)
+{
+    __m256i acc = _mm256_loadu_si256((const __m256i*)lanes);
+    __m256i prime1 = _mm256_set1_epi32(HASH_PRIME32_1);
+    __m256i prime2 = _mm256_set1_epi32(HASH_PRIME32_2);
+    for (size_t s = 0; s < stripes; ++s, p += HASH_STRIPE) {
+        __m256i input = _mm256_loadu_si256((const __m256i*)p);
+        acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(input, prime2));
+        acc = _mm256_or_si256(_mm256_slli_epi32(acc, 13), _mm256_srli_epi32(acc, 32 - 13));
+        acc = _mm256_mullo_epi32(acc, prime1);
+    }
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+}
+
+#endif // HASH_X86
+
+static uint64_t hash_mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t hash_block(Hash_Kernel kernel, const uint8_t *p, size_t size)
+{
+    uint32_t lanes[HASH_LANES];
+    hash_init_lanes(lanes);
+
+    size_t stripes = size/HASH_STRIPE;
+    switch (kernel) {
+#ifdef HASH_X86
+    case HASH_KERNEL_AVX2:  hash_stripes_avx2(lanes, p, stripes);  break;
+    case HASH_KERNEL_SSE41: hash_stripes_sse41(lanes, p, stripes); break;
+#endif
+    default:                hash_stripes_scalar(lanes, p, stripes);
+    }
+
+    uint64_t h = size;
+    for (size_t i = 0; i < HASH_LANES; ++i) h = (h ^ lanes[i])*HASH_PRIME64;
+    for (size_t i = stripes*HASH_STRIPE; i < size; ++i) h = (h ^ p[i])*HASH_PRIME64;
+    return hash_mix64(h);
+}
+
+static size_t hash_block_size(size_t size)
+{
+    size_t block_size = (size + HASH_MAX_BLOCKS - 1)/HASH_MAX_BLOCKS;
+    if (block_size < HASH_MIN_BLOCK_SIZE) block_size = HASH_MIN_BLOCK_SIZE;
+    // Whole stripes, so only the last block has a scalar tail
+    return (block_size + HASH_STRIPE - 1)/HASH_STRIPE*HASH_STRIPE;
+}
+
+static uint64_t hash_combine(const uint64_t *blocks, size_t blocks_count, size_t size)
+{
+    uint64_t h = size;
+    for (size_t i = 0; i < blocks_count; ++i) h = hash_mix64(h ^ blocks[i]);
+    return h;
+}
+
+typedef struct {
+    Hash_Kernel kernel;
+    const uint8_t *data;
+    size_t size;
+    size_t block_size;
+    uint64_t blocks[HASH_MAX_BLOCKS];
+} Hash_Job;
+
+static void hash_job(void *ctx, size_t begin, size_t end)
+{
+    Hash_Job *job = ctx;
+    for (size_t i = begin; i < end; ++i) {
+        size_t offset = i*job->block_size;
+        size_t size = job->size - offset;
+        if (size > job->block_size) size = job->block_size;
+        job->blocks[i] = hash_block(job->kernel, job->data + offset, size);
+    }
+}
+
+const char *hash_kernel_name(Hash_Kernel kernel)
+{
+    switch (kernel) {
+    case HASH_KERNEL_SCALAR: return "scalar";
+    case HASH_KERNEL_SSE41:  return "SSE4.1";
+    case HASH_KERNEL_AVX2:   return "AVX2";
+    case COUNT_HASH_KERNELS:
+    default:                 return "unknown";
+    }
+}
+
+Hash_Kernel hash_best_kernel(void)
+{
+#ifdef HASH_X86
+    if (__builtin_cpu_supports("avx2")) return HASH_KERNEL_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return HASH_KERNEL_SSE41;
+#endif
+    return HASH_KERNEL_SCALAR;
+}
+
+uint64_t hash_frame_with(Hash_Kernel kernel, const void *data, size_t size)
+{
+    Hash_Job job = {
+        .kernel = kernel,
+        .data = data,
+        .size = size,
+        .block_size = hash_block_size(size),
+    };
+    size_t blocks_count = (size + job.block_size - 1)/job.block_size;
+    hash_job(&job, 0, blocks_count);
+    return hash_combine(job.blocks, blocks_count, size);
+}
+
+uint64_t hash_rect(const void *data, size_t stride, size_t row_size, size_t rows)
+{
+    // Called from the workers, so no lazily initialized static here
+    Hash_Kernel kernel = hash_best_kernel();
+    uint64_t h = row_size*rows;
+    for (size_t y = 0; y < rows; ++y) {
+        h = hash_mix64(h ^ hash_block(kernel, (const uint8_t*)data + y*stride, row_size));
+    }
+    return h;
+}
+
+uint64_t hash_frame(const void *data, size_t size)
+{
+    static Hash_Kernel kernel = COUNT_HASH_KERNELS;
+    if (kernel == COUNT_HASH_KERNELS) kernel = hash_best_kernel();
+
+    Hash_Job job = {
+        .kernel = kernel,
+        .data = data,
+        .size = size,
+        .block_size = hash_block_size(size),
+    };
+    size_t blocks_count = (size + job.block_size - 1)/job.block_size;
+    workers_parallel_for(blocks_count, hash_job, &job);
+    return hash_combine(job.blocks, blocks_count, size);
+}
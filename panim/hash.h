@@ -0,0 +1,28 @@
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 64-bit non-cryptographic hash of frames used to detect the ones that did not change.
+// The data is split into blocks that are hashed across the workers, each block with
+// 8 independent 32-bit lanes of xxHash32 rounds, so it vectorizes into AVX2 or SSE4.1.
+// The result does not depend on the kernel or on the amount of threads.
+
+typedef enum {
+    HASH_KERNEL_SCALAR,
+    HASH_KERNEL_SSE41,
+    HASH_KERNEL_AVX2,
+    COUNT_HASH_KERNELS,
+} Hash_Kernel;
+
+uint64_t hash_frame(const void *data, size_t size);
+// The fastest kernel supported by this CPU, used by hash_frame()
+Hash_Kernel hash_best_kernel(void);
+const char *hash_kernel_name(Hash_Kernel kernel);
+// Single threaded hash of rows rows of row_size bytes that are stride bytes apart
+uint64_t hash_rect(const void *data, size_t stride, size_t row_size, size_t rows);
+// Single threaded hash_frame() with a specific kernel
+uint64_t hash_frame_with(Hash_Kernel kernel, const void *data, size_t size);
+
+#endif // HASH_H_
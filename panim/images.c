@@ -0,0 +1,406 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <raylib.h>
+
+#include "nob.h"
+#include "images.h"
+#include "qoi.h"
+#include "workers.h"
+
+#define IMAGES_MAX_THREADS 64
+// Frames that may be queued or encoding per encoder thread
+#define IMAGES_FRAMES_PER_THREAD 2
+#define IMAGES_MAX_IN_FLIGHT (IMAGES_MAX_THREADS*IMAGES_FRAMES_PER_THREAD)
+
+typedef struct {
+    void *pixels;
+    size_t index;
+} Images_Frame;
+
+typedef struct {
+    size_t src;
+    size_t dst;
+} Images_Repeat;
+
+typedef struct {
+    Images_Repeat *items;
+    size_t count;
+    size_t capacity;
+} Images_Repeats;
+
+struct Images {
+    Images_Format format;
+    char *output_path;
+    size_t width;
+    size_t height;
+    size_t first_index;
+    size_t next_index;
+
+    pthread_t threads[IMAGES_MAX_THREADS];
+    size_t threads_count;
+    size_t max_in_flight;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t queued; // A frame was queued or the export is over
+    pthread_cond_t freed;  // An encoder is done with a frame
+    Images_Frame queue[IMAGES_MAX_IN_FLIGHT];
+    size_t queue_begin;
+    size_t queue_count;
+    // Buffers the encoders are done with
+    void *free_buffers[IMAGES_MAX_IN_FLIGHT];
+    size_t free_count;
+    // Frames owned by the encoders, queued or being encoded
+    size_t in_flight;
+    bool stop;
+    bool cancel;
+    bool failed;
+
+    Images_Repeats repeats;
+
+    // The frame that is being sent in strips with images_send_rows(), encoded on the calling thread
+    FILE *rows_file;
+    char *rows_path;
+    Qoi_Encoder rows_qoi;
+    uint8_t *rows_buffer;
+    size_t rows_buffer_size;
+    size_t rows_sent;
+};
+
+Images_Format images_format_from_path(const char *output_path)
+{
+    const char *ext = strrchr(output_path, '.');
+    if (ext == NULL) return IMAGES_FORMAT_NONE;
+    if (strcmp(ext, ".qoi") == 0) return IMAGES_FORMAT_QOI;
+    if (strcmp(ext, ".png") == 0) return IMAGES_FORMAT_PNG;
+    return IMAGES_FORMAT_NONE;
+}
+
+// Returns a malloc()ed path of the frame
+static char *images_frame_path(const char *output_path, size_t index)
+{
+    const char *percent = strchr(output_path, '%');
+    const char *ext = strrchr(output_path, '.');
+    int digits = 6;
+    const char *prefix_end = ext;
+    const char *suffix = ext;
+    if (percent != NULL) {
+        const char *p = percent + 1;
+        int width = 0;
+        while (*p >= '0' && *p <= '9') width = width*10 + (*p++ - '0');
+        if (*p == 'd') {
+            digits = width;
+            prefix_end = percent;
+            suffix = p + 1;
+        }
+    }
+
+    int size = snprintf(NULL, 0, "%.*s%0*zu%s", (int)(prefix_end - output_path), output_path, digits, index, suffix);
+    char *path = malloc(size + 1);
+    assert(path != NULL && "Buy MORE RAM lol!!");
+    snprintf(path, size + 1, "%.*s%0*zu%s", (int)(prefix_end - output_path), output_path, digits, index, suffix);
+    return path;
+}
+
+typedef struct {
+    uint8_t *qoi;
+    uint8_t *flipped;
+} Images_Scratch;
+
+static bool images_write_frame(Images *images, Images_Scratch *scratch, Images_Frame frame)
+{
+    char *path = images_frame_path(images->output_path, frame.index);
+    bool ok = false;
+
+    switch (images->format) {
+    case IMAGES_FORMAT_QOI: {
+        if (scratch->qoi == NULL) {
+            scratch->qoi = malloc(qoi_frame_max_size(images->width, images->height));
+            assert(scratch->qoi != NULL && "Buy MORE RAM lol!!");
+        }
+        size_t size = qoi_encode_frame(frame.pixels, images->width, images->height, true, scratch->qoi);
+        FILE *f = fopen(path, "wb");
+        if (f == NULL) {
+            TraceLog(LOG_ERROR, "IMAGES: could not open %s: %s", path, strerror(errno));
+            break;
+        }
+        ok = fwrite(scratch->qoi, 1, size, f) == size;
+        if (fclose(f) != 0) ok = false;
+        if (!ok) TraceLog(LOG_ERROR, "IMAGES: could not write %s: %s", path, strerror(errno));
+    } break;
+
+    case IMAGES_FORMAT_PNG: {
+        // stb_image_write wants the rows top-down
+        size_t stride = images->width*4;
+        if (scratch->flipped == NULL) {
+            scratch->flipped = malloc(stride*images->height);
+            assert(scratch->flipped != NULL && "Buy MORE RAM lol!!");
+        }
+        for (size_t y = 0; y < images->height; ++y) {
+            memcpy(scratch->flipped + y*stride, (uint8_t*)frame.pixels + (images->height - 1 - y)*stride, stride);
+        }
+        ok = ExportImage(CLITERAL(Image) {
+            .data = scratch->flipped,
+            .width = images->width,
+            .height = images->height,
+            .mipmaps = 1,
+            .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+        }, path);
+        if (!ok) TraceLog(LOG_ERROR, "IMAGES: could not write %s", path);
+    } break;
+
+    case IMAGES_FORMAT_NONE:
+    default:
+        assert(0 && "unreachable");
+    }
+
+    free(path);
+    return ok;
+}
+
+static void *images_encoder(void *arg)
+{
+    Images *images = arg;
+    Images_Scratch scratch = {0};
+
+    pthread_mutex_lock(&images->mutex);
+    for (;;) {
+        while (images->queue_count == 0 && !images->stop) pthread_cond_wait(&images->queued, &images->mutex);
+        if (images->queue_count == 0) break;
+
+        Images_Frame frame = images->queue[images->queue_begin];
+        images->queue_begin = (images->queue_begin + 1)%IMAGES_MAX_IN_FLIGHT;
+        images->queue_count -= 1;
+        bool skip = images->cancel || images->failed;
+        pthread_mutex_unlock(&images->mutex);
+
+        bool ok = skip || images_write_frame(images, &scratch, frame);
+
+        pthread_mutex_lock(&images->mutex);
+        if (!ok) images->failed = true;
+        images->free_buffers[images->free_count++] = frame.pixels;
+        images->in_flight -= 1;
+        pthread_cond_signal(&images->freed);
+    }
+    pthread_mutex_unlock(&images->mutex);
+
+    free(scratch.qoi);
+    free(scratch.flipped);
+    return NULL;
+}
+
+Images *images_start(const char *output_path, size_t width, size_t height, size_t first_index)
+{
+    Images_Format format = images_format_from_path(output_path);
+    if (format == IMAGES_FORMAT_NONE) {
+        TraceLog(LOG_ERROR, "IMAGES: %s is neither .qoi nor .png", output_path);
+        return NULL;
+    }
+
+    Images *images = malloc(sizeof(Images));
+    assert(images != NULL && "Buy MORE RAM lol!!");
+    memset(images, 0, sizeof(*images));
+    images->format = format;
+    images->output_path = strdup(output_path);
+    assert(images->output_path != NULL && "Buy MORE RAM lol!!");
+    images->width = width;
+    images->height = height;
+    images->first_index = first_index;
+    images->next_index = first_index;
+    pthread_mutex_init(&images->mutex, NULL);
+    pthread_cond_init(&images->queued, NULL);
+    pthread_cond_init(&images->freed, NULL);
+
+    size_t wanted = workers_count();
+    if (wanted > IMAGES_MAX_THREADS) wanted = IMAGES_MAX_THREADS;
+    for (size_t i = 0; i < wanted; ++i) {
+        int err = pthread_create(&images->threads[images->threads_count], NULL, images_encoder, images);
+        if (err != 0) {
+            TraceLog(LOG_WARNING, "IMAGES: could only start %zu encoder threads: %s", images->threads_count, strerror(err));
+            break;
+        }
+        images->threads_count += 1;
+    }
+    if (images->threads_count == 0) {
+        images_end(images, true);
+        return NULL;
+    }
+    images->max_in_flight = images->threads_count*IMAGES_FRAMES_PER_THREAD;
+
+    return images;
+}
+
+Images *images_start_rows(const char *output_path, size_t width, size_t height, size_t first_index)
+{
+    if (images_format_from_path(output_path) != IMAGES_FORMAT_QOI) {
+        TraceLog(LOG_ERROR, "IMAGES: only .qoi can be written in strips, but got %s", output_path);
+        return NULL;
+    }
+
+    Images *images = malloc(sizeof(Images));
+    assert(images != NULL && "Buy MORE RAM lol!!");
+    memset(images, 0, sizeof(*images));
+    images->format = IMAGES_FORMAT_QOI;
+    images->output_path = strdup(output_path);
+    assert(images->output_path != NULL && "Buy MORE RAM lol!!");
+    images->width = width;
+    images->height = height;
+    images->first_index = first_index;
+    images->next_index = first_index;
+    pthread_mutex_init(&images->mutex, NULL);
+    pthread_cond_init(&images->queued, NULL);
+    pthread_cond_init(&images->freed, NULL);
+    return images;
+}
+
+bool images_send_rows(Images *images, const void *rows, size_t count)
+{
+    assert(images->rows_sent + count <= images->height);
+    size_t size = qoi_rows_max_size(images->width, count);
+    if (images->rows_buffer_size < size) {
+        free(images->rows_buffer);
+        images->rows_buffer = malloc(size);
+        assert(images->rows_buffer != NULL && "Buy MORE RAM lol!!");
+        images->rows_buffer_size = size;
+    }
+
+    uint8_t *p = images->rows_buffer;
+    if (images->rows_sent == 0) {
+        images->rows_path = images_frame_path(images->output_path, images->next_index);
+        images->rows_file = fopen(images->rows_path, "wb");
+        if (images->rows_file == NULL) {
+            TraceLog(LOG_ERROR, "IMAGES: could not open %s: %s", images->rows_path, strerror(errno));
+            free(images->rows_path);
+            images->rows_path = NULL;
+            return false;
+        }
+        p += qoi_encoder_begin(&images->rows_qoi, images->width, images->height, p);
+    }
+    p += qoi_encoder_rows(&images->rows_qoi, rows, images->width, count, false, p);
+    images->rows_sent += count;
+    bool last = images->rows_sent == images->height;
+    if (last) p += qoi_encoder_end(&images->rows_qoi, p);
+
+    size_t written = p - images->rows_buffer;
+    bool ok = fwrite(images->rows_buffer, 1, written, images->rows_file) == written;
+    if (last) {
+        if (fclose(images->rows_file) != 0) ok = false;
+        images->rows_file = NULL;
+    }
+    if (!ok) {
+        TraceLog(LOG_ERROR, "IMAGES: could not write %s: %s", images->rows_path, strerror(errno));
+        return false;
+    }
+    if (last) {
+        free(images->rows_path);
+        images->rows_path = NULL;
+        images->rows_sent = 0;
+        images->next_index += 1;
+    }
+    return true;
+}
+
+void *images_send_frame_flipped(Images *images, void *pixels)
+{
+    pthread_mutex_lock(&images->mutex);
+    if (images->failed) {
+        pthread_mutex_unlock(&images->mutex);
+        return NULL;
+    }
+
+    size_t end = (images->queue_begin + images->queue_count)%IMAGES_MAX_IN_FLIGHT;
+    images->queue[end] = CLITERAL(Images_Frame) {
+        .pixels = pixels,
+        .index = images->next_index++,
+    };
+    images->queue_count += 1;
+    images->in_flight += 1;
+    pthread_cond_signal(&images->queued);
+
+    // Every buffer is either in flight, free, or with the caller, so there are never more
+    // than max_in_flight + 1 of them
+    while (images->free_count == 0 && images->in_flight >= images->max_in_flight) {
+        pthread_cond_wait(&images->freed, &images->mutex);
+    }
+    void *next = images->free_count > 0 ? images->free_buffers[--images->free_count] : NULL;
+    pthread_mutex_unlock(&images->mutex);
+
+    if (next == NULL) {
+        next = malloc(images->width*images->height*4);
+        assert(next != NULL && "Buy MORE RAM lol!!");
+    }
+    return next;
+}
+
+bool images_send_repeated_frame(Images *images)
+{
+    if (images->next_index == images->first_index) {
+        TraceLog(LOG_ERROR, "IMAGES: there is no previous frame to repeat");
+        return false;
+    }
+    Images_Repeat repeat = {
+        .src = images->next_index - 1,
+        .dst = images->next_index,
+    };
+    // A run of repeats refers to the frame that was actually encoded
+    if (images->repeats.count > 0 && images->repeats.items[images->repeats.count - 1].dst == repeat.src) {
+        repeat.src = images->repeats.items[images->repeats.count - 1].src;
+    }
+    nob_da_append(&images->repeats, repeat);
+    images->next_index += 1;
+    return true;
+}
+
+static bool images_write_repeats(Images *images)
+{
+    for (size_t i = 0; i < images->repeats.count; ++i) {
+        char *src = images_frame_path(images->output_path, images->repeats.items[i].src);
+        char *dst = images_frame_path(images->output_path, images->repeats.items[i].dst);
+        remove(dst);
+        bool ok = false;
+#ifndef _WIN32
+        ok = link(src, dst) == 0;
+#endif
+        if (!ok) ok = nob_copy_file(src, dst);
+        free(src);
+        free(dst);
+        if (!ok) return false;
+    }
+    return true;
+}
+
+bool images_end(Images *images, bool cancel)
+{
+    pthread_mutex_lock(&images->mutex);
+    images->stop = true;
+    images->cancel = cancel;
+    pthread_cond_broadcast(&images->queued);
+    pthread_mutex_unlock(&images->mutex);
+    for (size_t i = 0; i < images->threads_count; ++i) pthread_join(images->threads[i], NULL);
+
+    bool ok = !cancel && !images->failed && images_write_repeats(images);
+    if (images->rows_file != NULL) {
+        // A frame that was only partially sent is not worth keeping
+        fclose(images->rows_file);
+        remove(images->rows_path);
+        ok = false;
+    }
+    free(images->rows_path);
+    free(images->rows_buffer);
+
+    for (size_t i = 0; i < images->free_count; ++i) free(images->free_buffers[i]);
+    pthread_cond_destroy(&images->freed);
+    pthread_cond_destroy(&images->queued);
+    pthread_mutex_destroy(&images->mutex);
+    nob_da_free(images->repeats);
+    free(images->output_path);
+    free(images);
+    return ok;
+}
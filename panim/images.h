@@ -0,0 +1,40 @@
+#ifndef IMAGES_H_
+#define IMAGES_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Exports the rendered frames as a sequence of numbered still images, for compositing them in
+// other tools. The frames are compressed and written by a pool of encoder threads, so even PNG
+// keeps up with the rendering. The frame buffers themselves are handed over to the encoders
+// instead of being copied, and at most a fixed amount of them is in flight at once.
+//
+// Frame N of output_path goes into the file named by the first %d (or %0Nd) of it, or gets
+// a 6 digit number inserted in front of the extension if output_path has no %d.
+
+typedef enum {
+    IMAGES_FORMAT_NONE,
+    IMAGES_FORMAT_QOI,
+    IMAGES_FORMAT_PNG,
+} Images_Format;
+
+typedef struct Images Images;
+
+// Picks the format by the extension of output_path. IMAGES_FORMAT_NONE is not an image sequence.
+Images_Format images_format_from_path(const char *output_path);
+// first_index is the number of the first frame that is sent
+Images *images_start(const char *output_path, size_t width, size_t height, size_t first_index);
+// Takes over pixels, which are bottom-up RGBA malloc()ed frames of width*height*4 bytes, and
+// returns another such buffer for the next frame (waiting for one if too many are in flight).
+// Returns NULL if the export has failed, and pixels then stays with the caller.
+void *images_send_frame_flipped(Images *images, void *pixels);
+// Writes the previous frame again. The file is linked (or copied) when the export ends.
+bool images_send_repeated_frame(Images *images);
+// Frames that are too big to be in memory at once (see --tile) are sent in horizontal strips
+// instead, which only .qoi can take. They are encoded and written on the calling thread as the
+// strips arrive. The rows are top-down RGBA, and the strips of a frame have to add up to its height.
+Images *images_start_rows(const char *output_path, size_t width, size_t height, size_t first_index);
+bool images_send_rows(Images *images, const void *rows, size_t count);
+bool images_end(Images *images, bool cancel);
+
+#endif // IMAGES_H_
@@ -0,0 +1,146 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "mixer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MIXER_X86
+#include <immintrin.h>
+#endif
+
+static inline int16_t mixer_saturate(int x)
+{
+    if (x > INT16_MAX) return INT16_MAX;
+    if (x < INT16_MIN) return INT16_MIN;
+    return x;
+}
+
+// Rounds the same way as pmulhrsw, so all the kernels produce identical output
+static inline int16_t mixer_scale(int16_t sample, int16_t gain)
+{
+    return (sample*gain + (1 << 14)) >> 15;
+}
+
+static void mixer_add_scalar(int16_t *dst, const int16_t *src, size_t count, int16_t gain, bool unity, size_t i)
+{
+    for (; i < count; ++i) {
+        int16_t sample = unity ? src[i] : mixer_scale(src[i], gain);
+        dst[i] = mixer_saturate(dst[i] + sample);
+    }
+}
+
+#ifdef MIXER_X86
+
+__attribute__((target("ssse3")))
+static void mixer_add_ssse3(int16_t *dst, const int16_t *src, size_t count, int16_t gain, bool unity)
+{
+    __m128i g = _mm_set1_epi16(gain);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        if (!unity) s = _mm_mulhrs_epi16(s, g);
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_adds_epi16(d, s));
+    }
+    mixer_add_scalar(dst, src, count, gain, unity, i);
+}
+
+__attribute__((target("avx2")))
+static void mixer_add_avx2(int16_t *dst, const int16_t *src, size_t count, int16_t gain, bool unity)
+{
+    __m256i g = _mm256_set1_epi16(gain);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        if (!unity) s = _mm256_mulhrs_epi16(s, g);
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_adds_epi16(d, s));
+    }
+    mixer_add_scalar(dst, src, count, gain, unity, i);
+}
+
+#endif // MIXER_X86
+
+const char *mixer_kernel_name(Mixer_Kernel kernel)
+{
+    switch (kernel) {
+    case MIXER_KERNEL_SCALAR: return "scalar";
+    case MIXER_KERNEL_SSSE3:  return "SSSE3";
+    case MIXER_KERNEL_AVX2:   return "AVX2";
+    case COUNT_MIXER_KERNELS:
+    default:                  return "unknown";
+    }
+}
+
+Mixer_Kernel mixer_best_kernel(void)
+{
+#ifdef MIXER_X86
+    if (__builtin_cpu_supports("avx2")) return MIXER_KERNEL_AVX2;
+    if (__builtin_cpu_supports("ssse3")) return MIXER_KERNEL_SSSE3;
+#endif
+    return MIXER_KERNEL_SCALAR;
+}
+
+void mixer_init(Mixer *mixer)
+{
+    memset(mixer, 0, sizeof(*mixer));
+    mixer->kernel = mixer_best_kernel();
+}
+
+void mixer_clear(Mixer *mixer)
+{
+    mixer->voices_count = 0;
+}
+
+void mixer_play(Mixer *mixer, const int16_t *samples, size_t count, float gain)
+{
+    if (count == 0) return;
+
+    Mixer_Voice *voice = NULL;
+    if (mixer->voices_count < MIXER_MAX_VOICES) {
+        voice = &mixer->voices[mixer->voices_count++];
+    } else {
+        voice = &mixer->voices[0];
+        for (size_t i = 1; i < mixer->voices_count; ++i) {
+            Mixer_Voice *it = &mixer->voices[i];
+            if (it->count - it->cursor < voice->count - voice->cursor) voice = it;
+        }
+    }
+
+    if (gain < 0.0f) gain = 0.0f;
+    if (gain > 1.0f) gain = 1.0f;
+    int q15 = gain*32768.0f + 0.5f;
+    voice->samples = samples;
+    voice->count = count;
+    voice->cursor = 0;
+    voice->unity = q15 > INT16_MAX;
+    voice->gain = voice->unity ? INT16_MAX : q15;
+}
+
+void mixer_mix(Mixer *mixer, int16_t *out, size_t count)
+{
+    memset(out, 0, count*sizeof(*out));
+
+    for (size_t i = 0; i < mixer->voices_count;) {
+        Mixer_Voice *voice = &mixer->voices[i];
+        size_t n = voice->count - voice->cursor;
+        if (n > count) n = count;
+        const int16_t *src = voice->samples + voice->cursor;
+
+        switch (mixer->kernel) {
+#ifdef MIXER_X86
+        case MIXER_KERNEL_AVX2:  mixer_add_avx2(out, src, n, voice->gain, voice->unity);  break;
+        case MIXER_KERNEL_SSSE3: mixer_add_ssse3(out, src, n, voice->gain, voice->unity); break;
+#endif
+        default:                 mixer_add_scalar(out, src, n, voice->gain, voice->unity, 0);
+        }
+
+        voice->cursor += n;
+        if (voice->cursor >= voice->count) {
+            *voice = mixer->voices[--mixer->voices_count];
+        } else {
+            i += 1;
+        }
+    }
+}
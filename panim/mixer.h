@@ -0,0 +1,50 @@
+#ifndef MIXER_H_
+#define MIXER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Mixes the sounds played by the animation into the audio track of the rendering.
+// Every sound becomes a voice and all the active voices are summed with saturating
+// 16-bit adds, using AVX2 or SSSE3 when the CPU has them. The voices live in a
+// fixed array, so nothing is allocated while mixing.
+
+#define MIXER_MAX_VOICES 256
+
+typedef enum {
+    MIXER_KERNEL_SCALAR,
+    MIXER_KERNEL_SSSE3,
+    MIXER_KERNEL_AVX2,
+    COUNT_MIXER_KERNELS,
+} Mixer_Kernel;
+
+typedef struct {
+    const int16_t *samples;
+    size_t count;
+    size_t cursor;
+    // Q15, ignored when unity is set, because 1.0 does not fit into Q15
+    int16_t gain;
+    bool unity;
+} Mixer_Voice;
+
+typedef struct {
+    Mixer_Voice voices[MIXER_MAX_VOICES];
+    size_t voices_count;
+    Mixer_Kernel kernel;
+} Mixer;
+
+void mixer_init(Mixer *mixer);
+// Stops all the voices
+void mixer_clear(Mixer *mixer);
+// Starts playing count interleaved samples with the gain in [0, 1]. The samples are not copied
+// and must outlive the voice. When all the voices are busy the one closest to its end is replaced.
+void mixer_play(Mixer *mixer, const int16_t *samples, size_t count, float gain);
+// Mixes the next count interleaved samples of all the voices into out
+void mixer_mix(Mixer *mixer, int16_t *out, size_t count);
+
+// The fastest kernel supported by this CPU, picked by mixer_init()
+Mixer_Kernel mixer_best_kernel(void);
+const char *mixer_kernel_name(Mixer_Kernel kernel);
+
+#endif // MIXER_H_
@@ -0,0 +1,101 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "gl.h"
+#include "msaa.h"
+
+struct Msaa {
+    size_t width;
+    size_t height;
+    size_t samples;
+    GLuint fbo;
+    // Color and depth
+    GLuint renderbuffers[2];
+};
+
+Msaa *msaa_create(size_t width, size_t height, size_t samples)
+{
+    if (samples <= 1) return NULL;
+    // glGetIntegerv() is in the core list, and only that one of it is needed here
+    gl_load_procs();
+    if (!gl_load_msaa_procs() || gl.GetIntegerv == NULL) {
+        TraceLog(LOG_WARNING, "MSAA: multisampled framebuffers are not available, rendering without MSAA");
+        return NULL;
+    }
+
+    GLint max_samples = 0;
+    gl.GetIntegerv(GL_MAX_SAMPLES, &max_samples);
+    if (max_samples <= 1) {
+        TraceLog(LOG_WARNING, "MSAA: the GPU does not support multisampling, rendering without MSAA");
+        return NULL;
+    }
+    if (samples > (size_t)max_samples) {
+        TraceLog(LOG_WARNING, "MSAA: %zu samples requested, but the GPU supports at most %d", samples, max_samples);
+        samples = max_samples;
+    }
+
+    Msaa *msaa = malloc(sizeof(Msaa));
+    assert(msaa != NULL && "Buy MORE RAM lol!!");
+    memset(msaa, 0, sizeof(*msaa));
+    msaa->width = width;
+    msaa->height = height;
+    msaa->samples = samples;
+
+    gl.GenFramebuffers(1, &msaa->fbo);
+    gl.BindFramebuffer(GL_FRAMEBUFFER, msaa->fbo);
+    gl.GenRenderbuffers(2, msaa->renderbuffers);
+    gl.BindRenderbuffer(GL_RENDERBUFFER, msaa->renderbuffers[0]);
+    gl.RenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+    gl.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, msaa->renderbuffers[0]);
+    gl.BindRenderbuffer(GL_RENDERBUFFER, msaa->renderbuffers[1]);
+    gl.RenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+    gl.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, msaa->renderbuffers[1]);
+    gl.BindRenderbuffer(GL_RENDERBUFFER, 0);
+    GLenum status = gl.CheckFramebufferStatus(GL_FRAMEBUFFER);
+    gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        TraceLog(LOG_WARNING, "MSAA: the multisampled framebuffer is incomplete (0x%X), rendering without MSAA", status);
+        msaa_destroy(msaa);
+        return NULL;
+    }
+
+    TraceLog(LOG_INFO, "MSAA: rendering with %zu samples", samples);
+    return msaa;
+}
+
+void msaa_destroy(Msaa *msaa)
+{
+    gl.DeleteFramebuffers(1, &msaa->fbo);
+    gl.DeleteRenderbuffers(2, msaa->renderbuffers);
+    free(msaa);
+}
+
+RenderTexture2D msaa_target(const Msaa *msaa)
+{
+    return CLITERAL(RenderTexture2D) {
+        .id = msaa->fbo,
+        .texture = {
+            .width = msaa->width,
+            .height = msaa->height,
+            .mipmaps = 1,
+            .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+        },
+    };
+}
+
+size_t msaa_samples(const Msaa *msaa)
+{
+    return msaa->samples;
+}
+
+void msaa_resolve(Msaa *msaa, unsigned int fbo)
+{
+    gl.BindFramebuffer(GL_READ_FRAMEBUFFER, msaa->fbo);
+    gl.BindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+    gl.BlitFramebuffer(0, 0, msaa->width, msaa->height, 0, 0, msaa->width, msaa->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+}
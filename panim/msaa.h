@@ -0,0 +1,23 @@
+#ifndef MSAA_H_
+#define MSAA_H_
+
+#include <stddef.h>
+
+#include <raylib.h>
+
+// Multisampled offscreen framebuffer. raylib's LoadRenderTexture() has no multisampling
+// (FLAG_MSAA_4X_HINT only applies to the window), so the animation is drawn into this one
+// instead and resolved into the render texture that is read back after every frame.
+
+typedef struct Msaa Msaa;
+
+// samples is clamped to what the GPU supports. Returns NULL if there is no multisampling at all.
+Msaa *msaa_create(size_t width, size_t height, size_t samples);
+void msaa_destroy(Msaa *msaa);
+// For BeginTextureMode(). Its texture only carries the size, it can not be sampled from.
+RenderTexture2D msaa_target(const Msaa *msaa);
+size_t msaa_samples(const Msaa *msaa);
+// Averages the samples into the framebuffer object fbo of the same size. Call after EndTextureMode().
+void msaa_resolve(Msaa *msaa, unsigned int fbo);
+
+#endif // MSAA_H_
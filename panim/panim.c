@@ -4,8 +4,10 @@
 
 #include <raylib.h>
 #include <raymath.h>
+#include <rlgl.h>
 #ifndef _WIN32
 #include <dlfcn.h>
+#include <signal.h>
 #else
 #include <minwindef.h>
 #define dlclose(dll) FreeLibrary(dll)
@@ -15,6 +17,21 @@
 #include "nob.h"
 #include "plug.h"
 #include "ffmpeg.h"
+#include "readback.h"
+#include "mixer.h"
+#include "damage.h"
+#include "frame_cache.h"
+#include "images.h"
+#include "scale.h"
+#include "gif.h"
+#include "msaa.h"
+#include "gpu_timer.h"
+#include "accum.h"
+#include "hash.h"
+#include "tiles.h"
+#include "frame_server.h"
+#include "checkpoint.h"
+#include "range.h"
 
 // #define FFMPEG_VIDEO_WIDTH 1600
 // #define FFMPEG_VIDEO_HEIGHT 900
@@ -29,6 +46,25 @@
 #define FFMPEG_SOUND_SAMPLE_SIZE_BYTES (FFMPEG_SOUND_SAMPLE_SIZE_BITS/8)
 // SPF - Samples Per Frame
 #define FFMPEG_SOUND_SPF (FFMPEG_SOUND_SAMPLE_RATE/FFMPEG_VIDEO_FPS)
+// Sample rate of the audio track muxed into the videos. ffmpeg_windows.c can not encode one,
+// so the videos rendered there are silent.
+#ifndef _WIN32
+#define FFMPEG_VIDEO_SAMPLE_RATE FFMPEG_SOUND_SAMPLE_RATE
+#else
+#define FFMPEG_VIDEO_SAMPLE_RATE 0
+#endif
+// Amount of frames read back from the GPU asynchronously while the next ones are drawn.
+// 0 makes the readback synchronous.
+#define READBACK_FRAMES 3
+// Default memory budget of the compressed preview frames
+#define PREVIEW_CACHE_MIB 256
+#define RENDITIONS_MAX 8
+#define SEGMENT_CACHE_FRAMES (5*FFMPEG_VIDEO_FPS)
+// Bump it when the way the segments are encoded changes, so the cached ones are not reused
+#define SEGMENT_CACHE_VERSION 1
+#define CHECKPOINT_SECONDS 10
+// Bump it when the segments could come out differently, so an old checkpoint is not resumed
+#define CHECKPOINT_VERSION 1
 #define RENDERING_FONT_SIZE 78
 #define POPUP_DISAPPER_TIME 1.5f
 
@@ -36,12 +72,169 @@
 static bool paused = false;
 static FFMPEG *ffmpeg_video = NULL;
 static FFMPEG *ffmpeg_audio = NULL;
+// Rendering into an image sequence instead of ffmpeg_video
+static Images *images_video = NULL;
+// Rendering into an animated GIF instead of ffmpeg_video
+static Gif *gif_video = NULL;
+// Size of the rendered frames, FFMPEG_VIDEO_WIDTH x FFMPEG_VIDEO_HEIGHT unless --size says otherwise
+static size_t video_width = FFMPEG_VIDEO_WIDTH;
+static size_t video_height = FFMPEG_VIDEO_HEIGHT;
 static RenderTexture2D screen = {0};
+// Multisampled framebuffer the rendered video is drawn into before it is resolved into screen, see --msaa
+static size_t msaa_samples_wanted = 0;
+static Msaa *msaa = NULL;
+static Gpu_Timer *gpu_timer = NULL;
+static Readback *readback = NULL;
 static Font rendering_font = {0};
 static void *libplug = NULL;
-static Wave ffmpeg_wave = {0};
-static size_t ffmpeg_wave_cursor = 0;
-static uint8_t silence[FFMPEG_SOUND_SPF*FFMPEG_SOUND_SAMPLE_SIZE_BYTES*FFMPEG_SOUND_CHANNELS] = {0};
+static Mixer mixer = {0};
+static int16_t mixed_samples[FFMPEG_SOUND_SPF*FFMPEG_SOUND_CHANNELS] = {0};
+
+typedef struct {
+    size_t frames;
+    // Frames that were identical to the previous one and were sent as repeats
+    size_t repeated_frames;
+    // Tiles that were read back out of all the tiles of all the frames
+    size_t read_tiles;
+    size_t total_tiles;
+    double start_time;
+    double readback_time;
+    double hash_time;
+    double scale_time;
+    double gpu_time;
+    double motion_blur_time;
+} Render_Stats;
+
+static Render_Stats render_stats = {0};
+
+// Damage reported by the plug for the frame that is being rendered
+static Damage frame_damage = {0};
+static bool frame_damage_reported = false;
+// The first frame of a rendering has to be read back whole, the persistent frame
+// of the readback still has the pixels of whatever was rendered before
+static bool frame_damage_reset = true;
+static uint64_t tile_hashes[DAMAGE_MAX_TILES] = {0};
+
+// Sub-frames averaged into every frame of the video, see --motion-blur
+static size_t motion_blur = 1;
+static uint16_t *motion_blur_sum = NULL;
+static void *motion_blur_pixels = NULL;
+// Sub-frames of the current frame that are in the sum
+static size_t motion_blur_count = 0;
+// The average can only differ from the previous one in the tiles that changed in the sub-frames of both
+static Damage motion_blur_damage = {0};
+static Damage motion_blur_previous_damage = {0};
+
+// With --tile (or a --size bigger than the GPU can render into) screen is a single tile, and
+// the frames are drawn and read back tile by tile and sent to the encoder in strips
+static size_t tile_size = 0;
+static Tiles *tiles = NULL;
+// Tiles that came out of the readback since the rendering started, which says which tile is next
+static size_t tiles_read = 0;
+
+// Downscaled copies of the video encoded next to it from the same rendered frames
+typedef struct {
+    size_t width;
+    size_t height;
+    const char *output_path;
+    Scaler *scaler;
+    FFMPEG *ffmpeg;
+    void *pixels;
+} Rendition;
+
+static Rendition renditions[RENDITIONS_MAX] = {0};
+static size_t renditions_count = 0;
+static Scale_Filter renditions_filter = SCALE_FILTER_LANCZOS3;
+
+// Frames of the animation rendered by --render
+static size_t segment_begin = 0;
+static size_t segment_end = SIZE_MAX;
+
+typedef struct {
+    uint64_t *items;
+    size_t count;
+    size_t capacity;
+} Frame_Hashes;
+
+// --segment-cache keeps the encoded segments of the video in a directory, named by the hash of
+// what is in them, and only renders the segments that are not there yet
+static const char *segment_cache_dir = NULL;
+// Where send_video_frame() puts the hashes of the frames instead of encoding them, see fingerprint_video()
+static Frame_Hashes *fingerprint_hashes = NULL;
+
+// --checkpoint renders the video in segments of checkpoint_frames frames and keeps track of the
+// complete ones, so --resume can continue an interrupted render from the last of them
+static size_t checkpoint_frames = 0;
+static bool checkpoint_resume = false;
+
+// Frames shown by the preview, kept compressed for replaying and scrubbing without calling into the plug
+static size_t preview_cache_budget = (size_t)PREVIEW_CACHE_MIB*1024*1024;
+static Frame_Cache *preview_cache = NULL;
+static void *preview_pixels = NULL;
+static Texture2D preview_texture = {0};
+// Frames the plug has advanced through since the last reset
+static size_t preview_live = 0;
+// Next frame to show. The plug is only called again once it catches up with preview_live.
+static size_t preview_cursor = 0;
+
+// Recording of what the preview window shows, toggled with C. The window does not keep exactly
+// FFMPEG_VIDEO_FPS, so its frames are repeated or dropped to keep the video in step with the clock.
+static FFMPEG *recording = NULL;
+static size_t recording_width = 0;
+static size_t recording_height = 0;
+static double recording_start_time = 0.0;
+// Frames of the video that are sent or in flight
+static size_t recording_frames = 0;
+// The window cut to the even size of the video, if it is odd wide
+static void *recording_pixels = NULL;
+
+// --frame-server publishes the rendered frames, or the frames the preview window shows, to other processes
+static const char *frame_server_path = NULL;
+static Frame_Server *frame_server = NULL;
+
+// The window is read back once per frame for the preview cache, the recording and the frame server together
+typedef struct {
+    // Frame of the preview cache, or SIZE_MAX if it does not keep this one
+    size_t preview_index;
+    // How many frames of the recording it stands for, 0 if none
+    size_t recording_copies;
+    bool serve;
+} Window_Capture;
+static Readback *window_readback = NULL;
+static size_t window_width = 0;
+static size_t window_height = 0;
+// The readbacks in flight, oldest first
+static Window_Capture window_pending[READBACK_FRAMES + 1] = {0};
+static size_t window_pending_count = 0;
+
+// Everything parse_render_flag() sets. Every job of --batch starts from the flags of the batch itself.
+typedef struct {
+    FFMPEG_Config ffmpeg_config;
+    size_t video_width;
+    size_t video_height;
+    size_t msaa_samples_wanted;
+    size_t motion_blur;
+    size_t tile_size;
+    size_t segment_begin;
+    size_t segment_end;
+    Rendition renditions[RENDITIONS_MAX];
+    size_t renditions_count;
+    Scale_Filter renditions_filter;
+} Render_Settings;
+
+// A job of --batch, the words of its line in the manifest: <library> <output> [flags]
+typedef struct {
+    const char **items;
+    size_t count;
+    size_t capacity;
+    size_t line;
+} Batch_Job;
+
+typedef struct {
+    Batch_Job *items;
+    size_t count;
+    size_t capacity;
+} Batch_Jobs;
 
 static float delta_time_multiplier = 1.0f;
 static float delta_time_multiplier_popup = 0.0f;
@@ -49,6 +242,7 @@ static float delta_time_multiplier_popup = 0.0f;
 #define PLUG(name, ret, ...) static ret (*name)(__VA_ARGS__);
 LIST_OF_PLUGS
 #undef PLUG
+static void (*plug_unload)(void *state) = NULL;
 
 static bool reload_libplug(const char *libplug_path)
 {
@@ -82,17 +276,1120 @@ static bool reload_libplug(const char *libplug_path)
 #endif
     LIST_OF_PLUGS
     #undef PLUG
+#ifndef _WIN32
+    plug_unload = dlsym(libplug, "plug_unload");
+#else
+    plug_unload = (void(*)(void*))GetProcAddress(libplug, "plug_unload");
+#endif
+
+    return true;
+}
+
+void dummy_play_sound(Sound _sound, Wave _wave)
+{
+    (void)_sound;
+    (void)_wave;
+}
+
+void dummy_report_damage(Rectangle _rect)
+{
+    (void)_rect;
+}
+
+void render_report_damage(Rectangle rect)
+{
+    frame_damage_reported = true;
+    damage_add_rect(&frame_damage, rect);
+}
+
+static void start_render_stats(void)
+{
+    memset(&render_stats, 0, sizeof(render_stats));
+    render_stats.start_time = GetTime();
+    if (gpu_timer != NULL) gpu_timer_reset(gpu_timer);
+}
+
+static void log_render_stats(void)
+{
+    size_t frames = render_stats.frames;
+    double total_time = GetTime() - render_stats.start_time;
+    if (frames == 0) return;
+    TraceLog(LOG_INFO, "RENDER: %zu frames in %.2fs (%.2f ms/frame)", frames, total_time, total_time*1000.0/frames);
+    TraceLog(LOG_INFO, "RENDER: %s readback: %.2f ms/frame",
+             readback_is_async(readback) ? "asynchronous" : "synchronous",
+             render_stats.readback_time*1000.0/frames);
+    TraceLog(LOG_INFO, "RENDER: %zu static frames elided (%.1f%%), hashing: %.2f ms/frame",
+             render_stats.repeated_frames, render_stats.repeated_frames*100.0/frames,
+             render_stats.hash_time*1000.0/frames);
+    TraceLog(LOG_INFO, "RENDER: %.1f%% of the screen was damaged and read back",
+             render_stats.total_tiles > 0 ? render_stats.read_tiles*100.0/render_stats.total_tiles : 100.0);
+    if (gpu_timer != NULL) {
+        // Compare with rendering at a multiple of the size and scaling it down with --rendition to see what MSAA saves
+        render_stats.gpu_time = gpu_timer_total(gpu_timer);
+        TraceLog(LOG_INFO, "RENDER: GPU drawing at %zux%zu%s: %.2f ms/frame", video_width, video_height,
+                 msaa != NULL ? TextFormat(" with %zux MSAA", msaa_samples(msaa)) : "",
+                 render_stats.gpu_time*1000.0/frames);
+    }
+    if (tiles != NULL) {
+        TraceLog(LOG_INFO, "RENDER: %zu tiles of %zux%zu per frame, streamed in strips of %zu rows",
+                 tiles_count(tiles), tile_size, tile_size, tile_size);
+    }
+    if (motion_blur > 1) {
+        TraceLog(LOG_INFO, "RENDER: motion blur of %zu sub-frames, accumulating with the %s kernel: %.2f ms/frame",
+                 motion_blur, accum_kernel_name(accum_best_kernel()), render_stats.motion_blur_time*1000.0/frames);
+    }
+    if (renditions_count > 0) {
+        TraceLog(LOG_INFO, "RENDER: %zu renditions, %s scaling with the %s kernel: %.2f ms/frame",
+                 renditions_count, scale_filter_name(renditions_filter), scale_kernel_name(scale_best_kernel()),
+                 render_stats.scale_time*1000.0/frames);
+    }
+}
+
+// Scales the bottom-up pixels of a changed frame down for every rendition and sends them
+static bool send_renditions_frame(const void *pixels)
+{
+    double start = GetTime();
+    for (size_t i = 0; i < renditions_count; ++i) {
+        Rendition *r = &renditions[i];
+        scaler_run(r->scaler, r->pixels, pixels);
+        if (!ffmpeg_send_frame_flipped(r->ffmpeg, r->pixels, r->width, r->height)) return false;
+    }
+    render_stats.scale_time += GetTime() - start;
+    return true;
+}
+
+static bool start_renditions(void)
+{
+    for (size_t i = 0; i < renditions_count; ++i) {
+        Rendition *r = &renditions[i];
+        r->ffmpeg = ffmpeg_start_rendering_video(r->output_path,
+                                                 r->width, r->height, FFMPEG_VIDEO_FPS,
+                                                 FFMPEG_VIDEO_SAMPLE_RATE, FFMPEG_SOUND_CHANNELS);
+        if (r->ffmpeg == NULL) {
+            for (size_t j = 0; j < i; ++j) {
+                ffmpeg_end_rendering(renditions[j].ffmpeg, true);
+                renditions[j].ffmpeg = NULL;
+            }
+            return false;
+        }
+        if (r->scaler == NULL) {
+            r->scaler = scaler_create(video_width, video_height, r->width, r->height, renditions_filter);
+            r->pixels = malloc(r->width*r->height*4);
+            assert(r->pixels != NULL && "Buy MORE RAM lol!!");
+        }
+    }
+    return true;
+}
+
+static void destroy_renditions(void)
+{
+    for (size_t i = 0; i < renditions_count; ++i) {
+        if (renditions[i].scaler != NULL) scaler_destroy(renditions[i].scaler);
+        free(renditions[i].pixels);
+        renditions[i].scaler = NULL;
+        renditions[i].pixels = NULL;
+    }
+}
+
+static bool finish_renditions(bool cancel)
+{
+    bool ok = true;
+    for (size_t i = 0; i < renditions_count; ++i) {
+        if (!ffmpeg_end_rendering(renditions[i].ffmpeg, cancel)) ok = false;
+        renditions[i].ffmpeg = NULL;
+    }
+    return ok;
+}
+
+// Only the dirty tiles of damage can differ from the previous frame
+static bool send_video_frame(void *pixels, const Damage *damage)
+{
+    render_stats.read_tiles += damage->dirty_count;
+    render_stats.total_tiles += damage->cols*damage->rows;
+
+    double start = GetTime();
+    Damage changed;
+    damage_hash_tiles(damage, pixels, tile_hashes, &changed);
+    if (fingerprint_hashes != NULL) {
+        // The hashes of the tiles that did not change are still those of the previous frames
+        nob_da_append(fingerprint_hashes, hash_frame(tile_hashes, damage->cols*damage->rows*sizeof(*tile_hashes)));
+    }
+    render_stats.hash_time += GetTime() - start;
+    if (fingerprint_hashes != NULL) {
+        render_stats.frames += 1;
+        return true;
+    }
+
+    // Repeated frames too, the readers get every frame of the video
+    if (frame_server != NULL) frame_server_publish(frame_server, pixels, video_width, video_height);
+
+    bool first = render_stats.frames == 0;
+    render_stats.frames += 1;
+    if (!first && changed.dirty_count == 0) {
+        render_stats.repeated_frames += 1;
+        for (size_t i = 0; i < renditions_count; ++i) {
+            if (!ffmpeg_send_repeated_frame(renditions[i].ffmpeg)) return false;
+        }
+        if (images_video) return images_send_repeated_frame(images_video);
+        if (gif_video) return gif_send_repeated_frame(gif_video);
+        return ffmpeg_send_repeated_frame(ffmpeg_video);
+    }
+    // Before the image encoders take the pixels away
+    if (!send_renditions_frame(pixels)) return false;
+    if (images_video) {
+        // The encoders take the persistent buffer of the readback over, and it continues with another one
+        void *next = images_send_frame_flipped(images_video, pixels);
+        if (next == NULL) return false;
+        if (pixels == motion_blur_pixels) {
+            motion_blur_pixels = next;
+        } else {
+            readback_set_pixels(readback, next);
+        }
+        return true;
+    }
+    if (gif_video) return gif_send_frame_flipped(gif_video, pixels);
+    if (first) return ffmpeg_send_frame_flipped(ffmpeg_video, pixels, video_width, video_height);
+    return ffmpeg_send_frame_flipped_damage(ffmpeg_video, pixels, video_width, video_height, &changed);
+}
+
+// Adds a sub-frame that was read back to the motion blur, and sends the average once all the
+// sub-frames of the frame are in. Without motion blur every sub-frame is a frame.
+static bool send_video_subframe(void *pixels)
+{
+    if (pixels == NULL) return true;
+    if (motion_blur == 1) return send_video_frame(pixels, readback_damage(readback));
+
+    double start = GetTime();
+    size_t size = video_width*video_height*4;
+    const Damage *damage = readback_damage(readback);
+    if (motion_blur_count == 0) {
+        motion_blur_damage = *damage;
+    } else {
+        damage_merge(&motion_blur_damage, damage);
+    }
+    accum_add(motion_blur_sum, pixels, size, motion_blur_count == 0);
+    motion_blur_count += 1;
+    if (motion_blur_count < motion_blur) {
+        render_stats.motion_blur_time += GetTime() - start;
+        return true;
+    }
+
+    accum_resolve(motion_blur_pixels, motion_blur_sum, size, motion_blur);
+    motion_blur_count = 0;
+    Damage changed = motion_blur_damage;
+    damage_merge(&changed, &motion_blur_previous_damage);
+    motion_blur_previous_damage = motion_blur_damage;
+    render_stats.motion_blur_time += GetTime() - start;
+    return send_video_frame(motion_blur_pixels, &changed);
+}
+
+// Stitches a tile that was read back into its strip, and sends the strip once it is complete.
+// The tiles come out of the readback in the order they were drawn in.
+static bool send_video_tile(void *pixels)
+{
+    if (pixels == NULL) return true;
+    size_t rows = 0;
+    const void *strip = tiles_stitch(tiles, tiles_read%tiles_count(tiles), pixels, &rows);
+    tiles_read += 1;
+    if (strip == NULL) return true;
+    if (images_video) return images_send_rows(images_video, strip, rows);
+    return ffmpeg_send_rows(ffmpeg_video, strip, video_width, rows);
+}
+
+// Sends the frames that are still being read back and closes the outputs
+static bool finish_video_output(bool cancel)
+{
+    SetTraceLogLevel(LOG_INFO);
+    if (cancel) {
+        readback_discard(readback);
+    } else {
+        for (;;) {
+            double start = GetTime();
+            void *pixels = readback_pop(readback);
+            render_stats.readback_time += GetTime() - start;
+            if (pixels == NULL) break;
+            if (!(tiles != NULL ? send_video_tile(pixels) : send_video_subframe(pixels))) {
+                readback_discard(readback);
+                cancel = true;
+                break;
+            }
+        }
+    }
+    if (!cancel) log_render_stats();
+    bool ok = images_video ? images_end(images_video, cancel)
+            : gif_video    ? gif_end(gif_video, cancel)
+            : ffmpeg_end_rendering(ffmpeg_video, cancel) && !cancel;
+    if (!finish_renditions(cancel)) ok = false;
+    ffmpeg_video = NULL;
+    images_video = NULL;
+    gif_video = NULL;
+    return ok;
+}
+
+static bool finish_ffmpeg_video_rendering(bool cancel)
+{
+    bool ok = finish_video_output(cancel);
+    plug_reset();
+    paused = true;
+    return ok;
+}
+
+void ffmpeg_play_sound(Sound _sound, Wave wave)
+{
+    (void)_sound;
+
+    if (
+        wave.sampleRate != FFMPEG_SOUND_SAMPLE_RATE      ||
+        wave.sampleSize != FFMPEG_SOUND_SAMPLE_SIZE_BITS ||
+        wave.channels   != FFMPEG_SOUND_CHANNELS
+    ) {
+        TraceLog(LOG_ERROR,
+                 "Animation tried to play sound with rate: %dhz, sample size: %d bits, channels: %d. "
+                 "But we only support rate: %dhz, sample size: %d bits, channels: %d for now",
+                 wave.sampleRate, wave.sampleSize, wave.channels,
+                 FFMPEG_SOUND_SAMPLE_RATE, FFMPEG_SOUND_SAMPLE_SIZE_BITS, FFMPEG_SOUND_CHANNELS);
+        return;
+    }
+
+    mixer_play(&mixer, wave.data, wave.frameCount*wave.channels, 1.0f);
+}
+
+// Sends the last mix into the audio track of a video, if it has one
+static bool send_mixed_samples(FFMPEG *ffmpeg)
+{
+    if (ffmpeg == NULL || FFMPEG_VIDEO_SAMPLE_RATE == 0) return true;
+    return ffmpeg_send_sound_samples(ffmpeg, mixed_samples, sizeof(mixed_samples));
+}
+
+// Sends the mix of all the sounds that are playing during one video frame.
+// With ffmpeg == NULL only advances the sounds.
+static bool send_audio_frame(FFMPEG *ffmpeg)
+{
+    mixer_mix(&mixer, mixed_samples, FFMPEG_SOUND_SPF*FFMPEG_SOUND_CHANNELS);
+    return send_mixed_samples(ffmpeg);
+}
+
+// Forgets everything about the previous frames, so the next one is sent whole
+static void reset_video_output(void)
+{
+    start_render_stats();
+    tiles_read = 0;
+    frame_damage_reset = true;
+    motion_blur_count = 0;
+    damage_init(&motion_blur_previous_damage, video_width, video_height);
+}
+
+// Opens the outputs the frames go to, without touching the animation
+static bool start_video_output(const char *output_path)
+{
+    SetTraceLogLevel(LOG_WARNING);
+    if (tiles != NULL) {
+        // Whole frames are never in memory, so they go wherever strips can go
+        if (images_format_from_path(output_path) != IMAGES_FORMAT_NONE) {
+            images_video = images_start_rows(output_path, video_width, video_height, segment_begin);
+        } else if (gif_is_path(output_path)) {
+            TraceLog(LOG_ERROR, "RENDER: GIFs can not be rendered in tiles");
+        } else {
+            ffmpeg_video = ffmpeg_start_rendering_video_rows(output_path,
+                                                             video_width, video_height, FFMPEG_VIDEO_FPS,
+                                                             FFMPEG_VIDEO_SAMPLE_RATE, FFMPEG_SOUND_CHANNELS);
+        }
+    } else if (images_format_from_path(output_path) != IMAGES_FORMAT_NONE) {
+        // The frames are numbered from the start of the animation, so the segments of --jobs fill in the same sequence
+        images_video = images_start(output_path, video_width, video_height, segment_begin);
+        if (images_video == NULL) {
+            SetTraceLogLevel(LOG_INFO);
+            return false;
+        }
+    } else if (gif_is_path(output_path)) {
+        gif_video = gif_start(output_path, video_width, video_height, FFMPEG_VIDEO_FPS);
+    } else {
+        ffmpeg_video = ffmpeg_start_rendering_video(output_path,
+                                                    video_width, video_height, FFMPEG_VIDEO_FPS,
+                                                    FFMPEG_VIDEO_SAMPLE_RATE, FFMPEG_SOUND_CHANNELS);
+    }
+    if (ffmpeg_video == NULL && images_video == NULL && gif_video == NULL) {
+        SetTraceLogLevel(LOG_INFO);
+        return false;
+    }
+    if (!start_renditions()) {
+        if (images_video) images_end(images_video, true);
+        if (gif_video) gif_end(gif_video, true);
+        if (ffmpeg_video) ffmpeg_end_rendering(ffmpeg_video, true);
+        ffmpeg_video = NULL;
+        images_video = NULL;
+        gif_video = NULL;
+        SetTraceLogLevel(LOG_INFO);
+        return false;
+    }
+    reset_video_output();
+    return true;
+}
+
+static bool start_ffmpeg_video_rendering(const char *output_path)
+{
+    if (!start_video_output(output_path)) return false;
+    mixer_clear(&mixer);
+    plug_reset();
+    return true;
+}
+
+// Renders the next frame of the animation tile by tile. Every tile draws the whole frame with the
+// projection shifted so that only the tile lands in the texture, and the GPU clips away the rest.
+// Only the first tile advances the animation, the others draw the same moment again like a paused
+// preview does. Plugs that set up their own projection (BeginMode3D()) are not supported.
+static bool render_tiled_frame(void)
+{
+    for (size_t i = 0; i < tiles_count(tiles); ++i) {
+        size_t x, y;
+        tiles_origin(tiles, i, &x, &y);
+
+        if (gpu_timer != NULL) gpu_timer_begin(gpu_timer);
+        BeginTextureMode(msaa != NULL ? msaa_target(msaa) : screen);
+        rlMatrixMode(RL_PROJECTION);
+        rlLoadIdentity();
+        rlOrtho(x, x + tile_size, y + tile_size, y, 0.0, 1.0);
+        rlMatrixMode(RL_MODELVIEW);
+        rlLoadIdentity();
+        plug_update(CLITERAL(Env) {
+            .screen_width = video_width,
+            .screen_height = video_height,
+            .delta_time = i == 0 ? FFMPEG_VIDEO_DELTA_TIME : 0.0f,
+            .rendering = true,
+            .play_sound = i == 0 ? ffmpeg_play_sound : dummy_play_sound,
+            .report_damage = dummy_report_damage,
+        });
+        EndTextureMode();
+        if (msaa != NULL) msaa_resolve(msaa, screen.id);
+        if (gpu_timer != NULL) gpu_timer_end(gpu_timer);
+
+        double start = GetTime();
+        void *pixels = readback_push(readback, screen.id);
+        render_stats.readback_time += GetTime() - start;
+        if (!send_video_tile(pixels)) return false;
+    }
+    render_stats.frames += 1;
+
+    return send_audio_frame(ffmpeg_video);
+}
+
+// Renders the next frame of the animation into the video together with its sound.
+// With motion blur the frame is drawn as motion_blur sub-frames spread over its duration. Their
+// readbacks are in flight while the next ones are drawn, and they are summed up as they arrive.
+static bool render_video_frame(void)
+{
+    if (tiles != NULL) return render_tiled_frame();
+    for (size_t i = 0; i < motion_blur; ++i) {
+        damage_clear(&frame_damage);
+        frame_damage_reported = false;
+
+        if (gpu_timer != NULL) gpu_timer_begin(gpu_timer);
+        BeginTextureMode(msaa != NULL ? msaa_target(msaa) : screen);
+        plug_update(CLITERAL(Env) {
+            .screen_width = video_width,
+            .screen_height = video_height,
+            .delta_time = FFMPEG_VIDEO_DELTA_TIME/motion_blur,
+            .rendering = true,
+            .play_sound = ffmpeg_play_sound,
+            .report_damage = render_report_damage,
+        });
+        EndTextureMode();
+        if (msaa != NULL) msaa_resolve(msaa, screen.id);
+        if (gpu_timer != NULL) gpu_timer_end(gpu_timer);
+
+        // The buffers handed back by the image encoders do not have the previous frame in them.
+        // With motion blur they replace the buffer of the average, and the readback keeps its own.
+        if (!frame_damage_reported || frame_damage_reset || (images_video && motion_blur == 1)) damage_fill(&frame_damage);
+        frame_damage_reset = false;
+
+        double start = GetTime();
+        void *pixels = readback_push_damage(readback, screen.id, &frame_damage);
+        render_stats.readback_time += GetTime() - start;
+        if (!send_video_subframe(pixels)) return false;
+    }
+
+    if (!send_audio_frame(ffmpeg_video)) return false;
+    for (size_t i = 0; i < renditions_count; ++i) {
+        if (!send_mixed_samples(renditions[i].ffmpeg)) return false;
+    }
+    return true;
+}
+
+// Advances the animation and its sound by one frame without reading it back or encoding it.
+// The zero sized scissor lets the GPU throw the draw calls away.
+static void skip_video_frame(void)
+{
+    BeginTextureMode(screen);
+    BeginScissorMode(0, 0, 0, 0);
+    // In the same steps as render_video_frame(), so the animation ends up in exactly the same state
+    for (size_t i = 0; i < motion_blur; ++i) {
+        plug_update(CLITERAL(Env) {
+            .screen_width = video_width,
+            .screen_height = video_height,
+            .delta_time = FFMPEG_VIDEO_DELTA_TIME/motion_blur,
+            .rendering = true,
+            .play_sound = ffmpeg_play_sound,
+            .report_damage = dummy_report_damage,
+        });
+    }
+    EndScissorMode();
+    EndTextureMode();
+    send_audio_frame(NULL);
+}
+
+// Renders the frames [segment_begin, segment_end) of the animation offscreen as fast as possible,
+// without drawing anything into the window
+static int render_headless(const char *output_path)
+{
+    if (!start_ffmpeg_video_rendering(output_path)) return 1;
+    double start = GetTime();
+    size_t frame = 0;
+    for (; frame < segment_begin && !plug_finished(); ++frame) skip_video_frame();
+    if (frame > 0) TraceLog(LOG_INFO, "RENDER: skipped %zu frames in %.2fs", frame, GetTime() - start);
+    for (; frame < segment_end && !plug_finished(); ++frame) {
+        if (!render_video_frame()) {
+            finish_ffmpeg_video_rendering(true);
+            return 1;
+        }
+    }
+    return finish_ffmpeg_video_rendering(false) ? 0 : 1;
+}
+
+// Up to segment_end, there is no need to run the animation any further
+static size_t count_video_frames(void)
+{
+    plug_reset();
+    size_t count = 0;
+    while (!plug_finished() && count < segment_end) {
+        skip_video_frame();
+        count += 1;
+    }
+    plug_reset();
+    return count;
+}
+
+// The extension of path with its dot, or "" at the end of path when it does not have one
+static const char *path_ext(const char *path)
+{
+    const char *ext = strrchr(path, '.');
+    if (ext == NULL || strchr(ext, '/') != NULL) ext = path + strlen(path);
+    return ext;
+}
+
+static const char *segment_path(const char *output_path, size_t index)
+{
+    const char *ext = path_ext(output_path);
+    return nob_temp_sprintf("%.*s.part%zu%s", (int)(ext - output_path), output_path, index, ext);
+}
+
+// .wav next to a .y4m, see ffmpeg_start_rendering_video()
+static const char *y4m_audio_path(const char *y4m_path)
+{
+    int size = ffmpeg_y4m_audio_path(NULL, 0, y4m_path) + 1;
+    char *path = nob_temp_alloc(size);
+    ffmpeg_y4m_audio_path(path, size, y4m_path);
+    return path;
+}
+
+// Joins the files of the list without re-encoding them
+static bool concat_segments(Nob_Cmd *cmd, const char *list_path, Nob_String_Builder list, const char *output_path)
+{
+    if (!nob_write_entire_file(list_path, list.items, list.count)) return false;
+
+    cmd->count = 0;
+    nob_cmd_append(cmd, "ffmpeg", "-loglevel", "error", "-y");
+    nob_cmd_append(cmd, "-f", "concat", "-safe", "0", "-i", list_path);
+    nob_cmd_append(cmd, "-c", "copy", output_path);
+    if (!nob_cmd_run_sync(*cmd)) return false;
+
+    remove(list_path);
+    return true;
+}
+
+// Joins the segments of output_path rendered by render_parallel() and removes them
+static bool concat_output_segments(Nob_Cmd *cmd, const char *output_path, size_t jobs_count)
+{
+    // The audio of .y4m segments is in separate files that have to be joined as well
+    bool y4m = ffmpeg_is_y4m_path(output_path);
+
+    Nob_String_Builder list = {0};
+    Nob_String_Builder audio_list = {0};
+    for (size_t i = 0; i < jobs_count; ++i) {
+        const char *path = segment_path(output_path, i);
+        nob_sb_append_cstr(&list, nob_temp_sprintf("file '%s'\n", path));
+        if (y4m) nob_sb_append_cstr(&audio_list, nob_temp_sprintf("file '%s'\n", y4m_audio_path(path)));
+    }
+
+    bool ok = concat_segments(cmd, nob_temp_sprintf("%s.segments.txt", output_path), list, output_path);
+    if (ok && y4m) ok = concat_segments(cmd, nob_temp_sprintf("%s.audio-segments.txt", output_path), audio_list, y4m_audio_path(output_path));
+    if (ok) {
+        for (size_t i = 0; i < jobs_count; ++i) {
+            remove(segment_path(output_path, i));
+            if (y4m) remove(y4m_audio_path(segment_path(output_path, i)));
+        }
+    }
+
+    nob_sb_free(list);
+    nob_sb_free(audio_list);
+    return ok;
+}
+
+// Draws the whole animation and hashes every frame and its sound, without encoding anything.
+// Drawing and reading back the frames is a small part of what encoding them costs.
+static void fingerprint_video(Frame_Hashes *video, Frame_Hashes *audio)
+{
+    reset_video_output();
+    mixer_clear(&mixer);
+    plug_reset();
+    fingerprint_hashes = video;
+    while (!plug_finished()) {
+        render_video_frame();
+        nob_da_append(audio, hash_frame(mixed_samples, sizeof(mixed_samples)));
+    }
+    for (void *pixels; (pixels = readback_pop(readback)) != NULL;) send_video_subframe(pixels);
+    fingerprint_hashes = NULL;
+    plug_reset();
+}
+
+// Every setting that changes how the frames are encoded into a file with the extension ext
+static const char *encoding_settings(const char *ext)
+{
+    return nob_temp_sprintf("%zux%zu@%d %s %s", video_width, video_height, FFMPEG_VIDEO_FPS,
+                            ffmpeg_config.codec == FFMPEG_CODEC_FFV1 ? "ffv1" : "h264", ext);
+}
+
+// The frames and the sound of the segment, and every setting that changes how they are encoded
+static uint64_t segment_cache_key(const Frame_Hashes *video, const Frame_Hashes *audio, size_t begin, size_t end, const char *ext)
+{
+    Nob_String_Builder sb = {0};
+    nob_sb_append_cstr(&sb, nob_temp_sprintf("panim segment v%d %s\n", SEGMENT_CACHE_VERSION, encoding_settings(ext)));
+    nob_sb_append_buf(&sb, video->items + begin, (end - begin)*sizeof(*video->items));
+    nob_sb_append_buf(&sb, audio->items + begin, (end - begin)*sizeof(*audio->items));
+    uint64_t key = hash_frame(sb.items, sb.count);
+    nob_sb_free(sb);
+    return key;
+}
+
+static const char *segment_cache_name(uint64_t key, const char *ext)
+{
+    return nob_temp_sprintf("%016llx%s", (unsigned long long)key, ext);
+}
+
+// Renders the video in segments of SEGMENT_CACHE_FRAMES frames that are kept in segment_cache_dir.
+// A segment is named by the hash of its frames and its sound, so after a change only the segments
+// that actually look or sound different are encoded again, and the rest is joined from the cache.
+// The frames before a segment that has to be rendered are skipped without drawing them.
+static int render_cached(const char *output_path)
+{
+    if (tiles != NULL) {
+        // The tiles are never hashed
+        TraceLog(LOG_ERROR, "RENDER: --segment-cache does not work with tiles");
+        return 1;
+    }
+    const char *ext = path_ext(output_path);
+    if (*ext == '\0') {
+        // ffmpeg picks the container of the segments by their extension
+        TraceLog(LOG_ERROR, "RENDER: --segment-cache needs an extension on %s", output_path);
+        return 1;
+    }
+    if (!nob_mkdir_if_not_exists(segment_cache_dir)) return 1;
+
+    double start = GetTime();
+    Frame_Hashes video = {0};
+    Frame_Hashes audio = {0};
+    fingerprint_video(&video, &audio);
+    double fingerprint_time = GetTime() - start;
+
+    size_t frames_count = video.count;
+    size_t segments_count = (frames_count + SEGMENT_CACHE_FRAMES - 1)/SEGMENT_CACHE_FRAMES;
+    uint64_t *keys = malloc(segments_count*sizeof(*keys));
+    bool *cached = malloc(segments_count*sizeof(*cached));
+    assert((segments_count == 0 || (keys != NULL && cached != NULL)) && "Buy MORE RAM lol!!");
+    size_t missing = 0;
+    size_t last_missing = 0;
+    for (size_t i = 0; i < segments_count; ++i) {
+        size_t end = (i + 1)*SEGMENT_CACHE_FRAMES < frames_count ? (i + 1)*SEGMENT_CACHE_FRAMES : frames_count;
+        keys[i] = segment_cache_key(&video, &audio, i*SEGMENT_CACHE_FRAMES, end, ext);
+        cached[i] = nob_file_exists(nob_temp_sprintf("%s/%s", segment_cache_dir, segment_cache_name(keys[i], ext))) == 1;
+        if (!cached[i]) {
+            missing += 1;
+            last_missing = i;
+        }
+    }
+    TraceLog(LOG_INFO, "RENDER: %zu frames fingerprinted in %.2fs, %zu of %zu segments have to be rendered",
+             frames_count, fingerprint_time, missing, segments_count);
+
+    int status = 0;
+    if (missing > 0) {
+        mixer_clear(&mixer);
+        plug_reset();
+        size_t frame = 0;
+        for (size_t i = 0; i <= last_missing && status == 0; ++i) {
+            size_t end = (i + 1)*SEGMENT_CACHE_FRAMES < frames_count ? (i + 1)*SEGMENT_CACHE_FRAMES : frames_count;
+            if (cached[i]) {
+                for (; frame < end; ++frame) skip_video_frame();
+                continue;
+            }
+
+            // Renamed once it is complete, so an interrupted render never leaves a broken segment behind
+            const char *path = nob_temp_sprintf("%s/%s", segment_cache_dir, segment_cache_name(keys[i], ext));
+            const char *temp_path = nob_temp_sprintf("%s/%016llx.tmp%s", segment_cache_dir, (unsigned long long)keys[i], ext);
+            if (!start_video_output(temp_path)) {
+                status = 1;
+                break;
+            }
+            for (; frame < end && status == 0; ++frame) {
+                if (!render_video_frame()) status = 1;
+            }
+            if (!finish_video_output(status != 0)) status = 1;
+            if (status == 0 && !nob_rename(temp_path, path)) status = 1;
+            if (status != 0) remove(temp_path);
+        }
+        plug_reset();
+    }
+
+    if (status == 0 && segments_count > 0) {
+        // The list is next to the segments, because the paths in it are relative to it
+        Nob_String_Builder list = {0};
+        for (size_t i = 0; i < segments_count; ++i) {
+            nob_sb_append_cstr(&list, nob_temp_sprintf("file '%s'\n", segment_cache_name(keys[i], ext)));
+        }
+        Nob_Cmd cmd = {0};
+        if (!concat_segments(&cmd, nob_temp_sprintf("%s/segments.txt", segment_cache_dir), list, output_path)) status = 1;
+        nob_cmd_free(cmd);
+        nob_sb_free(list);
+    }
+    if (status == 0) {
+        double total_time = GetTime() - start;
+        TraceLog(LOG_INFO, "RENDER: %zu frames in %.2fs, %zu segments rendered and %zu reused from %s",
+                 frames_count, total_time, missing, segments_count - missing, segment_cache_dir);
+    }
+
+    free(keys);
+    free(cached);
+    nob_da_free(video);
+    nob_da_free(audio);
+    return status;
+}
+
+// The animation library by its path and the hash of its content, so a plug that was rebuilt in
+// the meantime does not continue the frames of the old one
+static const char *plug_identity(const char *libplug_path)
+{
+    Nob_String_Builder sb = {0};
+    uint64_t hash = nob_read_entire_file(libplug_path, &sb) ? hash_frame(sb.items, sb.count) : 0;
+    nob_sb_free(sb);
+    return nob_temp_sprintf("%s@%016llx", libplug_path, (unsigned long long)hash);
+}
+
+// Everything that changes the frames of the render, so a checkpoint is never resumed with different ones
+static const char *checkpoint_settings(const char *libplug_path, const char *ext)
+{
+    return nob_temp_sprintf("panim checkpoint v%d %s %s msaa=%zu motion-blur=%zu tile=%zu segment=%zu:%zu",
+                            CHECKPOINT_VERSION, plug_identity(libplug_path), encoding_settings(ext),
+                            msaa_samples_wanted, motion_blur, tile_size, segment_begin, segment_end);
+}
+
+static bool checkpoint_finished(void *ctx)
+{
+    (void) ctx;
+    return plug_finished();
+}
+
+static void checkpoint_skip_frame(void *ctx)
+{
+    (void) ctx;
+    skip_video_frame();
+}
+
+static bool checkpoint_start_segment(void *ctx, const char *path)
+{
+    (void) ctx;
+    return start_video_output(path);
+}
+
+static bool checkpoint_render_frame(void *ctx)
+{
+    (void) ctx;
+    return render_video_frame();
+}
+
+static bool checkpoint_finish_segment(void *ctx, bool cancel)
+{
+    (void) ctx;
+    return finish_video_output(cancel);
+}
+
+// Renders the video in segments of checkpoint_frames frames that survive an interrupted render,
+// which is continued with --resume. See checkpoint.h.
+static int render_checkpointed(const char *libplug_path, const char *output_path)
+{
+    const char *ext = path_ext(output_path);
+    if (*ext == '\0') {
+        // ffmpeg picks the container of the segments by their extension
+        TraceLog(LOG_ERROR, "RENDER: --checkpoint needs an extension on %s", output_path);
+        return 1;
+    }
+    Checkpoint cp = {
+        .dir = checkpoint_dir(output_path),
+        .settings = checkpoint_settings(libplug_path, ext),
+        .ext = ext,
+        .segment_frames = checkpoint_frames,
+    };
+    if (!checkpoint_start(&cp, checkpoint_resume)) return 1;
+
+    static const Checkpoint_Renderer renderer = {
+        .finished = checkpoint_finished,
+        .skip_frame = checkpoint_skip_frame,
+        .start_segment = checkpoint_start_segment,
+        .render_frame = checkpoint_render_frame,
+        .finish_segment = checkpoint_finish_segment,
+    };
+    double start = GetTime();
+    mixer_clear(&mixer);
+    plug_reset();
+    size_t frame = 0;
+    bool ok = checkpoint_render(&cp, segment_begin, segment_end, &renderer, &frame);
+    plug_reset();
+    if (!ok) {
+        TraceLog(LOG_INFO, "RENDER: %zu complete segments are kept in %s, continue with --resume %s", cp.segments_count, cp.dir, output_path);
+        return 1;
+    }
+
+    if (cp.segments_count > 0) {
+        // The list is next to the segments, because the paths in it are relative to it
+        Nob_String_Builder list = {0};
+        for (size_t i = 0; i < cp.segments_count; ++i) {
+            nob_sb_append_cstr(&list, nob_temp_sprintf("file '%s'\n", nob_path_name(checkpoint_segment_path(&cp, i))));
+        }
+        Nob_Cmd cmd = {0};
+        ok = concat_segments(&cmd, nob_temp_sprintf("%s/segments.txt", cp.dir), list, output_path);
+        nob_cmd_free(cmd);
+        nob_sb_free(list);
+        if (!ok) return 1;
+    }
+    checkpoint_remove(&cp);
+
+    double total_time = GetTime() - start;
+    TraceLog(LOG_INFO, "RENDER: %zu frames in %.2fs in %zu segments", frame - segment_begin, total_time, cp.segments_count);
+    return 0;
+}
+
+// Stops the processes that were already started when starting the rest of them failed, and reaps them
+static void kill_procs(Nob_Procs procs)
+{
+    for (size_t i = 0; i < procs.count; ++i) {
+    #ifndef _WIN32
+        kill(procs.items[i], SIGTERM);
+    #else
+        TerminateProcess(procs.items[i], 1);
+    #endif
+    }
+    nob_procs_wait(procs);
+}
+
+// Splits the frames [segment_begin, segment_end) of the animation into jobs_count ranges, renders
+// each of them in its own panim process, and concatenates the resulting segments without re-encoding them
+static int render_parallel(const char *program_name, const char *libplug_path, const char *output_path, size_t jobs_count)
+{
+    size_t last_frame = count_video_frames();
+    size_t first_frame = segment_begin < last_frame ? segment_begin : last_frame;
+    size_t frames_count = last_frame - first_frame;
+    if (jobs_count > frames_count) jobs_count = frames_count > 0 ? frames_count : 1;
+    TraceLog(LOG_INFO, "RENDER: splitting %zu frames between %zu processes", frames_count, jobs_count);
+
+    // The segments of an image sequence are numbered by the frames and go straight into it
+    bool images = images_format_from_path(output_path) != IMAGES_FORMAT_NONE;
+
+    double start = GetTime();
+    Nob_Procs procs = {0};
+    Nob_Cmd cmd = {0};
+    for (size_t i = 0; i < jobs_count; ++i) {
+        size_t begin, end;
+        range_split(first_frame, last_frame, jobs_count, i, &begin, &end);
+        const char *path = images ? output_path : segment_path(output_path, i);
+
+        cmd.count = 0;
+        nob_cmd_append(&cmd, program_name);
+        nob_cmd_append(&cmd, "--render", path);
+        nob_cmd_append(&cmd, "--segment", nob_temp_sprintf("%zu:%zu", begin, end));
+        nob_cmd_append(&cmd, "--queue-depth", nob_temp_sprintf("%zu", ffmpeg_config.queue_depth));
+        nob_cmd_append(&cmd, "--codec", ffmpeg_config.codec == FFMPEG_CODEC_FFV1 ? "ffv1" : "h264");
+        nob_cmd_append(&cmd, "--size", nob_temp_sprintf("%zux%zu", video_width, video_height));
+        nob_cmd_append(&cmd, "--scale-filter", scale_filter_name(renditions_filter));
+        nob_cmd_append(&cmd, "--msaa", nob_temp_sprintf("%zu", msaa_samples_wanted));
+        nob_cmd_append(&cmd, "--motion-blur", nob_temp_sprintf("%zu", motion_blur));
+        if (tile_size > 0) nob_cmd_append(&cmd, "--tile", nob_temp_sprintf("%zu", tile_size));
+        for (size_t j = 0; j < renditions_count; ++j) {
+            nob_cmd_append(&cmd, "--rendition", nob_temp_sprintf("%zu:%s", renditions[j].height, segment_path(renditions[j].output_path, i)));
+        }
+        nob_cmd_append(&cmd, libplug_path);
+        Nob_Proc proc = nob_cmd_run_async(cmd);
+        if (proc == NOB_INVALID_PROC) {
+            kill_procs(procs);
+            nob_cmd_free(cmd);
+            nob_da_free(procs);
+            return 1;
+        }
+        nob_da_append(&procs, proc);
+    }
+    bool ok = nob_procs_wait(procs);
+
+    if (ok && !images) ok = concat_output_segments(&cmd, output_path, jobs_count);
+    for (size_t i = 0; ok && i < renditions_count; ++i) {
+        ok = concat_output_segments(&cmd, renditions[i].output_path, jobs_count);
+    }
+    nob_cmd_free(cmd);
+    nob_da_free(procs);
+    if (!ok) return 1;
+
+    double total_time = GetTime() - start;
+    TraceLog(LOG_INFO, "RENDER: %zu frames in %.2fs (%.2f ms/frame) with %zu processes",
+             frames_count, total_time, frames_count > 0 ? total_time*1000.0/frames_count : 0.0, jobs_count);
+    return 0;
+}
+
+static bool send_recording_frame(void *pixels, size_t copies)
+{
+    // The window is read back whole. An odd column at the edge is cut off here, an odd row is
+    // cut off by only taking the first rows, which are the bottom ones.
+    if (recording_width != window_width) {
+        recording_pixels = realloc(recording_pixels, recording_width*recording_height*4);
+        assert(recording_pixels != NULL && "Buy MORE RAM lol!!");
+        for (size_t y = 0; y < recording_height; ++y) {
+            memcpy((char*)recording_pixels + y*recording_width*4, (char*)pixels + y*window_width*4, recording_width*4);
+        }
+        pixels = recording_pixels;
+    }
+
+    if (!ffmpeg_send_frame_flipped(recording, pixels, recording_width, recording_height)) return false;
+    for (size_t i = 1; i < copies; ++i) {
+        if (!ffmpeg_send_repeated_frame(recording)) return false;
+    }
+    return true;
+}
+
+// Stops handing the frames in flight over to the preview cache or to the recording
+static void window_forget_pending(bool forget_preview, bool forget_recording)
+{
+    for (size_t i = 0; i < window_pending_count; ++i) {
+        if (forget_preview) window_pending[i].preview_index = SIZE_MAX;
+        if (forget_recording) window_pending[i].recording_copies = 0;
+    }
+}
+
+// Hands a frame that was read back over to everything that wanted it.
+// Returns false if sending it to the recording failed.
+static bool window_dispatch(void *pixels)
+{
+    if (pixels == NULL) return true;
+    assert(window_pending_count > 0);
+    Window_Capture capture = window_pending[0];
+    window_pending_count -= 1;
+    memmove(window_pending, window_pending + 1, window_pending_count*sizeof(*window_pending));
+
+    if (capture.preview_index != SIZE_MAX) {
+        frame_cache_put(preview_cache, capture.preview_index, pixels, window_width, window_height);
+    }
+    if (capture.serve) frame_server_publish(frame_server, pixels, window_width, window_height);
+    if (capture.recording_copies > 0 && !send_recording_frame(pixels, capture.recording_copies)) {
+        window_forget_pending(false, true);
+        return false;
+    }
+    return true;
+}
+
+// Finishes the readbacks in flight. Returns false if sending them to the recording failed.
+static bool window_flush(void)
+{
+    if (window_readback == NULL) return true;
+    bool ok = true;
+    for (void *pixels; (pixels = readback_pop(window_readback)) != NULL;) ok = window_dispatch(pixels) && ok;
+    return ok;
+}
+
+static void finish_preview_recording(bool cancel)
+{
+    if (!cancel && !window_flush()) cancel = true;
+    window_forget_pending(false, true);
+    if (ffmpeg_end_rendering(recording, cancel) && !cancel) {
+        TraceLog(LOG_INFO, "RECORDING: recorded %zu frames (%.2fs)", recording_frames, (double)recording_frames/FFMPEG_VIDEO_FPS);
+    } else {
+        TraceLog(LOG_ERROR, "RECORDING: the recording failed");
+    }
+    recording = NULL;
+    free(recording_pixels);
+    recording_pixels = NULL;
+    mixer_clear(&mixer);
+}
+
+// Finishes the readbacks in flight, so all the shown frames are in the cache
+static void preview_cache_flush(void)
+{
+    if (!window_flush()) finish_preview_recording(true);
+}
+
+// Forgets the cached frames, for when they do not match what the plug would draw anymore
+static void preview_cache_invalidate(void)
+{
+    if (preview_cache == NULL) return;
+    window_forget_pending(true, false);
+    frame_cache_clear(preview_cache);
+    if (preview_cursor < preview_live) preview_cursor = preview_live;
+}
+
+// The plug was reset and starts over from frame 0
+static void preview_restart(void)
+{
+    preview_cache_invalidate();
+    preview_live = 0;
+    preview_cursor = 0;
+}
+
+// Draws the next cached frame instead of calling into the plug.
+// Returns false if the preview is live, or the frame got evicted and it had to go live.
+static bool preview_show_cached(void)
+{
+    if (preview_cache == NULL || preview_cursor >= preview_live) return false;
+
+    size_t size = window_width*window_height*4;
+    preview_pixels = realloc(preview_pixels, size);
+    assert(preview_pixels != NULL && "Buy MORE RAM lol!!");
+    if (!frame_cache_get(preview_cache, preview_cursor, preview_pixels, window_width, window_height)) {
+        preview_cursor = preview_live;
+        return false;
+    }
+
+    if (preview_texture.width != (int)window_width || preview_texture.height != (int)window_height) {
+        UnloadTexture(preview_texture);
+        preview_texture = LoadTextureFromImage(CLITERAL(Image) {
+            .data = preview_pixels,
+            .width = window_width,
+            .height = window_height,
+            .mipmaps = 1,
+            .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+        });
+    } else {
+        UpdateTexture(preview_texture, preview_pixels);
+    }
+    // The frames are bottom-up like they came out of OpenGL
+    Rectangle source = { 0, 0, window_width, -(float)window_height };
+    Rectangle dest = { 0, 0, GetScreenWidth(), GetScreenHeight() };
+    DrawTexturePro(preview_texture, source, dest, Vector2Zero(), 0.0f, WHITE);
+
+    if (!paused) preview_cursor += 1;
+    return true;
+}
+
+// Replays the animation from the cache if its beginning is still there, otherwise starts it over
+static void preview_replay(bool force_reset)
+{
+    preview_cache_flush();
+    if (!force_reset && preview_cache != NULL && frame_cache_has(preview_cache, 0)) {
+        preview_cursor = 0;
+    } else {
+        plug_reset();
+        preview_restart();
+    }
+}
+
+// Pauses and steps through the cached frames one by one
+static void preview_scrub(int direction)
+{
+    if (preview_cache == NULL || preview_live == 0) return;
+    preview_cache_flush();
+
+    size_t shown = preview_cursor;
+    if (!(paused && preview_cursor < preview_live) && shown > 0) shown -= 1;
+    paused = true;
+
+    if (direction < 0) {
+        preview_cursor = shown > 0 && frame_cache_has(preview_cache, shown - 1) ? shown - 1 : shown;
+    } else {
+        preview_cursor = shown + 1 < preview_live - 1 ? shown + 1 : preview_live;
+    }
+}
 
+static bool start_preview_recording(const char *output_path)
+{
+    // yuv420p needs an even size, an odd row or column at the edge is left out
+    size_t width = GetRenderWidth()/2*2;
+    size_t height = GetRenderHeight()/2*2;
+    if (width == 0 || height == 0) return false;
+    recording = ffmpeg_start_rendering_video(output_path, width, height, FFMPEG_VIDEO_FPS,
+                                             FFMPEG_VIDEO_SAMPLE_RATE, FFMPEG_SOUND_CHANNELS);
+    if (recording == NULL) return false;
+    recording_width = width;
+    recording_height = height;
+    recording_start_time = GetTime();
+    recording_frames = 0;
+    mixer_clear(&mixer);
+    TraceLog(LOG_INFO, "RECORDING: recording the preview at %zux%zu into %s", width, height, output_path);
     return true;
 }
 
-static void finish_ffmpeg_video_rendering(bool cancel)
+// Reads back what the window shows right now, once for everything that wants it: the preview
+// cache if the plug has just drawn frame preview_live, the recording unless its video is still
+// ahead of the clock, and the frame server. The readbacks are asynchronous, so the frames are
+// handed over a few frames late and the preview keeps its frame rate. The sound of the recording
+// goes out right away, the readback does not delay it.
+static void capture_window(bool live)
 {
-    SetTraceLogLevel(LOG_INFO);
-    ffmpeg_end_rendering(ffmpeg_video, cancel);
-    plug_reset();
-    paused = true;
-    ffmpeg_video = NULL;
+    if (recording != NULL &&
+        ((size_t)GetRenderWidth()/2*2 != recording_width || (size_t)GetRenderHeight()/2*2 != recording_height)) {
+        TraceLog(LOG_WARNING, "RECORDING: the window was resized, stopping the recording");
+        finish_preview_recording(false);
+    }
+
+    Window_Capture capture = {
+        .preview_index = live && preview_cache != NULL ? preview_live : SIZE_MAX,
+        .serve = frame_server != NULL,
+    };
+    if (recording != NULL) {
+        size_t due = (size_t)((GetTime() - recording_start_time)*FFMPEG_VIDEO_FPS) + 1;
+        if (due > recording_frames) {
+            capture.recording_copies = due - recording_frames;
+            recording_frames = due;
+            bool ok = true;
+            for (size_t i = 0; i < capture.recording_copies && ok; ++i) ok = send_audio_frame(recording);
+            if (!ok) {
+                finish_preview_recording(true);
+                capture.recording_copies = 0;
+            }
+        }
+    }
+    if (capture.preview_index == SIZE_MAX && capture.recording_copies == 0 && !capture.serve) return;
+
+    size_t width = GetRenderWidth();
+    size_t height = GetRenderHeight();
+    if (window_readback == NULL || width != window_width || height != window_height) {
+        // The frames in flight are still handed over at the size they were read back at
+        if (!window_flush()) {
+            finish_preview_recording(true);
+            capture.recording_copies = 0;
+        }
+        preview_cache_invalidate();
+        if (window_readback != NULL) readback_destroy(window_readback);
+        window_readback = readback_create(width, height, READBACK_FRAMES);
+        window_width = width;
+        window_height = height;
+    }
+
+    rlDrawRenderBatchActive();
+    window_pending[window_pending_count++] = capture;
+    if (!window_dispatch(readback_push(window_readback, 0))) finish_preview_recording(true);
+}
+
+// Encodes the intermediate that was just rendered into the final video with ffmpeg, in its own process
+static int encode_final(const char *intermediate_path, const char *final_path)
+{
+    const char *audio_path = ffmpeg_is_y4m_path(intermediate_path) ? y4m_audio_path(intermediate_path) : NULL;
+    TraceLog(LOG_INFO, "FINAL: encoding %s into %s", intermediate_path, final_path);
+    double start = GetTime();
+    FFMPEG *ffmpeg = ffmpeg_start_encoding_final(intermediate_path, audio_path, final_path);
+    if (ffmpeg == NULL || !ffmpeg_end_rendering(ffmpeg, false)) return 1;
+    TraceLog(LOG_INFO, "FINAL: done in %.2fs", GetTime() - start);
+    return 0;
 }
 
 static void finish_ffmpeg_audio_rendering(bool cancel)
@@ -104,36 +1401,10 @@ static void finish_ffmpeg_audio_rendering(bool cancel)
     ffmpeg_audio = NULL;
 }
 
-void dummy_play_sound(Sound _sound, Wave _wave)
-{
-    (void)_sound;
-    (void)_wave;
-}
-
-void ffmpeg_play_sound(Sound _sound, Wave wave)
-{
-    (void)_sound;
-
-    if (
-        wave.sampleRate != FFMPEG_SOUND_SAMPLE_RATE      ||
-        wave.sampleSize != FFMPEG_SOUND_SAMPLE_SIZE_BITS ||
-        wave.channels   != FFMPEG_SOUND_CHANNELS
-    ) {
-        TraceLog(LOG_ERROR,
-                 "Animation tried to play sound with rate: %dhz, sample size: %d bits, channels: %d. "
-                 "But we only support rate: %dhz, sample size: %d bits, channels: %d for now",
-                 wave.sampleRate, wave.sampleSize, wave.channels);
-        return;
-    }
-
-    ffmpeg_wave = wave;
-    ffmpeg_wave_cursor = 0;
-}
-
-void preview_play_sound(Sound sound, Wave _wave)
+void preview_play_sound(Sound sound, Wave wave)
 {
-    (void)_wave;
     PlaySound(sound);
+    if (recording != NULL) ffmpeg_play_sound(sound, wave);
 }
 
 void rendering_scene(const char *text)
@@ -179,30 +1450,741 @@ void rendering_scene(const char *text)
     }
 }
 
+static void usage(const char *program_name)
+{
+    fprintf(stderr, "Usage: %s [OPTIONS] <libplug.so>\n", program_name);
+    fprintf(stderr, "OPTIONS:\n");
+    fprintf(stderr, "    --render <output>         Render the animation into <output> without showing a window and exit\n");
+    fprintf(stderr, "                              (.qoi or .png renders numbered stills, like frame%%05d.png)\n");
+    fprintf(stderr, "                              (.gif renders an animated GIF without sound)\n");
+    fprintf(stderr, "    --codec <h264|ffv1>       Lossy H.264 (default) or lossless FFV1 for masters, into .mkv for example\n");
+    fprintf(stderr, "                              (.y4m outputs are always written raw, without ffmpeg)\n");
+    fprintf(stderr, "    --final <output>          After --render, encode its output into the final H.264 <output> with ffmpeg\n");
+    fprintf(stderr, "    --queue-depth <frames>    Frames buffered for the encoder thread (0 encodes on the render thread)\n");
+    fprintf(stderr, "    --jobs <n>                Split --render between <n> processes and concatenate their segments\n");
+    fprintf(stderr, "    --from <frame|seconds>    Start --render at a frame, or at a time like 2.5s, skipping the frames before it\n");
+    fprintf(stderr, "    --to <frame|seconds>      Stop --render before a frame, or before a time like 4s\n");
+    fprintf(stderr, "    --segment <begin>:<end>   Only render the frames [begin, end) with --render (used by --jobs)\n");
+    fprintf(stderr, "    --preview-cache <MiB>     Memory for replaying and scrubbing the preview (default %d, 0 disables it)\n", PREVIEW_CACHE_MIB);
+    fprintf(stderr, "    --size <width>x<height>   Size of the rendered video (default %dx%d)\n", FFMPEG_VIDEO_WIDTH, FFMPEG_VIDEO_HEIGHT);
+    fprintf(stderr, "    --rendition <height>:<output>\n");
+    fprintf(stderr, "                              Also encode the video scaled down to <height> into <output>, can be repeated\n");
+    fprintf(stderr, "    --msaa <samples>          Draw the rendered video with multisampling, like 4 or 8 (default 0, off)\n");
+    fprintf(stderr, "    --motion-blur <n>         Average <n> sub-frames into every frame of the rendered video (default 1, off)\n");
+    fprintf(stderr, "    --tile <size>             Render the video in tiles of <size>x<size> and stream them to the encoder\n");
+    fprintf(stderr, "                              (on its own when --size is bigger than the GPU can render into)\n");
+    fprintf(stderr, "    --segment-cache <dir>     Keep the segments of the video in <dir> and only render the ones that changed\n");
+    fprintf(stderr, "    --checkpoint <seconds>    With --render, render in segments of <seconds> that survive an interrupted render (default %d with --resume)\n", CHECKPOINT_SECONDS);
+    fprintf(stderr, "    --resume <output>         Like --render, but continue after the last checkpoint of an interrupted --render into <output>\n");
+    fprintf(stderr, "    --frame-server <socket>   Share the frames with other processes through shared memory, see frame_server.h\n");
+    fprintf(stderr, "    --batch <manifest>        Render the jobs of <manifest> one after another in this process and exit, see README.md\n");
+    fprintf(stderr, "                              (--jobs <n> spreads them over <n> processes)\n");
+    fprintf(stderr, "    --batch-queue <dir>       Only render the jobs of --batch that no other process took from <dir> (used by --jobs)\n");
+    fprintf(stderr, "    --scale-filter <box|lanczos>\n");
+    fprintf(stderr, "                              Filter used for scaling the renditions (default lanczos)\n");
+}
+
+static bool parse_size(const char *flag, const char *value, size_t *result)
+{
+    char *end = NULL;
+    unsigned long long x = strtoull(value, &end, 10);
+    if (*value == '\0' || *value == '-' || *end != '\0') {
+        fprintf(stderr, "ERROR: %s expects a non-negative integer, but got `%s`\n", flag, value);
+        return false;
+    }
+    *result = x;
+    return true;
+}
+
+static bool parse_segment(const char *flag, const char *value, size_t *begin, size_t *end)
+{
+    const char *colon = strchr(value, ':');
+    if (colon == NULL) {
+        fprintf(stderr, "ERROR: %s expects <begin>:<end>, but got `%s`\n", flag, value);
+        return false;
+    }
+    if (!parse_size(flag, nob_temp_sprintf("%.*s", (int)(colon - value), value), begin)) return false;
+    if (!parse_size(flag, colon + 1, end)) return false;
+    return true;
+}
+
+static bool parse_frame_time(const char *flag, const char *value, size_t *frame)
+{
+    if (!range_parse_frame(value, FFMPEG_VIDEO_FPS, frame)) {
+        fprintf(stderr, "ERROR: %s expects a frame or a non-negative time in seconds like 2.5s, but got `%s`\n", flag, value);
+        return false;
+    }
+    return true;
+}
+
+static bool parse_video_size(const char *flag, const char *value, size_t *width, size_t *height)
+{
+    const char *x = strchr(value, 'x');
+    if (x == NULL) {
+        fprintf(stderr, "ERROR: %s expects <width>x<height>, but got `%s`\n", flag, value);
+        return false;
+    }
+    if (!parse_size(flag, nob_temp_sprintf("%.*s", (int)(x - value), value), width)) return false;
+    if (!parse_size(flag, x + 1, height)) return false;
+    // yuv420p needs both of them even
+    if (*width == 0 || *height == 0 || *width%2 != 0 || *height%2 != 0) {
+        fprintf(stderr, "ERROR: %s expects an even width and height, but got `%s`\n", flag, value);
+        return false;
+    }
+    return true;
+}
+
+static bool parse_rendition(const char *flag, const char *value)
+{
+    const char *colon = strchr(value, ':');
+    if (colon == NULL) {
+        fprintf(stderr, "ERROR: %s expects <height>:<output>, but got `%s`\n", flag, value);
+        return false;
+    }
+    if (renditions_count >= RENDITIONS_MAX) {
+        fprintf(stderr, "ERROR: at most %d renditions are supported\n", RENDITIONS_MAX);
+        return false;
+    }
+    Rendition *r = &renditions[renditions_count];
+    if (!parse_size(flag, nob_temp_sprintf("%.*s", (int)(colon - value), value), &r->height)) return false;
+    r->output_path = colon + 1;
+    if (images_format_from_path(r->output_path) != IMAGES_FORMAT_NONE || gif_is_path(r->output_path)) {
+        fprintf(stderr, "ERROR: %s expects a video, but got `%s`\n", flag, r->output_path);
+        return false;
+    }
+    renditions_count += 1;
+    return true;
+}
+
+// The widths of the renditions keep the aspect ratio of the video, so they depend on --size
+static bool init_renditions(void)
+{
+    for (size_t i = 0; i < renditions_count; ++i) {
+        Rendition *r = &renditions[i];
+        if (r->height == 0 || r->height%2 != 0 || r->height > video_height) {
+            fprintf(stderr, "ERROR: the height of a rendition has to be even and at most %zu, but got %zu\n", video_height, r->height);
+            return false;
+        }
+        r->width = (video_width*r->height + video_height)/(2*video_height)*2;
+        if (r->width == 0) r->width = 2;
+    }
+    return true;
+}
+
+// ffmpeg_windows.c encodes only whole frames, and has no ffmpeg executable to run for --final
+static bool supported_on_this_platform(const char *arg)
+{
+#ifdef _WIN32
+    fprintf(stderr, "ERROR: %s is not supported on Windows\n", arg);
+    return false;
+#else
+    (void) arg;
+    return true;
+#endif
+}
+
+// Needs the GL context for finding out how big the render textures can be
+static bool init_tiles(void)
+{
+    size_t max_size = tiles_max_texture_size();
+    if (tile_size == 0 && max_size > 0 && (video_width > max_size || video_height > max_size)) {
+        tile_size = max_size < TILES_DEFAULT_SIZE ? max_size : TILES_DEFAULT_SIZE;
+        TraceLog(LOG_INFO, "RENDER: %zux%zu is bigger than the GPU can render into (%zu), rendering in tiles of %zu",
+                 video_width, video_height, max_size, tile_size);
+    }
+    if (max_size > 0 && tile_size > max_size) {
+        TraceLog(LOG_ERROR, "RENDER: tiles of %zu are bigger than the GPU can render into (%zu)", tile_size, max_size);
+        return false;
+    }
+    // A single tile is just the frame
+    if (tile_size == 0 || (tile_size >= video_width && tile_size >= video_height)) return true;
+
+    // Both of them need whole frames
+    if (motion_blur > 1 || renditions_count > 0) {
+        TraceLog(LOG_ERROR, "RENDER: --motion-blur and --rendition do not work with tiles");
+        return false;
+    }
+    if (!supported_on_this_platform("rendering in tiles")) return false;
+    tiles = tiles_create(video_width, video_height, tile_size);
+    return true;
+}
+
+// Parses one of the flags that change how the video is rendered, which the jobs of a batch can set
+// on their own. Sets *known to false for every other flag.
+static bool parse_render_flag(const char *arg, const char *value, bool *known)
+{
+    *known = true;
+    if (strcmp(arg, "--codec") == 0) {
+        if (strcmp(value, "h264") == 0) {
+            ffmpeg_config.codec = FFMPEG_CODEC_H264;
+        } else if (strcmp(value, "ffv1") == 0) {
+            ffmpeg_config.codec = FFMPEG_CODEC_FFV1;
+        } else {
+            fprintf(stderr, "ERROR: unknown codec `%s`\n", value);
+            return false;
+        }
+    } else if (strcmp(arg, "--queue-depth") == 0) {
+        if (!parse_size(arg, value, &ffmpeg_config.queue_depth)) return false;
+    } else if (strcmp(arg, "--segment") == 0) {
+        if (!parse_segment(arg, value, &segment_begin, &segment_end)) return false;
+    } else if (strcmp(arg, "--from") == 0) {
+        if (!parse_frame_time(arg, value, &segment_begin)) return false;
+    } else if (strcmp(arg, "--to") == 0) {
+        if (!parse_frame_time(arg, value, &segment_end)) return false;
+    } else if (strcmp(arg, "--size") == 0) {
+        if (!parse_video_size(arg, value, &video_width, &video_height)) return false;
+    } else if (strcmp(arg, "--rendition") == 0) {
+        if (!parse_rendition(arg, value)) return false;
+    } else if (strcmp(arg, "--msaa") == 0) {
+        if (!parse_size(arg, value, &msaa_samples_wanted)) return false;
+    } else if (strcmp(arg, "--motion-blur") == 0) {
+        if (!parse_size(arg, value, &motion_blur)) return false;
+        if (motion_blur == 0 || motion_blur > ACCUM_MAX_COUNT) {
+            fprintf(stderr, "ERROR: %s expects between 1 and %d sub-frames, but got %zu\n", arg, ACCUM_MAX_COUNT, motion_blur);
+            return false;
+        }
+    } else if (strcmp(arg, "--tile") == 0) {
+        if (!supported_on_this_platform(arg)) return false;
+        if (!parse_size(arg, value, &tile_size)) return false;
+        if (tile_size == 0 || tile_size%2 != 0) {
+            fprintf(stderr, "ERROR: %s expects an even size, but got %zu\n", arg, tile_size);
+            return false;
+        }
+    } else if (strcmp(arg, "--scale-filter") == 0) {
+        if (strcmp(value, "box") == 0) {
+            renditions_filter = SCALE_FILTER_BOX;
+        } else if (strcmp(value, "lanczos") == 0) {
+            renditions_filter = SCALE_FILTER_LANCZOS3;
+        } else {
+            fprintf(stderr, "ERROR: unknown scale filter `%s`\n", value);
+            return false;
+        }
+    } else {
+        *known = false;
+    }
+    return true;
+}
+
+// Creates everything the frames are drawn into and read back through, for the size and the
+// settings of the video. Needs the GL context.
+static bool create_render_targets(void)
+{
+    if (!init_tiles()) return false;
+    // Tiles are always read back whole
+    if (tiles == NULL) damage_init(&frame_damage, video_width, video_height);
+
+    size_t screen_width = tiles != NULL ? tile_size : video_width;
+    size_t screen_height = tiles != NULL ? tile_size : video_height;
+    screen = LoadRenderTexture(screen_width, screen_height);
+    readback = readback_create(screen_width, screen_height, READBACK_FRAMES);
+    msaa = msaa_create(screen_width, screen_height, msaa_samples_wanted);
+    if (motion_blur > 1) {
+        motion_blur_sum = malloc(video_width*video_height*4*sizeof(*motion_blur_sum));
+        motion_blur_pixels = malloc(video_width*video_height*4);
+        assert(motion_blur_sum != NULL && motion_blur_pixels != NULL && "Buy MORE RAM lol!!");
+    }
+    return true;
+}
+
+static void destroy_render_targets(void)
+{
+    UnloadRenderTexture(screen);
+    readback_destroy(readback);
+    if (msaa != NULL) msaa_destroy(msaa);
+    free(motion_blur_sum);
+    free(motion_blur_pixels);
+    if (tiles != NULL) tiles_destroy(tiles);
+    screen = CLITERAL(RenderTexture2D) {0};
+    readback = NULL;
+    msaa = NULL;
+    motion_blur_sum = NULL;
+    motion_blur_pixels = NULL;
+    tiles = NULL;
+}
+
+static Render_Settings save_render_settings(void)
+{
+    Render_Settings settings = {
+        .ffmpeg_config = ffmpeg_config,
+        .video_width = video_width,
+        .video_height = video_height,
+        .msaa_samples_wanted = msaa_samples_wanted,
+        .motion_blur = motion_blur,
+        .tile_size = tile_size,
+        .segment_begin = segment_begin,
+        .segment_end = segment_end,
+        .renditions_count = renditions_count,
+        .renditions_filter = renditions_filter,
+    };
+    memcpy(settings.renditions, renditions, sizeof(renditions));
+    return settings;
+}
+
+static void restore_render_settings(const Render_Settings *settings)
+{
+    ffmpeg_config = settings->ffmpeg_config;
+    video_width = settings->video_width;
+    video_height = settings->video_height;
+    msaa_samples_wanted = settings->msaa_samples_wanted;
+    motion_blur = settings->motion_blur;
+    tile_size = settings->tile_size;
+    segment_begin = settings->segment_begin;
+    segment_end = settings->segment_end;
+    memcpy(renditions, settings->renditions, sizeof(renditions));
+    renditions_count = settings->renditions_count;
+    renditions_filter = settings->renditions_filter;
+}
+
+// Whether the render targets made for the settings fit the current ones as well
+static bool same_render_targets(const Render_Settings *settings)
+{
+    return settings->video_width == video_width && settings->video_height == video_height &&
+           settings->msaa_samples_wanted == msaa_samples_wanted && settings->motion_blur == motion_blur &&
+           settings->tile_size == tile_size && settings->renditions_count == renditions_count;
+}
+
+// Reads the jobs out of the manifest, one per line with its words separated by spaces. Lines that
+// start with # are comments. The words point into content, which has to outlive the jobs.
+static bool load_batch(const char *manifest_path, Nob_String_Builder *content, Batch_Jobs *jobs)
+{
+    if (!nob_read_entire_file(manifest_path, content)) return false;
+    nob_sb_append_null(content);
+
+    char *line = content->items;
+    for (size_t line_number = 1; line != NULL; ++line_number) {
+        char *next = strchr(line, '\n');
+        if (next != NULL) *next++ = '\0';
+
+        Batch_Job job = { .line = line_number };
+        for (char *word = strtok(line, " \t\r"); word != NULL; word = strtok(NULL, " \t\r")) {
+            nob_da_append(&job, word);
+        }
+        line = next;
+        if (job.count == 0 || job.items[0][0] == '#') {
+            nob_da_free(job);
+            continue;
+        }
+        if (job.count < 2) {
+            fprintf(stderr, "ERROR: %s:%zu: expected <library> <output> [flags]\n", manifest_path, job.line);
+            nob_da_free(job);
+            return false;
+        }
+        nob_da_append(jobs, job);
+    }
+    return true;
+}
+
+// Applies the flags of the job over the render settings of the batch itself
+static bool apply_batch_job(const char *manifest_path, const Batch_Job *job, const Render_Settings *defaults, const char **final_output_path)
+{
+    destroy_renditions();
+    restore_render_settings(defaults);
+    *final_output_path = NULL;
+    for (size_t i = 2; i < job->count; i += 2) {
+        const char *arg = job->items[i];
+        if (i + 1 >= job->count) {
+            fprintf(stderr, "ERROR: %s:%zu: no value is provided for %s\n", manifest_path, job->line, arg);
+            return false;
+        }
+        const char *value = job->items[i + 1];
+
+        bool known = false;
+        if (!parse_render_flag(arg, value, &known)) {
+            fprintf(stderr, "ERROR: %s:%zu: invalid job\n", manifest_path, job->line);
+            return false;
+        }
+        if (known) continue;
+        if (strcmp(arg, "--final") == 0) {
+            if (!supported_on_this_platform(arg)) {
+                fprintf(stderr, "ERROR: %s:%zu: invalid job\n", manifest_path, job->line);
+                return false;
+            }
+            *final_output_path = value;
+        } else {
+            fprintf(stderr, "ERROR: %s:%zu: %s can not be used in the jobs of a batch\n", manifest_path, job->line, arg);
+            return false;
+        }
+    }
+    if (!init_renditions()) {
+        fprintf(stderr, "ERROR: %s:%zu: invalid job\n", manifest_path, job->line);
+        return false;
+    }
+    if (segment_begin >= segment_end) {
+        fprintf(stderr, "ERROR: %s:%zu: --from has to be before --to, but got frames %zu and %zu\n",
+                manifest_path, job->line, segment_begin, segment_end);
+        return false;
+    }
+    return true;
+}
+
+// Lets the plug unload its assets and free its state before its library is closed for good
+static void unload_plug(void)
+{
+    void *state = plug_pre_reload();
+    if (plug_unload != NULL) plug_unload(state);
+}
+
+static const char *batch_claim_path(const char *queue_dir, size_t job)
+{
+    return nob_temp_sprintf("%s/job%05zu", queue_dir, job);
+}
+
+// Takes the first job from *job on that no other worker has taken yet. A job is taken by creating
+// its file in the queue directory, which only one of the workers manages to do. Without a queue
+// directory every job is taken. Returns false once there are no jobs left.
+static bool claim_batch_job(const char *queue_dir, size_t jobs_count, size_t *job)
+{
+    for (; *job < jobs_count; *job += 1) {
+        if (queue_dir == NULL) return true;
+        FILE *f = fopen(batch_claim_path(queue_dir, *job), "wx");
+        if (f != NULL) {
+            fclose(f);
+            return true;
+        }
+        if (errno != EEXIST) {
+            TraceLog(LOG_ERROR, "BATCH: could not take job %zu from %s: %s", *job + 1, queue_dir, strerror(errno));
+            return false;
+        }
+    }
+    return false;
+}
+
+// Renders the jobs of the batch that the other workers sharing queue_dir did not take, in order and
+// back to back with one GL context. The library of a job stays loaded and initialized for the next
+// job that renders it, and the render targets for the next job of the same size.
+static int render_batch_jobs(const char *manifest_path, const Batch_Jobs *jobs, const char *queue_dir)
+{
+    // The window only provides the GL context, like with --render
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    InitWindow(16*100, 9*100, "Panim");
+    InitAudioDevice();
+    SetExitKey(KEY_NULL);
+    mixer_init(&mixer);
+    gpu_timer = gpu_timer_create();
+
+    Render_Settings defaults = save_render_settings();
+    // What the render targets were asked for, and the tile size init_tiles() ended up with for them
+    Render_Settings targets = {0};
+    size_t targets_tile_size = 0;
+    bool targets_created = false;
+    const char *loaded_libplug_path = NULL;
+    size_t done = 0;
+    size_t failed = 0;
+    double start = GetTime();
+    for (size_t i = 0; claim_batch_job(queue_dir, jobs->count, &i); ++i) {
+        const Batch_Job *job = &jobs->items[i];
+        const char *libplug_path = job->items[0];
+        const char *output_path = job->items[1];
+        TraceLog(LOG_INFO, "BATCH: job %zu of %zu, %s into %s", i + 1, jobs->count, libplug_path, output_path);
+        double job_start = GetTime();
+
+        const char *final_output_path = NULL;
+        bool ok = apply_batch_job(manifest_path, job, &defaults, &final_output_path);
+        if (ok && (loaded_libplug_path == NULL || strcmp(loaded_libplug_path, libplug_path) != 0)) {
+            if (loaded_libplug_path != NULL) unload_plug();
+            loaded_libplug_path = NULL;
+            ok = reload_libplug(libplug_path);
+            if (ok) {
+                plug_init();
+                loaded_libplug_path = libplug_path;
+            }
+        }
+        if (ok && targets_created && same_render_targets(&targets)) {
+            // The job asked for the same tile size, but init_tiles() may have picked another one
+            tile_size = targets_tile_size;
+        } else if (ok) {
+            if (targets_created) destroy_render_targets();
+            targets = save_render_settings();
+            targets_created = create_render_targets();
+            targets_tile_size = tile_size;
+            ok = targets_created;
+        }
+        if (ok) ok = render_headless(output_path) == 0;
+        if (ok && final_output_path != NULL) ok = encode_final(output_path, final_output_path) == 0;
+
+        done += 1;
+        if (ok) {
+            TraceLog(LOG_INFO, "BATCH: job %zu of %zu done in %.2fs", i + 1, jobs->count, GetTime() - job_start);
+        } else {
+            TraceLog(LOG_ERROR, "BATCH: job %zu of %zu (%s:%zu) failed", i + 1, jobs->count, manifest_path, job->line);
+            failed += 1;
+        }
+        nob_temp_reset();
+    }
+    TraceLog(LOG_INFO, "BATCH: %zu jobs in %.2fs, %zu of them failed", done, GetTime() - start, failed);
+
+    if (loaded_libplug_path != NULL) unload_plug();
+    destroy_renditions();
+    if (targets_created) destroy_render_targets();
+    if (gpu_timer != NULL) gpu_timer_destroy(gpu_timer);
+    CloseAudioDevice();
+    CloseWindow();
+    return failed > 0 ? 1 : 0;
+}
+
+static void remove_batch_queue(const char *queue_dir, size_t jobs_count)
+{
+    for (size_t i = 0; i < jobs_count; ++i) remove(batch_claim_path(queue_dir, i));
+    remove(queue_dir);
+}
+
+// Shares the jobs of the batch between workers_count panim processes, every one of them started with
+// the same args as this one and --batch-queue. A worker that is done with a job takes the next one that
+// nobody has taken yet, so a long job does not hold up the jobs after it while the others are idle.
+static int render_batch(const char *program_name, char **args, int args_count, const char *manifest_path, const Batch_Jobs *jobs, size_t workers_count)
+{
+    if (workers_count > jobs->count) workers_count = jobs->count;
+    if (workers_count <= 1) return render_batch_jobs(manifest_path, jobs, NULL);
+    TraceLog(LOG_INFO, "BATCH: sharing %zu jobs between %zu processes", jobs->count, workers_count);
+
+    // Left behind by a batch that was killed, it would make the workers skip the jobs it took
+    const char *queue_dir = nob_temp_sprintf("%s.queue", manifest_path);
+    remove_batch_queue(queue_dir, jobs->count);
+    if (!nob_mkdir_if_not_exists(queue_dir)) return 1;
+
+    double start = GetTime();
+    Nob_Procs procs = {0};
+    Nob_Cmd cmd = {0};
+    for (size_t i = 0; i < workers_count; ++i) {
+        cmd.count = 0;
+        nob_cmd_append(&cmd, program_name);
+        for (int j = 0; j < args_count; ++j) nob_cmd_append(&cmd, args[j]);
+        nob_cmd_append(&cmd, "--batch-queue", queue_dir);
+        Nob_Proc proc = nob_cmd_run_async(cmd);
+        if (proc == NOB_INVALID_PROC) {
+            kill_procs(procs);
+            remove_batch_queue(queue_dir, jobs->count);
+            nob_cmd_free(cmd);
+            nob_da_free(procs);
+            return 1;
+        }
+        nob_da_append(&procs, proc);
+    }
+    bool ok = nob_procs_wait(procs);
+    // A worker that could not take a job does not fail on its own
+    for (size_t i = 0; i < jobs->count && ok; ++i) {
+        if (nob_file_exists(batch_claim_path(queue_dir, i)) != 1) {
+            TraceLog(LOG_ERROR, "BATCH: job %zu of %zu (%s:%zu) was never taken", i + 1, jobs->count, manifest_path, jobs->items[i].line);
+            ok = false;
+        }
+    }
+    TraceLog(LOG_INFO, "BATCH: %zu jobs in %.2fs with %zu processes%s", jobs->count, GetTime() - start, workers_count,
+             ok ? "" : ", some of them failed");
+
+    remove_batch_queue(queue_dir, jobs->count);
+    nob_cmd_free(cmd);
+    nob_da_free(procs);
+    return ok ? 0 : 1;
+}
+
 int main(int argc, char **argv)
 {
     const char *program_name = nob_shift_args(&argc, &argv);
+    // Passed on to the workers of --batch
+    char **args = argv;
+    int args_count = argc;
+    const char *libplug_path = NULL;
+    const char *render_output_path = NULL;
+    const char *final_output_path = NULL;
+    size_t jobs_count = 1;
+    const char *batch_path = NULL;
+    const char *batch_queue_dir = NULL;
+
+    while (argc > 0) {
+        const char *arg = nob_shift_args(&argc, &argv);
+        if (strncmp(arg, "--", 2) != 0) {
+            if (libplug_path != NULL) {
+                usage(program_name);
+                fprintf(stderr, "ERROR: more than one animation dynamic library is provided\n");
+                return 1;
+            }
+            libplug_path = arg;
+            continue;
+        }
+
+        if (argc <= 0) {
+            usage(program_name);
+            fprintf(stderr, "ERROR: no value is provided for %s\n", arg);
+            return 1;
+        }
+        const char *value = nob_shift_args(&argc, &argv);
+
+        bool known = false;
+        if (!parse_render_flag(arg, value, &known)) return 1;
+        if (known) continue;
+
+        if (strcmp(arg, "--render") == 0) {
+            render_output_path = value;
+        } else if (strcmp(arg, "--final") == 0) {
+            if (!supported_on_this_platform(arg)) return 1;
+            final_output_path = value;
+        } else if (strcmp(arg, "--jobs") == 0) {
+            if (!parse_size(arg, value, &jobs_count)) return 1;
+        } else if (strcmp(arg, "--preview-cache") == 0) {
+            size_t mib = 0;
+            if (!parse_size(arg, value, &mib)) return 1;
+            preview_cache_budget = mib*1024*1024;
+        } else if (strcmp(arg, "--segment-cache") == 0) {
+            segment_cache_dir = value;
+        } else if (strcmp(arg, "--checkpoint") == 0) {
+            size_t seconds = 0;
+            if (!parse_size(arg, value, &seconds)) return 1;
+            if (seconds == 0) {
+                fprintf(stderr, "ERROR: %s expects at least 1 second\n", arg);
+                return 1;
+            }
+            checkpoint_frames = seconds*FFMPEG_VIDEO_FPS;
+        } else if (strcmp(arg, "--resume") == 0) {
+            render_output_path = value;
+            checkpoint_resume = true;
+        } else if (strcmp(arg, "--frame-server") == 0) {
+            frame_server_path = value;
+        } else if (strcmp(arg, "--batch") == 0) {
+            batch_path = value;
+        } else if (strcmp(arg, "--batch-queue") == 0) {
+            batch_queue_dir = value;
+        } else {
+            usage(program_name);
+            fprintf(stderr, "ERROR: unknown flag %s\n", arg);
+            return 1;
+        }
+    }
+
+    if (batch_path != NULL) {
+        if (libplug_path != NULL || render_output_path != NULL || final_output_path != NULL || segment_cache_dir != NULL ||
+            checkpoint_frames > 0 || checkpoint_resume || frame_server_path != NULL) {
+            usage(program_name);
+            fprintf(stderr, "ERROR: --batch takes the libraries and outputs from the manifest, and only works with --jobs and the flags of the jobs\n");
+            return 1;
+        }
+        Nob_String_Builder content = {0};
+        Batch_Jobs jobs = {0};
+        if (!load_batch(batch_path, &content, &jobs)) return 1;
+        // Every job is checked before any of them is rendered
+        Render_Settings defaults = save_render_settings();
+        for (size_t i = 0; i < jobs.count; ++i) {
+            const char *final_path = NULL;
+            if (!apply_batch_job(batch_path, &jobs.items[i], &defaults, &final_path)) return 1;
+        }
+        restore_render_settings(&defaults);
+
+        int status = batch_queue_dir != NULL ? render_batch_jobs(batch_path, &jobs, batch_queue_dir)
+                   :                           render_batch(program_name, args, args_count, batch_path, &jobs, jobs_count);
+        for (size_t i = 0; i < jobs.count; ++i) nob_da_free(jobs.items[i]);
+        nob_da_free(jobs);
+        nob_sb_free(content);
+        return status;
+    }
 
-    if (argc <= 0) {
-        fprintf(stderr, "Usage: %s <libplug.so>\n", program_name);
+    if (libplug_path == NULL) {
+        usage(program_name);
         fprintf(stderr, "ERROR: no animation dynamic library is provided\n");
         return 1;
     }
 
-    const char *libplug_path = nob_shift_args(&argc, &argv);
+    if (!init_renditions()) return 1;
+    if (segment_begin > 0 || segment_end != SIZE_MAX) {
+        if (render_output_path == NULL) {
+            fprintf(stderr, "ERROR: --from and --to only work with --render\n");
+            return 1;
+        }
+        if (segment_begin >= segment_end) {
+            fprintf(stderr, "ERROR: --from has to be before --to, but got frames %zu and %zu\n", segment_begin, segment_end);
+            return 1;
+        }
+        if (segment_cache_dir != NULL) {
+            // The segments of the cache start at the beginning of the animation
+            fprintf(stderr, "ERROR: --from and --to do not work with --segment-cache\n");
+            return 1;
+        }
+    }
+    if (jobs_count > 1 && render_output_path != NULL && gif_is_path(render_output_path)) {
+        // Every frame of a GIF depends on the previous one, so its segments could not be joined
+        fprintf(stderr, "WARNING: --jobs does not work with GIFs, rendering in one process\n");
+        jobs_count = 1;
+    }
+    if (segment_cache_dir != NULL) {
+        // The segments are joined by ffmpeg without re-encoding them
+        if (render_output_path == NULL || *path_ext(render_output_path) == '\0' || images_format_from_path(render_output_path) != IMAGES_FORMAT_NONE ||
+            gif_is_path(render_output_path) || ffmpeg_is_y4m_path(render_output_path) || renditions_count > 0) {
+            fprintf(stderr, "ERROR: --segment-cache needs --render into a video, and does not work with --rendition\n");
+            return 1;
+        }
+        if (jobs_count > 1) {
+            fprintf(stderr, "WARNING: --jobs does not work with --segment-cache, rendering in one process\n");
+            jobs_count = 1;
+        }
+    }
+
+    if (checkpoint_resume && checkpoint_frames == 0) checkpoint_frames = CHECKPOINT_SECONDS*FFMPEG_VIDEO_FPS;
+    if (checkpoint_frames > 0) {
+        // The segments are joined by ffmpeg without re-encoding them, like those of --segment-cache
+        if (render_output_path == NULL || *path_ext(render_output_path) == '\0' || images_format_from_path(render_output_path) != IMAGES_FORMAT_NONE ||
+            gif_is_path(render_output_path) || ffmpeg_is_y4m_path(render_output_path) || renditions_count > 0) {
+            fprintf(stderr, "ERROR: --checkpoint and --resume need a video to render into, and do not work with --rendition\n");
+            return 1;
+        }
+        if (segment_cache_dir != NULL) {
+            // The segments in the cache already survive an interrupted render
+            fprintf(stderr, "ERROR: --checkpoint and --resume do not work with --segment-cache, which resumes on its own\n");
+            return 1;
+        }
+        if (jobs_count > 1) {
+            fprintf(stderr, "WARNING: --jobs does not work with --checkpoint, rendering in one process\n");
+            jobs_count = 1;
+        }
+    }
 
     if (!reload_libplug(libplug_path)) return 1;
 
     float factor = 100.0f;
-    SetConfigFlags(FLAG_MSAA_4X_HINT | FLAG_WINDOW_RESIZABLE);
+    if (render_output_path != NULL) {
+        // The window only provides the GL context. No vsync and no frame rate cap, because nothing is ever presented.
+        SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    } else {
+        SetConfigFlags(FLAG_MSAA_4X_HINT | FLAG_WINDOW_RESIZABLE);
+    }
     InitWindow(16*factor, 9*factor, "Panim");
     InitAudioDevice();
-    SetTargetFPS(60);
+    if (render_output_path == NULL) SetTargetFPS(60);
     SetExitKey(KEY_NULL);
     plug_init();
+    mixer_init(&mixer);
+    if (!create_render_targets()) {
+        CloseAudioDevice();
+        CloseWindow();
+        return 1;
+    }
+    gpu_timer = gpu_timer_create();
+    if (frame_server_path != NULL) {
+        if (render_output_path != NULL && jobs_count > 1) {
+            // The frames are rendered by the child processes, out of order
+            fprintf(stderr, "WARNING: --frame-server does not work with --jobs, not serving the frames\n");
+        } else if (tiles != NULL) {
+            // Whole frames are never in memory
+            fprintf(stderr, "WARNING: --frame-server does not work with tiles, not serving the frames\n");
+        } else {
+            frame_server = frame_server_create(frame_server_path, FFMPEG_VIDEO_FPS);
+        }
+    }
+
+    if (render_output_path != NULL) {
+        int status = jobs_count > 1            ? render_parallel(program_name, libplug_path, render_output_path, jobs_count)
+                   : segment_cache_dir != NULL ? render_cached(render_output_path)
+                   : checkpoint_frames > 0     ? render_checkpointed(libplug_path, render_output_path)
+                   :                             render_headless(render_output_path);
+        destroy_render_targets();
+        if (gpu_timer != NULL) gpu_timer_destroy(gpu_timer);
+        destroy_renditions();
+        if (frame_server != NULL) frame_server_destroy(frame_server);
+        if (status == 0 && final_output_path != NULL) status = encode_final(render_output_path, final_output_path);
+        CloseAudioDevice();
+        CloseWindow();
+        return status;
+    }
 
-    screen = LoadRenderTexture(FFMPEG_VIDEO_WIDTH, FFMPEG_VIDEO_HEIGHT);
     rendering_font = LoadFontEx("./assets/fonts/Vollkorn-Regular.ttf", RENDERING_FONT_SIZE, NULL, 0);
+    if (preview_cache_budget > 0) preview_cache = frame_cache_create(preview_cache_budget);
 
     while (!WindowShouldClose()) {
         BeginDrawing();
@@ -211,22 +2193,8 @@ int main(int argc, char **argv)
                     finish_ffmpeg_video_rendering(false);
                 } else if (IsKeyPressed(KEY_ESCAPE)) {
                     finish_ffmpeg_video_rendering(true);
-                } else {
-                    BeginTextureMode(screen);
-                    plug_update(CLITERAL(Env) {
-                        .screen_width = FFMPEG_VIDEO_WIDTH,
-                        .screen_height = FFMPEG_VIDEO_HEIGHT,
-                        .delta_time = FFMPEG_VIDEO_DELTA_TIME,
-                        .rendering = true,
-                        .play_sound = dummy_play_sound,
-                    });
-                    EndTextureMode();
-
-                    Image image = LoadImageFromTexture(screen.texture);
-                    if (!ffmpeg_send_frame_flipped(ffmpeg_video, image.data, image.width, image.height)) {
-                        finish_ffmpeg_video_rendering(true);
-                    }
-                    UnloadImage(image);
+                } else if (!render_video_frame()) {
+                    finish_ffmpeg_video_rendering(true);
                 }
                 rendering_scene("Rendering Video");
             } else if (ffmpeg_audio) {
@@ -237,53 +2205,52 @@ int main(int argc, char **argv)
                 } else {
                     BeginTextureMode(screen);
                     plug_update(CLITERAL(Env) {
-                        .screen_width = FFMPEG_VIDEO_WIDTH,
-                        .screen_height = FFMPEG_VIDEO_HEIGHT,
+                        .screen_width = video_width,
+                        .screen_height = video_height,
                         .delta_time = FFMPEG_VIDEO_DELTA_TIME,
                         .rendering = true,
                         .play_sound = ffmpeg_play_sound,
+                        .report_damage = dummy_report_damage,
                     });
                     EndTextureMode();
 
-                    size_t frame_count = ffmpeg_wave.frameCount;
-                    size_t frame_size = FFMPEG_SOUND_SAMPLE_SIZE_BYTES*FFMPEG_SOUND_CHANNELS;
-                    size_t frames_begin = ffmpeg_wave_cursor;
-                    size_t frames_end = ffmpeg_wave_cursor + FFMPEG_SOUND_SPF;
-                    if (frames_end > frame_count) {
-                        frames_end = frame_count;
-                    }
-                    void *sound_data = (uint8_t*)ffmpeg_wave.data + frames_begin*frame_size;
-                    size_t sound_size = (frames_end - frames_begin)*frame_size;
-                    if (!ffmpeg_send_sound_samples(ffmpeg_audio, sound_data, sound_size)) {
-                        finish_ffmpeg_audio_rendering(true);
-                    }
-                    ffmpeg_wave_cursor += frames_end - frames_begin;
-                    size_t silence_size = (FFMPEG_SOUND_SPF - (frames_end - frames_begin))*frame_size;
-                    if (!ffmpeg_send_sound_samples(ffmpeg_audio, silence, silence_size)) {
+                    if (!send_audio_frame(ffmpeg_audio)) {
                         finish_ffmpeg_audio_rendering(true);
                     }
                 }
                 rendering_scene("Rendering Audio");
             } else {
+                if ((IsKeyPressed(KEY_R) || IsKeyPressed(KEY_T)) && recording != NULL) {
+                    // Both of them use the mixer
+                    finish_preview_recording(false);
+                }
                 if (IsKeyPressed(KEY_R)) {
-                    SetTraceLogLevel(LOG_WARNING);
-                    ffmpeg_video = ffmpeg_start_rendering_video("output.mp4", FFMPEG_VIDEO_WIDTH, FFMPEG_VIDEO_HEIGHT, FFMPEG_VIDEO_FPS);
-                    plug_reset();
+                    preview_restart();
+                    start_ffmpeg_video_rendering("output.mp4");
                 } else if (IsKeyPressed(KEY_T)) {
+                    preview_restart();
                     SetTraceLogLevel(LOG_WARNING);
                     ffmpeg_audio = ffmpeg_start_rendering_audio("output.wav");
+                    mixer_clear(&mixer);
                     plug_reset();
                 } else {
                     if (IsKeyPressed(KEY_H)) {
                         void *state = plug_pre_reload();
                         reload_libplug(libplug_path);
                         plug_post_reload(state);
+                        preview_cache_invalidate();
                     }
                     if (IsKeyPressed(KEY_SPACE)) {
                         paused = !paused;
                     }
                     if (IsKeyPressed(KEY_Q)) {
-                        plug_reset();
+                        preview_replay(IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT));
+                    }
+                    if (IsKeyPressed(KEY_LEFT) || IsKeyPressedRepeat(KEY_LEFT)) {
+                        preview_scrub(-1);
+                    }
+                    if (IsKeyPressed(KEY_RIGHT) || IsKeyPressedRepeat(KEY_RIGHT)) {
+                        preview_scrub(1);
                     }
                     if (IsKeyPressed(KEY_PERIOD)) {
                         delta_time_multiplier += 0.1;
@@ -297,14 +2264,32 @@ int main(int argc, char **argv)
                         delta_time_multiplier = 1.0;
                         delta_time_multiplier_popup = 1.0f;
                     }
+                    if (IsKeyPressed(KEY_C)) {
+                        if (recording != NULL) {
+                            finish_preview_recording(false);
+                        } else {
+                            start_preview_recording("recording.mp4");
+                        }
+                    }
 
-                    plug_update(CLITERAL(Env) {
-                        .screen_width = GetScreenWidth(),
-                        .screen_height = GetScreenHeight(),
-                        .delta_time = paused ? 0.0 : GetFrameTime()*delta_time_multiplier,
-                        .rendering = false,
-                        .play_sound = preview_play_sound,
-                    });
+                    bool live = false;
+                    if (!preview_show_cached()) {
+                        plug_update(CLITERAL(Env) {
+                            .screen_width = GetScreenWidth(),
+                            .screen_height = GetScreenHeight(),
+                            .delta_time = paused ? 0.0 : GetFrameTime()*delta_time_multiplier,
+                            .rendering = false,
+                            .play_sound = preview_play_sound,
+                            .report_damage = dummy_report_damage,
+                        });
+                        live = !paused;
+                    }
+                    // Before anything is drawn on top of the animation
+                    capture_window(live);
+                    if (live) {
+                        preview_live += 1;
+                        preview_cursor = preview_live;
+                    }
 
                     const char *text = TextFormat("Delta Time Multiplier: %.2fx", delta_time_multiplier);
                     Vector2 text_size = MeasureTextEx(rendering_font, text, RENDERING_FONT_SIZE, 0);
@@ -317,11 +2302,24 @@ int main(int argc, char **argv)
                     if (delta_time_multiplier_popup > 0.0f) {
                         delta_time_multiplier_popup = (delta_time_multiplier_popup*POPUP_DISAPPER_TIME - GetFrameTime())/POPUP_DISAPPER_TIME;
                     }
+                    if (recording != NULL) {
+                        float radius = RENDERING_FONT_SIZE*0.2f;
+                        DrawCircleV(CLITERAL(Vector2) { radius*2, radius*2 }, radius, ColorAlpha(RED, (sinf(GetTime()*4) + 3)/4));
+                    }
                 }
             }
         EndDrawing();
     }
 
+    if (recording != NULL) finish_preview_recording(false);
+    if (preview_cache != NULL) frame_cache_destroy(preview_cache);
+    UnloadTexture(preview_texture);
+    free(preview_pixels);
+    destroy_render_targets();
+    if (gpu_timer != NULL) gpu_timer_destroy(gpu_timer);
+    destroy_renditions();
+    if (window_readback != NULL) readback_destroy(window_readback);
+    if (frame_server != NULL) frame_server_destroy(frame_server);
     CloseWindow();
 
     return 0;
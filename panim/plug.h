@@ -18,4 +18,9 @@
     PLUG(plug_reset, void, void)        /* Reset the state of the animation */ \
     PLUG(plug_finished, bool, void)     /* Check if the animation is finished */ \
 
+// void plug_unload(void *state)
+//
+// Optional. Frees the state plug_pre_reload() returned, when the library is closed for good because
+// --batch moves on to another one. A library that does not export it leaves its state behind.
+
 #endif // PLUG_H_
@@ -0,0 +1,218 @@
+#include <assert.h>
+#include <string.h>
+
+#include "qoi.h"
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+#define QOI_MASK_2   0xc0
+
+#define QOI_HEADER_SIZE 14
+#define QOI_MAX_RUN 62
+
+static const uint8_t qoi_padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+typedef union {
+    struct { uint8_t r, g, b, a; } rgba;
+    uint32_t v;
+} Qoi_Pixel;
+
+static inline size_t qoi_hash(Qoi_Pixel p)
+{
+    return (p.rgba.r*3 + p.rgba.g*5 + p.rgba.b*7 + p.rgba.a*11)%64;
+}
+
+static inline uint8_t *qoi_write_32(uint8_t *p, uint32_t x)
+{
+    *p++ = x >> 24;
+    *p++ = x >> 16;
+    *p++ = x >> 8;
+    *p++ = x;
+    return p;
+}
+
+static inline uint32_t qoi_read_32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+size_t qoi_frame_max_size(size_t width, size_t height)
+{
+    return width*height*5 + QOI_HEADER_SIZE + sizeof(qoi_padding);
+}
+
+size_t qoi_rows_max_size(size_t width, size_t rows)
+{
+    return width*rows*5 + QOI_HEADER_SIZE + sizeof(qoi_padding);
+}
+
+size_t qoi_encoder_begin(Qoi_Encoder *qoi, size_t width, size_t height, uint8_t *out)
+{
+    memset(qoi, 0, sizeof(*qoi));
+    Qoi_Pixel prev = { .rgba = { 0, 0, 0, 255 } };
+    qoi->prev = prev.v;
+    qoi->remaining = width*height;
+
+    uint8_t *p = out;
+    memcpy(p, "qoif", 4);
+    p = qoi_write_32(p + 4, width);
+    p = qoi_write_32(p, height);
+    *p++ = 4; // channels
+    *p++ = 0; // sRGB with linear alpha
+    return p - out;
+}
+
+size_t qoi_encoder_rows(Qoi_Encoder *qoi, const void *rgba, size_t width, size_t rows, bool flipped, uint8_t *out)
+{
+    assert(width*rows <= qoi->remaining);
+    uint8_t *p = out;
+    Qoi_Pixel index[64];
+    memcpy(index, qoi->index, sizeof(index));
+    Qoi_Pixel prev = { .v = qoi->prev };
+    size_t run = qoi->run;
+    size_t count = width*rows;
+    // The last pixel of the image has to flush the run
+    size_t last = qoi->remaining == count ? count : SIZE_MAX;
+    const uint8_t *pixels = rgba;
+    ptrdiff_t stride = flipped ? -(ptrdiff_t)width*4 : (ptrdiff_t)width*4;
+    const uint8_t *row = flipped && rows > 0 ? pixels + (rows - 1)*width*4 : pixels;
+
+    for (size_t i = 0, x = 0; i < count; ++i, ++x) {
+        if (x == width) {
+            row += stride;
+            x = 0;
+        }
+        Qoi_Pixel px;
+        memcpy(&px, row + x*4, 4);
+
+        if (px.v == prev.v) {
+            run += 1;
+            if (run == QOI_MAX_RUN || i + 1 == last) {
+                *p++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run > 0) {
+            *p++ = QOI_OP_RUN | (run - 1);
+            run = 0;
+        }
+
+        size_t h = qoi_hash(px);
+        if (index[h].v == px.v) {
+            *p++ = QOI_OP_INDEX | h;
+        } else {
+            index[h] = px;
+            if (px.rgba.a == prev.rgba.a) {
+                int8_t vr = px.rgba.r - prev.rgba.r;
+                int8_t vg = px.rgba.g - prev.rgba.g;
+                int8_t vb = px.rgba.b - prev.rgba.b;
+                int8_t vg_r = vr - vg;
+                int8_t vg_b = vb - vg;
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                    *p++ = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+                } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+                    *p++ = QOI_OP_LUMA | (vg + 32);
+                    *p++ = (vg_r + 8) << 4 | (vg_b + 8);
+                } else {
+                    *p++ = QOI_OP_RGB;
+                    *p++ = px.rgba.r;
+                    *p++ = px.rgba.g;
+                    *p++ = px.rgba.b;
+                }
+            } else {
+                *p++ = QOI_OP_RGBA;
+                *p++ = px.rgba.r;
+                *p++ = px.rgba.g;
+                *p++ = px.rgba.b;
+                *p++ = px.rgba.a;
+            }
+        }
+        prev = px;
+    }
+
+    memcpy(qoi->index, index, sizeof(index));
+    qoi->prev = prev.v;
+    qoi->run = run;
+    qoi->remaining -= count;
+    return p - out;
+}
+
+size_t qoi_encoder_end(Qoi_Encoder *qoi, uint8_t *out)
+{
+    assert(qoi->remaining == 0 && qoi->run == 0);
+    memcpy(out, qoi_padding, sizeof(qoi_padding));
+    return sizeof(qoi_padding);
+}
+
+size_t qoi_encode_frame(const void *rgba, size_t width, size_t height, bool flipped, uint8_t *out)
+{
+    Qoi_Encoder qoi;
+    uint8_t *p = out;
+    p += qoi_encoder_begin(&qoi, width, height, p);
+    p += qoi_encoder_rows(&qoi, rgba, width, height, flipped, p);
+    p += qoi_encoder_end(&qoi, p);
+    return p - out;
+}
+
+bool qoi_decode_frame(const uint8_t *data, size_t size, void *rgba, size_t width, size_t height)
+{
+    if (size < QOI_HEADER_SIZE + sizeof(qoi_padding)) return false;
+    if (memcmp(data, "qoif", 4) != 0) return false;
+    if (qoi_read_32(data + 4) != width || qoi_read_32(data + 8) != height) return false;
+
+    const uint8_t *p = data + QOI_HEADER_SIZE;
+    const uint8_t *end = data + size - sizeof(qoi_padding);
+    Qoi_Pixel index[64] = {0};
+    Qoi_Pixel px = { .rgba = { 0, 0, 0, 255 } };
+    size_t run = 0;
+    size_t count = width*height;
+    uint8_t *pixels = rgba;
+
+    for (size_t i = 0; i < count; ++i) {
+        if (run > 0) {
+            run -= 1;
+        } else {
+            if (p >= end) return false;
+            uint8_t b1 = *p++;
+            if (b1 == QOI_OP_RGB) {
+                if (end - p < 3) return false;
+                px.rgba.r = p[0];
+                px.rgba.g = p[1];
+                px.rgba.b = p[2];
+                p += 3;
+            } else if (b1 == QOI_OP_RGBA) {
+                if (end - p < 4) return false;
+                px.rgba.r = p[0];
+                px.rgba.g = p[1];
+                px.rgba.b = p[2];
+                px.rgba.a = p[3];
+                p += 4;
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+                px = index[b1];
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+                px.rgba.r += ((b1 >> 4) & 0x03) - 2;
+                px.rgba.g += ((b1 >> 2) & 0x03) - 2;
+                px.rgba.b += ( b1       & 0x03) - 2;
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+                if (p >= end) return false;
+                uint8_t b2 = *p++;
+                int vg = (b1 & 0x3f) - 32;
+                px.rgba.r += vg - 8 + ((b2 >> 4) & 0x0f);
+                px.rgba.g += vg;
+                px.rgba.b += vg - 8 + (b2 & 0x0f);
+            } else {
+                run = b1 & 0x3f;
+            }
+            index[qoi_hash(px)] = px;
+        }
+        memcpy(pixels + i*4, &px, 4);
+    }
+
+    return true;
+}
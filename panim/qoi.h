@@ -0,0 +1,39 @@
+#ifndef QOI_H_
+#define QOI_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Encoder and decoder of the QOI image format (https://qoiformat.org/) for RGBA8 pixels.
+// Fast enough to compress whole frames on the fly, and lossless.
+
+// Upper bound of qoi_encode_frame() output for a width x height image
+size_t qoi_frame_max_size(size_t width, size_t height);
+// Writes a complete .qoi file into out, which must have room for qoi_frame_max_size() bytes.
+// Not called qoi_encode() because raylib already exports one.
+// If flipped is true the rows of rgba are bottom-up like they come out of OpenGL.
+// Returns the amount of bytes written.
+size_t qoi_encode_frame(const void *rgba, size_t width, size_t height, bool flipped, uint8_t *out);
+// Decodes a .qoi file of exactly width x height pixels. Returns false if the data is malformed.
+bool qoi_decode_frame(const uint8_t *data, size_t size, void *rgba, size_t width, size_t height);
+
+// Encodes a .qoi file piece by piece, for images that are never in memory all at once.
+// qoi_encoder_begin() writes the header, then all the rows of the image go through
+// qoi_encoder_rows() top to bottom, in strips of any height, and qoi_encoder_end() writes the end.
+typedef struct {
+    uint32_t index[64];
+    uint32_t prev;
+    size_t run;
+    size_t remaining;
+} Qoi_Encoder;
+
+// Upper bound of the output for a strip, including the header or the end written along with it
+size_t qoi_rows_max_size(size_t width, size_t rows);
+// All of them return the amount of bytes written into out
+size_t qoi_encoder_begin(Qoi_Encoder *qoi, size_t width, size_t height, uint8_t *out);
+// If flipped is true the rows of this strip are bottom-up
+size_t qoi_encoder_rows(Qoi_Encoder *qoi, const void *rgba, size_t width, size_t rows, bool flipped, uint8_t *out);
+size_t qoi_encoder_end(Qoi_Encoder *qoi, uint8_t *out);
+
+#endif // QOI_H_
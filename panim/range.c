@@ -0,0 +1,47 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "range.h"
+
+bool range_parse_frame(const char *value, size_t fps, size_t *frame)
+{
+    // Only digits and a decimal point, because strtoull() and strtod() would also take leading
+    // spaces, signs, exponents and hexadecimal numbers
+    size_t length = strlen(value);
+    bool seconds = length > 0 && value[length - 1] == 's';
+    size_t digits = 0;
+    size_t points = 0;
+    for (size_t i = 0; i < length - seconds; ++i) {
+        if (value[i] >= '0' && value[i] <= '9') {
+            digits += 1;
+        } else if (value[i] == '.' && seconds) {
+            points += 1;
+        } else {
+            return false;
+        }
+    }
+    if (digits == 0 || points > 1) return false;
+
+    if (!seconds) {
+        errno = 0;
+        unsigned long long x = strtoull(value, NULL, 10);
+        if (errno == ERANGE || x > SIZE_MAX) return false;
+        *frame = x;
+        return true;
+    }
+    double x = strtod(value, NULL);
+    if (!(x < 1e9)) return false;
+    *frame = (size_t)(x*fps + 0.5);
+    return true;
+}
+
+void range_split(size_t begin, size_t end, size_t count, size_t index, size_t *part_begin, size_t *part_end)
+{
+    assert(begin <= end && index < count);
+    size_t length = end - begin;
+    *part_begin = begin + index*length/count;
+    *part_end = begin + (index + 1)*length/count;
+}
@@ -0,0 +1,18 @@
+#ifndef RANGE_H_
+#define RANGE_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// The ranges of frames of the animation that are rendered with --from, --to and --segment, and
+// how they are split between the processes of --jobs. A range [begin, end) starts at begin and
+// stops right before end.
+
+// A frame number, or a time in seconds like 2.5s that is rounded to the nearest frame at fps.
+// Returns false if value is neither of them.
+bool range_parse_frame(const char *value, size_t fps, size_t *frame);
+// The index-th of count consecutive parts of [begin, end), which differ in length by at most one
+// frame and together cover all of it
+void range_split(size_t begin, size_t end, size_t count, size_t index, size_t *part_begin, size_t *part_end);
+
+#endif // RANGE_H_
@@ -0,0 +1,215 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "gl.h"
+#include "readback.h"
+
+#define READBACK_MAX_COUNT 8
+
+struct Readback {
+    size_t width;
+    size_t height;
+    size_t count;
+    GLuint pbos[READBACK_MAX_COUNT];
+    GLsync fences[READBACK_MAX_COUNT];
+    size_t begin;   // Oldest frame in flight
+    size_t pending; // Amount of frames in flight
+    void *pixels;   // Persistent CPU frame
+    Damage damages[READBACK_MAX_COUNT]; // What each frame in flight reads back
+    Damage damage;  // Damage of the last returned frame
+    Damage full;
+};
+
+static size_t readback_size(Readback *rb)
+{
+    return rb->width*rb->height*4;
+}
+
+Readback *readback_create(size_t width, size_t height, size_t count)
+{
+    Readback *rb = malloc(sizeof(Readback));
+    assert(rb != NULL && "Buy MORE RAM lol!!");
+    memset(rb, 0, sizeof(*rb));
+    rb->width = width;
+    rb->height = height;
+    rb->pixels = malloc(readback_size(rb));
+    assert(rb->pixels != NULL && "Buy MORE RAM lol!!");
+    damage_init(&rb->full, width, height);
+    damage_fill(&rb->full);
+
+    if (count > READBACK_MAX_COUNT) count = READBACK_MAX_COUNT;
+    bool procs_loaded = gl_load_procs();
+    if (count > 0 && !procs_loaded) {
+        TraceLog(LOG_WARNING, "READBACK: pixel pack buffers are not available, falling back to synchronous readback");
+        count = 0;
+    }
+    rb->count = count;
+
+    if (rb->count > 0) {
+        gl.GenBuffers(rb->count, rb->pbos);
+        for (size_t i = 0; i < rb->count; ++i) {
+            gl.BindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbos[i]);
+            gl.BufferData(GL_PIXEL_PACK_BUFFER, readback_size(rb), NULL, GL_STREAM_READ);
+        }
+        gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    return rb;
+}
+
+void readback_destroy(Readback *rb)
+{
+    readback_discard(rb);
+    if (rb->count > 0) gl.DeleteBuffers(rb->count, rb->pbos);
+    free(rb->pixels);
+    free(rb);
+}
+
+// pixels is either a CPU frame or an offset into the bound pixel pack buffer.
+// Either way it has the layout of the whole frame, only the read region is written.
+static void readback_read_region(Readback *rb, void *pixels, size_t x, size_t y, size_t w, size_t h)
+{
+    gl.ReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, (uint8_t*)pixels + (y*rb->width + x)*4);
+}
+
+typedef void (*Readback_Region)(Readback *rb, void *pixels, size_t x, size_t y, size_t w, size_t h);
+
+// Calls region for every horizontal run of dirty tiles, so neighbouring tiles go in one call
+static void readback_for_each_run(Readback *rb, const Damage *damage, Readback_Region region, void *pixels)
+{
+    for (size_t row = 0; row < damage->rows; ++row) {
+        const bool *tiles = &damage->tiles[row*damage->cols];
+        for (size_t col = 0; col < damage->cols;) {
+            if (!tiles[col]) {
+                col += 1;
+                continue;
+            }
+            size_t end = col;
+            while (end < damage->cols && tiles[end]) end += 1;
+
+            size_t x, y, w, h, last_x, last_y, last_w, last_h;
+            damage_tile_rect(damage, col, row, &x, &y, &w, &h);
+            damage_tile_rect(damage, end - 1, row, &last_x, &last_y, &last_w, &last_h);
+            region(rb, pixels, x, y, last_x + last_w - x, h);
+            col = end;
+        }
+    }
+}
+
+static void readback_read_pixels(Readback *rb, unsigned int fbo, void *pixels, const Damage *damage)
+{
+    gl.BindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    if (damage == NULL || damage_is_full(damage)) {
+        gl.ReadPixels(0, 0, rb->width, rb->height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    } else {
+        gl.PixelStorei(GL_PACK_ROW_LENGTH, rb->width);
+        readback_for_each_run(rb, damage, readback_read_region, pixels);
+        gl.PixelStorei(GL_PACK_ROW_LENGTH, 0);
+    }
+    gl.BindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+static void readback_copy_region(Readback *rb, void *src, size_t x, size_t y, size_t w, size_t h)
+{
+    size_t stride = rb->width*4;
+    for (size_t row = y; row < y + h; ++row) {
+        memcpy((uint8_t*)rb->pixels + row*stride + x*4, (uint8_t*)src + row*stride + x*4, w*4);
+    }
+}
+
+void *readback_push(Readback *rb, unsigned int fbo)
+{
+    return readback_push_damage(rb, fbo, NULL);
+}
+
+void *readback_push_damage(Readback *rb, unsigned int fbo, const Damage *damage)
+{
+    // Tiles need the PixelStorei entry point, which is not there when the procs failed to load
+    if (damage != NULL && gl.PixelStorei == NULL) damage = NULL;
+    if (damage == NULL) damage = &rb->full;
+
+    if (rb->count == 0) {
+        readback_read_pixels(rb, fbo, rb->pixels, damage);
+        rb->damage = *damage;
+        return rb->pixels;
+    }
+
+    void *pixels = NULL;
+    if (rb->pending == rb->count) pixels = readback_pop(rb);
+
+    size_t index = (rb->begin + rb->pending)%rb->count;
+    rb->damages[index] = *damage;
+    gl.BindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbos[index]);
+    readback_read_pixels(rb, fbo, NULL, damage);
+    gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    rb->fences[index] = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // Make sure the driver actually starts the transfer instead of sitting on it until we map
+    gl.Flush();
+    rb->pending += 1;
+
+    return pixels;
+}
+
+void *readback_pop(Readback *rb)
+{
+    if (rb->pending == 0) return NULL;
+
+    size_t index = rb->begin;
+    if (gl.ClientWaitSync(rb->fences[index], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED) == GL_WAIT_FAILED) {
+        TraceLog(LOG_WARNING, "READBACK: waiting for the frame fence failed");
+    }
+    gl.DeleteSync(rb->fences[index]);
+    rb->fences[index] = NULL;
+
+    gl.BindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbos[index]);
+    void *mapped = gl.MapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readback_size(rb), GL_MAP_READ_BIT);
+    Damage *damage = &rb->damages[index];
+    if (mapped != NULL) {
+        if (damage_is_full(damage)) {
+            memcpy(rb->pixels, mapped, readback_size(rb));
+        } else {
+            readback_for_each_run(rb, damage, readback_copy_region, mapped);
+        }
+        gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        rb->damage = *damage;
+    } else {
+        TraceLog(LOG_WARNING, "READBACK: could not map pixel pack buffer");
+        // The persistent frame did not change
+        rb->damage = *damage;
+        damage_clear(&rb->damage);
+    }
+    gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    rb->begin = (rb->begin + 1)%rb->count;
+    rb->pending -= 1;
+    return rb->pixels;
+}
+
+void readback_set_pixels(Readback *rb, void *pixels)
+{
+    rb->pixels = pixels;
+}
+
+void readback_discard(Readback *rb)
+{
+    while (rb->pending > 0) {
+        gl.DeleteSync(rb->fences[rb->begin]);
+        rb->fences[rb->begin] = NULL;
+        rb->begin = (rb->begin + 1)%rb->count;
+        rb->pending -= 1;
+    }
+}
+
+const Damage *readback_damage(Readback *rb)
+{
+    return &rb->damage;
+}
+
+bool readback_is_async(Readback *rb)
+{
+    return rb->count > 0;
+}
@@ -0,0 +1,40 @@
+#ifndef READBACK_H_
+#define READBACK_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Asynchronous GPU->CPU readback of RGBA8 framebuffers through a ring of
+// pixel-pack buffers. Frame N is copied into a PBO while frame N+1 is drawn,
+// and is only mapped once the ring is full or drained.
+//
+// The returned pixels are bottom-up (OpenGL order) and live in a persistent
+// buffer owned by the Readback. They are valid until the next readback call.
+
+#include "damage.h"
+
+typedef struct Readback Readback;
+
+// count is the amount of frames in flight. 0 means synchronous glReadPixels,
+// which is also the fallback if the required GL entry points are missing.
+Readback *readback_create(size_t width, size_t height, size_t count);
+void readback_destroy(Readback *rb);
+// Start reading back framebuffer object `fbo`. If the ring was full the oldest
+// frame is finished first and its pixels are returned, otherwise NULL.
+void *readback_push(Readback *rb, unsigned int fbo);
+// Same as readback_push(), but only the dirty tiles of damage are read back and patched
+// into the persistent buffer. The rest of it keeps the pixels of the previous frames.
+void *readback_push_damage(Readback *rb, unsigned int fbo, const Damage *damage);
+// Damage of the frame returned by the last push or pop, relative to the one before it
+const Damage *readback_damage(Readback *rb);
+// Finish the oldest frame in flight. Returns NULL if there is nothing in flight.
+void *readback_pop(Readback *rb);
+// Replaces the persistent buffer with pixels (malloc()ed, width*height*4 bytes), for when the caller
+// took the old one over instead of copying it. The readback frees it on destroy. The tiles that are
+// not read back into it afterwards keep whatever was in pixels.
+void readback_set_pixels(Readback *rb, void *pixels);
+// Drop all the frames in flight without reading them.
+void readback_discard(Readback *rb);
+bool readback_is_async(Readback *rb);
+
+#endif // READBACK_H_
@@ -0,0 +1,400 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scale.h"
+#include "workers.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCALE_X86
+#include <immintrin.h>
+#endif
+
+#define SCALE_PRECISION_BITS 14
+#define SCALE_ONE (1 << SCALE_PRECISION_BITS)
+#define SCALE_ROUND (1 << (SCALE_PRECISION_BITS - 1))
+
+// Weights of one direction. Every destination pixel reads the same amount of taps starting
+// at its begin, with zero weights where its filter does not reach, so the windows near the
+// edges are shifted to stay inside the source.
+typedef struct {
+    size_t taps;
+    size_t *begins;
+    int16_t *weights;
+} Scale_Axis;
+
+struct Scaler {
+    size_t src_width;
+    size_t src_height;
+    size_t dst_width;
+    size_t dst_height;
+    Scale_Axis horizontal;
+    Scale_Axis vertical;
+    Scale_Kernel kernel;
+    // Rows of the source already scaled horizontally
+    uint8_t *temp;
+};
+
+static double scale_sinc(double x)
+{
+    if (x == 0.0) return 1.0;
+    x *= M_PI;
+    return sin(x)/x;
+}
+
+static double scale_filter(Scale_Filter filter, double x)
+{
+    switch (filter) {
+    case SCALE_FILTER_BOX:      return x > -0.5 && x <= 0.5 ? 1.0 : 0.0;
+    case SCALE_FILTER_LANCZOS3: return x > -3.0 && x < 3.0 ? scale_sinc(x)*scale_sinc(x/3.0) : 0.0;
+    case COUNT_SCALE_FILTERS:
+    default:                    assert(0 && "unreachable");
+    }
+    return 0.0;
+}
+
+static double scale_filter_support(Scale_Filter filter)
+{
+    return filter == SCALE_FILTER_LANCZOS3 ? 3.0 : 0.5;
+}
+
+static void scale_axis_init(Scale_Axis *axis, size_t src, size_t dst, Scale_Filter filter)
+{
+    double scale = (double)src/dst;
+    // Downscaling stretches the filter over the source pixels that fall into one destination pixel
+    double filter_scale = scale < 1.0 ? 1.0 : scale;
+    double support = scale_filter_support(filter)*filter_scale;
+    size_t taps = (size_t)ceil(support)*2 + 1;
+    if (taps > src) taps = src;
+
+    axis->taps = taps;
+    axis->begins = malloc(dst*sizeof(*axis->begins));
+    axis->weights = calloc(dst*taps, sizeof(*axis->weights));
+    double *weights = malloc(taps*sizeof(*weights));
+    assert(axis->begins != NULL && axis->weights != NULL && weights != NULL && "Buy MORE RAM lol!!");
+
+    for (size_t i = 0; i < dst; ++i) {
+        double center = (i + 0.5)*scale;
+        double lo = floor(center - support + 0.5);
+        double hi = floor(center + support + 0.5);
+        size_t first = lo < 0.0 ? 0 : (size_t)lo;
+        size_t last = hi > (double)src ? src : (size_t)hi;
+        size_t begin = first + taps > src ? src - taps : first;
+
+        double total = 0.0;
+        for (size_t k = 0; k < taps; ++k) {
+            size_t x = begin + k;
+            weights[k] = x >= first && x < last ? scale_filter(filter, (x + 0.5 - center)/filter_scale) : 0.0;
+            total += weights[k];
+        }
+
+        // Quantized weights have to add up to exactly one, or flat areas would change their color
+        int16_t *w = axis->weights + i*taps;
+        int sum = 0;
+        size_t biggest = 0;
+        for (size_t k = 0; k < taps; ++k) {
+            w[k] = (int16_t)lround(total != 0.0 ? weights[k]/total*SCALE_ONE : 0.0);
+            sum += w[k];
+            if (w[k] > w[biggest]) biggest = k;
+        }
+        w[biggest] += SCALE_ONE - sum;
+        axis->begins[i] = begin;
+    }
+
+    free(weights);
+}
+
+static void scale_axis_free(Scale_Axis *axis)
+{
+    free(axis->begins);
+    free(axis->weights);
+}
+
+static inline uint8_t scale_clamp(int32_t x)
+{
+    x >>= SCALE_PRECISION_BITS;
+    return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+// One row of width axis->taps-wide windows of RGBA pixels
+static void scale_row_h_scalar(const uint8_t *src, uint8_t *dst, size_t dst_width, const Scale_Axis *axis)
+{
+    for (size_t x = 0; x < dst_width; ++x) {
+        const uint8_t *p = src + axis->begins[x]*4;
+        const int16_t *w = axis->weights + x*axis->taps;
+        int32_t sum[4] = { SCALE_ROUND, SCALE_ROUND, SCALE_ROUND, SCALE_ROUND };
+        for (size_t k = 0; k < axis->taps; ++k) {
+            for (size_t c = 0; c < 4; ++c) sum[c] += p[k*4 + c]*w[k];
+        }
+        for (size_t c = 0; c < 4; ++c) dst[x*4 + c] = scale_clamp(sum[c]);
+    }
+}
+
+// Weighted sum of taps rows, the bytes [i, size)
+static void scale_row_v_scalar(const uint8_t *src, size_t stride, const int16_t *w, size_t taps, uint8_t *dst, size_t i, size_t size)
+{
+    for (; i < size; ++i) {
+        int32_t sum = SCALE_ROUND;
+        for (size_t k = 0; k < taps; ++k) sum += src[k*stride + i]*w[k];
+        dst[i] = scale_clamp(sum);
+    }
+}
+
+#ifdef SCALE_X86
+static inline int32_t scale_weight_pair(const int16_t *w, size_t k, size_t taps)
+{
+    uint16_t w0 = w[k];
+    uint16_t w1 = k + 1 < taps ? w[k + 1] : 0;
+    return (int32_t)((uint32_t)w0 | ((uint32_t)w1 << 16));
+}
+
+// Sums the pixel windows two taps at a time: the channels of both pixels are interleaved
+// into 16-bit pairs, which madd multiplies by the pair of weights and adds together
+__attribute__((target("sse4.1")))
+static inline __m128i scale_taps_sse41(const uint8_t *p, const int16_t *w, size_t k, size_t taps, __m128i sum)
+{
+    const __m128i interleave = _mm_setr_epi8(0, -1, 4, -1, 1, -1, 5, -1, 2, -1, 6, -1, 3, -1, 7, -1);
+    for (; k + 2 <= taps; k += 2) {
+        __m128i px = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i*)(p + k*4)), interleave);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(px, _mm_set1_epi32(scale_weight_pair(w, k, taps))));
+    }
+    if (k < taps) {
+        int32_t last;
+        memcpy(&last, p + k*4, sizeof(last));
+        __m128i px = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(last));
+        sum = _mm_add_epi32(sum, _mm_mullo_epi32(px, _mm_set1_epi32(w[k])));
+    }
+    return sum;
+}
+
+__attribute__((target("sse4.1")))
+static inline void scale_store_pixel_sse41(uint8_t *dst, __m128i sum)
+{
+    sum = _mm_srai_epi32(sum, SCALE_PRECISION_BITS);
+    sum = _mm_packs_epi32(sum, sum);
+    sum = _mm_packus_epi16(sum, sum);
+    int32_t pixel = _mm_cvtsi128_si32(sum);
+    memcpy(dst, &pixel, sizeof(pixel));
+}
+
+__attribute__((target("sse4.1")))
+static void scale_row_h_sse41(const uint8_t *src, uint8_t *dst, size_t dst_width, const Scale_Axis *axis)
+{
+    for (size_t x = 0; x < dst_width; ++x) {
+        const uint8_t *p = src + axis->begins[x]*4;
+        const int16_t *w = axis->weights + x*axis->taps;
+        __m128i sum = scale_taps_sse41(p, w, 0, axis->taps, _mm_set1_epi32(SCALE_ROUND));
+        scale_store_pixel_sse41(dst + x*4, sum);
+    }
+}
+
+// Adds the rows a and b weighted by the pair of weights ww to the 16 sums of their 16 bytes
+__attribute__((target("sse4.1")))
+static inline void scale_rows_madd_sse41(__m128i a, __m128i b, __m128i ww, __m128i acc[4])
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(a, b);
+    __m128i hi = _mm_unpackhi_epi8(a, b);
+    acc[0] = _mm_add_epi32(acc[0], _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), ww));
+    acc[1] = _mm_add_epi32(acc[1], _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), ww));
+    acc[2] = _mm_add_epi32(acc[2], _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), ww));
+    acc[3] = _mm_add_epi32(acc[3], _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), ww));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i scale_pack_sse41(__m128i acc[4])
+{
+    __m128i lo = _mm_packs_epi32(_mm_srai_epi32(acc[0], SCALE_PRECISION_BITS), _mm_srai_epi32(acc[1], SCALE_PRECISION_BITS));
+    __m128i hi = _mm_packs_epi32(_mm_srai_epi32(acc[2], SCALE_PRECISION_BITS), _mm_srai_epi32(acc[3], SCALE_PRECISION_BITS));
+    return _mm_packus_epi16(lo, hi);
+}
+
+__attribute__((target("sse4.1")))
+static size_t scale_row_v_sse41(const uint8_t *src, size_t stride, const int16_t *w, size_t taps, uint8_t *dst, size_t i, size_t size)
+{
+    for (; i + 16 <= size; i += 16) {
+        __m128i acc[4];
+        for (size_t j = 0; j < 4; ++j) acc[j] = _mm_set1_epi32(SCALE_ROUND);
+        for (size_t k = 0; k < taps; k += 2) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(src + k*stride + i));
+            __m128i b = k + 1 < taps ? _mm_loadu_si128((const __m128i*)(src + (k + 1)*stride + i)) : _mm_setzero_si128();
+            scale_rows_madd_sse41(a, b, _mm_set1_epi32(scale_weight_pair(w, k, taps)), acc);
+        }
+        _mm_storeu_si128((__m128i*)(dst + i), scale_pack_sse41(acc));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static void scale_row_h_avx2(const uint8_t *src, uint8_t *dst, size_t dst_width, const Scale_Axis *axis)
+{
+    // Same as the SSE4.1 interleave, but on pixels already widened to 16 bits, two of them per lane
+    const __m256i interleave = _mm256_setr_epi8(
+        0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15,
+        0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+    size_t taps = axis->taps;
+    for (size_t x = 0; x < dst_width; ++x) {
+        const uint8_t *p = src + axis->begins[x]*4;
+        const int16_t *w = axis->weights + x*taps;
+        __m256i acc = _mm256_setzero_si256();
+        size_t k = 0;
+        for (; k + 4 <= taps; k += 4) {
+            __m256i px = _mm256_shuffle_epi8(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p + k*4))), interleave);
+            __m256i ww = _mm256_setr_epi32(
+                scale_weight_pair(w, k, taps), scale_weight_pair(w, k, taps), scale_weight_pair(w, k, taps), scale_weight_pair(w, k, taps),
+                scale_weight_pair(w, k + 2, taps), scale_weight_pair(w, k + 2, taps), scale_weight_pair(w, k + 2, taps), scale_weight_pair(w, k + 2, taps));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(px, ww));
+        }
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        sum = _mm_add_epi32(sum, _mm_set1_epi32(SCALE_ROUND));
+        sum = scale_taps_sse41(p, w, k, taps, sum);
+        scale_store_pixel_sse41(dst + x*4, sum);
+    }
+}
+
+// The unpacks and packs work within 128-bit lanes, and undo each other, so the bytes come out in order
+__attribute__((target("avx2")))
+static size_t scale_row_v_avx2(const uint8_t *src, size_t stride, const int16_t *w, size_t taps, uint8_t *dst, size_t i, size_t size)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 32 <= size; i += 32) {
+        __m256i acc[4];
+        for (size_t j = 0; j < 4; ++j) acc[j] = _mm256_set1_epi32(SCALE_ROUND);
+        for (size_t k = 0; k < taps; k += 2) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(src + k*stride + i));
+            __m256i b = k + 1 < taps ? _mm256_loadu_si256((const __m256i*)(src + (k + 1)*stride + i)) : zero;
+            __m256i ww = _mm256_set1_epi32(scale_weight_pair(w, k, taps));
+            __m256i lo = _mm256_unpacklo_epi8(a, b);
+            __m256i hi = _mm256_unpackhi_epi8(a, b);
+            acc[0] = _mm256_add_epi32(acc[0], _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), ww));
+            acc[1] = _mm256_add_epi32(acc[1], _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), ww));
+            acc[2] = _mm256_add_epi32(acc[2], _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), ww));
+            acc[3] = _mm256_add_epi32(acc[3], _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), ww));
+        }
+        __m256i lo = _mm256_packs_epi32(_mm256_srai_epi32(acc[0], SCALE_PRECISION_BITS), _mm256_srai_epi32(acc[1], SCALE_PRECISION_BITS));
+        __m256i hi = _mm256_packs_epi32(_mm256_srai_epi32(acc[2], SCALE_PRECISION_BITS), _mm256_srai_epi32(acc[3], SCALE_PRECISION_BITS));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    return scale_row_v_sse41(src, stride, w, taps, dst, i, size);
+}
+#endif // SCALE_X86
+
+const char *scale_kernel_name(Scale_Kernel kernel)
+{
+    switch (kernel) {
+    case SCALE_KERNEL_SCALAR: return "scalar";
+    case SCALE_KERNEL_SSE41:  return "SSE4.1";
+    case SCALE_KERNEL_AVX2:   return "AVX2";
+    case COUNT_SCALE_KERNELS:
+    default:                  return "unknown";
+    }
+}
+
+const char *scale_filter_name(Scale_Filter filter)
+{
+    switch (filter) {
+    case SCALE_FILTER_BOX:      return "box";
+    case SCALE_FILTER_LANCZOS3: return "lanczos";
+    case COUNT_SCALE_FILTERS:
+    default:                    return "unknown";
+    }
+}
+
+Scale_Kernel scale_best_kernel(void)
+{
+#ifdef SCALE_X86
+    if (__builtin_cpu_supports("avx2")) return SCALE_KERNEL_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return SCALE_KERNEL_SSE41;
+#endif
+    return SCALE_KERNEL_SCALAR;
+}
+
+Scaler *scaler_create(size_t src_width, size_t src_height, size_t dst_width, size_t dst_height, Scale_Filter filter)
+{
+    assert(dst_width > 0 && dst_height > 0 && dst_width <= src_width && dst_height <= src_height);
+    Scaler *scaler = malloc(sizeof(Scaler));
+    assert(scaler != NULL && "Buy MORE RAM lol!!");
+    memset(scaler, 0, sizeof(*scaler));
+    scaler->src_width = src_width;
+    scaler->src_height = src_height;
+    scaler->dst_width = dst_width;
+    scaler->dst_height = dst_height;
+    scale_axis_init(&scaler->horizontal, src_width, dst_width, filter);
+    scale_axis_init(&scaler->vertical, src_height, dst_height, filter);
+    scaler->kernel = scale_best_kernel();
+    scaler->temp = malloc(src_height*dst_width*4);
+    assert(scaler->temp != NULL && "Buy MORE RAM lol!!");
+    return scaler;
+}
+
+void scaler_destroy(Scaler *scaler)
+{
+    scale_axis_free(&scaler->horizontal);
+    scale_axis_free(&scaler->vertical);
+    free(scaler->temp);
+    free(scaler);
+}
+
+typedef struct {
+    Scaler *scaler;
+    Scale_Kernel kernel;
+    uint8_t *dst;
+    const uint8_t *src;
+} Scale_Job;
+
+static void scale_horizontal_job(void *ctx, size_t begin, size_t end)
+{
+    Scale_Job *job = ctx;
+    Scaler *scaler = job->scaler;
+    for (size_t y = begin; y < end; ++y) {
+        const uint8_t *src = job->src + y*scaler->src_width*4;
+        uint8_t *dst = scaler->temp + y*scaler->dst_width*4;
+        switch (job->kernel) {
+#ifdef SCALE_X86
+        case SCALE_KERNEL_AVX2:  scale_row_h_avx2(src, dst, scaler->dst_width, &scaler->horizontal);  break;
+        case SCALE_KERNEL_SSE41: scale_row_h_sse41(src, dst, scaler->dst_width, &scaler->horizontal); break;
+#endif
+        default:                 scale_row_h_scalar(src, dst, scaler->dst_width, &scaler->horizontal);
+        }
+    }
+}
+
+static void scale_vertical_job(void *ctx, size_t begin, size_t end)
+{
+    Scale_Job *job = ctx;
+    Scaler *scaler = job->scaler;
+    const Scale_Axis *axis = &scaler->vertical;
+    size_t stride = scaler->dst_width*4;
+    for (size_t y = begin; y < end; ++y) {
+        const uint8_t *src = scaler->temp + axis->begins[y]*stride;
+        const int16_t *w = axis->weights + y*axis->taps;
+        uint8_t *dst = job->dst + y*stride;
+        size_t i = 0;
+        switch (job->kernel) {
+#ifdef SCALE_X86
+        case SCALE_KERNEL_AVX2:  i = scale_row_v_avx2(src, stride, w, axis->taps, dst, 0, stride);  break;
+        case SCALE_KERNEL_SSE41: i = scale_row_v_sse41(src, stride, w, axis->taps, dst, 0, stride); break;
+#endif
+        default: break;
+        }
+        scale_row_v_scalar(src, stride, w, axis->taps, dst, i, stride);
+    }
+}
+
+void scaler_run_with(Scaler *scaler, Scale_Kernel kernel, void *dst, const void *src)
+{
+    Scale_Job job = {
+        .scaler = scaler,
+        .kernel = kernel,
+        .dst = dst,
+        .src = src,
+    };
+    workers_parallel_for(scaler->src_height, scale_horizontal_job, &job);
+    workers_parallel_for(scaler->dst_height, scale_vertical_job, &job);
+}
+
+void scaler_run(Scaler *scaler, void *dst, const void *src)
+{
+    scaler_run_with(scaler, scaler->kernel, dst, src);
+}
@@ -0,0 +1,38 @@
+#ifndef SCALE_H_
+#define SCALE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Downscaling of RGBA8 frames for the renditions of a video. The image is resampled
+// separably, first the rows then the columns, with the filter weights precomputed once
+// per Scaler in 2.14 fixed point. Both passes are split across the workers and use AVX2
+// or SSE4.1 kernels when the CPU has them, with a scalar fallback that is also the
+// reference implementation. Rows can go either way up, the mapping is symmetric.
+
+typedef enum {
+    SCALE_FILTER_BOX,      // Averages the covered area, exact and cheap for integer ratios
+    SCALE_FILTER_LANCZOS3, // Sharper, but several times the taps
+    COUNT_SCALE_FILTERS,
+} Scale_Filter;
+
+typedef enum {
+    SCALE_KERNEL_SCALAR,
+    SCALE_KERNEL_SSE41,
+    SCALE_KERNEL_AVX2,
+    COUNT_SCALE_KERNELS,
+} Scale_Kernel;
+
+typedef struct Scaler Scaler;
+
+// Only downscaling is supported, dst_width <= src_width and dst_height <= src_height
+Scaler *scaler_create(size_t src_width, size_t src_height, size_t dst_width, size_t dst_height, Scale_Filter filter);
+void scaler_destroy(Scaler *scaler);
+void scaler_run(Scaler *scaler, void *dst, const void *src);
+// Same as scaler_run() with a specific kernel. Mostly useful for checking the kernels against each other.
+void scaler_run_with(Scaler *scaler, Scale_Kernel kernel, void *dst, const void *src);
+Scale_Kernel scale_best_kernel(void);
+const char *scale_kernel_name(Scale_Kernel kernel);
+const char *scale_filter_name(Scale_Filter filter);
+
+#endif // SCALE_H_
@@ -0,0 +1,88 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gl.h"
+#include "tiles.h"
+
+#define GL_MAX_TEXTURE_SIZE 0x0D33
+
+struct Tiles {
+    size_t width;
+    size_t height;
+    size_t tile_size;
+    size_t cols;
+    size_t rows;
+    // tile_size rows of the whole width
+    uint8_t *strip;
+    size_t stitched;
+};
+
+size_t tiles_max_texture_size(void)
+{
+    gl_load_procs();
+    if (gl.GetIntegerv == NULL) return 0;
+    GLint size = 0;
+    gl.GetIntegerv(GL_MAX_TEXTURE_SIZE, &size);
+    return size > 0 ? size : 0;
+}
+
+Tiles *tiles_create(size_t width, size_t height, size_t tile_size)
+{
+    assert(width > 0 && height > 0 && tile_size > 0);
+    Tiles *tiles = malloc(sizeof(Tiles));
+    assert(tiles != NULL && "Buy MORE RAM lol!!");
+    memset(tiles, 0, sizeof(*tiles));
+    tiles->width = width;
+    tiles->height = height;
+    tiles->tile_size = tile_size;
+    tiles->cols = (width + tile_size - 1)/tile_size;
+    tiles->rows = (height + tile_size - 1)/tile_size;
+    tiles->strip = malloc(width*tile_size*4);
+    assert(tiles->strip != NULL && "Buy MORE RAM lol!!");
+    return tiles;
+}
+
+void tiles_destroy(Tiles *tiles)
+{
+    free(tiles->strip);
+    free(tiles);
+}
+
+size_t tiles_count(const Tiles *tiles)
+{
+    return tiles->cols*tiles->rows;
+}
+
+void tiles_origin(const Tiles *tiles, size_t index, size_t *x, size_t *y)
+{
+    assert(index < tiles_count(tiles));
+    *x = index%tiles->cols*tiles->tile_size;
+    *y = index/tiles->cols*tiles->tile_size;
+}
+
+const void *tiles_stitch(Tiles *tiles, size_t index, const void *pixels, size_t *rows)
+{
+    // The tiles have to come in order, a strip is sent before the next one starts
+    assert(index%tiles->cols == tiles->stitched);
+    size_t x, y;
+    tiles_origin(tiles, index, &x, &y);
+    size_t w = tiles->width - x < tiles->tile_size ? tiles->width - x : tiles->tile_size;
+    size_t h = tiles->height - y < tiles->tile_size ? tiles->height - y : tiles->tile_size;
+
+    // Row r of the strip is row tile_size - 1 - r of the readback, so the part of the
+    // tile past the bottom of the frame is at the start of the readback and skipped
+    size_t tile_stride = tiles->tile_size*4;
+    size_t strip_stride = tiles->width*4;
+    const uint8_t *src = pixels;
+    for (size_t r = 0; r < h; ++r) {
+        memcpy(tiles->strip + r*strip_stride + x*4, src + (tiles->tile_size - 1 - r)*tile_stride, w*4);
+    }
+
+    tiles->stitched += 1;
+    if (tiles->stitched < tiles->cols) return NULL;
+    tiles->stitched = 0;
+    *rows = h;
+    return tiles->strip;
+}
@@ -0,0 +1,28 @@
+#ifndef TILES_H_
+#define TILES_H_
+
+#include <stddef.h>
+
+// Frames bigger than the GPU can render into at once (GL_MAX_TEXTURE_SIZE) are drawn as a grid of
+// square tiles instead. Every tile is rendered into the same tile sized texture with the projection
+// shifted onto it and read back on its own, and the tiles of a row are stitched into a strip that
+// is streamed to the encoder top to bottom. Only one strip of the frame is ever in memory.
+
+// Size of the tiles when they are not asked for explicitly
+#define TILES_DEFAULT_SIZE 4096
+
+typedef struct Tiles Tiles;
+
+// The biggest render texture the GPU supports, 0 if it can not tell
+size_t tiles_max_texture_size(void);
+Tiles *tiles_create(size_t width, size_t height, size_t tile_size);
+void tiles_destroy(Tiles *tiles);
+size_t tiles_count(const Tiles *tiles);
+// Top-left corner of the tile in the frame, with y going down. The tiles go row by row from the top.
+void tiles_origin(const Tiles *tiles, size_t index, size_t *x, size_t *y);
+// Copies the bottom-up tile_size x tile_size readback of the tile into the strip of its row, leaving
+// out what is past the edges of the frame. Returns the strip once its last tile is in, with *rows
+// top-down rows of the frame in it, and NULL otherwise. The strip is valid until the next stitch.
+const void *tiles_stitch(Tiles *tiles, size_t index, const void *pixels, size_t *rows);
+
+#endif // TILES_H_
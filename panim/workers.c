@@ -0,0 +1,126 @@
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <raylib.h>
+
+#include "workers.h"
+
+#define WORKERS_MAX 64
+// More chunks than threads, so a thread that got a cheap chunk can pick up another one
+#define WORKERS_CHUNKS_PER_THREAD 4
+
+static struct {
+    pthread_once_t once;
+    pthread_mutex_t run_mutex; // Serializes workers_parallel_for() callers
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    pthread_t threads[WORKERS_MAX];
+    size_t threads_count;
+
+    size_t generation;
+    size_t busy;
+    Workers_Job job;
+    void *ctx;
+    size_t count;
+    size_t chunks;
+    atomic_size_t next_chunk;
+} workers = {
+    .once = PTHREAD_ONCE_INIT,
+    .run_mutex = PTHREAD_MUTEX_INITIALIZER,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static void workers_run_chunks(void)
+{
+    for (;;) {
+        size_t chunk = atomic_fetch_add(&workers.next_chunk, 1);
+        if (chunk >= workers.chunks) break;
+        size_t begin = chunk*workers.count/workers.chunks;
+        size_t end = (chunk + 1)*workers.count/workers.chunks;
+        if (begin < end) workers.job(workers.ctx, begin, end);
+    }
+}
+
+static void *workers_thread(void *arg)
+{
+    (void) arg;
+    size_t generation = 0;
+    for (;;) {
+        pthread_mutex_lock(&workers.mutex);
+        while (workers.generation == generation) pthread_cond_wait(&workers.start, &workers.mutex);
+        generation = workers.generation;
+        pthread_mutex_unlock(&workers.mutex);
+
+        workers_run_chunks();
+
+        pthread_mutex_lock(&workers.mutex);
+        workers.busy -= 1;
+        if (workers.busy == 0) pthread_cond_signal(&workers.done);
+        pthread_mutex_unlock(&workers.mutex);
+    }
+    return NULL;
+}
+
+static void workers_init(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    long cpus = pthread_num_processors_np(); // winpthreads
+#endif
+    size_t wanted = cpus > 1 ? cpus - 1 : 0;
+    if (wanted > WORKERS_MAX) wanted = WORKERS_MAX;
+
+    for (size_t i = 0; i < wanted; ++i) {
+        if (pthread_create(&workers.threads[workers.threads_count], NULL, workers_thread, NULL) != 0) {
+            TraceLog(LOG_WARNING, "WORKERS: could only start %zu worker threads", workers.threads_count);
+            break;
+        }
+        workers.threads_count += 1;
+    }
+}
+
+size_t workers_count(void)
+{
+    pthread_once(&workers.once, workers_init);
+    return workers.threads_count + 1;
+}
+
+void workers_parallel_for(size_t count, Workers_Job job, void *ctx)
+{
+    pthread_once(&workers.once, workers_init);
+    if (count == 0) return;
+
+    if (workers.threads_count == 0) {
+        job(ctx, 0, count);
+        return;
+    }
+
+    pthread_mutex_lock(&workers.run_mutex);
+
+    pthread_mutex_lock(&workers.mutex);
+    workers.job = job;
+    workers.ctx = ctx;
+    workers.count = count;
+    workers.chunks = (workers.threads_count + 1)*WORKERS_CHUNKS_PER_THREAD;
+    if (workers.chunks > count) workers.chunks = count;
+    atomic_store(&workers.next_chunk, 0);
+    workers.busy = workers.threads_count;
+    workers.generation += 1;
+    pthread_cond_broadcast(&workers.start);
+    pthread_mutex_unlock(&workers.mutex);
+
+    workers_run_chunks();
+
+    pthread_mutex_lock(&workers.mutex);
+    while (workers.busy > 0) pthread_cond_wait(&workers.done, &workers.mutex);
+    pthread_mutex_unlock(&workers.mutex);
+
+    pthread_mutex_unlock(&workers.run_mutex);
+}
@@ -0,0 +1,19 @@
+#ifndef WORKERS_H_
+#define WORKERS_H_
+
+#include <stddef.h>
+
+// A pool of worker threads shared by everything in panim that wants to split
+// a loop across the cores. The threads are started lazily on the first call.
+
+// Processes the items [begin, end)
+typedef void (*Workers_Job)(void *ctx, size_t begin, size_t end);
+
+// Splits [0, count) into chunks and runs job on them across the workers and the
+// calling thread. Returns when all of them are done. Calls from different threads
+// are serialized.
+void workers_parallel_for(size_t count, Workers_Job job, void *ctx);
+// Amount of threads participating in workers_parallel_for(), including the caller
+size_t workers_count(void);
+
+#endif // WORKERS_H_
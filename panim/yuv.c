@@ -0,0 +1,314 @@
+#include <assert.h>
+
+#include "workers.h"
+#include "yuv.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YUV_X86
+#include <immintrin.h>
+#endif
+
+// BT.601 limited range in 8.8 fixed point. The +16 and +128 offsets are folded
+// into the rounding constants, which keeps every intermediate result inside
+// [0, 65535], so the SIMD kernels can do the exact same math in wrapping 16-bit lanes.
+#define YUV_Y_OFFSET  (128 + (16 << 8))
+#define YUV_UV_OFFSET (128 + (128 << 8))
+
+static inline uint8_t yuv_luma(int r, int g, int b)
+{
+    return (66*r + 129*g + 25*b + YUV_Y_OFFSET) >> 8;
+}
+
+static inline uint8_t yuv_cb(int r, int g, int b)
+{
+    return (-38*r - 74*g + 112*b + YUV_UV_OFFSET) >> 8;
+}
+
+static inline uint8_t yuv_cr(int r, int g, int b)
+{
+    return (112*r - 94*g - 18*b + YUV_UV_OFFSET) >> 8;
+}
+
+// Converts the pixels [x, width) of a pair of rows
+static void yuv_rows_scalar(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, size_t x, size_t width)
+{
+    for (; x < width; x += 2) {
+        const uint8_t *p00 = row0 + x*4;
+        const uint8_t *p01 = p00 + 4;
+        const uint8_t *p10 = row1 + x*4;
+        const uint8_t *p11 = p10 + 4;
+
+        y0[x + 0] = yuv_luma(p00[0], p00[1], p00[2]);
+        y0[x + 1] = yuv_luma(p01[0], p01[1], p01[2]);
+        y1[x + 0] = yuv_luma(p10[0], p10[1], p10[2]);
+        y1[x + 1] = yuv_luma(p11[0], p11[1], p11[2]);
+
+        int r = (p00[0] + p01[0] + p10[0] + p11[0] + 2) >> 2;
+        int g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) >> 2;
+        int b = (p00[2] + p01[2] + p10[2] + p11[2] + 2) >> 2;
+        u[x/2] = yuv_cb(r, g, b);
+        v[x/2] = yuv_cr(r, g, b);
+    }
+}
+
+#ifdef YUV_X86
+// Splits 16 RGBA pixels into 16-bit R, G and B lanes in pixel order, 8 pixels per register
+__attribute__((target("sse4.1")))
+static inline void yuv_planar_sse41(const uint8_t *p, __m128i r[2], __m128i g[2], __m128i b[2])
+{
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    __m128i l[4];
+    for (int i = 0; i < 4; ++i) l[i] = _mm_loadu_si128((const __m128i*)(p + i*16));
+    for (int i = 0; i < 2; ++i) {
+        __m128i a = l[2*i + 0];
+        __m128i c = l[2*i + 1];
+        r[i] = _mm_packus_epi32(_mm_and_si128(a, mask), _mm_and_si128(c, mask));
+        g[i] = _mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(a, 8), mask), _mm_and_si128(_mm_srli_epi32(c, 8), mask));
+        b[i] = _mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(a, 16), mask), _mm_and_si128(_mm_srli_epi32(c, 16), mask));
+    }
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i yuv_dot_sse41(__m128i r, __m128i g, __m128i b, short cr, short cg, short cb, short offset)
+{
+    __m128i x = _mm_mullo_epi16(r, _mm_set1_epi16(cr));
+    x = _mm_add_epi16(x, _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+    x = _mm_add_epi16(x, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+    x = _mm_add_epi16(x, _mm_set1_epi16(offset));
+    return _mm_srli_epi16(x, 8);
+}
+
+// Average of the 2x2 blocks of 8 pixels of two rows, 4 blocks as 32-bit lanes
+__attribute__((target("sse4.1")))
+static inline __m128i yuv_block_avg_sse41(__m128i top, __m128i bottom)
+{
+    __m128i sum = _mm_madd_epi16(_mm_add_epi16(top, bottom), _mm_set1_epi16(1));
+    return _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(2)), 2);
+}
+
+__attribute__((target("sse4.1")))
+static void yuv_rows_sse41(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, size_t width)
+{
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i r0[2], g0[2], b0[2];
+        __m128i r1[2], g1[2], b1[2];
+        yuv_planar_sse41(row0 + x*4, r0, g0, b0);
+        yuv_planar_sse41(row1 + x*4, r1, g1, b1);
+
+        __m128i l0 = yuv_dot_sse41(r0[0], g0[0], b0[0], 66, 129, 25, YUV_Y_OFFSET);
+        __m128i h0 = yuv_dot_sse41(r0[1], g0[1], b0[1], 66, 129, 25, YUV_Y_OFFSET);
+        __m128i l1 = yuv_dot_sse41(r1[0], g1[0], b1[0], 66, 129, 25, YUV_Y_OFFSET);
+        __m128i h1 = yuv_dot_sse41(r1[1], g1[1], b1[1], 66, 129, 25, YUV_Y_OFFSET);
+        _mm_storeu_si128((__m128i*)(y0 + x), _mm_packus_epi16(l0, h0));
+        _mm_storeu_si128((__m128i*)(y1 + x), _mm_packus_epi16(l1, h1));
+
+        __m128i r = _mm_packus_epi32(yuv_block_avg_sse41(r0[0], r1[0]), yuv_block_avg_sse41(r0[1], r1[1]));
+        __m128i g = _mm_packus_epi32(yuv_block_avg_sse41(g0[0], g1[0]), yuv_block_avg_sse41(g0[1], g1[1]));
+        __m128i b = _mm_packus_epi32(yuv_block_avg_sse41(b0[0], b1[0]), yuv_block_avg_sse41(b0[1], b1[1]));
+        __m128i cb = yuv_dot_sse41(r, g, b, -38, -74, 112, (short)YUV_UV_OFFSET);
+        __m128i cr = yuv_dot_sse41(r, g, b, 112, -94, -18, (short)YUV_UV_OFFSET);
+        __m128i uv = _mm_packus_epi16(cb, cr);
+        _mm_storel_epi64((__m128i*)(u + x/2), uv);
+        _mm_storel_epi64((__m128i*)(v + x/2), _mm_srli_si128(uv, 8));
+    }
+    yuv_rows_scalar(row0, row1, y0, y1, u, v, x, width);
+}
+
+// Same as the SSE4.1 version, but packing within 128-bit lanes leaves the pixels of
+// 32 loaded pixels in groups of 4 ordered as 0 2 4 6 | 1 3 5 7. Every channel gets
+// the same order, so the math doesn't care and only the stores have to undo it.
+__attribute__((target("avx2")))
+static inline void yuv_planar_avx2(const uint8_t *p, __m256i r[2], __m256i g[2], __m256i b[2])
+{
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    __m256i l[4];
+    for (int i = 0; i < 4; ++i) l[i] = _mm256_loadu_si256((const __m256i*)(p + i*32));
+    for (int i = 0; i < 2; ++i) {
+        __m256i a = l[2*i + 0];
+        __m256i c = l[2*i + 1];
+        r[i] = _mm256_packus_epi32(_mm256_and_si256(a, mask), _mm256_and_si256(c, mask));
+        g[i] = _mm256_packus_epi32(_mm256_and_si256(_mm256_srli_epi32(a, 8), mask), _mm256_and_si256(_mm256_srli_epi32(c, 8), mask));
+        b[i] = _mm256_packus_epi32(_mm256_and_si256(_mm256_srli_epi32(a, 16), mask), _mm256_and_si256(_mm256_srli_epi32(c, 16), mask));
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i yuv_dot_avx2(__m256i r, __m256i g, __m256i b, short cr, short cg, short cb, short offset)
+{
+    __m256i x = _mm256_mullo_epi16(r, _mm256_set1_epi16(cr));
+    x = _mm256_add_epi16(x, _mm256_mullo_epi16(g, _mm256_set1_epi16(cg)));
+    x = _mm256_add_epi16(x, _mm256_mullo_epi16(b, _mm256_set1_epi16(cb)));
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(offset));
+    return _mm256_srli_epi16(x, 8);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i yuv_block_avg_avx2(__m256i top, __m256i bottom)
+{
+    __m256i sum = _mm256_madd_epi16(_mm256_add_epi16(top, bottom), _mm256_set1_epi16(1));
+    return _mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(2)), 2);
+}
+
+__attribute__((target("avx2")))
+static void yuv_rows_avx2(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, size_t width)
+{
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i r0[2], g0[2], b0[2];
+        __m256i r1[2], g1[2], b1[2];
+        yuv_planar_avx2(row0 + x*4, r0, g0, b0);
+        yuv_planar_avx2(row1 + x*4, r1, g1, b1);
+
+        __m256i l0 = yuv_dot_avx2(r0[0], g0[0], b0[0], 66, 129, 25, YUV_Y_OFFSET);
+        __m256i h0 = yuv_dot_avx2(r0[1], g0[1], b0[1], 66, 129, 25, YUV_Y_OFFSET);
+        __m256i l1 = yuv_dot_avx2(r1[0], g1[0], b1[0], 66, 129, 25, YUV_Y_OFFSET);
+        __m256i h1 = yuv_dot_avx2(r1[1], g1[1], b1[1], 66, 129, 25, YUV_Y_OFFSET);
+        _mm256_storeu_si256((__m256i*)(y0 + x), _mm256_permutevar8x32_epi32(_mm256_packus_epi16(l0, h0), order));
+        _mm256_storeu_si256((__m256i*)(y1 + x), _mm256_permutevar8x32_epi32(_mm256_packus_epi16(l1, h1), order));
+
+        __m256i r = _mm256_packus_epi32(yuv_block_avg_avx2(r0[0], r1[0]), yuv_block_avg_avx2(r0[1], r1[1]));
+        __m256i g = _mm256_packus_epi32(yuv_block_avg_avx2(g0[0], g1[0]), yuv_block_avg_avx2(g0[1], g1[1]));
+        __m256i b = _mm256_packus_epi32(yuv_block_avg_avx2(b0[0], b1[0]), yuv_block_avg_avx2(b0[1], b1[1]));
+        __m256i cb = yuv_dot_avx2(r, g, b, -38, -74, 112, (short)YUV_UV_OFFSET);
+        __m256i cr = yuv_dot_avx2(r, g, b, 112, -94, -18, (short)YUV_UV_OFFSET);
+        // Lane 0 holds the blocks 0 1 4 5 8 9 12 13 and lane 1 the blocks 2 3 6 7 10 11 14 15,
+        // so interleaving the 16-bit pairs of the lanes puts them back in order
+        __m256i uv = _mm256_packus_epi16(cb, cr);
+        __m128i lo = _mm256_castsi256_si128(uv);
+        __m128i hi = _mm256_extracti128_si256(uv, 1);
+        _mm_storeu_si128((__m128i*)(u + x/2), _mm_unpacklo_epi16(lo, hi));
+        _mm_storeu_si128((__m128i*)(v + x/2), _mm_unpackhi_epi16(lo, hi));
+    }
+    yuv_rows_scalar(row0, row1, y0, y1, u, v, x, width);
+}
+#endif // YUV_X86
+
+size_t yuv420_size(size_t width, size_t height)
+{
+    return width*height + 2*(width/2)*(height/2);
+}
+
+const char *yuv420_kernel_name(Yuv_Kernel kernel)
+{
+    switch (kernel) {
+    case YUV_KERNEL_SCALAR: return "scalar";
+    case YUV_KERNEL_SSE41:  return "SSE4.1";
+    case YUV_KERNEL_AVX2:   return "AVX2";
+    case COUNT_YUV_KERNELS:
+    default:                return "unknown";
+    }
+}
+
+Yuv_Kernel yuv420_best_kernel(void)
+{
+#ifdef YUV_X86
+    if (__builtin_cpu_supports("avx2")) return YUV_KERNEL_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return YUV_KERNEL_SSE41;
+#endif
+    return YUV_KERNEL_SCALAR;
+}
+
+// Converts the columns [x, x + w) of the row pairs [begin, end)
+static void yuv420_from_rgba_span(Yuv_Kernel kernel, uint8_t *dst, const void *rgba, size_t width, size_t height, bool flipped, size_t begin, size_t end, size_t x, size_t w)
+{
+    assert(width%2 == 0 && height%2 == 0 && x%2 == 0 && w%2 == 0);
+
+    uint8_t *plane_y = dst;
+    uint8_t *plane_u = plane_y + width*height;
+    uint8_t *plane_v = plane_u + (width/2)*(height/2);
+    size_t stride = width*4;
+
+    for (size_t pair = begin; pair < end; ++pair) {
+        size_t y = pair*2;
+        const uint8_t *row0 = (const uint8_t*)rgba + (flipped ? height - 1 - y : y)*stride + x*4;
+        const uint8_t *row1 = (const uint8_t*)rgba + (flipped ? height - 2 - y : y + 1)*stride + x*4;
+        uint8_t *y0 = plane_y + y*width + x;
+        uint8_t *y1 = y0 + width;
+        uint8_t *u = plane_u + pair*(width/2) + x/2;
+        uint8_t *v = plane_v + pair*(width/2) + x/2;
+
+        switch (kernel) {
+#ifdef YUV_X86
+        case YUV_KERNEL_AVX2:  yuv_rows_avx2(row0, row1, y0, y1, u, v, w);  break;
+        case YUV_KERNEL_SSE41: yuv_rows_sse41(row0, row1, y0, y1, u, v, w); break;
+#endif
+        default:               yuv_rows_scalar(row0, row1, y0, y1, u, v, 0, w);
+        }
+    }
+}
+
+void yuv420_from_rgba_rows(Yuv_Kernel kernel, uint8_t *dst, const void *rgba, size_t width, size_t height, bool flipped, size_t begin, size_t end)
+{
+    yuv420_from_rgba_span(kernel, dst, rgba, width, height, flipped, begin, end, 0, width);
+}
+
+typedef struct {
+    Yuv_Kernel kernel;
+    uint8_t *dst;
+    const void *rgba;
+    size_t width;
+    size_t height;
+    bool flipped;
+} Yuv_Job;
+
+static void yuv_job(void *ctx, size_t begin, size_t end)
+{
+    Yuv_Job *job = ctx;
+    yuv420_from_rgba_rows(job->kernel, job->dst, job->rgba, job->width, job->height, job->flipped, begin, end);
+}
+
+static Yuv_Kernel yuv_kernel(void)
+{
+    static Yuv_Kernel kernel = COUNT_YUV_KERNELS;
+    if (kernel == COUNT_YUV_KERNELS) kernel = yuv420_best_kernel();
+    return kernel;
+}
+
+void yuv420_from_rgba(uint8_t *dst, const void *rgba, size_t width, size_t height, bool flipped)
+{
+    Yuv_Kernel kernel = yuv_kernel();
+
+    Yuv_Job job = {
+        .kernel = kernel,
+        .dst = dst,
+        .rgba = rgba,
+        .width = width,
+        .height = height,
+        .flipped = flipped,
+    };
+    workers_parallel_for(height/2, yuv_job, &job);
+}
+
+typedef struct {
+    Yuv_Kernel kernel;
+    uint8_t *dst;
+    const void *rgba;
+    const Damage *damage;
+} Yuv_Damage_Job;
+
+static void yuv_damage_job(void *ctx, size_t begin, size_t end)
+{
+    Yuv_Damage_Job *job = ctx;
+    const Damage *damage = job->damage;
+    for (size_t i = begin; i < end; ++i) {
+        if (!damage->tiles[i]) continue;
+        size_t x, y, w, h;
+        damage_tile_rect(damage, i%damage->cols, i/damage->cols, &x, &y, &w, &h);
+        // The tile is bottom-up, the planes are top-down
+        size_t top = damage->height - (y + h);
+        yuv420_from_rgba_span(job->kernel, job->dst, job->rgba, damage->width, damage->height, true, top/2, (top + h)/2, x, w);
+    }
+}
+
+void yuv420_from_rgba_damage(uint8_t *dst, const void *rgba, const Damage *damage)
+{
+    Yuv_Damage_Job job = {
+        .kernel = yuv_kernel(),
+        .dst = dst,
+        .rgba = rgba,
+        .damage = damage,
+    };
+    workers_parallel_for(damage->cols*damage->rows, yuv_damage_job, &job);
+}
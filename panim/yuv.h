@@ -0,0 +1,37 @@
+#ifndef YUV_H_
+#define YUV_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "damage.h"
+
+// RGBA -> planar YUV 4:2:0 (yuv420p) conversion with BT.601 limited range coefficients,
+// the same ones ffmpeg uses by default for this conversion. Chroma is computed from the
+// average of every 2x2 block. Width and height must be even.
+//
+// The rows are split across the workers and converted with AVX2 or SSE4.1 kernels when
+// the CPU has them, with a scalar fallback that is also the reference implementation.
+
+typedef enum {
+    YUV_KERNEL_SCALAR,
+    YUV_KERNEL_SSE41,
+    YUV_KERNEL_AVX2,
+    COUNT_YUV_KERNELS,
+} Yuv_Kernel;
+
+size_t yuv420_size(size_t width, size_t height);
+// If flipped is true the rows of rgba are bottom-up like they come out of OpenGL.
+// dst receives the Y plane followed by the U and V planes, all of them tightly packed.
+void yuv420_from_rgba(uint8_t *dst, const void *rgba, size_t width, size_t height, bool flipped);
+// Converts only the dirty tiles of the bottom-up rgba, leaving the rest of dst as it is
+void yuv420_from_rgba_damage(uint8_t *dst, const void *rgba, const Damage *damage);
+// The fastest kernel supported by this CPU, used by yuv420_from_rgba()
+Yuv_Kernel yuv420_best_kernel(void);
+const char *yuv420_kernel_name(Yuv_Kernel kernel);
+// Single threaded conversion of the row pairs [begin, end) with a specific kernel.
+// Mostly useful for checking the kernels against each other.
+void yuv420_from_rgba_rows(Yuv_Kernel kernel, uint8_t *dst, const void *rgba, size_t width, size_t height, bool flipped, size_t begin, size_t end);
+
+#endif // YUV_H_
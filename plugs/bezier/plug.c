@@ -158,6 +158,13 @@ void plug_post_reload(void *state)
     load_assets();
 }
 
+void plug_unload(void *state)
+{
+    Plug *old = state;
+    nob_sb_free(old->sb);
+    free(old);
+}
+
 void plug_update(Env env)
 {
     Color background_color = ColorFromHSV(0, 0, 0.05);
@@ -175,6 +175,13 @@ void plug_post_reload(void *state)
     load_assets();
 }
 
+void plug_unload(void *state)
+{
+    Plug *old = (Plug*)state;
+    if (old->task) delete old->task;
+    free(old);
+}
+
 void plug_update(Env env)
 {
     p->finished = p->task->update(env);
@@ -239,6 +239,15 @@ void plug_post_reload(void *state)
     load_assets();
 }
 
+void plug_unload(void *state)
+{
+    Plug *old = (Plug*)state;
+    if (old->task) delete old->task;
+    delete old->points;
+    delete old->texs;
+    free(old);
+}
+
 void plug_update(Env env)
 {
     if(IsKeyPressed(KEY_E)){
@@ -136,6 +136,14 @@ void plug_post_reload(void *state)
     load_assets();
 }
 
+void plug_unload(void *state)
+{
+    Plug *old = state;
+    arena_free(&old->state_arena);
+    arena_free(&old->asset_arena);
+    free(old);
+}
+
 void plug_update(Env env)
 {
     p->finished = task_update(p->task, env);
@@ -159,6 +167,11 @@ void plug_update(Env env)
         DrawRectangleRec(boundary, ColorFromNormalized(p->squares[i].color));
     }
     EndMode2D();
+
+    // The squares only ever move between the cells of the 2x2 grid, so the rest of the screen stays the same
+    Vector2 grid_position = GetWorldToScreen2D(grid(0, 0), camera);
+    float grid_size = 2*SQUARE_SIZE + SQUARE_PAD;
+    env.report_damage(CLITERAL(Rectangle) { grid_position.x, grid_position.y, grid_size, grid_size });
 }
 
 bool plug_finished(void)
@@ -63,6 +63,11 @@ void plug_post_reload(void *state)
     load_assets();
 }
 
+void plug_unload(void *state)
+{
+    free(state);
+}
+
 void plug_update(Env env)
 {
     Color background_color = ColorFromHSV(0, 0, 0.05);
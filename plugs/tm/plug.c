@@ -689,6 +689,14 @@ void plug_post_reload(void *state)
     load_assets();
 }
 
+void plug_unload(void *state)
+{
+    Plug *old = state;
+    arena_free(&old->arena_state);
+    arena_free(&old->arena_assets);
+    free(old);
+}
+
 static void text_in_rec(Rectangle rec, const char *text, Font_Style style, float size, Color color)
 {
     Vector2 rec_size = {rec.width, rec.height};
@@ -0,0 +1,161 @@
+// Checks the accumulation of frames of panim/accum.c
+// - every SIMD kernel the CPU supports against the scalar kernel, bit for bit, for the sums
+//   and for the averages
+// - the threaded accum_add() and accum_resolve() against the scalar kernel
+// - that the average is the sum divided by the count and rounded to the nearest, for every
+//   sum that count frames can add up to, with every count up to ACCUM_MAX_COUNT
+//
+// The sizes are mostly not multiples of the 16 and 32 bytes the SIMD kernels do at once, the
+// offsets make the loads unaligned, and the biggest size is split into several chunks of the workers.
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "accum.h"
+
+static const size_t sizes[] = {1, 15, 16, 17, 31, 32, 33, 100, 1000, 200000};
+static const size_t offsets[] = {0, 3};
+static const size_t counts[] = {1, 2, 3, 5, 7, 16, 100, 255, 256};
+
+#define MAX_SIZE 200000
+#define MAX_OFFSET 3
+
+static uint32_t random_state = 0x1234567;
+
+static uint8_t random_byte(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state >> 24;
+}
+
+// Mostly random, with runs of 255 so that the sums of the biggest counts reach their maximum
+static void fill_frame(uint8_t *frame, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) frame[i] = i%64 < 16 ? 255 : random_byte();
+}
+
+// Adds up count random frames. Garbage in the sums beforehand makes sure the first frame
+// replaces them instead of being added to them.
+static void add_frames(Accum_Kernel kernel, bool threaded, uint16_t *sum, uint8_t *frame, size_t size, size_t count)
+{
+    memset(sum, 0xAA, size*sizeof(uint16_t));
+    for (size_t i = 0; i < count; ++i) {
+        fill_frame(frame, size);
+        if (threaded) {
+            accum_add(sum, frame, size, i == 0);
+        } else {
+            accum_add_with(kernel, sum, frame, size, i == 0);
+        }
+    }
+}
+
+static bool check_sums(const uint16_t *expected, const uint16_t *actual, size_t size, const char *what)
+{
+    for (size_t i = 0; i < size; ++i) {
+        if (expected[i] != actual[i]) {
+            fprintf(stderr, "FAIL: %s: sum %zu is %d instead of %d\n", what, i, actual[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool check_bytes(const uint8_t *expected, const uint8_t *actual, size_t size, const char *what)
+{
+    for (size_t i = 0; i < size; ++i) {
+        if (expected[i] != actual[i]) {
+            fprintf(stderr, "FAIL: %s: byte %zu is %d instead of %d\n", what, i, actual[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every sum from 0 to count*255 goes through the kernel and is compared against the division
+static bool check_division(Accum_Kernel kernel, size_t count, uint16_t *sum, uint8_t *dst)
+{
+    size_t size = count*255 + 1;
+    for (size_t i = 0; i < size; ++i) sum[i] = i;
+    accum_resolve_with(kernel, dst, sum, size, count);
+    for (size_t i = 0; i < size; ++i) {
+        size_t expected = (i + count/2)/count;
+        if (dst[i] != expected) {
+            fprintf(stderr, "FAIL: %s: %zu/%zu is %d instead of %zu\n", accum_kernel_name(kernel), i, count, dst[i], expected);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(void)
+{
+    Accum_Kernel best = accum_best_kernel();
+    printf("Kernels up to %s are supported by this CPU\n", accum_kernel_name(best));
+
+    uint8_t *frame = malloc(MAX_SIZE + MAX_OFFSET);
+    uint16_t *scalar_sum = malloc((MAX_SIZE + MAX_OFFSET)*sizeof(uint16_t));
+    uint16_t *sum = malloc((MAX_SIZE + MAX_OFFSET)*sizeof(uint16_t));
+    uint8_t *scalar_dst = malloc(MAX_SIZE + MAX_OFFSET);
+    uint8_t *dst = malloc(MAX_SIZE + MAX_OFFSET);
+    if (frame == NULL || scalar_sum == NULL || sum == NULL || scalar_dst == NULL || dst == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+    }
+
+    size_t checks = 0;
+    bool ok = true;
+    for (size_t si = 0; si < sizeof(sizes)/sizeof(sizes[0]); ++si) {
+        size_t size = sizes[si];
+        for (size_t oi = 0; oi < sizeof(offsets)/sizeof(offsets[0]); ++oi) {
+            size_t offset = offsets[oi];
+            for (size_t ci = 0; ci < sizeof(counts)/sizeof(counts[0]); ++ci) {
+                size_t count = counts[ci];
+                char what[128];
+                #define WHAT(kind) (snprintf(what, sizeof(what), "%s size %zu offset %zu count %zu", kind, size, offset, count), what)
+
+                uint32_t frames_state = random_state;
+                add_frames(ACCUM_KERNEL_SCALAR, false, scalar_sum + offset, frame + offset, size, count);
+                accum_resolve_with(ACCUM_KERNEL_SCALAR, scalar_dst + offset, scalar_sum + offset, size, count);
+
+                for (Accum_Kernel kernel = ACCUM_KERNEL_SCALAR + 1; kernel <= best; ++kernel) {
+                    random_state = frames_state;
+                    add_frames(kernel, false, sum + offset, frame + offset, size, count);
+                    ok = check_sums(scalar_sum + offset, sum + offset, size, WHAT(accum_kernel_name(kernel))) && ok;
+                    memset(dst, 0xAA, MAX_SIZE + MAX_OFFSET);
+                    accum_resolve_with(kernel, dst + offset, scalar_sum + offset, size, count);
+                    ok = check_bytes(scalar_dst + offset, dst + offset, size, WHAT(accum_kernel_name(kernel))) && ok;
+                    checks += 2;
+                }
+
+                random_state = frames_state;
+                add_frames(best, true, sum + offset, frame + offset, size, count);
+                ok = check_sums(scalar_sum + offset, sum + offset, size, WHAT("threaded")) && ok;
+                memset(dst, 0xAA, MAX_SIZE + MAX_OFFSET);
+                accum_resolve(dst + offset, scalar_sum + offset, size, count);
+                ok = check_bytes(scalar_dst + offset, dst + offset, size, WHAT("threaded")) && ok;
+                checks += 2;
+                #undef WHAT
+            }
+        }
+    }
+
+    for (Accum_Kernel kernel = ACCUM_KERNEL_SCALAR; kernel <= best; ++kernel) {
+        for (size_t count = 1; count <= ACCUM_MAX_COUNT; ++count) {
+            ok = check_division(kernel, count, sum, dst) && ok;
+            checks += 1;
+        }
+    }
+
+    free(frame);
+    free(scalar_sum);
+    free(sum);
+    free(scalar_dst);
+    free(dst);
+    if (!ok) return 1;
+    printf("OK: %zu checks passed\n", checks);
+    return 0;
+}
@@ -0,0 +1,293 @@
+// Checks the checkpointed renders of panim/checkpoint.c with an animation that writes its state
+// into the segments instead of drawing frames
+// - that a render interrupted in the middle of a segment, at the start of one, at its very first
+//   frame or at its last one, and then resumed, comes out the same as a render that was never
+//   interrupted, also with --segment and with an animation that ends before the segment
+// - that resuming skips exactly the frames of the complete segments and renders all of the rest,
+//   and takes over the length of the segments of the interrupted render
+// - that the segment that was being rendered when it was interrupted is not kept
+// - that no checkpoint starts from the beginning, and that one with other settings is refused
+#define NOB_IMPLEMENTATION
+#include "nob.h"
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include <raylib.h>
+
+#include "checkpoint.h"
+
+#define SETTINGS "panim checkpoint test 1920x1080@60 h264 .bin"
+#define NEVER SIZE_MAX
+
+typedef struct {
+    size_t frames;
+    size_t next_frame;
+    // Advances every frame, skipped or rendered, like the state of a plug
+    uint64_t state;
+    size_t skipped;
+    size_t rendered;
+    size_t fail_at;
+    FILE *segment;
+    const char *segment_path;
+} Animation;
+
+static void animation_advance(Animation *a)
+{
+    a->state = a->state*6364136223846793005ull + 1442695040888963407ull;
+    a->next_frame += 1;
+}
+
+static bool animation_finished(void *ctx)
+{
+    Animation *a = ctx;
+    return a->next_frame >= a->frames;
+}
+
+static void animation_skip_frame(void *ctx)
+{
+    Animation *a = ctx;
+    a->skipped += 1;
+    animation_advance(a);
+}
+
+static bool animation_start_segment(void *ctx, const char *path)
+{
+    Animation *a = ctx;
+    a->segment = fopen(path, "wb");
+    a->segment_path = path;
+    return a->segment != NULL;
+}
+
+// Every frame is its number and the state it was drawn in
+static bool animation_render_frame(void *ctx)
+{
+    Animation *a = ctx;
+    if (a->next_frame == a->fail_at) return false;
+    uint64_t frame[2] = {a->next_frame, a->state};
+    fwrite(frame, sizeof(frame), 1, a->segment);
+    a->rendered += 1;
+    animation_advance(a);
+    return true;
+}
+
+static bool animation_finish_segment(void *ctx, bool cancel)
+{
+    Animation *a = ctx;
+    bool ok = fclose(a->segment) == 0;
+    a->segment = NULL;
+    if (cancel) remove(a->segment_path);
+    return ok && !cancel;
+}
+
+static Checkpoint_Renderer animation_renderer(Animation *a)
+{
+    return (Checkpoint_Renderer) {
+        .ctx = a,
+        .finished = animation_finished,
+        .skip_frame = animation_skip_frame,
+        .start_segment = animation_start_segment,
+        .render_frame = animation_render_frame,
+        .finish_segment = animation_finish_segment,
+    };
+}
+
+// The frames from begin to end of an animation that was never interrupted
+static void expected_frames(size_t frames, size_t begin, size_t end, Nob_String_Builder *sb)
+{
+    Animation a = { .frames = frames };
+    for (; a.next_frame < end && a.next_frame < frames; animation_advance(&a)) {
+        if (a.next_frame < begin) continue;
+        uint64_t frame[2] = {a.next_frame, a.state};
+        nob_sb_append_buf(sb, frame, sizeof(frame));
+    }
+}
+
+static bool join_segments(const Checkpoint *cp, Nob_String_Builder *sb)
+{
+    for (size_t i = 0; i < cp->segments_count; ++i) {
+        if (!nob_read_entire_file(checkpoint_segment_path(cp, i), sb)) return false;
+    }
+    return true;
+}
+
+typedef struct {
+    size_t frames;
+    size_t begin;
+    size_t end;
+    size_t segment_frames;
+    size_t fail_at;
+    // The length of the segments asked for when resuming, which the checkpoint overrides
+    size_t resume_segment_frames;
+} Case;
+
+static const Case cases[] = {
+    {100, 0, NEVER, 10, 35, 10},
+    {100, 0, NEVER, 10, 40, 10},
+    {100, 0, NEVER, 10, 0, 10},
+    {100, 0, NEVER, 10, 99, 10},
+    {100, 0, NEVER, 10, 35, 7},
+    {100, 13, 77, 10, 50, 10},
+    {100, 13, 77, 10, 13, 10},
+    {55, 0, NEVER, 10, 52, 10},
+    {100, 0, NEVER, 1, 64, 1},
+    {100, 0, NEVER, 1000, 64, 1000},
+};
+
+static bool check_case(const char *dir, const Case *c)
+{
+    char what[128];
+    snprintf(what, sizeof(what), "%zu frames from %zu to %s in segments of %zu failing at %zu", c->frames, c->begin,
+             c->end == NEVER ? "the end" : nob_temp_sprintf("%zu", c->end), c->segment_frames, c->fail_at);
+    Nob_String_Builder expected = {0};
+    Nob_String_Builder actual = {0};
+    expected_frames(c->frames, c->begin, c->end, &expected);
+    bool ok = true;
+
+    Checkpoint cp = {
+        .dir = nob_temp_sprintf("%s/output.bin.checkpoint", dir),
+        .settings = SETTINGS,
+        .ext = ".bin",
+        .segment_frames = c->segment_frames,
+    };
+    Animation a = { .frames = c->frames, .fail_at = c->fail_at };
+    Checkpoint_Renderer renderer = animation_renderer(&a);
+    size_t frame = 0;
+    if (!checkpoint_start(&cp, false) || checkpoint_render(&cp, c->begin, c->end, &renderer, &frame)) {
+        fprintf(stderr, "FAIL: %s: the render is not interrupted\n", what);
+        return false;
+    }
+    size_t complete = (c->fail_at - c->begin)/c->segment_frames;
+    if (cp.segments_count != complete) {
+        fprintf(stderr, "FAIL: %s: %zu segments are complete instead of %zu\n", what, cp.segments_count, complete);
+        ok = false;
+    }
+    if (nob_file_exists(checkpoint_segment_path(&cp, cp.segments_count)) != 0) {
+        fprintf(stderr, "FAIL: %s: the interrupted segment is kept\n", what);
+        ok = false;
+    }
+
+    // A new process that knows nothing but the output and the settings
+    Checkpoint resumed = {
+        .dir = cp.dir,
+        .settings = SETTINGS,
+        .ext = ".bin",
+        .segment_frames = c->resume_segment_frames,
+    };
+    a = (Animation) { .frames = c->frames, .fail_at = NEVER };
+    renderer = animation_renderer(&a);
+    if (!checkpoint_start(&resumed, true) || resumed.segments_count != complete || resumed.segment_frames != c->segment_frames) {
+        fprintf(stderr, "FAIL: %s: the checkpoint says %zu segments of %zu frames\n", what, resumed.segments_count, resumed.segment_frames);
+        ok = false;
+    } else if (!checkpoint_render(&resumed, c->begin, c->end, &renderer, &frame)) {
+        fprintf(stderr, "FAIL: %s: the resumed render failed\n", what);
+        ok = false;
+    } else {
+        size_t skipped = c->begin + complete*c->segment_frames;
+        size_t last = c->end < c->frames ? c->end : c->frames;
+        if (a.skipped != skipped || a.rendered != last - skipped || frame != last) {
+            fprintf(stderr, "FAIL: %s: %zu frames are skipped and %zu rendered instead of %zu and %zu\n", what,
+                    a.skipped, a.rendered, skipped, last - skipped);
+            ok = false;
+        }
+        if (!join_segments(&resumed, &actual) || actual.count != expected.count ||
+            memcmp(actual.items, expected.items, expected.count) != 0) {
+            fprintf(stderr, "FAIL: %s: the resumed render is not the render that was never interrupted\n", what);
+            ok = false;
+        }
+    }
+
+    checkpoint_remove(&resumed);
+    if (nob_file_exists(cp.dir) != 0) {
+        fprintf(stderr, "FAIL: %s: the checkpoint is left behind\n", what);
+        ok = false;
+    }
+    nob_sb_free(expected);
+    nob_sb_free(actual);
+    return ok;
+}
+
+static bool check_uninterrupted(const char *dir)
+{
+    Nob_String_Builder expected = {0};
+    Nob_String_Builder actual = {0};
+    expected_frames(100, 0, NEVER, &expected);
+    Checkpoint cp = {
+        .dir = nob_temp_sprintf("%s/output.bin.checkpoint", dir),
+        .settings = SETTINGS,
+        .ext = ".bin",
+        .segment_frames = 30,
+    };
+    Animation a = { .frames = 100, .fail_at = NEVER };
+    Checkpoint_Renderer renderer = animation_renderer(&a);
+    size_t frame = 0;
+    // --resume without a checkpoint starts from the beginning
+    bool ok = checkpoint_start(&cp, true) && cp.segments_count == 0 && checkpoint_render(&cp, 0, NEVER, &renderer, &frame) &&
+              cp.segments_count == 4 && a.skipped == 0 && join_segments(&cp, &actual) && actual.count == expected.count &&
+              memcmp(actual.items, expected.items, expected.count) == 0;
+    if (!ok) fprintf(stderr, "FAIL: the render that is never interrupted is not every frame in 4 segments\n");
+    checkpoint_remove(&cp);
+    nob_sb_free(expected);
+    nob_sb_free(actual);
+    return ok;
+}
+
+static bool check_other_settings(const char *dir)
+{
+    Checkpoint cp = {
+        .dir = nob_temp_sprintf("%s/output.bin.checkpoint", dir),
+        .settings = SETTINGS,
+        .ext = ".bin",
+        .segment_frames = 10,
+    };
+    bool ok = checkpoint_start(&cp, false);
+
+    // The errors are expected here
+    SetTraceLogLevel(LOG_NONE);
+    static const char *other_settings[] = {SETTINGS "@other", "panim checkpoint test", ""};
+    for (size_t i = 0; i < NOB_ARRAY_LEN(other_settings) && ok; ++i) {
+        Checkpoint other = cp;
+        other.settings = other_settings[i];
+        if (checkpoint_start(&other, true)) {
+            fprintf(stderr, "FAIL: a checkpoint made with \"%s\" is resumed with \"%s\"\n", SETTINGS, other_settings[i]);
+            ok = false;
+        }
+    }
+    SetTraceLogLevel(LOG_WARNING);
+    checkpoint_remove(&cp);
+    return ok;
+}
+
+int main(void)
+{
+    SetTraceLogLevel(LOG_WARNING);
+    nob_minimal_log_level = NOB_WARNING;
+
+    char dir_template[] = "/tmp/panim-checkpoint-test-XXXXXX";
+    const char *dir = mkdtemp(dir_template);
+    if (dir == NULL) {
+        fprintf(stderr, "ERROR: could not create a temporary directory: %s\n", strerror(errno));
+        return 1;
+    }
+
+    size_t checks = 0;
+    bool ok = true;
+    for (size_t i = 0; i < NOB_ARRAY_LEN(cases); ++i) {
+        ok = check_case(dir, &cases[i]) && ok;
+        checks += 1;
+    }
+    ok = check_uninterrupted(dir) && ok;
+    checks += 1;
+    ok = check_other_settings(dir) && ok;
+    checks += 1;
+
+    if (rmdir(dir) != 0) {
+        fprintf(stderr, "FAIL: files are left behind in %s\n", dir);
+        ok = false;
+    }
+    checks += 1;
+
+    if (!ok) return 1;
+    printf("OK: %zu checks passed\n", checks);
+    return 0;
+}
@@ -0,0 +1,161 @@
+// Checks the preview frame cache of panim/frame_cache.c
+// - that the frames come back bit for bit, also when they have fewer rows than the cache has strips
+// - that replacing a frame replaces its pixels and its share of the budget
+// - that the least recently used frames are evicted once the budget is full, and that
+//   frame_cache_get() makes a frame recently used
+// - that missing frames, frames of another size and frames bigger than the budget are refused
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_cache.h"
+
+typedef struct {
+    size_t width;
+    size_t height;
+} Size;
+
+static const Size sizes[] = {{1, 1}, {7, 5}, {33, 17}, {640, 360}};
+
+#define FLAT_WIDTH 64
+#define FLAT_HEIGHT 32
+
+static uint32_t random_state = 0x1234567;
+
+static uint8_t random_byte(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state >> 24;
+}
+
+// Half noise and half gradient, so the strips compress into very different sizes
+static void fill_frame(uint8_t *rgba, size_t width, size_t height)
+{
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            uint8_t *p = rgba + (y*width + x)*4;
+            if (y < height/2) {
+                p[0] = random_byte();
+                p[1] = random_byte();
+                p[2] = random_byte();
+                p[3] = random_byte();
+            } else {
+                p[0] = x;
+                p[1] = y;
+                p[2] = x + y;
+                p[3] = 255;
+            }
+        }
+    }
+}
+
+// Flat frames of the grays far from black compress into the same amount of bytes, because the
+// first pixel of every strip is a full RGB pixel
+static void fill_flat(uint8_t *rgba, size_t shade)
+{
+    uint8_t color = 100 + shade*10;
+    for (size_t i = 0; i < FLAT_WIDTH*FLAT_HEIGHT; ++i) {
+        rgba[i*4 + 0] = color;
+        rgba[i*4 + 1] = color;
+        rgba[i*4 + 2] = color;
+        rgba[i*4 + 3] = 255;
+    }
+}
+
+#define CHECK(cond, ...)                            \
+    do {                                            \
+        checks += 1;                                \
+        if (!(cond)) {                              \
+            fprintf(stderr, "FAIL: " __VA_ARGS__);  \
+            fprintf(stderr, "\n");                  \
+            ok = false;                             \
+        }                                           \
+    } while (0)
+
+int main(void)
+{
+    size_t checks = 0;
+    bool ok = true;
+
+    uint8_t *rgba = malloc(640*360*4);
+    uint8_t *decoded = malloc(640*360*4);
+    if (rgba == NULL || decoded == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+    }
+
+    {
+        Frame_Cache *fc = frame_cache_create(64*1024*1024);
+        for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); ++i) {
+            size_t width = sizes[i].width;
+            size_t height = sizes[i].height;
+            fill_frame(rgba, width, height);
+            CHECK(frame_cache_put(fc, i, rgba, width, height), "%zux%zu: the frame is not cached", width, height);
+            memset(decoded, 0xAA, width*height*4);
+            CHECK(frame_cache_get(fc, i, decoded, width, height), "%zux%zu: the cached frame is not decoded", width, height);
+            CHECK(memcmp(rgba, decoded, width*height*4) == 0, "%zux%zu: the decoded frame is not the cached one", width, height);
+            CHECK(!frame_cache_get(fc, i, decoded, width + 1, height) && !frame_cache_get(fc, i, decoded, width, height + 1),
+                  "%zux%zu: the frame is decoded into a frame of another size", width, height);
+        }
+        CHECK(frame_cache_count(fc) == sizeof(sizes)/sizeof(sizes[0]), "%zu frames are counted instead of %zu",
+              frame_cache_count(fc), sizeof(sizes)/sizeof(sizes[0]));
+        CHECK(!frame_cache_has(fc, 100) && !frame_cache_get(fc, 100, decoded, 1, 1), "a missing frame is found");
+        CHECK(!frame_cache_has(fc, 1000000), "a frame far beyond the cached ones is found");
+
+        // The last frame is replaced by one that compresses much better
+        size_t last = sizeof(sizes)/sizeof(sizes[0]) - 1;
+        size_t size_before = frame_cache_size(fc);
+        memset(rgba, 0, 640*360*4);
+        CHECK(frame_cache_put(fc, last, rgba, 640, 360), "the replacement frame is not cached");
+        CHECK(frame_cache_get(fc, last, decoded, 640, 360) && memcmp(rgba, decoded, 640*360*4) == 0,
+              "the replaced frame is decoded instead of its replacement");
+        CHECK(frame_cache_count(fc) == last + 1, "replacing a frame changes the amount of frames");
+        CHECK(frame_cache_size(fc) < size_before, "the replaced frame still takes up the budget");
+
+        frame_cache_clear(fc);
+        CHECK(frame_cache_count(fc) == 0 && frame_cache_size(fc) == 0 && !frame_cache_has(fc, 0),
+              "the frames are still there after clearing the cache");
+        frame_cache_destroy(fc);
+    }
+
+    {
+        Frame_Cache *fc = frame_cache_create(1024*1024);
+        fill_flat(rgba, 0);
+        CHECK(frame_cache_put(fc, 0, rgba, FLAT_WIDTH, FLAT_HEIGHT), "the flat frame is not cached");
+        size_t frame_size = frame_cache_size(fc);
+        frame_cache_destroy(fc);
+
+        // Room for 4 frames
+        fc = frame_cache_create(frame_size*4 + frame_size/2);
+        for (size_t i = 0; i < 4; ++i) {
+            fill_flat(rgba, i);
+            frame_cache_put(fc, i, rgba, FLAT_WIDTH, FLAT_HEIGHT);
+        }
+        CHECK(frame_cache_count(fc) == 4 && frame_cache_size(fc) == frame_size*4, "4 frames do not fit into their budget");
+        // Frame 0 becomes the most recently used one, so frame 1 is the oldest one now
+        CHECK(frame_cache_get(fc, 0, decoded, FLAT_WIDTH, FLAT_HEIGHT), "frame 0 is not decoded");
+        fill_flat(rgba, 4);
+        CHECK(frame_cache_put(fc, 4, rgba, FLAT_WIDTH, FLAT_HEIGHT), "frame 4 is not cached");
+        CHECK(frame_cache_count(fc) == 4 && frame_cache_size(fc) <= frame_size*4 + frame_size/2,
+              "%zu bytes of %zu frames are cached beyond the budget", frame_cache_size(fc), frame_cache_count(fc));
+        CHECK(frame_cache_has(fc, 0), "the most recently used frame is evicted");
+        CHECK(!frame_cache_has(fc, 1), "the least recently used frame is not evicted");
+        CHECK(frame_cache_has(fc, 2) && frame_cache_has(fc, 3) && frame_cache_has(fc, 4), "the wrong frames are evicted");
+        frame_cache_destroy(fc);
+
+        fc = frame_cache_create(frame_size - 1);
+        CHECK(!frame_cache_put(fc, 0, rgba, FLAT_WIDTH, FLAT_HEIGHT), "a frame bigger than the budget is cached");
+        CHECK(frame_cache_count(fc) == 0 && frame_cache_size(fc) == 0, "a frame bigger than the budget is counted");
+        frame_cache_destroy(fc);
+    }
+
+    free(rgba);
+    free(decoded);
+    if (!ok) return 1;
+    printf("OK: %zu checks passed\n", checks);
+    return 0;
+}
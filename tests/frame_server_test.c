@@ -0,0 +1,367 @@
+// Checks the frame server of panim/frame_server.c with readers in forked processes
+// - that a reader that keeps up gets every frame, intact and with the header describing it
+// - that a reader that falls behind sees its frame overwritten and skips to the latest one
+// - that a change of the size closes the memfd, and that the readers connect again and get the
+//   frames of the new size
+// - that waiting without new frames times out
+// - that readers reading as fast as they can while frames are published as fast as possible never
+//   take a frame that was overwritten under them for an intact one
+// - that connecting without a server and listening on a path that does not fit fail
+//
+// The readers tell the server what they are doing through pipes, so the steps happen in the
+// same order on every run.
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <raylib.h>
+
+#include "frame_server.h"
+
+#define WIDTH 320
+#define HEIGHT 180
+#define RESIZED_WIDTH 160
+#define RESIZED_HEIGHT 90
+#define FPS 60
+#define LOCKSTEP_FRAMES 20
+#define RESIZED_FRAMES 5
+
+#define STRESS_READERS 3
+#define STRESS_WIDTH 640
+#define STRESS_HEIGHT 360
+#define STRESS_FRAMES 300
+
+// Every reply of a reader to the server is a byte
+#define REPLY_CONNECTED 'c'
+#define REPLY_RECONNECTING 'n'
+#define REPLY_OK '1'
+#define REPLY_FAIL '0'
+// The server lets the reader go on
+#define GO 'g'
+
+// Long enough to never be hit unless something hangs
+#define TIMEOUT_MS 5000
+
+static char socket_path[64];
+
+// Every pixel of every frame is different, so a frame from the wrong slot or a torn one is noticed
+static uint32_t pixel(uint64_t sequence, size_t width, size_t i)
+{
+    return (uint32_t)sequence*0x9E3779B1u ^ (uint32_t)i*0x85EBCA77u ^ (uint32_t)width;
+}
+
+static void fill_frame(uint32_t *pixels, uint64_t sequence, size_t width, size_t height)
+{
+    for (size_t i = 0; i < width*height; ++i) pixels[i] = pixel(sequence, width, i);
+}
+
+static bool check_frame(const uint32_t *pixels, uint64_t sequence, size_t width, size_t height)
+{
+    for (size_t i = 0; i < width*height; ++i) {
+        if (pixels[i] != pixel(sequence, width, i)) return false;
+    }
+    return true;
+}
+
+static void send_byte(int fd, char byte)
+{
+    if (write(fd, &byte, 1) != 1) {
+        perror("write");
+        exit(1);
+    }
+}
+
+// Returns -1 if nothing comes within timeout_ms
+static int receive_byte(int fd, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    char byte;
+    if (poll(&pfd, 1, timeout_ms) <= 0 || read(fd, &byte, 1) != 1) return -1;
+    return byte;
+}
+
+#define READER_CHECK(cond, ...)                                 \
+    do {                                                        \
+        if (!(cond)) {                                          \
+            fprintf(stderr, "FAIL: reader: " __VA_ARGS__);      \
+            fprintf(stderr, "\n");                              \
+            return false;                                       \
+        }                                                       \
+    } while (0)
+
+// Takes the next frame and checks that it is sequence of the given size, or the latest one if sequence is 0
+static bool reader_take(Frame_Client *client, uint64_t *sequence, uint64_t expected, size_t width, size_t height)
+{
+    const uint32_t *pixels = frame_client_wait(client, sequence, TIMEOUT_MS);
+    READER_CHECK(pixels != NULL, "no frame comes after %llu", (unsigned long long)*sequence);
+    READER_CHECK(expected == 0 || *sequence == expected, "got frame %llu instead of %llu",
+                 (unsigned long long)*sequence, (unsigned long long)expected);
+    const Frame_Server_Header *header = client->header;
+    READER_CHECK(header->width == width && header->height == height && header->fps == FPS &&
+                 header->slots_count == FRAME_SERVER_SLOTS, "the header says %ux%u at %u fps with %u slots",
+                 header->width, header->height, header->fps, header->slots_count);
+    READER_CHECK(check_frame(pixels, *sequence, width, height), "frame %llu is not the one that was published",
+                 (unsigned long long)*sequence);
+    READER_CHECK(frame_client_valid(client, *sequence), "frame %llu is overwritten while nobody publishes",
+                 (unsigned long long)*sequence);
+    return true;
+}
+
+// The server stops publishing once it knows the reader is connected, so the latest frame stays the latest
+static bool reader_connect(Frame_Client *client, uint64_t *sequence, size_t width, size_t height, int in, int out)
+{
+    READER_CHECK(frame_client_connect(client, socket_path), "could not connect");
+    send_byte(out, REPLY_CONNECTED);
+    READER_CHECK(receive_byte(in, TIMEOUT_MS) == GO, "the server is gone");
+    *sequence = 0;
+    bool ok = reader_take(client, sequence, 0, width, height);
+    send_byte(out, ok ? REPLY_OK : REPLY_FAIL);
+    return ok;
+}
+
+// Connects and takes the latest frame, then follows the server step by step
+static bool reader_lockstep(int in, int out)
+{
+    Frame_Client client;
+    uint64_t sequence = 0;
+    if (!reader_connect(&client, &sequence, WIDTH, HEIGHT, in, out)) return false;
+
+    for (size_t i = 0; i < LOCKSTEP_FRAMES; ++i) {
+        bool ok = reader_take(&client, &sequence, sequence + 1, WIDTH, HEIGHT);
+        send_byte(out, ok ? REPLY_OK : REPLY_FAIL);
+        if (!ok) return false;
+    }
+
+    // The server publishes more frames than there are slots before going on
+    READER_CHECK(receive_byte(in, TIMEOUT_MS) == GO, "the server is gone");
+    READER_CHECK(!frame_client_valid(&client, sequence), "frame %llu is still valid after all slots were written",
+                 (unsigned long long)sequence);
+    bool ok = reader_take(&client, &sequence, sequence + FRAME_SERVER_SLOTS + 1, WIDTH, HEIGHT);
+    send_byte(out, ok ? REPLY_OK : REPLY_FAIL);
+    if (!ok) return false;
+
+    // The server publishes a frame of another size
+    READER_CHECK(receive_byte(in, TIMEOUT_MS) == GO, "the server is gone");
+    READER_CHECK(frame_client_wait(&client, &sequence, TIMEOUT_MS) == NULL && client.header->closed,
+                 "the memfd is not closed after the size changed");
+    frame_client_disconnect(&client);
+    send_byte(out, REPLY_RECONNECTING);
+    if (!reader_connect(&client, &sequence, RESIZED_WIDTH, RESIZED_HEIGHT, in, out)) return false;
+    for (size_t i = 0; i < RESIZED_FRAMES; ++i) {
+        ok = reader_take(&client, &sequence, sequence + 1, RESIZED_WIDTH, RESIZED_HEIGHT);
+        send_byte(out, ok ? REPLY_OK : REPLY_FAIL);
+        if (!ok) return false;
+    }
+
+    uint64_t latest = sequence;
+    READER_CHECK(frame_client_wait(&client, &sequence, 50) == NULL && !client.header->closed && sequence == latest,
+                 "waiting without new frames does not time out");
+    frame_client_disconnect(&client);
+    send_byte(out, REPLY_OK);
+    return true;
+}
+
+// Publishes frames until the reader replies that it is connected
+static bool publish_until_connected(Frame_Server *server, uint32_t *pixels, uint64_t *sequence, size_t width, size_t height, int from)
+{
+    for (size_t tries = 0; tries < TIMEOUT_MS/10; ++tries) {
+        *sequence += 1;
+        fill_frame(pixels, *sequence, width, height);
+        if (!frame_server_publish(server, pixels, width, height)) return false;
+        if (receive_byte(from, 10) == REPLY_CONNECTED) return true;
+    }
+    return false;
+}
+
+static bool publish(Frame_Server *server, uint32_t *pixels, uint64_t *sequence, size_t width, size_t height)
+{
+    *sequence += 1;
+    fill_frame(pixels, *sequence, width, height);
+    return frame_server_publish(server, pixels, width, height);
+}
+
+static bool check_lockstep(Frame_Server *server)
+{
+    int to_reader[2], from_reader[2];
+    if (pipe(to_reader) < 0 || pipe(from_reader) < 0) {
+        perror("pipe");
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(to_reader[1]);
+        close(from_reader[0]);
+        _exit(reader_lockstep(to_reader[0], from_reader[1]) ? 0 : 1);
+    }
+    close(to_reader[0]);
+    close(from_reader[1]);
+    int to = to_reader[1];
+    int from = from_reader[0];
+
+    uint32_t *pixels = malloc(WIDTH*HEIGHT*4);
+    assert(pixels != NULL && "Buy MORE RAM lol!!");
+    uint64_t sequence = 0;
+    bool ok = publish_until_connected(server, pixels, &sequence, WIDTH, HEIGHT, from);
+    if (ok) send_byte(to, GO);
+    ok = ok && receive_byte(from, TIMEOUT_MS) == REPLY_OK;
+    for (size_t i = 0; i < LOCKSTEP_FRAMES && ok; ++i) {
+        ok = publish(server, pixels, &sequence, WIDTH, HEIGHT) && receive_byte(from, TIMEOUT_MS) == REPLY_OK;
+    }
+
+    for (size_t i = 0; i < FRAME_SERVER_SLOTS + 1 && ok; ++i) ok = publish(server, pixels, &sequence, WIDTH, HEIGHT);
+    if (ok) send_byte(to, GO);
+    ok = ok && receive_byte(from, TIMEOUT_MS) == REPLY_OK;
+
+    // The sequence starts over in the new memfd
+    sequence = 0;
+    ok = ok && publish(server, pixels, &sequence, RESIZED_WIDTH, RESIZED_HEIGHT);
+    if (ok) send_byte(to, GO);
+    ok = ok && receive_byte(from, TIMEOUT_MS) == REPLY_RECONNECTING;
+    ok = ok && publish_until_connected(server, pixels, &sequence, RESIZED_WIDTH, RESIZED_HEIGHT, from);
+    if (ok) send_byte(to, GO);
+    ok = ok && receive_byte(from, TIMEOUT_MS) == REPLY_OK;
+    for (size_t i = 0; i < RESIZED_FRAMES && ok; ++i) {
+        ok = publish(server, pixels, &sequence, RESIZED_WIDTH, RESIZED_HEIGHT) && receive_byte(from, TIMEOUT_MS) == REPLY_OK;
+    }
+    ok = ok && receive_byte(from, TIMEOUT_MS) == REPLY_OK;
+
+    // Closing the pipes lets a reader that waits for the server go
+    close(to);
+    close(from);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    free(pixels);
+    if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "FAIL: the reader that keeps up does not get every frame\n");
+        return false;
+    }
+    return true;
+}
+
+// Reads whatever is the latest frame until the server stops publishing
+static bool reader_stress(int out)
+{
+    Frame_Client client;
+    READER_CHECK(frame_client_connect(&client, socket_path), "could not connect");
+    send_byte(out, REPLY_CONNECTED);
+    uint64_t sequence = 0;
+    size_t intact = 0;
+    for (;;) {
+        const uint32_t *pixels = frame_client_wait(&client, &sequence, 1000);
+        if (pixels == NULL) break;
+        bool same = check_frame(pixels, sequence, STRESS_WIDTH, STRESS_HEIGHT);
+        if (!frame_client_valid(&client, sequence)) continue;
+        READER_CHECK(same, "frame %llu is torn but valid", (unsigned long long)sequence);
+        intact += 1;
+    }
+    frame_client_disconnect(&client);
+    READER_CHECK(intact > 0, "not a single frame was read");
+    return true;
+}
+
+static bool check_stress(Frame_Server *server)
+{
+    int from_readers[2];
+    if (pipe(from_readers) < 0) {
+        perror("pipe");
+        return false;
+    }
+    pid_t pids[STRESS_READERS];
+    for (size_t i = 0; i < STRESS_READERS; ++i) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            close(from_readers[0]);
+            _exit(reader_stress(from_readers[1]) ? 0 : 1);
+        }
+    }
+    close(from_readers[1]);
+
+    uint32_t *pixels = malloc(STRESS_WIDTH*STRESS_HEIGHT*4);
+    assert(pixels != NULL && "Buy MORE RAM lol!!");
+    uint64_t sequence = 0;
+    bool ok = true;
+    for (size_t i = 0; i < STRESS_READERS && ok; ++i) {
+        ok = publish_until_connected(server, pixels, &sequence, STRESS_WIDTH, STRESS_HEIGHT, from_readers[0]);
+    }
+    for (size_t i = 0; i < STRESS_FRAMES && ok; ++i) ok = publish(server, pixels, &sequence, STRESS_WIDTH, STRESS_HEIGHT);
+    close(from_readers[0]);
+
+    for (size_t i = 0; i < STRESS_READERS; ++i) {
+        int status = 0;
+        waitpid(pids[i], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) ok = false;
+    }
+    free(pixels);
+    if (!ok) fprintf(stderr, "FAIL: the readers that read as fast as they can do not get intact frames\n");
+    return ok;
+}
+
+int main(void)
+{
+    SetTraceLogLevel(LOG_WARNING);
+
+    char dir_template[] = "/tmp/panim-frame-server-test-XXXXXX";
+    const char *dir = mkdtemp(dir_template);
+    if (dir == NULL) {
+        fprintf(stderr, "ERROR: could not create a temporary directory: %s\n", strerror(errno));
+        return 1;
+    }
+    snprintf(socket_path, sizeof(socket_path), "%s/frames.sock", dir);
+
+    size_t checks = 0;
+    bool ok = true;
+
+    Frame_Client client;
+    if (frame_client_connect(&client, socket_path)) {
+        fprintf(stderr, "FAIL: a reader connects without a server\n");
+        frame_client_disconnect(&client);
+        ok = false;
+    }
+    checks += 1;
+
+    // The error is expected here
+    char long_path[200];
+    memset(long_path, 'a', sizeof(long_path) - 1);
+    long_path[sizeof(long_path) - 1] = '\0';
+    SetTraceLogLevel(LOG_NONE);
+    Frame_Server *server = frame_server_create(long_path, FPS);
+    SetTraceLogLevel(LOG_WARNING);
+    if (server != NULL) {
+        fprintf(stderr, "FAIL: the server listens on a path that does not fit into a socket address\n");
+        frame_server_destroy(server);
+        ok = false;
+    }
+    checks += 1;
+
+    server = frame_server_create(socket_path, FPS);
+    if (server == NULL) {
+        fprintf(stderr, "FAIL: the server does not listen on %s\n", socket_path);
+        rmdir(dir);
+        return 1;
+    }
+    ok = check_lockstep(server) && ok;
+    checks += 1;
+    frame_server_destroy(server);
+
+    server = frame_server_create(socket_path, FPS);
+    ok = server != NULL && check_stress(server) && ok;
+    checks += 1;
+    if (server != NULL) frame_server_destroy(server);
+
+    if (rmdir(dir) != 0) {
+        fprintf(stderr, "FAIL: the socket is left behind in %s\n", dir);
+        ok = false;
+    }
+    checks += 1;
+
+    if (!ok) return 1;
+    printf("OK: %zu checks passed\n", checks);
+    return 0;
+}
@@ -0,0 +1,268 @@
+// Checks the GIF export of panim/gif.c
+// - that the file is well formed, and its delays add up to the length of the animation
+// - that the frames decoded by the GIF decoder raylib ships with stay close to the frames that were
+//   sent, also after the colors change so much that a new palette is needed
+// - that repeated and unchanged frames only make the frame before them longer, and that with more
+//   than 50 fps only every other frame is kept
+// - that an export without frames or a canceled one leaves no file behind
+#define NOB_IMPLEMENTATION
+#include "nob.h"
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include <raylib.h>
+
+#include "gif.h"
+
+#define WIDTH 160
+#define HEIGHT 90
+#define FRAMES 60
+
+// Ordered dithering spreads every pixel a little around its color, but on average the frames
+// have to stay close
+#define MAX_MEAN_ERROR 6.0
+
+typedef enum {
+    SEND_FRAME,
+    SEND_REPEAT,
+    // The same pixels as the previous frame, sent as a new frame
+    SEND_SAME,
+} Send;
+
+static Send send_kind(size_t frame)
+{
+    if (frame >= 10 && frame < 15) return SEND_REPEAT;
+    if (frame >= 30 && frame < 34) return SEND_SAME;
+    return SEND_FRAME;
+}
+
+// The frame whose pixels are shown at frame
+static size_t source_frame(size_t frame)
+{
+    while (frame > 0 && send_kind(frame) != SEND_FRAME) frame -= 1;
+    return frame;
+}
+
+// A square moving over a gradient, top-down. The second half of the animation turns the
+// colors around, so the first palette does not fit it anymore.
+static void fill_frame(uint8_t *rgba, size_t frame)
+{
+    bool second_half = frame >= FRAMES/2;
+    size_t sx = frame*2%(WIDTH - 20);
+    size_t sy = frame%(HEIGHT - 20);
+    for (size_t y = 0; y < HEIGHT; ++y) {
+        for (size_t x = 0; x < WIDTH; ++x) {
+            uint8_t *p = rgba + (y*WIDTH + x)*4;
+            p[0] = x*255/WIDTH;
+            p[1] = y*255/HEIGHT;
+            p[2] = second_half ? 220 : 30;
+            p[3] = 255;
+            if (x >= sx && x < sx + 20 && y >= sy && y < sy + 20) {
+                p[0] = 255;
+                p[1] = second_half ? 0 : 255;
+                p[2] = second_half ? 255 : 0;
+            }
+        }
+    }
+}
+
+static void flip_rows(uint8_t *dst, const uint8_t *src)
+{
+    for (size_t y = 0; y < HEIGHT; ++y) memcpy(dst + y*WIDTH*4, src + (HEIGHT - 1 - y)*WIDTH*4, WIDTH*4);
+}
+
+static bool export_gif(const char *path, size_t fps, size_t frames)
+{
+    Gif *gif = gif_start(path, WIDTH, HEIGHT, fps);
+    if (gif == NULL) return false;
+    uint8_t *rgba = malloc(WIDTH*HEIGHT*4);
+    uint8_t *flipped = malloc(WIDTH*HEIGHT*4);
+    assert(rgba != NULL && flipped != NULL && "Buy MORE RAM lol!!");
+    bool ok = true;
+    for (size_t frame = 0; frame < frames && ok; ++frame) {
+        if (send_kind(frame) == SEND_REPEAT) {
+            ok = gif_send_repeated_frame(gif);
+        } else {
+            fill_frame(rgba, source_frame(frame));
+            flip_rows(flipped, rgba);
+            ok = gif_send_frame_flipped(gif, flipped);
+        }
+    }
+    free(rgba);
+    free(flipped);
+    return gif_end(gif, false) && ok;
+}
+
+typedef struct {
+    size_t frames;
+    size_t delays[FRAMES];
+    bool trailer;
+} Gif_Blocks;
+
+// Walks the blocks of the file the way a decoder does, without decoding the images
+static bool parse_blocks(const Nob_String_Builder *file, Gif_Blocks *blocks)
+{
+    const uint8_t *d = (const uint8_t*)file->items;
+    size_t size = file->count;
+    memset(blocks, 0, sizeof(*blocks));
+    if (size < 13 || memcmp(d, "GIF89a", 6) != 0) return false;
+    if ((d[6] | d[7] << 8) != WIDTH || (d[8] | d[9] << 8) != HEIGHT) return false;
+    size_t i = 13 + ((d[10] & 0x80) ? 3*(2 << (d[10] & 7)) : 0);
+    size_t delay = 0;
+    while (i < size) {
+        if (d[i] == 0x21 && i + 1 < size) {
+            if (d[i + 1] == 0xF9 && i + 5 < size) delay = d[i + 4] | d[i + 5] << 8;
+            i += 2;
+        } else if (d[i] == 0x2C && i + 9 < size) {
+            if (blocks->frames >= FRAMES) return false;
+            blocks->delays[blocks->frames++] = delay;
+            size_t flags = d[i + 9];
+            i += 10 + ((flags & 0x80) ? 3*(2 << (flags & 7)) : 0);
+            // LZW minimum code size
+            i += 1;
+        } else if (d[i] == 0x3B) {
+            blocks->trailer = i + 1 == size;
+            return blocks->trailer;
+        } else {
+            return false;
+        }
+        // Sub-blocks until the empty one
+        while (i < size && d[i] != 0) i += d[i] + 1;
+        i += 1;
+    }
+    return false;
+}
+
+static double mean_error(const uint8_t *decoded, const uint8_t *rgba)
+{
+    double error = 0.0;
+    for (size_t i = 0; i < WIDTH*HEIGHT; ++i) {
+        for (size_t c = 0; c < 3; ++c) error += abs(decoded[i*4 + c] - rgba[i*4 + c]);
+    }
+    return error/(WIDTH*HEIGHT*3);
+}
+
+static size_t centiseconds(size_t frame, size_t fps)
+{
+    return (frame*100 + fps/2)/fps;
+}
+
+static bool check_gif(const char *path, size_t fps)
+{
+    if (!export_gif(path, fps, FRAMES)) {
+        fprintf(stderr, "FAIL: %zu fps: the export failed\n", fps);
+        return false;
+    }
+
+    Nob_String_Builder file = {0};
+    Gif_Blocks blocks;
+    bool ok = nob_read_entire_file(path, &file) && parse_blocks(&file, &blocks);
+    nob_sb_free(file);
+    if (!ok) {
+        fprintf(stderr, "FAIL: %zu fps: the file is malformed\n", fps);
+        remove(path);
+        return false;
+    }
+
+    // The frames that are kept, and the ones of them that show new pixels
+    size_t stride = fps > 50 ? 2 : 1;
+    size_t starts[FRAMES];
+    size_t starts_count = 0;
+    for (size_t frame = 0; frame < FRAMES; frame += stride) {
+        if (frame == 0 || source_frame(frame) != source_frame(frame - stride)) starts[starts_count++] = frame;
+    }
+    if (blocks.frames != starts_count) {
+        fprintf(stderr, "FAIL: %zu fps: %zu frames are written instead of %zu\n", fps, blocks.frames, starts_count);
+        ok = false;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < blocks.frames && ok; ++i) {
+        size_t until = i + 1 < starts_count ? starts[i + 1] : FRAMES;
+        size_t expected = centiseconds(until, fps) - centiseconds(starts[i], fps);
+        if (blocks.delays[i] != expected) {
+            fprintf(stderr, "FAIL: %zu fps: frame %zu is shown for %zu cs instead of %zu\n", fps, i, blocks.delays[i], expected);
+            ok = false;
+        }
+        total += blocks.delays[i];
+    }
+    if (ok && total != centiseconds(FRAMES, fps)) {
+        fprintf(stderr, "FAIL: %zu fps: the animation is %zu cs long instead of %zu\n", fps, total, centiseconds(FRAMES, fps));
+        ok = false;
+    }
+
+    int count = 0;
+    Image anim = LoadImageAnim(path, &count);
+    if (anim.data == NULL || (size_t)count != starts_count || anim.width != WIDTH || anim.height != HEIGHT) {
+        fprintf(stderr, "FAIL: %zu fps: the decoder does not take the file\n", fps);
+        ok = false;
+    } else {
+        uint8_t *rgba = malloc(WIDTH*HEIGHT*4);
+        assert(rgba != NULL && "Buy MORE RAM lol!!");
+        for (size_t i = 0; i < starts_count; ++i) {
+            fill_frame(rgba, source_frame(starts[i]));
+            double error = mean_error((const uint8_t*)anim.data + i*WIDTH*HEIGHT*4, rgba);
+            if (error > MAX_MEAN_ERROR) {
+                fprintf(stderr, "FAIL: %zu fps: frame %zu is off by %.2f on average\n", fps, starts[i], error);
+                ok = false;
+            }
+        }
+        free(rgba);
+    }
+    UnloadImage(anim);
+    remove(path);
+    return ok;
+}
+
+int main(void)
+{
+    SetTraceLogLevel(LOG_WARNING);
+
+    char dir_template[] = "/tmp/panim-gif-test-XXXXXX";
+    const char *dir = mkdtemp(dir_template);
+    if (dir == NULL) {
+        fprintf(stderr, "ERROR: could not create a temporary directory: %s\n", strerror(errno));
+        return 1;
+    }
+    const char *path = nob_temp_sprintf("%s/test.gif", dir);
+
+    size_t checks = 0;
+    bool ok = true;
+
+    if (!gif_is_path("out.gif") || gif_is_path("out.mp4") || gif_is_path("out.gif.mp4")) {
+        fprintf(stderr, "FAIL: gif_is_path() does not go by the extension\n");
+        ok = false;
+    }
+    checks += 1;
+
+    static const size_t fps[] = {25, 30, 60};
+    for (size_t i = 0; i < NOB_ARRAY_LEN(fps); ++i) {
+        ok = check_gif(path, fps[i]) && ok;
+        checks += 1;
+    }
+
+    // The error of the export without frames is expected here
+    SetTraceLogLevel(LOG_NONE);
+    if (export_gif(path, 30, 0) || access(path, F_OK) == 0) {
+        fprintf(stderr, "FAIL: an export without frames succeeds or leaves the file behind\n");
+        ok = false;
+    }
+    SetTraceLogLevel(LOG_WARNING);
+    checks += 1;
+
+    Gif *gif = gif_start(path, WIDTH, HEIGHT, 30);
+    uint8_t *rgba = calloc(WIDTH*HEIGHT, 4);
+    assert(gif != NULL && rgba != NULL);
+    gif_send_frame_flipped(gif, rgba);
+    if (gif_end(gif, true) || access(path, F_OK) == 0) {
+        fprintf(stderr, "FAIL: a canceled export succeeds or leaves the file behind\n");
+        ok = false;
+    }
+    free(rgba);
+    checks += 1;
+
+    rmdir(dir);
+    if (!ok) return 1;
+    printf("OK: %zu checks passed\n", checks);
+    return 0;
+}
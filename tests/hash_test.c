@@ -0,0 +1,137 @@
+// Checks the frame hashes of panim/hash.c
+// - every SIMD kernel the CPU supports against the scalar kernel, bit for bit
+// - the threaded hash_frame() against the single threaded one
+// - that flipping any single bit changes the hash, also in the scalar tails
+// - that hash_rect() only depends on the bytes inside of the rectangle
+//
+// The sizes are mostly not multiples of the 32 byte stripes and of the 64 KiB blocks, and the data
+// is not aligned, so the tails and the unaligned loads are covered too.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+
+#define FRAME_SIZE (1920*1080*4)
+
+static const size_t sizes[] = {0, 1, 31, 32, 33, 1000, 64*1024 - 1, 64*1024, 64*1024*3 + 7, 640*360*4, FRAME_SIZE, FRAME_SIZE + 37};
+
+static uint32_t random_state = 0x1234567;
+
+static uint8_t random_byte(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state >> 24;
+}
+
+// A bit in the first stripe, the middle and the last byte, which is in the tail of most of the sizes
+static bool check_bit_flips(const char *what, uint8_t *data, size_t size, uint64_t h)
+{
+    if (size == 0) return true;
+    const size_t offsets[] = {0, size/2, size - 1};
+    for (size_t i = 0; i < sizeof(offsets)/sizeof(offsets[0]); ++i) {
+        data[offsets[i]] ^= 0x10;
+        uint64_t flipped = hash_frame(data, size);
+        data[offsets[i]] ^= 0x10;
+        if (flipped == h) {
+            fprintf(stderr, "FAIL: %s: flipping a bit of byte %zu does not change the hash\n", what, offsets[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// The same 100x50 pixel rectangle in frames with different strides and different pixels around it
+static bool check_rect(void)
+{
+    const size_t width = 100, height = 50;
+    const size_t row_size = width*4;
+    const size_t strides[] = {row_size, row_size + 4, 1920*4};
+    uint8_t *rect = malloc(row_size*height);
+    uint8_t *frame = malloc(strides[2]*height);
+    if (rect == NULL || frame == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < row_size*height; ++i) rect[i] = random_byte();
+
+    bool ok = true;
+    uint64_t expected = 0;
+    for (size_t i = 0; i < sizeof(strides)/sizeof(strides[0]); ++i) {
+        for (size_t j = 0; j < strides[i]*height; ++j) frame[j] = random_byte();
+        for (size_t y = 0; y < height; ++y) memcpy(frame + y*strides[i], rect + y*row_size, row_size);
+        uint64_t h = hash_rect(frame, strides[i], row_size, height);
+        if (i == 0) expected = h;
+        if (h != expected) {
+            fprintf(stderr, "FAIL: hash_rect() with stride %zu depends on the bytes outside of the rectangle\n", strides[i]);
+            ok = false;
+        }
+        frame[(height - 1)*strides[i] + row_size - 1] ^= 1;
+        if (hash_rect(frame, strides[i], row_size, height) == h) {
+            fprintf(stderr, "FAIL: hash_rect() with stride %zu does not change with the last byte of the rectangle\n", strides[i]);
+            ok = false;
+        }
+    }
+
+    free(rect);
+    free(frame);
+    return ok;
+}
+
+int main(void)
+{
+    Hash_Kernel best = hash_best_kernel();
+    printf("Kernels up to %s are supported by this CPU\n", hash_kernel_name(best));
+
+    // With room for the unaligned starts
+    uint8_t *buffer = malloc(FRAME_SIZE + 37 + 3);
+    if (buffer == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < FRAME_SIZE + 37 + 3; ++i) buffer[i] = random_byte();
+
+    size_t checks = 0;
+    bool ok = true;
+    for (size_t si = 0; si < sizeof(sizes)/sizeof(sizes[0]); ++si) {
+        for (size_t offset = 0; offset <= 3; offset += 3) {
+            size_t size = sizes[si];
+            uint8_t *data = buffer + offset;
+            char what[64];
+            snprintf(what, sizeof(what), "%zu bytes at offset %zu", size, offset);
+
+            uint64_t scalar = hash_frame_with(HASH_KERNEL_SCALAR, data, size);
+            for (Hash_Kernel kernel = HASH_KERNEL_SCALAR + 1; kernel <= best; ++kernel) {
+                uint64_t h = hash_frame_with(kernel, data, size);
+                if (h != scalar) {
+                    fprintf(stderr, "FAIL: %s %s: the hash is %016llx instead of %016llx\n", hash_kernel_name(kernel), what,
+                            (unsigned long long)h, (unsigned long long)scalar);
+                    ok = false;
+                }
+                checks += 1;
+            }
+
+            uint64_t h = hash_frame(data, size);
+            if (h != scalar) {
+                fprintf(stderr, "FAIL: threaded %s: the hash is %016llx instead of %016llx\n", what,
+                        (unsigned long long)h, (unsigned long long)scalar);
+                ok = false;
+            }
+            checks += 1;
+
+            ok = check_bit_flips(what, data, size, h) && ok;
+            checks += 1;
+        }
+    }
+
+    ok = check_rect() && ok;
+    checks += 1;
+
+    free(buffer);
+    if (!ok) return 1;
+    printf("OK: %zu checks passed\n", checks);
+    return 0;
+}
@@ -0,0 +1,190 @@
+// Checks the export of still images of panim/images.c
+// - that the formats are picked by the extension and the frames are numbered like the README says
+// - that every frame of a .qoi and a .png sequence decodes into the frame that was sent, top-down,
+//   also with more frames than there are encoders and buffers in flight
+// - that repeated frames are hard links to the frame they repeat
+// - that an export into a directory that does not exist fails instead of hanging
+#define NOB_IMPLEMENTATION
+#include "nob.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <raylib.h>
+
+#include "images.h"
+#include "qoi.h"
+
+#define WIDTH 320
+#define HEIGHT 180
+#define FRAMES 40
+#define FIRST_INDEX 10
+
+// Every 4th frame is a repeat of the one before it
+static bool is_repeat(size_t frame)
+{
+    return frame%4 == 3;
+}
+
+// The frames are different enough that a frame written into the wrong file is noticed
+static void fill_frame(uint8_t *rgba, size_t frame, bool flipped)
+{
+    for (size_t y = 0; y < HEIGHT; ++y) {
+        uint8_t *row = rgba + (flipped ? HEIGHT - 1 - y : y)*WIDTH*4;
+        for (size_t x = 0; x < WIDTH; ++x) {
+            row[x*4 + 0] = x + frame;
+            row[x*4 + 1] = y;
+            row[x*4 + 2] = frame*10;
+            row[x*4 + 3] = 255 - frame;
+        }
+    }
+}
+
+typedef struct {
+    const char *output_path;
+    // printf format of the expected file names, taking the frame number
+    const char *expected_path;
+} Sequence;
+
+static const char *dir = NULL;
+
+static bool export_sequence(const char *output_path)
+{
+    Images *images = images_start(output_path, WIDTH, HEIGHT, FIRST_INDEX);
+    if (images == NULL) return false;
+    uint8_t *pixels = malloc(WIDTH*HEIGHT*4);
+    assert(pixels != NULL && "Buy MORE RAM lol!!");
+    for (size_t frame = 0; frame < FRAMES; ++frame) {
+        if (is_repeat(frame)) {
+            if (!images_send_repeated_frame(images)) break;
+            continue;
+        }
+        fill_frame(pixels, frame, true);
+        uint8_t *next = images_send_frame_flipped(images, pixels);
+        if (next == NULL) break;
+        pixels = next;
+    }
+    free(pixels);
+    return images_end(images, false);
+}
+
+static bool check_sequence(const Sequence *sequence, Images_Format format)
+{
+    const char *output_path = nob_temp_sprintf("%s/%s", dir, sequence->output_path);
+    if (images_format_from_path(output_path) != format) {
+        fprintf(stderr, "FAIL: %s is not taken for the right format\n", output_path);
+        return false;
+    }
+    if (!export_sequence(output_path)) {
+        fprintf(stderr, "FAIL: %s: the export failed\n", output_path);
+        return false;
+    }
+
+    bool ok = true;
+    uint8_t *expected = malloc(WIDTH*HEIGHT*4);
+    uint8_t *decoded = malloc(WIDTH*HEIGHT*4);
+    assert(expected != NULL && decoded != NULL && "Buy MORE RAM lol!!");
+    struct stat previous = {0};
+    for (size_t frame = 0; frame < FRAMES; ++frame) {
+        char name[64];
+        snprintf(name, sizeof(name), sequence->expected_path, FIRST_INDEX + frame);
+        const char *path = nob_temp_sprintf("%s/%s", dir, name);
+        fill_frame(expected, is_repeat(frame) ? frame - 1 : frame, false);
+
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            fprintf(stderr, "FAIL: %s is not written\n", path);
+            ok = false;
+            continue;
+        }
+        if (is_repeat(frame) && st.st_ino != previous.st_ino) {
+            fprintf(stderr, "FAIL: %s is not a link to the frame it repeats\n", path);
+            ok = false;
+        }
+        previous = st;
+
+        bool decodes = false;
+        if (format == IMAGES_FORMAT_QOI) {
+            int size = 0;
+            unsigned char *data = LoadFileData(path, &size);
+            decodes = data != NULL && qoi_decode_frame(data, size, decoded, WIDTH, HEIGHT);
+            UnloadFileData(data);
+        } else {
+            Image image = LoadImage(path);
+            decodes = image.data != NULL && image.width == WIDTH && image.height == HEIGHT &&
+                      image.format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+            if (decodes) memcpy(decoded, image.data, WIDTH*HEIGHT*4);
+            UnloadImage(image);
+        }
+        if (!decodes || memcmp(expected, decoded, WIDTH*HEIGHT*4) != 0) {
+            fprintf(stderr, "FAIL: %s is not frame %zu\n", path, frame);
+            ok = false;
+        }
+        remove(path);
+    }
+
+    free(expected);
+    free(decoded);
+    return ok;
+}
+
+static const Sequence qoi_sequences[] = {
+    {"frame%04d.qoi", "frame%04zu.qoi"},
+    {"%d-still.qoi", "%zu-still.qoi"},
+    {"frame.qoi", "frame%06zu.qoi"},
+};
+
+static const Sequence png_sequences[] = {
+    {"frame%05d.png", "frame%05zu.png"},
+    {"frame.png", "frame%06zu.png"},
+};
+
+int main(void)
+{
+    SetTraceLogLevel(LOG_WARNING);
+
+    char dir_template[] = "/tmp/panim-images-test-XXXXXX";
+    dir = mkdtemp(dir_template);
+    if (dir == NULL) {
+        fprintf(stderr, "ERROR: could not create a temporary directory: %s\n", strerror(errno));
+        return 1;
+    }
+
+    size_t checks = 0;
+    bool ok = true;
+
+    if (images_format_from_path("out.mp4") != IMAGES_FORMAT_NONE || images_format_from_path("out") != IMAGES_FORMAT_NONE ||
+        images_format_from_path("out.qoi.mp4") != IMAGES_FORMAT_NONE) {
+        fprintf(stderr, "FAIL: a video is taken for an image sequence\n");
+        ok = false;
+    }
+    checks += 1;
+
+    for (size_t i = 0; i < NOB_ARRAY_LEN(qoi_sequences); ++i) {
+        ok = check_sequence(&qoi_sequences[i], IMAGES_FORMAT_QOI) && ok;
+        checks += 1;
+    }
+    for (size_t i = 0; i < NOB_ARRAY_LEN(png_sequences); ++i) {
+        ok = check_sequence(&png_sequences[i], IMAGES_FORMAT_PNG) && ok;
+        checks += 1;
+    }
+
+    // The error of the export is expected here
+    SetTraceLogLevel(LOG_NONE);
+    if (export_sequence(nob_temp_sprintf("%s/missing/frame%%04d.qoi", dir))) {
+        fprintf(stderr, "FAIL: the export into a directory that does not exist succeeds\n");
+        ok = false;
+    }
+    SetTraceLogLevel(LOG_WARNING);
+    checks += 1;
+
+    if (rmdir(dir) != 0) {
+        fprintf(stderr, "FAIL: files that are not frames are left in %s\n", dir);
+        ok = false;
+    }
+    checks += 1;
+
+    if (!ok) return 1;
+    printf("OK: %zu checks passed\n", checks);
+    return 0;
+}
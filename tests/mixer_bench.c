@@ -0,0 +1,68 @@
+// Measures the mixing of panim/mixer.c with all MIXER_MAX_VOICES voices playing, one video frame
+// of 44100 Hz stereo at a time like the rendering does, for every kernel the CPU supports.
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "mixer.h"
+
+#define BENCH_SECONDS 1.0
+#define FRAME_SAMPLES (44100/60*2)
+// Long enough that no voice ends during the benchmark
+#define SOUND_SAMPLES (FRAME_SAMPLES*1024)
+
+static double now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+int main(void)
+{
+    Mixer_Kernel best = mixer_best_kernel();
+    printf("%d voices, kernels up to %s\n", MIXER_MAX_VOICES, mixer_kernel_name(best));
+
+    int16_t *sound = malloc(SOUND_SAMPLES*sizeof(*sound));
+    Mixer *mixer = malloc(sizeof(*mixer));
+    if (sound == NULL || mixer == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+    }
+    uint32_t state = 0x1234567;
+    for (size_t i = 0; i < SOUND_SAMPLES; ++i) {
+        state = state*1664525 + 1013904223;
+        sound[i] = state >> 16;
+    }
+
+    static int16_t out[FRAME_SAMPLES];
+    for (Mixer_Kernel kernel = MIXER_KERNEL_SCALAR; kernel <= best; ++kernel) {
+        // The gains are what the kernels multiply with, unity skips the multiply
+        for (int unity = 0; unity <= 1; ++unity) {
+            size_t frames = 0;
+            double start = now();
+            double elapsed = 0.0;
+            while (elapsed < BENCH_SECONDS) {
+                // Every voice starts somewhere else in the sound, so they do not share the cache lines
+                mixer_init(mixer);
+                mixer->kernel = kernel;
+                for (size_t i = 0; i < MIXER_MAX_VOICES; ++i) {
+                    size_t offset = i*FRAME_SAMPLES;
+                    mixer_play(mixer, sound + offset, SOUND_SAMPLES - offset, unity ? 1.0f : 0.5f);
+                }
+                for (size_t i = 0; i < 128; ++i) {
+                    mixer_mix(mixer, out, FRAME_SAMPLES);
+                    frames += 1;
+                }
+                elapsed = now() - start;
+            }
+            double us = elapsed*1e6/frames;
+            printf("%-7s %-5s %8.2f us/frame %8.1f Msamples/s\n", mixer_kernel_name(kernel), unity ? "unity" : "gain",
+                   us, (double)MIXER_MAX_VOICES*FRAME_SAMPLES/us);
+        }
+    }
+
+    free(sound);
+    free(mixer);
+    return 0;
+}
@@ -0,0 +1,244 @@
+// Checks the mixing of panim/mixer.c
+// - the saturating adds on a few sums with known results
+// - MIXER_MAX_VOICES voices, with and without saturating, against a plain int reference
+// - every SIMD kernel the CPU supports against the scalar kernel, bit for bit
+//
+// The sounds end at random points and the chunks are mostly not multiples of the 8 and 16
+// samples the SIMD kernels do at once, so their scalar tails are covered too.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mixer.h"
+
+// One video frame of 44100 Hz stereo at 60 fps
+#define FRAME_SAMPLES (44100/60*2)
+#define MAX_SAMPLES (FRAME_SAMPLES*8)
+
+static const size_t chunks[] = {1, 7, 15, 17, 33, FRAME_SAMPLES};
+
+static uint32_t random_state = 0x1234567;
+
+static uint32_t random_u32(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static void fill_random(int16_t *samples, size_t count, int amplitude)
+{
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = (int)(random_u32()%(2*amplitude + 1)) - amplitude;
+    }
+}
+
+// The mixer without any tricks: every sample of every voice is scaled and added on its own,
+// in the order of mixer->voices, which is the order the saturating adds depend on
+static void reference_mix(Mixer *mixer, int16_t *out, size_t count)
+{
+    for (size_t j = 0; j < count; ++j) out[j] = 0;
+    for (size_t i = 0; i < mixer->voices_count;) {
+        Mixer_Voice *voice = &mixer->voices[i];
+        size_t n = voice->count - voice->cursor;
+        if (n > count) n = count;
+        for (size_t j = 0; j < n; ++j) {
+            int sample = voice->samples[voice->cursor + j];
+            if (!voice->unity) sample = (sample*voice->gain + (1 << 14)) >> 15;
+            int sum = out[j] + sample;
+            out[j] = sum > INT16_MAX ? INT16_MAX : sum < INT16_MIN ? INT16_MIN : sum;
+        }
+        voice->cursor += n;
+        if (voice->cursor >= voice->count) {
+            *voice = mixer->voices[--mixer->voices_count];
+        } else {
+            i += 1;
+        }
+    }
+}
+
+static bool check_equal(const int16_t *expected, const int16_t *actual, size_t count, const char *what)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (expected[i] != actual[i]) {
+            fprintf(stderr, "FAIL: %s: sample %zu is %d instead of %d\n", what, i, actual[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Plays the same sounds on a mixer with the given kernel and on the reference, and compares
+// every chunk they mix
+static bool check_mix(Mixer_Kernel kernel, int16_t **sounds, const size_t *counts, const float *gains, size_t voices,
+                      size_t chunk, int16_t *out, const char *what)
+{
+    static Mixer mixer, reference;
+    static int16_t expected[MAX_SAMPLES];
+    mixer_init(&mixer);
+    mixer_init(&reference);
+    mixer.kernel = kernel;
+    for (size_t i = 0; i < voices; ++i) {
+        mixer_play(&mixer, sounds[i], counts[i], gains[i]);
+        mixer_play(&reference, sounds[i], counts[i], gains[i]);
+    }
+
+    bool ok = true;
+    for (size_t done = 0; done < MAX_SAMPLES; done += chunk) {
+        size_t n = MAX_SAMPLES - done < chunk ? MAX_SAMPLES - done : chunk;
+        reference_mix(&reference, expected, n);
+        memset(out + done, 0xAA, n*sizeof(*out));
+        mixer_mix(&mixer, out + done, n);
+        ok = ok && check_equal(expected, out + done, n, what);
+    }
+    return ok;
+}
+
+typedef struct {
+    int16_t samples[3];
+    int16_t expected;
+} Clamp_Case;
+
+// Every sample is its own voice at unity gain, added in order
+static const Clamp_Case clamp_cases[] = {
+    {{30000, 30000, 0}, INT16_MAX},
+    {{-30000, -30000, 0}, INT16_MIN},
+    {{INT16_MAX, INT16_MAX, 0}, INT16_MAX},
+    {{INT16_MIN, INT16_MIN, 0}, INT16_MIN},
+    // The adds saturate one after another, so the sum does not come back from the clamp
+    {{30000, 30000, -30000}, INT16_MAX - 30000},
+    {{-30000, -30000, 30000}, INT16_MIN + 30000},
+    {{INT16_MAX, INT16_MIN, 0}, -1},
+};
+
+// The sounds outlast the mix, because an ended voice is replaced by the last one in the middle
+// of the mix and that changes the order of the adds
+static bool check_clamp(Mixer_Kernel kernel)
+{
+    static int16_t sounds[3][2*FRAME_SAMPLES];
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(clamp_cases)/sizeof(clamp_cases[0]); ++i) {
+        const Clamp_Case *c = &clamp_cases[i];
+        Mixer mixer;
+        mixer_init(&mixer);
+        mixer.kernel = kernel;
+        for (size_t v = 0; v < 3; ++v) {
+            for (size_t j = 0; j < 2*FRAME_SAMPLES; ++j) sounds[v][j] = c->samples[v];
+            mixer_play(&mixer, sounds[v], 2*FRAME_SAMPLES, 1.0f);
+        }
+        int16_t out[FRAME_SAMPLES];
+        mixer_mix(&mixer, out, FRAME_SAMPLES);
+        for (size_t j = 0; j < FRAME_SAMPLES; ++j) {
+            if (out[j] != c->expected) {
+                fprintf(stderr, "FAIL: %s clamp %d + %d + %d: sample %zu is %d instead of %d\n", mixer_kernel_name(kernel),
+                        c->samples[0], c->samples[1], c->samples[2], j, out[j], c->expected);
+                ok = false;
+                break;
+            }
+        }
+    }
+    return ok;
+}
+
+// MIXER_MAX_VOICES quiet voices at unity gain never saturate, so their mix is the exact sum
+static bool check_exact_sum(Mixer_Kernel kernel, int16_t **sounds)
+{
+    static Mixer mixer;
+    static int16_t out[FRAME_SAMPLES];
+    mixer_init(&mixer);
+    mixer.kernel = kernel;
+    for (size_t i = 0; i < MIXER_MAX_VOICES; ++i) mixer_play(&mixer, sounds[i], FRAME_SAMPLES, 1.0f);
+    mixer_mix(&mixer, out, FRAME_SAMPLES);
+    for (size_t j = 0; j < FRAME_SAMPLES; ++j) {
+        int sum = 0;
+        for (size_t i = 0; i < MIXER_MAX_VOICES; ++i) sum += sounds[i][j];
+        if (out[j] != sum) {
+            fprintf(stderr, "FAIL: %s sum of %d voices: sample %zu is %d instead of %d\n", mixer_kernel_name(kernel),
+                    MIXER_MAX_VOICES, j, out[j], sum);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Quiet enough that MIXER_MAX_VOICES of them fit into 16 bits
+#define QUIET_AMPLITUDE (INT16_MAX/MIXER_MAX_VOICES)
+
+int main(void)
+{
+    Mixer_Kernel best = mixer_best_kernel();
+    printf("Kernels up to %s are supported by this CPU\n", mixer_kernel_name(best));
+
+    static int16_t loud[MIXER_MAX_VOICES][MAX_SAMPLES];
+    static int16_t quiet[MIXER_MAX_VOICES][MAX_SAMPLES];
+    static int16_t scalar[MAX_SAMPLES];
+    static int16_t actual[MAX_SAMPLES];
+    int16_t *loud_sounds[MIXER_MAX_VOICES];
+    int16_t *quiet_sounds[MIXER_MAX_VOICES];
+    size_t counts[MIXER_MAX_VOICES];
+    float gains[MIXER_MAX_VOICES];
+    for (size_t i = 0; i < MIXER_MAX_VOICES; ++i) {
+        fill_random(loud[i], MAX_SAMPLES, INT16_MAX);
+        fill_random(quiet[i], MAX_SAMPLES, QUIET_AMPLITUDE);
+        loud_sounds[i] = loud[i];
+        quiet_sounds[i] = quiet[i];
+        // Some of the sounds end in the middle of a chunk and some outlast the mixing
+        counts[i] = 1 + random_u32()%(MAX_SAMPLES + MAX_SAMPLES/2);
+        // Silent, unity and everything in between
+        switch (i%4) {
+        case 0:  gains[i] = 1.0f; break;
+        case 1:  gains[i] = 0.0f; break;
+        default: gains[i] = (random_u32()%1001)/1000.0f;
+        }
+    }
+
+    size_t checks = 0;
+    bool ok = true;
+    for (Mixer_Kernel kernel = MIXER_KERNEL_SCALAR; kernel <= best; ++kernel) {
+        const char *name = mixer_kernel_name(kernel);
+        char what[128];
+
+        ok = check_clamp(kernel) && ok;
+        checks += 1;
+
+        ok = check_exact_sum(kernel, quiet_sounds) && ok;
+        checks += 1;
+
+        static const size_t voices[] = {1, 2, 3, 17, MIXER_MAX_VOICES};
+        for (size_t vi = 0; vi < sizeof(voices)/sizeof(voices[0]); ++vi) {
+            for (size_t ci = 0; ci < sizeof(chunks)/sizeof(chunks[0]); ++ci) {
+                for (int saturating = 0; saturating <= 1; ++saturating) {
+                    int16_t **sounds = saturating ? loud_sounds : quiet_sounds;
+                    snprintf(what, sizeof(what), "%s %zu %s voices in chunks of %zu", name, voices[vi],
+                             saturating ? "loud" : "quiet", chunks[ci]);
+                    ok = check_mix(kernel, sounds, counts, gains, voices[vi], chunks[ci], actual, what) && ok;
+                    checks += 1;
+
+                    if (kernel == MIXER_KERNEL_SCALAR) continue;
+                    check_mix(MIXER_KERNEL_SCALAR, sounds, counts, gains, voices[vi], chunks[ci], scalar, what);
+                    ok = check_equal(scalar, actual, MAX_SAMPLES, what) && ok;
+                    checks += 1;
+                }
+            }
+        }
+    }
+
+    // When all the voices are busy the one closest to its end makes room for the new one
+    {
+        static Mixer mixer;
+        mixer_init(&mixer);
+        for (size_t i = 0; i < MIXER_MAX_VOICES; ++i) mixer_play(&mixer, loud[i], MAX_SAMPLES - i, 1.0f);
+        mixer_play(&mixer, quiet[0], 1, 1.0f);
+        const Mixer_Voice *replaced = &mixer.voices[MIXER_MAX_VOICES - 1];
+        if (mixer.voices_count != MIXER_MAX_VOICES || replaced->samples != quiet[0] || replaced->count != 1) {
+            fprintf(stderr, "FAIL: the new voice did not replace the one closest to its end\n");
+            ok = false;
+        }
+        checks += 1;
+    }
+
+    if (!ok) return 1;
+    printf("OK: %zu checks passed\n", checks);
+    return 0;
+}
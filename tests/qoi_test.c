@@ -0,0 +1,193 @@
+// Checks the QOI encoder and decoder of panim/qoi.c
+// - that the frames survive the round trip, bit for bit, also when they are flipped
+// - that the files are decoded the same by the reference decoder that raylib ships with
+// - that the output fits into qoi_frame_max_size()
+// - that truncated and mismatched files are rejected
+//
+// The patterns make the encoder go through all of the ops: long runs, the index of
+// seen colors, small and medium differences, and full RGB and RGBA pixels.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <raylib.h>
+
+#include "qoi.h"
+
+typedef enum {
+    PATTERN_NOISE,
+    PATTERN_FLAT,
+    PATTERN_GRADIENT,
+    PATTERN_PALETTE,
+    PATTERN_ALPHA,
+    COUNT_PATTERNS,
+} Pattern;
+
+static const char *pattern_names[COUNT_PATTERNS] = {
+    [PATTERN_NOISE] = "noise",
+    [PATTERN_FLAT] = "flat",
+    [PATTERN_GRADIENT] = "gradient",
+    [PATTERN_PALETTE] = "palette",
+    [PATTERN_ALPHA] = "alpha",
+};
+
+typedef struct {
+    size_t width;
+    size_t height;
+} Size;
+
+// Runs are at most 62 pixels long, so the widths go around that
+static const Size sizes[] = {{1, 1}, {3, 5}, {61, 2}, {62, 3}, {63, 4}, {130, 7}, {640, 360}};
+
+static uint32_t random_state = 0x1234567;
+
+static uint8_t random_byte(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state >> 24;
+}
+
+static void fill_pattern(uint8_t *rgba, size_t width, size_t height, Pattern pattern)
+{
+    static const uint8_t palette[][4] = {
+        {255, 0, 0, 255}, {0, 255, 0, 255}, {0, 0, 255, 128}, {18, 18, 18, 255}, {200, 100, 50, 0}, {1, 2, 3, 4},
+    };
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            uint8_t *p = rgba + (y*width + x)*4;
+            switch (pattern) {
+            case PATTERN_FLAT:
+                // The row changes in its middle, so some runs go across the rows and some do not
+                p[0] = p[1] = p[2] = (y + (x > width/2))/3*40;
+                p[3] = 255;
+                break;
+            case PATTERN_GRADIENT:
+                p[0] = x + y;
+                p[1] = x*3 + random_byte()%4;
+                p[2] = y*20 + x;
+                p[3] = 255;
+                break;
+            case PATTERN_PALETTE:
+                memcpy(p, palette[random_byte()%6], 4);
+                break;
+            case PATTERN_ALPHA:
+                p[0] = p[1] = p[2] = 100;
+                p[3] = random_byte() < 128 ? 255 : random_byte();
+                break;
+            case PATTERN_NOISE:
+            case COUNT_PATTERNS:
+            default:
+                p[0] = random_byte();
+                p[1] = random_byte();
+                p[2] = random_byte();
+                p[3] = random_byte();
+            }
+        }
+    }
+}
+
+static void flip_rows(uint8_t *dst, const uint8_t *src, size_t width, size_t height)
+{
+    for (size_t y = 0; y < height; ++y) memcpy(dst + y*width*4, src + (height - 1 - y)*width*4, width*4);
+}
+
+static bool check_equal(const uint8_t *expected, const uint8_t *actual, size_t width, size_t height, const char *what)
+{
+    for (size_t i = 0; i < width*height*4; ++i) {
+        if (expected[i] != actual[i]) {
+            fprintf(stderr, "FAIL: %s: byte %zu of pixel (%zu, %zu) is %d instead of %d\n", what, i%4,
+                    i/4%width, i/4/width, actual[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(void)
+{
+    SetTraceLogLevel(LOG_WARNING);
+
+    size_t checks = 0;
+    bool ok = true;
+    for (size_t si = 0; si < sizeof(sizes)/sizeof(sizes[0]); ++si) {
+        size_t width = sizes[si].width;
+        size_t height = sizes[si].height;
+        size_t max_size = qoi_frame_max_size(width, height);
+        uint8_t *rgba = malloc(width*height*4);
+        uint8_t *flipped = malloc(width*height*4);
+        uint8_t *decoded = malloc(width*height*4);
+        uint8_t *qoi = malloc(max_size);
+        uint8_t *qoi_flipped = malloc(max_size);
+        if (rgba == NULL || flipped == NULL || decoded == NULL || qoi == NULL || qoi_flipped == NULL) {
+            fprintf(stderr, "ERROR: out of memory\n");
+            return 1;
+        }
+
+        for (Pattern pattern = 0; pattern < COUNT_PATTERNS; ++pattern) {
+            char what[64];
+            snprintf(what, sizeof(what), "%zux%zu %s", width, height, pattern_names[pattern]);
+            fill_pattern(rgba, width, height, pattern);
+
+            size_t size = qoi_encode_frame(rgba, width, height, false, qoi);
+            if (size > max_size) {
+                fprintf(stderr, "FAIL: %s: %zu bytes do not fit into the %zu of qoi_frame_max_size()\n", what, size, max_size);
+                ok = false;
+                continue;
+            }
+            checks += 1;
+
+            memset(decoded, 0xAA, width*height*4);
+            if (!qoi_decode_frame(qoi, size, decoded, width, height)) {
+                fprintf(stderr, "FAIL: %s: the encoded frame can not be decoded\n", what);
+                ok = false;
+            } else {
+                ok = check_equal(rgba, decoded, width, height, what) && ok;
+            }
+            checks += 1;
+
+            Image image = LoadImageFromMemory(".qoi", qoi, size);
+            if (image.data == NULL || (size_t)image.width != width || (size_t)image.height != height ||
+                image.format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) {
+                fprintf(stderr, "FAIL: %s: the reference decoder does not take the encoded frame\n", what);
+                ok = false;
+            } else {
+                ok = check_equal(rgba, image.data, width, height, TextFormat("%s reference decoder", what)) && ok;
+            }
+            UnloadImage(image);
+            checks += 1;
+
+            // A bottom-up frame encodes into the same file as the same frame top-down
+            flip_rows(flipped, rgba, width, height);
+            size_t size_flipped = qoi_encode_frame(flipped, width, height, true, qoi_flipped);
+            if (size_flipped != size || memcmp(qoi, qoi_flipped, size) != 0) {
+                fprintf(stderr, "FAIL: %s: the flipped frame is not encoded like the frame\n", what);
+                ok = false;
+            }
+            checks += 1;
+
+            if (qoi_decode_frame(qoi, size/2, decoded, width, height)) {
+                fprintf(stderr, "FAIL: %s: a truncated file is decoded\n", what);
+                ok = false;
+            }
+            if (qoi_decode_frame(qoi, size, decoded, width + 1, height) ||
+                qoi_decode_frame(qoi, size, decoded, width, height + 1)) {
+                fprintf(stderr, "FAIL: %s: the file is decoded into a frame of another size\n", what);
+                ok = false;
+            }
+            checks += 1;
+        }
+
+        free(rgba);
+        free(flipped);
+        free(decoded);
+        free(qoi);
+        free(qoi_flipped);
+    }
+
+    if (!ok) return 1;
+    printf("OK: %zu checks passed\n", checks);
+    return 0;
+}
@@ -0,0 +1,114 @@
+// Checks the frame ranges of panim/range.c
+// - that --from and --to take frame numbers and times in seconds, and reject everything else,
+//   also what strtoull() and strtod() would take on their own
+// - that the time of every frame is parsed back into that frame at the usual frame rates
+// - that splitting a range between the processes of --jobs covers every frame of it exactly once,
+//   in order and in parts that differ by at most one frame
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "range.h"
+
+typedef struct {
+    const char *value;
+    size_t fps;
+    size_t frame;
+} Parse_Case;
+
+static const Parse_Case valid_cases[] = {
+    {"0", 60, 0},
+    {"120", 60, 120},
+    {"120", 30, 120},
+    {"0s", 60, 0},
+    {"2.5s", 60, 150},
+    {"2.5s", 30, 75},
+    {".5s", 60, 30},
+    {"4s", 24, 96},
+    {"1.0083s", 60, 60},
+    {"1.0084s", 60, 61},
+    {"5.s", 60, 300},
+    {"18446744073709551615", 60, SIZE_MAX},
+};
+
+static const char *invalid_values[] = {
+    "", "s", ".s", "-1", "-1s", " 5", " -5", "+5", "2.5", "10ss", "1 s", "5 ", "0x10", "0x10s", "inf", "infs",
+    "nans", "1e1s", "1.2.3s", "1000000000s", "99999999999s", "18446744073709551616", "abc", "5f",
+};
+
+static const size_t fps_values[] = {24, 25, 30, 50, 60, 120};
+
+int main(void)
+{
+    size_t checks = 0;
+    bool ok = true;
+
+    for (size_t i = 0; i < sizeof(valid_cases)/sizeof(valid_cases[0]); ++i) {
+        const Parse_Case *c = &valid_cases[i];
+        size_t frame = 12345;
+        if (!range_parse_frame(c->value, c->fps, &frame) || frame != c->frame) {
+            fprintf(stderr, "FAIL: `%s` at %zu fps is frame %zu instead of %zu\n", c->value, c->fps, frame, c->frame);
+            ok = false;
+        }
+        checks += 1;
+    }
+
+    for (size_t i = 0; i < sizeof(invalid_values)/sizeof(invalid_values[0]); ++i) {
+        size_t frame = 12345;
+        if (range_parse_frame(invalid_values[i], 60, &frame) || frame != 12345) {
+            fprintf(stderr, "FAIL: `%s` is taken for frame %zu\n", invalid_values[i], frame);
+            ok = false;
+        }
+        checks += 1;
+    }
+
+    // The times are printed the way somebody would type them, with a few decimals
+    for (size_t i = 0; i < sizeof(fps_values)/sizeof(fps_values[0]); ++i) {
+        size_t fps = fps_values[i];
+        for (size_t frame = 0; frame < 10*fps; ++frame) {
+            char value[64];
+            snprintf(value, sizeof(value), "%.4fs", (double)frame/fps);
+            size_t parsed = 0;
+            if (!range_parse_frame(value, fps, &parsed) || parsed != frame) {
+                fprintf(stderr, "FAIL: `%s` at %zu fps is frame %zu instead of %zu\n", value, fps, parsed, frame);
+                ok = false;
+                break;
+            }
+        }
+        checks += 1;
+    }
+
+    static const size_t begins[] = {0, 1, 13, 600};
+    static const size_t lengths[] = {0, 1, 2, 7, 100, 601, 10000};
+    for (size_t bi = 0; bi < sizeof(begins)/sizeof(begins[0]); ++bi) {
+        for (size_t li = 0; li < sizeof(lengths)/sizeof(lengths[0]); ++li) {
+            size_t begin = begins[bi];
+            size_t end = begin + lengths[li];
+            for (size_t count = 1; count <= 16; ++count) {
+                size_t next = begin;
+                size_t shortest = SIZE_MAX;
+                size_t longest = 0;
+                for (size_t index = 0; index < count; ++index) {
+                    size_t part_begin, part_end;
+                    range_split(begin, end, count, index, &part_begin, &part_end);
+                    if (part_begin != next || part_end < part_begin) break;
+                    next = part_end;
+                    size_t length = part_end - part_begin;
+                    if (length < shortest) shortest = length;
+                    if (length > longest) longest = length;
+                }
+                if (next != end || longest - shortest > 1) {
+                    fprintf(stderr, "FAIL: [%zu, %zu) split into %zu parts does not cover it evenly\n", begin, end, count);
+                    ok = false;
+                }
+                checks += 1;
+            }
+        }
+    }
+
+    if (!ok) return 1;
+    printf("OK: %zu checks passed\n", checks);
+    return 0;
+}
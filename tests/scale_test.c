@@ -0,0 +1,181 @@
+// Checks the downscaling of panim/scale.c
+// - every SIMD kernel the CPU supports against the scalar kernel, bit for bit
+// - the threaded scaler_run() against the scalar kernel
+// - the box filter at half the size against the average of the 2x2 blocks
+// - that flat colors stay the same, and that scaling to the same size changes nothing
+//
+// The widths of the sizes are mostly not multiples of the 4 and 8 pixels the SIMD kernels do
+// at once, and the patterns with hard edges make Lanczos overshoot into the clamping.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scale.h"
+
+typedef enum {
+    PATTERN_RANDOM,
+    PATTERN_GRADIENT,
+    PATTERN_CHECKERS,
+    COUNT_PATTERNS,
+} Pattern;
+
+static const char *pattern_names[COUNT_PATTERNS] = {
+    [PATTERN_RANDOM] = "random",
+    [PATTERN_GRADIENT] = "gradient",
+    [PATTERN_CHECKERS] = "checkers",
+};
+
+typedef struct {
+    size_t src_width, src_height;
+    size_t dst_width, dst_height;
+} Scale_Size;
+
+static const Scale_Size sizes[] = {
+    {7, 5, 7, 5},
+    {4, 4, 1, 1},
+    {37, 23, 5, 3},
+    {101, 77, 33, 50},
+    {640, 360, 320, 180},
+    {640, 360, 427, 240},
+    {1920, 1080, 1280, 720},
+    {1920, 1080, 854, 480},
+};
+
+static uint32_t random_state = 0x1234567;
+
+static uint8_t random_byte(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state >> 24;
+}
+
+static void fill_pattern(uint8_t *rgba, size_t width, size_t height, Pattern pattern)
+{
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            uint8_t *p = rgba + (y*width + x)*4;
+            for (size_t c = 0; c < 4; ++c) {
+                switch (pattern) {
+                case PATTERN_GRADIENT: p[c] = x*(c + 1) + y; break;
+                case PATTERN_CHECKERS: p[c] = ((x/3 + y/2 + c)%2)*255; break;
+                case PATTERN_RANDOM:
+                case COUNT_PATTERNS:
+                default: p[c] = random_byte();
+                }
+            }
+        }
+    }
+}
+
+static bool check_equal(const uint8_t *expected, const uint8_t *actual, size_t size, const char *what)
+{
+    for (size_t i = 0; i < size; ++i) {
+        if (expected[i] != actual[i]) {
+            fprintf(stderr, "FAIL: %s: byte %zu is %d instead of %d\n", what, i, actual[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// The rows are averaged first and then the columns, so each pass rounds on its own
+#define BOX_TOLERANCE 1
+
+static bool check_box_half(const uint8_t *src, const uint8_t *dst, size_t dst_width, size_t dst_height, const char *what)
+{
+    size_t src_width = dst_width*2;
+    for (size_t y = 0; y < dst_height; ++y) {
+        for (size_t x = 0; x < dst_width; ++x) {
+            for (size_t c = 0; c < 4; ++c) {
+                const uint8_t *p = src + (2*y*src_width + 2*x)*4 + c;
+                int average = (p[0] + p[4] + p[src_width*4] + p[src_width*4 + 4] + 2)/4;
+                int actual = dst[(y*dst_width + x)*4 + c];
+                if (abs(actual - average) > BOX_TOLERANCE) {
+                    fprintf(stderr, "FAIL: %s: pixel (%zu, %zu) is %d instead of the average %d\n", what, x, y, actual, average);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int main(void)
+{
+    Scale_Kernel best = scale_best_kernel();
+    printf("Kernels up to %s are supported by this CPU\n", scale_kernel_name(best));
+
+    size_t checks = 0;
+    bool ok = true;
+    for (size_t si = 0; si < sizeof(sizes)/sizeof(sizes[0]); ++si) {
+        const Scale_Size *size = &sizes[si];
+        size_t src_size = size->src_width*size->src_height*4;
+        size_t dst_size = size->dst_width*size->dst_height*4;
+        uint8_t *src = malloc(src_size);
+        uint8_t *scalar = malloc(dst_size);
+        uint8_t *actual = malloc(dst_size);
+        if (src == NULL || scalar == NULL || actual == NULL) {
+            fprintf(stderr, "ERROR: out of memory\n");
+            return 1;
+        }
+
+        for (Scale_Filter filter = 0; filter < COUNT_SCALE_FILTERS; ++filter) {
+            Scaler *scaler = scaler_create(size->src_width, size->src_height, size->dst_width, size->dst_height, filter);
+            char what[128];
+
+            for (Pattern pattern = 0; pattern < COUNT_PATTERNS; ++pattern) {
+                #define WHAT(kind) (snprintf(what, sizeof(what), "%s %s %zux%zu -> %zux%zu %s", kind, scale_filter_name(filter), \
+                                             size->src_width, size->src_height, size->dst_width, size->dst_height,               \
+                                             pattern_names[pattern]), what)
+                fill_pattern(src, size->src_width, size->src_height, pattern);
+                scaler_run_with(scaler, SCALE_KERNEL_SCALAR, scalar, src);
+
+                for (Scale_Kernel kernel = SCALE_KERNEL_SCALAR + 1; kernel <= best; ++kernel) {
+                    memset(actual, 0xAA, dst_size);
+                    scaler_run_with(scaler, kernel, actual, src);
+                    ok = check_equal(scalar, actual, dst_size, WHAT(scale_kernel_name(kernel))) && ok;
+                    checks += 1;
+                }
+
+                memset(actual, 0xAA, dst_size);
+                scaler_run(scaler, actual, src);
+                ok = check_equal(scalar, actual, dst_size, WHAT("threaded")) && ok;
+                checks += 1;
+
+                if (size->src_width == size->dst_width && size->src_height == size->dst_height) {
+                    ok = check_equal(src, scalar, src_size, WHAT("same size")) && ok;
+                    checks += 1;
+                }
+                if (filter == SCALE_FILTER_BOX && size->src_width == 2*size->dst_width && size->src_height == 2*size->dst_height) {
+                    ok = check_box_half(src, scalar, size->dst_width, size->dst_height, WHAT("scalar")) && ok;
+                    checks += 1;
+                }
+                #undef WHAT
+            }
+
+            // The weights of every pixel add up to exactly one
+            memset(src, 123, src_size);
+            memset(actual, 123, dst_size);
+            for (Scale_Kernel kernel = SCALE_KERNEL_SCALAR; kernel <= best; ++kernel) {
+                scaler_run_with(scaler, kernel, scalar, src);
+                snprintf(what, sizeof(what), "%s %s %zux%zu -> %zux%zu flat", scale_kernel_name(kernel), scale_filter_name(filter),
+                         size->src_width, size->src_height, size->dst_width, size->dst_height);
+                ok = check_equal(actual, scalar, dst_size, what) && ok;
+                checks += 1;
+            }
+
+            scaler_destroy(scaler);
+        }
+
+        free(src);
+        free(scalar);
+        free(actual);
+    }
+
+    if (!ok) return 1;
+    printf("OK: %zu checks passed\n", checks);
+    return 0;
+}
@@ -0,0 +1,268 @@
+// Checks the rendering in tiles of panim/tiles.c, and the streaming of the strips into .qoi files
+// of panim/qoi.c and panim/images.c
+// - that the bottom-up readbacks of the tiles stitch into the frame, top-down, one strip per row
+//   of tiles, also when the tiles go past the right and the bottom edge of the frame
+// - that encoding a frame in strips of any height, top-down or bottom-up, gives the same bytes
+//   as encoding the whole frame at once, and that every strip fits into qoi_rows_max_size()
+// - that the frames sent in strips through images_send_rows() decode into the frames that were sent
+//
+// The GPU is not needed, the readbacks of the tiles are cut out of a frame in memory.
+#define NOB_IMPLEMENTATION
+#include "nob.h"
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include <raylib.h>
+
+#include "images.h"
+#include "qoi.h"
+#include "tiles.h"
+
+typedef struct {
+    size_t width;
+    size_t height;
+} Size;
+
+static const Size sizes[] = {{1, 1}, {61, 3}, {512, 256}, {1003, 517}};
+static const size_t tile_sizes[] = {1, 64, 128, 256, 1024};
+static const size_t strip_heights[] = {1, 7, 64, 100, 1024};
+
+#define IMAGES_FRAMES 3
+#define IMAGES_FIRST_INDEX 5
+
+static uint32_t random_state = 0x1234567;
+
+static uint8_t random_byte(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state >> 24;
+}
+
+// Runs, repeated colors, small differences and noise, so that the state of the encoder that is
+// carried from one strip to the next matters
+static void fill_frame(uint8_t *rgba, size_t width, size_t height)
+{
+    for (size_t i = 0; i < width*height; ++i) {
+        uint8_t *p = rgba + i*4;
+        uint8_t r = random_byte()%8;
+        if (i > 0 && r < 5) {
+            memcpy(p, p - 4, 4);
+        } else {
+            p[0] = random_byte();
+            p[1] = p[0] + random_byte()%3;
+            p[2] = r == 5 ? p[1] : random_byte();
+            p[3] = r == 7 ? random_byte() : 255;
+        }
+    }
+}
+
+static void flip_rows(uint8_t *dst, const uint8_t *src, size_t width, size_t height)
+{
+    for (size_t y = 0; y < height; ++y) memcpy(dst + y*width*4, src + (height - 1 - y)*width*4, width*4);
+}
+
+static bool check_tiles(const uint8_t *rgba, size_t width, size_t height, size_t tile_size)
+{
+    Tiles *tiles = tiles_create(width, height, tile_size);
+    uint8_t *tile = malloc(tile_size*tile_size*4);
+    uint8_t *stitched = malloc(width*height*4);
+    assert(tile != NULL && stitched != NULL && "Buy MORE RAM lol!!");
+    memset(stitched, 0xAA, width*height*4);
+
+    bool ok = true;
+    size_t cols = (width + tile_size - 1)/tile_size;
+    size_t stitched_rows = 0;
+    for (size_t i = 0; i < tiles_count(tiles) && ok; ++i) {
+        size_t x, y;
+        tiles_origin(tiles, i, &x, &y);
+        if (x != i%cols*tile_size || y != i/cols*tile_size) {
+            fprintf(stderr, "FAIL: %zux%zu tiles of %zu: tile %zu is at (%zu, %zu)\n", width, height, tile_size, i, x, y);
+            ok = false;
+            break;
+        }
+
+        // What the GPU reads back: the tile bottom-up, and garbage where it is past the frame
+        memset(tile, 0xAB, tile_size*tile_size*4);
+        for (size_t r = 0; r < tile_size && y + r < height; ++r) {
+            for (size_t c = 0; c < tile_size && x + c < width; ++c) {
+                memcpy(tile + ((tile_size - 1 - r)*tile_size + c)*4, rgba + ((y + r)*width + x + c)*4, 4);
+            }
+        }
+
+        size_t rows = 0;
+        const uint8_t *strip = tiles_stitch(tiles, i, tile, &rows);
+        bool last_of_row = i%cols == cols - 1;
+        if ((strip != NULL) != last_of_row) {
+            fprintf(stderr, "FAIL: %zux%zu tiles of %zu: tile %zu %s the strip\n", width, height, tile_size, i,
+                    last_of_row ? "does not finish" : "finishes");
+            ok = false;
+        } else if (strip != NULL) {
+            size_t expected = height - y < tile_size ? height - y : tile_size;
+            if (rows != expected) {
+                fprintf(stderr, "FAIL: %zux%zu tiles of %zu: the strip at row %zu has %zu rows instead of %zu\n",
+                        width, height, tile_size, y, rows, expected);
+                ok = false;
+            } else {
+                memcpy(stitched + stitched_rows*width*4, strip, rows*width*4);
+                stitched_rows += rows;
+            }
+        }
+    }
+    if (ok && (stitched_rows != height || memcmp(rgba, stitched, width*height*4) != 0)) {
+        fprintf(stderr, "FAIL: %zux%zu tiles of %zu: the strips are not the frame\n", width, height, tile_size);
+        ok = false;
+    }
+
+    tiles_destroy(tiles);
+    free(tile);
+    free(stitched);
+    return ok;
+}
+
+// flipped is the frame bottom-up, of which every strip is sent on its own, so the strips go
+// top to bottom but the rows in them go bottom-up
+static bool check_qoi_strips(const uint8_t *rgba, const uint8_t *flipped, size_t width, size_t height, size_t strip_height,
+                             const uint8_t *expected, size_t expected_size)
+{
+    uint8_t *out = malloc(qoi_frame_max_size(width, height));
+    assert(out != NULL && "Buy MORE RAM lol!!");
+    bool ok = true;
+    for (size_t bottom_up = 0; bottom_up <= 1; ++bottom_up) {
+        Qoi_Encoder qoi;
+        uint8_t *p = out;
+        p += qoi_encoder_begin(&qoi, width, height, p);
+        for (size_t y = 0; y < height; y += strip_height) {
+            size_t rows = height - y < strip_height ? height - y : strip_height;
+            const uint8_t *strip = bottom_up ? flipped + (height - y - rows)*width*4 : rgba + y*width*4;
+            size_t size = qoi_encoder_rows(&qoi, strip, width, rows, bottom_up, p);
+            if (size > qoi_rows_max_size(width, rows)) {
+                fprintf(stderr, "FAIL: %zux%zu in strips of %zu: %zu bytes of a strip do not fit into the %zu of qoi_rows_max_size()\n",
+                        width, height, strip_height, size, qoi_rows_max_size(width, rows));
+                ok = false;
+            }
+            p += size;
+        }
+        p += qoi_encoder_end(&qoi, p);
+        if ((size_t)(p - out) != expected_size || memcmp(out, expected, expected_size) != 0) {
+            fprintf(stderr, "FAIL: %zux%zu in %s strips of %zu: the file is not the one of the whole frame\n",
+                    width, height, bottom_up ? "bottom-up" : "top-down", strip_height);
+            ok = false;
+        }
+    }
+    free(out);
+    return ok;
+}
+
+// Every frame goes in strips of another height
+static bool check_images_rows(const char *dir)
+{
+    const size_t width = 1003;
+    const size_t height = 517;
+    uint8_t *frames = malloc(IMAGES_FRAMES*width*height*4);
+    uint8_t *decoded = malloc(width*height*4);
+    assert(frames != NULL && decoded != NULL && "Buy MORE RAM lol!!");
+
+    bool ok = true;
+    Images *images = images_start_rows(nob_temp_sprintf("%s/strip%%03d.qoi", dir), width, height, IMAGES_FIRST_INDEX);
+    if (images == NULL) {
+        fprintf(stderr, "FAIL: images_start_rows() does not take .qoi\n");
+        ok = false;
+    }
+    for (size_t frame = 0; frame < IMAGES_FRAMES && ok; ++frame) {
+        uint8_t *rgba = frames + frame*width*height*4;
+        fill_frame(rgba, width, height);
+        size_t strip_height = strip_heights[frame + 1];
+        for (size_t y = 0; y < height && ok; y += strip_height) {
+            size_t rows = height - y < strip_height ? height - y : strip_height;
+            ok = images_send_rows(images, rgba + y*width*4, rows);
+        }
+        if (!ok) fprintf(stderr, "FAIL: frame %zu could not be sent in strips\n", frame);
+    }
+    if (images != NULL && !images_end(images, false) && ok) {
+        fprintf(stderr, "FAIL: the export in strips failed\n");
+        ok = false;
+    }
+
+    for (size_t frame = 0; frame < IMAGES_FRAMES; ++frame) {
+        const char *path = nob_temp_sprintf("%s/strip%03zu.qoi", dir, IMAGES_FIRST_INDEX + frame);
+        int size = 0;
+        unsigned char *data = LoadFileData(path, &size);
+        if (ok && (data == NULL || !qoi_decode_frame(data, size, decoded, width, height) ||
+                   memcmp(decoded, frames + frame*width*height*4, width*height*4) != 0)) {
+            fprintf(stderr, "FAIL: %s is not frame %zu\n", path, frame);
+            ok = false;
+        }
+        UnloadFileData(data);
+        remove(path);
+    }
+
+    // The error is expected here
+    SetTraceLogLevel(LOG_NONE);
+    images = images_start_rows(nob_temp_sprintf("%s/strip%%03d.png", dir), width, height, 0);
+    SetTraceLogLevel(LOG_WARNING);
+    if (images != NULL) {
+        fprintf(stderr, "FAIL: images_start_rows() takes .png\n");
+        images_end(images, true);
+        ok = false;
+    }
+
+    free(frames);
+    free(decoded);
+    return ok;
+}
+
+int main(void)
+{
+    SetTraceLogLevel(LOG_WARNING);
+
+    size_t checks = 0;
+    bool ok = true;
+    for (size_t si = 0; si < NOB_ARRAY_LEN(sizes); ++si) {
+        size_t width = sizes[si].width;
+        size_t height = sizes[si].height;
+        uint8_t *rgba = malloc(width*height*4);
+        uint8_t *flipped = malloc(width*height*4);
+        uint8_t *expected = malloc(qoi_frame_max_size(width, height));
+        assert(rgba != NULL && flipped != NULL && expected != NULL && "Buy MORE RAM lol!!");
+        fill_frame(rgba, width, height);
+        flip_rows(flipped, rgba, width, height);
+
+        for (size_t i = 0; i < NOB_ARRAY_LEN(tile_sizes); ++i) {
+            // Tiles of one pixel on the biggest frames are half a million tiles, which says nothing new
+            if (tile_sizes[i] == 1 && width*height > 1000) continue;
+            ok = check_tiles(rgba, width, height, tile_sizes[i]) && ok;
+            checks += 1;
+        }
+
+        size_t expected_size = qoi_encode_frame(rgba, width, height, false, expected);
+        for (size_t i = 0; i < NOB_ARRAY_LEN(strip_heights); ++i) {
+            ok = check_qoi_strips(rgba, flipped, width, height, strip_heights[i], expected, expected_size) && ok;
+            checks += 1;
+        }
+
+        free(rgba);
+        free(flipped);
+        free(expected);
+    }
+
+    char dir_template[] = "/tmp/panim-tiles-test-XXXXXX";
+    const char *dir = mkdtemp(dir_template);
+    if (dir == NULL) {
+        fprintf(stderr, "ERROR: could not create a temporary directory: %s\n", strerror(errno));
+        return 1;
+    }
+    ok = check_images_rows(dir) && ok;
+    checks += 1;
+    if (rmdir(dir) != 0) {
+        fprintf(stderr, "FAIL: files that are not frames are left in %s\n", dir);
+        ok = false;
+    }
+    checks += 1;
+
+    if (!ok) return 1;
+    printf("OK: %zu checks passed\n", checks);
+    return 0;
+}
@@ -0,0 +1,82 @@
+// Measures the RGBA -> yuv420p conversion of panim/yuv.c on video sized frames: every kernel
+// the CPU supports on one thread, and the conversion panim actually uses across the workers.
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "yuv.h"
+#include "workers.h"
+
+#define BENCH_SECONDS 1.0
+
+typedef struct {
+    size_t width;
+    size_t height;
+} Bench_Size;
+
+static const Bench_Size sizes[] = {
+    {1280, 720},
+    {1920, 1080},
+    {3840, 2160},
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static void report(const char *what, const Bench_Size *size, size_t frames, double seconds)
+{
+    double ms = seconds*1000.0/frames;
+    printf("%-10s %4zux%-4zu %8.3f ms/frame %8.1f Mpix/s\n", what, size->width, size->height, ms,
+           size->width*size->height/(ms*1000.0));
+}
+
+int main(void)
+{
+    Yuv_Kernel best = yuv420_best_kernel();
+    printf("%zu threads, kernels up to %s\n", workers_count(), yuv420_kernel_name(best));
+
+    for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); ++i) {
+        const Bench_Size *size = &sizes[i];
+        uint8_t *rgba = malloc(size->width*size->height*4);
+        uint8_t *dst = malloc(yuv420_size(size->width, size->height));
+        if (rgba == NULL || dst == NULL) {
+            fprintf(stderr, "ERROR: out of memory\n");
+            return 1;
+        }
+        uint32_t state = 0x1234567;
+        for (size_t j = 0; j < size->width*size->height*4; ++j) {
+            state = state*1664525 + 1013904223;
+            rgba[j] = state >> 24;
+        }
+
+        for (Yuv_Kernel kernel = YUV_KERNEL_SCALAR; kernel <= best; ++kernel) {
+            size_t frames = 0;
+            double start = now();
+            double elapsed = 0.0;
+            while (elapsed < BENCH_SECONDS) {
+                yuv420_from_rgba_rows(kernel, dst, rgba, size->width, size->height, true, 0, size->height/2);
+                frames += 1;
+                elapsed = now() - start;
+            }
+            report(yuv420_kernel_name(kernel), size, frames, elapsed);
+        }
+
+        size_t frames = 0;
+        double start = now();
+        double elapsed = 0.0;
+        while (elapsed < BENCH_SECONDS) {
+            yuv420_from_rgba(dst, rgba, size->width, size->height, true);
+            frames += 1;
+            elapsed = now() - start;
+        }
+        report("threaded", size, frames, elapsed);
+
+        free(rgba);
+        free(dst);
+    }
+    return 0;
+}
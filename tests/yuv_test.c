@@ -0,0 +1,187 @@
+// Checks the RGBA -> yuv420p conversion of panim/yuv.c
+// - the scalar kernel against a floating point BT.601 limited range reference
+// - every SIMD kernel the CPU supports against the scalar kernel, bit for bit
+// - the threaded and the damage conversions against the single threaded one
+//
+// The widths are even like yuv420p needs, but mostly not multiples of the 16 and 32
+// pixels the SIMD kernels do at once, so their scalar tails are covered too.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "yuv.h"
+#include "damage.h"
+
+// Pixels with every component the same are the ones that hit the edges of the ranges
+typedef enum {
+    PATTERN_RANDOM,
+    PATTERN_BLACK,
+    PATTERN_WHITE,
+    PATTERN_PRIMARIES,
+    COUNT_PATTERNS,
+} Pattern;
+
+static const char *pattern_names[COUNT_PATTERNS] = {
+    [PATTERN_RANDOM] = "random",
+    [PATTERN_BLACK] = "black",
+    [PATTERN_WHITE] = "white",
+    [PATTERN_PRIMARIES] = "primaries",
+};
+
+static const size_t widths[] = {2, 6, 14, 16, 18, 30, 32, 34, 46, 62, 64, 66, 1922};
+static const size_t heights[] = {2, 6, 34};
+
+static uint32_t random_state = 0x1234567;
+
+static uint8_t random_byte(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state >> 24;
+}
+
+static void fill_pattern(uint8_t *rgba, size_t count, Pattern pattern)
+{
+    static const uint8_t primaries[][3] = {
+        {255, 0, 0}, {0, 255, 0}, {0, 0, 255}, {255, 255, 0}, {0, 255, 255}, {255, 0, 255}, {0, 0, 0}, {255, 255, 255},
+    };
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t *p = rgba + i*4;
+        switch (pattern) {
+        case PATTERN_BLACK: p[0] = p[1] = p[2] = 0; break;
+        case PATTERN_WHITE: p[0] = p[1] = p[2] = 255; break;
+        case PATTERN_PRIMARIES: memcpy(p, primaries[random_byte()%8], 3); break;
+        case PATTERN_RANDOM:
+        case COUNT_PATTERNS:
+        default: p[0] = random_byte(); p[1] = random_byte(); p[2] = random_byte();
+        }
+        p[3] = random_byte();
+    }
+}
+
+// The textbook BT.601 limited range matrix, without any fixed point
+static void reference(uint8_t *dst, const uint8_t *rgba, size_t width, size_t height, bool flipped)
+{
+    uint8_t *plane_y = dst;
+    uint8_t *plane_u = plane_y + width*height;
+    uint8_t *plane_v = plane_u + (width/2)*(height/2);
+    for (size_t y = 0; y < height; ++y) {
+        const uint8_t *row = rgba + (flipped ? height - 1 - y : y)*width*4;
+        for (size_t x = 0; x < width; ++x) {
+            const uint8_t *p = row + x*4;
+            plane_y[y*width + x] = (uint8_t)roundf(16.0f + (65.738f*p[0] + 129.057f*p[1] + 25.064f*p[2])/256.0f);
+        }
+    }
+    for (size_t y = 0; y < height/2; ++y) {
+        const uint8_t *row0 = rgba + (flipped ? height - 1 - 2*y : 2*y)*width*4;
+        const uint8_t *row1 = rgba + (flipped ? height - 2 - 2*y : 2*y + 1)*width*4;
+        for (size_t x = 0; x < width/2; ++x) {
+            float rgb[3];
+            for (size_t c = 0; c < 3; ++c) {
+                rgb[c] = (row0[x*8 + c] + row0[x*8 + 4 + c] + row1[x*8 + c] + row1[x*8 + 4 + c])/4.0f;
+            }
+            plane_u[y*(width/2) + x] = (uint8_t)roundf(128.0f + (-37.945f*rgb[0] - 74.494f*rgb[1] + 112.439f*rgb[2])/256.0f);
+            plane_v[y*(width/2) + x] = (uint8_t)roundf(128.0f + (112.439f*rgb[0] - 94.154f*rgb[1] - 18.285f*rgb[2])/256.0f);
+        }
+    }
+}
+
+// The 8.8 fixed point of the kernels rounds its coefficients, and the chroma of the 2x2 blocks
+// is computed from their rounded average
+#define LUMA_TOLERANCE 1
+#define CHROMA_TOLERANCE 2
+
+static bool check_reference(const uint8_t *expected, const uint8_t *actual, size_t width, size_t height, const char *what)
+{
+    size_t luma_size = width*height;
+    for (size_t i = 0; i < yuv420_size(width, height); ++i) {
+        int tolerance = i < luma_size ? LUMA_TOLERANCE : CHROMA_TOLERANCE;
+        if (abs(expected[i] - actual[i]) > tolerance) {
+            fprintf(stderr, "FAIL: %s: byte %zu of %s is %d, the reference is %d\n", what, i,
+                    i < luma_size ? "Y" : "UV", actual[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool check_equal(const uint8_t *expected, const uint8_t *actual, size_t width, size_t height, const char *what)
+{
+    for (size_t i = 0; i < yuv420_size(width, height); ++i) {
+        if (expected[i] != actual[i]) {
+            fprintf(stderr, "FAIL: %s: byte %zu is %d instead of %d\n", what, i, actual[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(void)
+{
+    Yuv_Kernel best = yuv420_best_kernel();
+    printf("Kernels up to %s are supported by this CPU\n", yuv420_kernel_name(best));
+
+    size_t checks = 0;
+    bool ok = true;
+    for (size_t wi = 0; wi < sizeof(widths)/sizeof(widths[0]); ++wi) {
+        for (size_t hi = 0; hi < sizeof(heights)/sizeof(heights[0]); ++hi) {
+            size_t width = widths[wi];
+            size_t height = heights[hi];
+            uint8_t *rgba = malloc(width*height*4);
+            uint8_t *expected = malloc(yuv420_size(width, height));
+            uint8_t *scalar = malloc(yuv420_size(width, height));
+            uint8_t *actual = malloc(yuv420_size(width, height));
+            if (rgba == NULL || expected == NULL || scalar == NULL || actual == NULL) {
+                fprintf(stderr, "ERROR: out of memory\n");
+                return 1;
+            }
+
+            for (Pattern pattern = 0; pattern < COUNT_PATTERNS; ++pattern) {
+                for (int flipped = 0; flipped <= 1; ++flipped) {
+                    fill_pattern(rgba, width*height, pattern);
+                    #define WHAT(kind) TextFormat("%s %zux%zu %s%s", kind, width, height, pattern_names[pattern], flipped ? " flipped" : "")
+
+                    reference(expected, rgba, width, height, flipped);
+                    yuv420_from_rgba_rows(YUV_KERNEL_SCALAR, scalar, rgba, width, height, flipped, 0, height/2);
+                    ok = check_reference(expected, scalar, width, height, WHAT("scalar")) && ok;
+                    checks += 1;
+
+                    for (Yuv_Kernel kernel = YUV_KERNEL_SCALAR + 1; kernel <= best; ++kernel) {
+                        memset(actual, 0xAA, yuv420_size(width, height));
+                        yuv420_from_rgba_rows(kernel, actual, rgba, width, height, flipped, 0, height/2);
+                        ok = check_equal(scalar, actual, width, height, WHAT(yuv420_kernel_name(kernel))) && ok;
+                        checks += 1;
+                    }
+
+                    memset(actual, 0xAA, yuv420_size(width, height));
+                    yuv420_from_rgba(actual, rgba, width, height, flipped);
+                    ok = check_equal(scalar, actual, width, height, WHAT("threaded")) && ok;
+                    checks += 1;
+
+                    // The damage conversion only takes bottom-up frames
+                    if (flipped) {
+                        Damage damage;
+                        damage_init(&damage, width, height);
+                        damage_fill(&damage);
+                        memset(actual, 0xAA, yuv420_size(width, height));
+                        yuv420_from_rgba_damage(actual, rgba, &damage);
+                        ok = check_equal(scalar, actual, width, height, WHAT("damage")) && ok;
+                        checks += 1;
+                    }
+                    #undef WHAT
+                }
+            }
+
+            free(rgba);
+            free(expected);
+            free(scalar);
+            free(actual);
+        }
+    }
+
+    if (!ok) return 1;
+    printf("OK: %zu checks passed\n", checks);
+    return 0;
+}